@@ -0,0 +1,86 @@
+#include "stdafx.h"
+#include "AllocationCounter.h"
+#include <atomic>
+#include <new>
+#include <malloc.h>
+
+namespace
+{
+	// Constant initialized, so allocations made by other static constructors are counted safely
+	std::atomic<size_t> allocationCount(0);
+	std::atomic<size_t> allocatedBytes(0);
+	std::atomic<size_t> liveBytes(0);
+	std::atomic<size_t> peakLiveBytes(0);
+	std::atomic<size_t> baselineBytes(0);
+
+	void *CountedAllocate(size_t size)
+	{
+		void *memory = malloc(size == 0 ? 1 : size);
+		if (memory == NULL)
+		{
+			throw std::bad_alloc();
+		}
+
+		// Count what the heap really handed out, delete only gets the pointer back
+		size_t actual = _msize(memory);
+		allocationCount.fetch_add(1, std::memory_order_relaxed);
+		allocatedBytes.fetch_add(actual, std::memory_order_relaxed);
+
+		size_t live = liveBytes.fetch_add(actual, std::memory_order_relaxed) + actual;
+		size_t peak = peakLiveBytes.load(std::memory_order_relaxed);
+		while (live > peak && !peakLiveBytes.compare_exchange_weak(peak, live, std::memory_order_relaxed))
+		{
+		}
+		return memory;
+	}
+
+	void CountedFree(void *memory)
+	{
+		if (memory != NULL)
+		{
+			liveBytes.fetch_sub(_msize(memory), std::memory_order_relaxed);
+			free(memory);
+		}
+	}
+}
+
+void *operator new(size_t size)
+{
+	return CountedAllocate(size);
+}
+
+void *operator new[](size_t size)
+{
+	return CountedAllocate(size);
+}
+
+void operator delete(void *memory) noexcept
+{
+	CountedFree(memory);
+}
+
+void operator delete[](void *memory) noexcept
+{
+	CountedFree(memory);
+}
+
+void AllocationCounter::Reset()
+{
+	size_t live = liveBytes.load(std::memory_order_relaxed);
+	baselineBytes.store(live, std::memory_order_relaxed);
+	peakLiveBytes.store(live, std::memory_order_relaxed);
+	allocationCount.store(0, std::memory_order_relaxed);
+	allocatedBytes.store(0, std::memory_order_relaxed);
+}
+
+AllocationCounter::Stats AllocationCounter::Get()
+{
+	Stats stats;
+	stats.allocations = allocationCount.load(std::memory_order_relaxed);
+	stats.bytes = allocatedBytes.load(std::memory_order_relaxed);
+
+	size_t peak = peakLiveBytes.load(std::memory_order_relaxed);
+	size_t baseline = baselineBytes.load(std::memory_order_relaxed);
+	stats.peakBytes = peak > baseline ? peak - baseline : 0;
+	return stats;
+}
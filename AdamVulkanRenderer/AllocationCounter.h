@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstddef>
+
+// Counts every global operator new/delete in the process
+// Replacing them is process wide, so this is only linked into OBJBenchmark, never the renderer
+class AllocationCounter
+{
+public:
+	struct Stats
+	{
+		// Allocations and bytes handed out since the last Reset
+		size_t allocations;
+		size_t bytes;
+
+		// Highest number of bytes live at once since the last Reset, over what was live at the Reset
+		size_t peakBytes;
+	};
+
+	static void Reset();
+	static Stats Get();
+};
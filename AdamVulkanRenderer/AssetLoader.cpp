@@ -0,0 +1,263 @@
+#include "stdafx.h"
+#include "AssetLoader.h"
+#include "MeshCache.h"
+#include "MeshCodec.h"
+#include "PPMFile.h"
+#include "MappedFile.h"
+#include "TextureCache.h"
+#include <utility>
+
+namespace
+{
+	void CALLBACK AssetJobCallback(PTP_CALLBACK_INSTANCE Instance, PVOID Parameter, PTP_WORK Work)
+	{
+		AssetLoader *loader = (AssetLoader*)Parameter;
+		loader->RunNextJob();
+		UNREFERENCED_PARAMETER(Instance);
+		UNREFERENCED_PARAMETER(Work);
+	}
+
+	template <typename T>
+	inline unsigned long long HashArray(unsigned long long hash, const std::vector<T> &data)
+	{
+		return (hash ^ MeshCodec::Checksum(data.data(), data.size() * sizeof(T))) * 0x100000001B3ull;
+	}
+
+	// Vertices, normals, indices and draw ranges of every level, materials only reach the GPU through the ranges
+	unsigned long long GeometryHash(const Model &model)
+	{
+		unsigned long long hash = 0;
+		hash = HashArray(hash, model.fileVertices);
+		hash = HashArray(hash, model.fileNormals);
+		hash = HashArray(hash, model.fileIndices);
+		hash = HashArray(hash, model.materialRanges);
+		for (size_t i = 0; i < model.lods.size(); ++i)
+		{
+			hash = HashArray(hash, model.lods[i].indices);
+			hash = HashArray(hash, model.lods[i].materialRanges);
+			hash = (hash ^ MeshCodec::Checksum(&model.lods[i].error, sizeof(float))) * 0x100000001B3ull;
+		}
+		return hash;
+	}
+}
+
+AssetLoader::AssetLoader()
+{
+	m_work = CreateThreadpoolWork(AssetJobCallback, this, NULL);
+}
+
+AssetLoader::~AssetLoader()
+{
+	Cancel();
+	CloseThreadpoolWork(m_work);
+}
+
+AssetLoader::Handle AssetLoader::LoadModels(const std::string &fileName, const OBJFile::LoadSettings &settings, VertexQuantizer::Format format)
+{
+	Job job;
+	job.fileName = fileName;
+	job.isModel = true;
+	job.settings = settings;
+	job.format = format;
+	job.blockCompress = false;
+	job.blockFormat = TextureCompressor::FormatBC7;
+	return Queue(job);
+}
+
+AssetLoader::Handle AssetLoader::LoadTexture(const std::string &fileName, bool blockCompress, TextureCompressor::Format blockFormat)
+{
+	Job job;
+	job.fileName = fileName;
+	job.isModel = false;
+	job.format = VertexQuantizer::FormatFloat;
+	job.blockCompress = blockCompress;
+	job.blockFormat = blockFormat;
+	return Queue(job);
+}
+
+AssetLoader::Handle AssetLoader::Queue(Job &job)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_states.push_back(StateQueued);
+		job.handle = Handle(m_states.size());
+		m_jobs.push_back(job);
+	}
+
+	// Each submit runs one callback, which takes the oldest job
+	SubmitThreadpoolWork(m_work);
+	return job.handle;
+}
+
+void AssetLoader::RunNextJob()
+{
+	Job job;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		// Cancel already cleared the queue
+		if (m_jobs.empty())
+		{
+			return;
+		}
+
+		job = m_jobs.front();
+		m_jobs.pop_front();
+		m_states[job.handle - 1] = StateLoading;
+	}
+
+	if (job.isModel)
+	{
+		LoadModelsJob(job);
+	}
+	else
+	{
+		LoadTextureJob(job);
+	}
+}
+
+void AssetLoader::LoadModelsJob(const Job &job)
+{
+	// Groups are handed over as they finish, so the first ones can be drawn while the rest parse
+	size_t modelCount = 0;
+	MeshCache::LoadOBJ(job.fileName, [this, &job, &modelCount](Model &model)
+	{
+		Result result;
+		result.handle = job.handle;
+		result.hasModel = true;
+		result.hash = GeometryHash(model);
+		result.model = std::move(model);
+		result.format = job.format;
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_results.push_back(std::move(result));
+		++modelCount;
+	}, job.settings);
+
+	if (modelCount == 0)
+	{
+		Finish(job.handle, NULL, StateFailed);
+		return;
+	}
+
+	Result end;
+	end.handle = job.handle;
+	end.last = true;
+	Finish(job.handle, &end, StateLoaded);
+}
+
+void AssetLoader::LoadTextureJob(const Job &job)
+{
+	Result result;
+	result.handle = job.handle;
+	result.hasImage = true;
+	result.last = true;
+
+	// .dds files already hold their mips in the device's layout, they're only parsed and the mapping goes along to the upload
+	const std::string &fileName = job.fileName;
+	if (fileName.size() >= 4 && _stricmp(fileName.c_str() + fileName.size() - 4, ".dds") == 0)
+	{
+		std::unique_ptr<MappedFile> file(new MappedFile());
+		DDSFile::Header header;
+		if (!file->Open(fileName) || !DDSFile::ParseHeader(file->Data(), file->Size(), header))
+		{
+			Finish(job.handle, NULL, StateFailed);
+			return;
+		}
+
+		result.imageFormat = header.format;
+		result.srgb = header.srgb;
+		result.levels.swap(header.levels);
+		result.mappingOffset = header.dataOffset;
+		result.mappingSize = header.dataSize;
+		result.mapping = std::move(file);
+		Finish(job.handle, &result, StateLoaded);
+		return;
+	}
+
+	// Encoded once per version of the file, later loads read the blocks back from the cache
+	if (job.blockCompress)
+	{
+		static const DDSFile::Format formats[TextureCompressor::FormatCount] = { DDSFile::FormatBC1, DDSFile::FormatBC3, DDSFile::FormatBC7 };
+
+		TextureCache::Image image;
+		if (!TextureCache::LoadPPM(job.fileName, job.blockFormat, image))
+		{
+			Finish(job.handle, NULL, StateFailed);
+			return;
+		}
+
+		result.imageFormat = formats[image.format];
+		result.levels.swap(image.levels);
+		result.data.swap(image.blocks);
+		Finish(job.handle, &result, StateLoaded);
+		return;
+	}
+
+	MappedFile file;
+	PPMFile::Header header;
+	if (!file.Open(job.fileName) || !PPMFile::ParseHeader(file.Data(), file.Size(), header))
+	{
+		Finish(job.handle, NULL, StateFailed);
+		return;
+	}
+
+	// The RGB rows are expanded straight out of the mapping into level 0, then the rest of the chain is filtered from it
+	result.data.resize(MipGenerator::Layout(static_cast<uint32_t>(header.width), static_cast<uint32_t>(header.height), result.levels));
+	PPMFile::ExpandRGB(reinterpret_cast<const unsigned char *>(file.Data()) + header.dataOffset, header.width, header.height, result.data.data(), size_t(header.width) * 4);
+	file.Close();
+	MipGenerator::Generate(result.data.data(), result.levels);
+
+	Finish(job.handle, &result, StateLoaded);
+}
+
+void AssetLoader::Finish(Handle handle, Result *result, State state)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (result != NULL)
+	{
+		m_results.push_back(std::move(*result));
+	}
+	m_states[handle - 1] = state;
+}
+
+void AssetLoader::TakeResults(std::vector<Result> &results)
+{
+	results.clear();
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	results.swap(m_results);
+}
+
+void AssetLoader::MarkResident(Handle handle)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (handle != invalidHandle && handle <= m_states.size() && m_states[handle - 1] == StateLoaded)
+	{
+		m_states[handle - 1] = StateResident;
+	}
+}
+
+AssetLoader::State AssetLoader::GetState(Handle handle) const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (handle == invalidHandle || handle > m_states.size())
+	{
+		return StateFailed;
+	}
+
+	return m_states[handle - 1];
+}
+
+void AssetLoader::Cancel()
+{
+	// Callbacks that haven't started are dropped, running ones finish first
+	WaitForThreadpoolWorkCallbacks(m_work, TRUE);
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	for (size_t i = 0; i < m_jobs.size(); ++i)
+	{
+		m_states[m_jobs[i].handle - 1] = StateFailed;
+	}
+	m_jobs.clear();
+}
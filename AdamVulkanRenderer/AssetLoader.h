@@ -0,0 +1,137 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <memory>
+#include "Model.h"
+#include "OBJFile.h"
+#include "VertexQuantizer.h"
+#include "MipGenerator.h"
+#include "DDSFile.h"
+#include "TextureCompressor.h"
+#include "MappedFile.h"
+
+// Background loading for .obj, .ppm and .dds files
+// Requests are queued and parsed on the thread pool, several at a time, without touching Vulkan
+// The render thread takes the finished CPU data once a frame, uploads it and marks the asset resident
+class AssetLoader
+{
+public:
+	// Handed out as soon as a file is queued, 0 is never used
+	typedef unsigned int Handle;
+	static const Handle invalidHandle = 0;
+
+	enum State
+	{
+		// Waiting for a worker
+		StateQueued,
+
+		// Being parsed, .obj groups that are done may already be waiting for upload
+		StateLoading,
+
+		// Parsed, waiting for the render thread to upload the rest
+		StateLoaded,
+
+		// Uploaded, safe to draw
+		StateResident,
+
+		// Missing or unreadable file, or cancelled before it started
+		StateFailed
+	};
+
+	// One piece of finished CPU data
+	struct Result
+	{
+		Handle handle;
+
+		// One .obj group, .obj files end with a Result that has no model
+		bool hasModel;
+		Model model;
+		VertexQuantizer::Format format;
+
+		// Over everything the group uploads, a reload can skip groups whose hash didn't change
+		unsigned long long hash;
+
+		// A texture's whole mip chain, filtered and compressed on the loader thread so the render thread only copies it
+		// Level 0 is the full image, offsets are from LevelData
+		bool hasImage;
+		DDSFile::Format imageFormat;
+
+		// Sampled through the sRGB format, only a .dds can ask for it
+		bool srgb;
+
+		std::vector<MipGenerator::Level> levels;
+		std::vector<unsigned char> data;
+
+		// A .dds isn't copied out of its file, the levels stay mapped until they're uploaded and data is left empty
+		std::unique_ptr<MappedFile> mapping;
+		size_t mappingOffset;
+		size_t mappingSize;
+
+		const unsigned char *LevelData() const { return mapping ? reinterpret_cast<const unsigned char *>(mapping->Data()) + mappingOffset : data.data(); }
+		size_t LevelBytes() const { return mapping ? mappingSize : data.size(); }
+
+		// Nothing else is coming for handle, it's resident once this is uploaded
+		bool last;
+
+		Result() : handle(invalidHandle), hasModel(false), format(VertexQuantizer::FormatFloat), hash(0), hasImage(false), imageFormat(DDSFile::FormatRGBA8), srgb(false), mappingOffset(0), mappingSize(0), last(false) {}
+	};
+
+	AssetLoader();
+	~AssetLoader();
+
+	// Queue a file, models arrive group by group as they finish
+	Handle LoadModels(const std::string &fileName, const OBJFile::LoadSettings &settings, VertexQuantizer::Format format = VertexQuantizer::FormatFloat);
+	// Block compressed through TextureCache when blockCompress is set, RGBA8 otherwise
+	Handle LoadTexture(const std::string &fileName, bool blockCompress = false, TextureCompressor::Format blockFormat = TextureCompressor::FormatBC7);
+
+	// Everything that finished since the last call, in the order it finished
+	// Only waits on the lock to swap the list, never on parsing
+	void TakeResults(std::vector<Result> &results);
+
+	// Called by the render thread once it has uploaded a Result with last set
+	void MarkResident(Handle handle);
+
+	State GetState(Handle handle) const;
+
+	// Drops the jobs that haven't started and waits for the running ones
+	// Results that already finished are still handed out by TakeResults
+	void Cancel();
+
+	// Code to run on the thread pool, there is one callback per queued job
+	void RunNextJob();
+
+private:
+	struct Job
+	{
+		Handle handle;
+		std::string fileName;
+
+		// .obj when set, a texture otherwise
+		bool isModel;
+		OBJFile::LoadSettings settings;
+		VertexQuantizer::Format format;
+		bool blockCompress;
+		TextureCompressor::Format blockFormat;
+	};
+
+	Handle Queue(Job &job);
+	void LoadModelsJob(const Job &job);
+	void LoadTextureJob(const Job &job);
+
+	// Result and the state change go in under one lock, so the render thread
+	// can't mark the handle resident before its state says it's loaded
+	void Finish(Handle handle, Result *result, State state);
+
+	PTP_WORK m_work;
+
+	// Guards everything below
+	mutable std::mutex m_mutex;
+	std::deque<Job> m_jobs;
+	std::vector<Result> m_results;
+
+	// Indexed by handle - 1
+	std::vector<State> m_states;
+};
@@ -0,0 +1,162 @@
+#include "stdafx.h"
+#include "DDSFile.h"
+#include <cstring>
+
+namespace
+{
+	const uint32_t saneDimension = 16384;
+
+	// DDS format from https://docs.microsoft.com/en-us/windows/win32/direct3ddds/dx-graphics-dds-pguide
+	// Magic, then a 124 byte DDS_HEADER, then a 20 byte DDS_HEADER_DXT10 if the pixel format's four CC is DX10
+	const size_t headerBytes = 4 + 124;
+	const size_t extendedHeaderBytes = 20;
+
+	const uint32_t flagDepth = 0x800000;
+	const uint32_t pixelFormatFourCC = 0x4;
+	const uint32_t pixelFormatRGB = 0x40;
+	const uint32_t caps2Cubemap = 0x200;
+	const uint32_t caps2Volume = 0x200000;
+
+	// DXGI_FORMAT values the DX10 header uses
+	const uint32_t dxgiRGBA8 = 28;
+	const uint32_t dxgiRGBA8SRGB = 29;
+	const uint32_t dxgiBC1 = 71;
+	const uint32_t dxgiBC1SRGB = 72;
+	const uint32_t dxgiBC3 = 77;
+	const uint32_t dxgiBC3SRGB = 78;
+	const uint32_t dxgiBC7 = 98;
+	const uint32_t dxgiBC7SRGB = 99;
+	const uint32_t dimensionTexture2D = 3;
+	const uint32_t miscTextureCube = 0x4;
+
+	inline uint32_t MakeFourCC(char a, char b, char c, char d)
+	{
+		return uint32_t(uint8_t(a)) | (uint32_t(uint8_t(b)) << 8) | (uint32_t(uint8_t(c)) << 16) | (uint32_t(uint8_t(d)) << 24);
+	}
+
+	// The file is little endian like everything it runs on, and the mapping needn't be aligned
+	inline uint32_t ReadU32(const char *data, size_t offset)
+	{
+		uint32_t value;
+		memcpy(&value, data + offset, sizeof(value));
+		return value;
+	}
+
+	bool FromDXGI(uint32_t dxgiFormat, DDSFile::Format &format, bool &srgb)
+	{
+		switch (dxgiFormat)
+		{
+		case dxgiRGBA8: format = DDSFile::FormatRGBA8; srgb = false; return true;
+		case dxgiRGBA8SRGB: format = DDSFile::FormatRGBA8; srgb = true; return true;
+		case dxgiBC1: format = DDSFile::FormatBC1; srgb = false; return true;
+		case dxgiBC1SRGB: format = DDSFile::FormatBC1; srgb = true; return true;
+		case dxgiBC3: format = DDSFile::FormatBC3; srgb = false; return true;
+		case dxgiBC3SRGB: format = DDSFile::FormatBC3; srgb = true; return true;
+		case dxgiBC7: format = DDSFile::FormatBC7; srgb = false; return true;
+		case dxgiBC7SRGB: format = DDSFile::FormatBC7; srgb = true; return true;
+		default: return false;
+		}
+	}
+
+	// Block formats round up to whole 4x4 blocks, RGBA8 rows are tightly packed
+	size_t LevelBytes(DDSFile::Format format, uint32_t width, uint32_t height)
+	{
+		if (format == DDSFile::FormatRGBA8)
+		{
+			return size_t(width) * height * 4;
+		}
+
+		size_t blockBytes = format == DDSFile::FormatBC1 ? 8 : 16;
+		return size_t((width + 3) / 4) * ((height + 3) / 4) * blockBytes;
+	}
+}
+
+bool DDSFile::ParseHeader(const char *data, size_t size, Header &header)
+{
+	if (size < headerBytes || ReadU32(data, 0) != MakeFourCC('D', 'D', 'S', ' ') || ReadU32(data, 4) != 124)
+	{
+		return false;
+	}
+
+	uint32_t flags = ReadU32(data, 8);
+	uint32_t height = ReadU32(data, 12);
+	uint32_t width = ReadU32(data, 16);
+	uint32_t depth = ReadU32(data, 24);
+	uint32_t mipMapCount = ReadU32(data, 28);
+	uint32_t pixelFlags = ReadU32(data, 80);
+	uint32_t fourCC = ReadU32(data, 84);
+	uint32_t caps2 = ReadU32(data, 112);
+
+	if (width == 0 || width > saneDimension || height == 0 || height > saneDimension)
+	{
+		return false;
+	}
+	if ((caps2 & (caps2Cubemap | caps2Volume)) != 0 || ((flags & flagDepth) != 0 && depth > 1))
+	{
+		return false;
+	}
+
+	header.dataOffset = headerBytes;
+	header.srgb = false;
+	if ((pixelFlags & pixelFormatFourCC) != 0 && fourCC == MakeFourCC('D', 'X', '1', '0'))
+	{
+		if (size < headerBytes + extendedHeaderBytes)
+		{
+			return false;
+		}
+
+		uint32_t dimension = ReadU32(data, headerBytes + 4);
+		uint32_t miscFlags = ReadU32(data, headerBytes + 8);
+		uint32_t arraySize = ReadU32(data, headerBytes + 12);
+		if (!FromDXGI(ReadU32(data, headerBytes), header.format, header.srgb) ||
+			dimension != dimensionTexture2D || (miscFlags & miscTextureCube) != 0 || arraySize != 1)
+		{
+			return false;
+		}
+		header.dataOffset += extendedHeaderBytes;
+	}
+	else if ((pixelFlags & pixelFormatFourCC) != 0 && fourCC == MakeFourCC('D', 'X', 'T', '1'))
+	{
+		header.format = FormatBC1;
+	}
+	else if ((pixelFlags & pixelFormatFourCC) != 0 && fourCC == MakeFourCC('D', 'X', 'T', '5'))
+	{
+		header.format = FormatBC3;
+	}
+	else if ((pixelFlags & pixelFormatRGB) != 0 && ReadU32(data, 88) == 32 &&
+		ReadU32(data, 92) == 0x000000FF && ReadU32(data, 96) == 0x0000FF00 && ReadU32(data, 100) == 0x00FF0000)
+	{
+		// Legacy uncompressed only in the byte order Vulkan's R8G8B8A8 has, alpha or not it's taken as it is
+		header.format = FormatRGBA8;
+	}
+	else
+	{
+		return false;
+	}
+
+	// Levels halve down to 1x1 at most, a count of 0 means just the one
+	// Plenty of exporters fill in the count without setting its flag, so the flag isn't checked
+	uint32_t maxLevels = 1;
+	for (uint32_t extent = width > height ? width : height; extent > 1; extent >>= 1)
+	{
+		++maxLevels;
+	}
+	uint32_t levelCount = mipMapCount > 0 ? mipMapCount : 1;
+	if (levelCount > maxLevels)
+	{
+		return false;
+	}
+
+	header.levels.resize(levelCount);
+	header.dataSize = 0;
+	for (uint32_t i = 0; i < levelCount; ++i)
+	{
+		MipGenerator::Level &level = header.levels[i];
+		level.width = (width >> i) > 0 ? width >> i : 1;
+		level.height = (height >> i) > 0 ? height >> i : 1;
+		level.offset = header.dataSize;
+		header.dataSize += LevelBytes(header.format, level.width, level.height);
+	}
+
+	return size - header.dataOffset >= header.dataSize;
+}
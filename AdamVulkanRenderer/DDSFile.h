@@ -0,0 +1,44 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include "MipGenerator.h"
+
+// .dds textures, the container most tools export block compressed textures with their mips already built
+// Only the header is parsed, the level payloads are left in the mapped file exactly as the GPU takes them
+// Single 2D images in RGBA8, BC1, BC3 or BC7, with the legacy header or the DX10 one
+class DDSFile
+{
+public:
+	enum Format
+	{
+		FormatRGBA8,
+		FormatBC1,
+		FormatBC3,
+		FormatBC7,
+
+		FormatCount
+	};
+
+	struct Header
+	{
+		Format format;
+
+		// Colors are sRGB encoded, only the DX10 header can say so
+		bool srgb;
+
+		// Level 0 is the full image, offsets are from dataOffset
+		std::vector<MipGenerator::Level> levels;
+
+		// Where the first level starts, every level follows the one before with no padding
+		size_t dataOffset;
+
+		// Bytes of every level together
+		size_t dataSize;
+	};
+
+	// Parse the header at the start of a mapped file
+	// False for cube maps, arrays, volumes, other formats, or if the file is too short for its levels
+	static bool ParseHeader(const char *data, size_t size, Header &header);
+};
@@ -0,0 +1,258 @@
+#include "stdafx.h"
+#include "FileWatcher.h"
+
+FileWatcher::FileWatcher() : m_thread(NULL), m_stopped(false)
+{
+	m_stopEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+	m_wakeEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+}
+
+FileWatcher::~FileWatcher()
+{
+	Stop();
+	CloseHandle(m_stopEvent);
+	CloseHandle(m_wakeEvent);
+}
+
+bool FileWatcher::Watch(const std::string &fileName)
+{
+	char fullPath[MAX_PATH];
+	char *namePart = NULL;
+	DWORD length = GetFullPathNameA(fileName.c_str(), MAX_PATH, fullPath, &namePart);
+	if (length == 0 || length >= MAX_PATH || namePart == NULL)
+	{
+		return false;
+	}
+
+	WatchedFile file;
+	file.name = namePart;
+	file.fileName = fileName;
+	std::string path(fullPath, namePart - fullPath);
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_stopped)
+	{
+		return false;
+	}
+
+	// Windows paths aren't case sensitive, neither are the matches
+	for (size_t i = 0; i < m_directories.size(); ++i)
+	{
+		Directory &directory = *m_directories[i];
+		if (_stricmp(directory.path.c_str(), path.c_str()) != 0)
+		{
+			continue;
+		}
+
+		for (size_t j = 0; j < directory.files.size(); ++j)
+		{
+			if (_stricmp(directory.files[j].name.c_str(), file.name.c_str()) == 0)
+			{
+				return true;
+			}
+		}
+		directory.files.push_back(file);
+		return true;
+	}
+
+	if (m_directories.size() >= maximumDirectories)
+	{
+		return false;
+	}
+
+	HANDLE handle = CreateFileA(path.c_str(), FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING,
+		FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, NULL);
+	if (handle == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+
+	Directory *directory = new Directory();
+	directory->path = path;
+	directory->handle = handle;
+	directory->overlapped.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+	directory->reading = false;
+	directory->files.push_back(file);
+	m_directories.push_back(directory);
+
+	// Nothing runs in the background until there's something to watch
+	if (m_thread == NULL)
+	{
+		m_thread = CreateThread(NULL, 0, ThreadCode, this, 0, NULL);
+	}
+	SetEvent(m_wakeEvent);
+	return true;
+}
+
+void FileWatcher::TakeChanges(std::vector<std::string> &fileNames)
+{
+	fileNames.clear();
+	ULONGLONG now = GetTickCount64();
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	std::map<std::string, ULONGLONG>::iterator it = m_pending.begin();
+	while (it != m_pending.end())
+	{
+		if (now - it->second >= settleMilliseconds)
+		{
+			fileNames.push_back(it->first);
+			it = m_pending.erase(it);
+		}
+		else
+		{
+			++it;
+		}
+	}
+}
+
+void FileWatcher::Stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_stopped)
+		{
+			return;
+		}
+		m_stopped = true;
+	}
+
+	if (m_thread != NULL)
+	{
+		SetEvent(m_stopEvent);
+		WaitForSingleObject(m_thread, INFINITE);
+		CloseHandle(m_thread);
+		m_thread = NULL;
+	}
+
+	for (size_t i = 0; i < m_directories.size(); ++i)
+	{
+		Directory *directory = m_directories[i];
+		if (directory->reading)
+		{
+			// The read writes into the directory's buffer until it's cancelled, wait for that before freeing it
+			DWORD bytes = 0;
+			CancelIoEx(directory->handle, &directory->overlapped);
+			GetOverlappedResult(directory->handle, &directory->overlapped, &bytes, TRUE);
+		}
+		CloseHandle(directory->handle);
+		CloseHandle(directory->overlapped.hEvent);
+		delete directory;
+	}
+	m_directories.clear();
+	m_pending.clear();
+}
+
+DWORD WINAPI FileWatcher::ThreadCode(LPVOID parameter)
+{
+	FileWatcher *watcher = static_cast<FileWatcher *>(parameter);
+	watcher->Run();
+	return 0;
+}
+
+void FileWatcher::Run()
+{
+	for (;;)
+	{
+		HANDLE handles[MAXIMUM_WAIT_OBJECTS];
+		Directory *waiting[MAXIMUM_WAIT_OBJECTS];
+		DWORD count = 0;
+		handles[count++] = m_stopEvent;
+		handles[count++] = m_wakeEvent;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			StartReads();
+			for (size_t i = 0; i < m_directories.size(); ++i)
+			{
+				if (m_directories[i]->reading)
+				{
+					waiting[count] = m_directories[i];
+					handles[count++] = m_directories[i]->overlapped.hEvent;
+				}
+			}
+		}
+
+		DWORD signalled = WaitForMultipleObjects(count, handles, FALSE, INFINITE);
+		if (signalled == WAIT_OBJECT_0 || signalled >= WAIT_OBJECT_0 + count)
+		{
+			return;
+		}
+
+		// A wake only means there are new directories, the next pass starts their reads
+		if (signalled > WAIT_OBJECT_0 + 1)
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			ReadChanges(*waiting[signalled - WAIT_OBJECT_0]);
+		}
+	}
+}
+
+// Called with the lock held
+void FileWatcher::StartReads()
+{
+	for (size_t i = 0; i < m_directories.size(); ++i)
+	{
+		Directory &directory = *m_directories[i];
+		if (directory.reading)
+		{
+			continue;
+		}
+
+		// Exporters that write a temporary file and rename it over the old one show up as a new name
+		ResetEvent(directory.overlapped.hEvent);
+		directory.reading = ReadDirectoryChangesW(directory.handle, directory.buffer, sizeof(directory.buffer), FALSE,
+			FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_SIZE | FILE_NOTIFY_CHANGE_LAST_WRITE, NULL, &directory.overlapped, NULL) != FALSE;
+	}
+}
+
+// Called with the lock held
+void FileWatcher::ReadChanges(Directory &directory)
+{
+	DWORD bytes = 0;
+	BOOL read = GetOverlappedResult(directory.handle, &directory.overlapped, &bytes, FALSE);
+	directory.reading = false;
+	if (!read)
+	{
+		return;
+	}
+
+	// Too many changes for the buffer and the list was dropped, assume every file here changed
+	if (bytes == 0)
+	{
+		for (size_t i = 0; i < directory.files.size(); ++i)
+		{
+			Changed(directory.files[i].fileName);
+		}
+		return;
+	}
+
+	const FILE_NOTIFY_INFORMATION *info = reinterpret_cast<const FILE_NOTIFY_INFORMATION *>(directory.buffer);
+	for (;;)
+	{
+		// A file that's gone has nothing to reload, its new version shows up as an add or a rename
+		if (info->Action != FILE_ACTION_REMOVED && info->Action != FILE_ACTION_RENAMED_OLD_NAME)
+		{
+			char name[MAX_PATH];
+			int length = WideCharToMultiByte(CP_ACP, 0, info->FileName, static_cast<int>(info->FileNameLength / sizeof(WCHAR)), name, MAX_PATH - 1, NULL, NULL);
+			name[length] = '\0';
+			for (size_t i = 0; i < directory.files.size(); ++i)
+			{
+				if (length > 0 && _stricmp(name, directory.files[i].name.c_str()) == 0)
+				{
+					Changed(directory.files[i].fileName);
+				}
+			}
+		}
+
+		if (info->NextEntryOffset == 0)
+		{
+			break;
+		}
+		info = reinterpret_cast<const FILE_NOTIFY_INFORMATION *>(reinterpret_cast<const char *>(info) + info->NextEntryOffset);
+	}
+}
+
+// Called with the lock held, every change pushes the report back
+void FileWatcher::Changed(const std::string &fileName)
+{
+	m_pending[fileName] = GetTickCount64();
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+
+// Reports when watched files are written, for reloading assets while the renderer runs
+// Every directory holding a watched file gets one ReadDirectoryChangesW read on a background thread,
+// changes to files nobody asked about are dropped there
+// Exporters tend to write a file in several steps, so a file is only reported once it has been quiet for a moment
+class FileWatcher
+{
+public:
+	// How long a file has to go without changing before it's reported
+	static const unsigned int settleMilliseconds = 250;
+
+	// Directories, one wait handle each next to the stop and wake events
+	static const size_t maximumDirectories = MAXIMUM_WAIT_OBJECTS - 2;
+
+	FileWatcher();
+	~FileWatcher();
+
+	// Start reporting changes to fileName, false if its directory can't be watched
+	// Files are matched by full path, so two relative paths to the same file share a watch
+	bool Watch(const std::string &fileName);
+
+	// Files that changed and settled since the last call, named as they were passed to Watch
+	void TakeChanges(std::vector<std::string> &fileNames);
+
+	// Cancels the reads and joins the thread, nothing is reported after this
+	void Stop();
+
+private:
+	struct WatchedFile
+	{
+		// Name inside the directory, what the notifications carry
+		std::string name;
+		std::string fileName;
+	};
+
+	struct Directory
+	{
+		std::string path;
+		HANDLE handle;
+		OVERLAPPED overlapped;
+		bool reading;
+		std::vector<WatchedFile> files;
+
+		// Filled by the read, DWORD aligned as ReadDirectoryChangesW wants
+		DWORD buffer[16 * 1024];
+	};
+
+	static DWORD WINAPI ThreadCode(LPVOID parameter);
+	void Run();
+	void StartReads();
+	void ReadChanges(Directory &directory);
+	void Changed(const std::string &fileName);
+
+	// Directories and the thread are released in the destructor, so don't allow copies
+	FileWatcher(const FileWatcher &);
+	FileWatcher &operator=(const FileWatcher &);
+
+	HANDLE m_thread;
+	HANDLE m_stopEvent;
+
+	// Set by Watch, the thread then starts reads on new directories
+	HANDLE m_wakeEvent;
+
+	// Guards everything below
+	std::mutex m_mutex;
+	bool m_stopped;
+	std::vector<Directory *> m_directories;
+
+	// Tick of the latest change to each file that hasn't been reported yet
+	std::map<std::string, ULONGLONG> m_pending;
+};
@@ -0,0 +1,163 @@
+#include "stdafx.h"
+#include "IndexPacker.h"
+#include <algorithm>
+#include <climits>
+#include <cstring>
+
+namespace
+{
+	// Widest vertex span one draw can cover with 16 bit indices, primitive restart is off so 0xFFFF is a normal index
+	const unsigned int maximumSpan = 0xFFFF;
+
+	// Every draw added by splitting has to save at least this much index memory
+	const size_t minimumSavingPerDraw = 64 * 1024;
+
+	// Cut a material range into draws whose vertices fit in a 16 bit window
+	// Vertices are numbered in order of first use, so neighbouring triangles land in the same window
+	// levelStart moves the draws to where the level's indices sit in the buffer
+	// Returns false if a single triangle spans more than a window
+	bool SplitRange(const std::vector<unsigned int> &indices, const MaterialRange &range, unsigned int levelStart, std::vector<IndexPacker::Draw> &draws)
+	{
+		IndexPacker::Draw draw = { range.material, levelStart + range.firstIndex, 0, 0 };
+		unsigned int low = UINT_MAX;
+		unsigned int high = 0;
+
+		size_t end = static_cast<size_t>(range.firstIndex) + range.indexCount;
+		for (size_t i = range.firstIndex; i + 3 <= end; i += 3)
+		{
+			unsigned int triangleLow = std::min(indices[i], std::min(indices[i + 1], indices[i + 2]));
+			unsigned int triangleHigh = std::max(indices[i], std::max(indices[i + 1], indices[i + 2]));
+			if (triangleHigh - triangleLow > maximumSpan)
+			{
+				return false;
+			}
+
+			unsigned int newLow = std::min(low, triangleLow);
+			unsigned int newHigh = std::max(high, triangleHigh);
+			if (draw.indexCount > 0 && newHigh - newLow > maximumSpan)
+			{
+				draw.vertexOffset = static_cast<int>(low);
+				draws.push_back(draw);
+
+				draw.firstIndex = levelStart + static_cast<unsigned int>(i);
+				draw.indexCount = 0;
+				newLow = triangleLow;
+				newHigh = triangleHigh;
+			}
+
+			low = newLow;
+			high = newHigh;
+			draw.indexCount += 3;
+		}
+
+		if (draw.indexCount > 0)
+		{
+			draw.vertexOffset = static_cast<int>(low);
+			draws.push_back(draw);
+		}
+		return true;
+	}
+
+	// Level 0 is the full model, the rest are its lods
+	const std::vector<unsigned int> &LevelIndices(const Model &model, size_t level)
+	{
+		return level == 0 ? model.fileIndices : model.lods[level - 1].indices;
+	}
+
+	// Models without materials still need a range per level to keep the levels apart
+	std::vector<MaterialRange> LevelRanges(const Model &model, size_t level)
+	{
+		std::vector<MaterialRange> ranges = level == 0 ? model.materialRanges : model.lods[level - 1].materialRanges;
+		if (ranges.empty())
+		{
+			MaterialRange whole = { 0, 0, static_cast<unsigned int>(LevelIndices(model, level).size()) };
+			ranges.push_back(whole);
+		}
+		return ranges;
+	}
+}
+
+void IndexPacker::Pack(const Model &model, PackedIndices &packed)
+{
+	packed.draws.clear();
+	packed.levelStarts.clear();
+
+	size_t levelCount = model.lods.size() + 1;
+	size_t vertexCount = model.fileVertices.size() / Model::vertexStride;
+
+	packed.indexCount = 0;
+	size_t rangeCount = 0;
+	for (size_t level = 0; level < levelCount; ++level)
+	{
+		packed.levelStarts.push_back(static_cast<unsigned int>(packed.indexCount));
+		packed.indexCount += LevelIndices(model, level).size();
+		rangeCount += LevelRanges(model, level).size();
+	}
+
+	bool sixteenBit = true;
+	if (vertexCount > maximumSpan + 1)
+	{
+		for (size_t level = 0; level < levelCount && sixteenBit; ++level)
+		{
+			std::vector<MaterialRange> ranges = LevelRanges(model, level);
+			for (size_t i = 0; i < ranges.size() && sixteenBit; ++i)
+			{
+				sixteenBit = SplitRange(LevelIndices(model, level), ranges[i], packed.levelStarts[level], packed.draws);
+			}
+		}
+
+		// Halving the indices has to pay for the extra draws
+		size_t extraDraws = packed.draws.size() - std::min(packed.draws.size(), rangeCount);
+		sixteenBit = sixteenBit && extraDraws * minimumSavingPerDraw <= packed.indexCount * sizeof(uint16_t);
+	}
+
+	// Small enough to draw every range as it is, or not worth splitting
+	if (vertexCount <= maximumSpan + 1 || !sixteenBit)
+	{
+		packed.draws.clear();
+		for (size_t level = 0; level < levelCount; ++level)
+		{
+			std::vector<MaterialRange> ranges = LevelRanges(model, level);
+			for (size_t i = 0; i < ranges.size(); ++i)
+			{
+				Draw draw = { ranges[i].material, packed.levelStarts[level] + ranges[i].firstIndex, ranges[i].indexCount, 0 };
+				packed.draws.push_back(draw);
+			}
+		}
+	}
+
+	packed.indexSize = sixteenBit ? sizeof(uint16_t) : sizeof(uint32_t);
+}
+
+void IndexPacker::Write(const Model &model, const PackedIndices &packed, void *destination)
+{
+	if (packed.indexSize == sizeof(uint32_t))
+	{
+		unsigned char *out = static_cast<unsigned char *>(destination);
+		for (size_t level = 0; level < packed.levelStarts.size(); ++level)
+		{
+			const std::vector<unsigned int> &indices = LevelIndices(model, level);
+			memcpy(out + static_cast<size_t>(packed.levelStarts[level]) * sizeof(uint32_t), indices.data(), indices.size() * sizeof(uint32_t));
+		}
+		return;
+	}
+
+	// Draws are in level order and never cross into the next level
+	uint16_t *out = static_cast<uint16_t *>(destination);
+	size_t level = 0;
+	for (size_t i = 0; i < packed.draws.size(); ++i)
+	{
+		const Draw &draw = packed.draws[i];
+		while (level + 1 < packed.levelStarts.size() && draw.firstIndex >= packed.levelStarts[level + 1])
+		{
+			++level;
+		}
+
+		const unsigned int *indices = LevelIndices(model, level).data() + (draw.firstIndex - packed.levelStarts[level]);
+		unsigned int offset = static_cast<unsigned int>(draw.vertexOffset);
+		for (size_t j = 0; j < draw.indexCount; ++j)
+		{
+			out[draw.firstIndex + j] = static_cast<uint16_t>(indices[j] - offset);
+		}
+	}
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include "Model.h"
+
+// Picks the narrowest index type for a model before upload
+// Models with up to 65536 vertices always get 16 bit indices
+// Bigger ones are split into draws whose vertices fit a 16 bit window, each drawn with its own vertex offset,
+// as long as every extra draw saves enough index memory to be worth it
+// Levels of detail follow the full model's indices in the same buffer, each with draws of its own
+class IndexPacker
+{
+public:
+	// One vkCmdDrawIndexed
+	struct Draw
+	{
+		// Index into Model::materials, 0 for models without materials
+		unsigned int material;
+		unsigned int firstIndex;
+		unsigned int indexCount;
+		int vertexOffset;
+	};
+
+	struct PackedIndices
+	{
+		// 2 or 4
+		unsigned int indexSize;
+
+		// Every level's indices back to back, the full model first
+		size_t indexCount;
+
+		// Where each level starts, the full model at 0 then Model::lods in order
+		std::vector<unsigned int> levelStarts;
+
+		// In level order, levels without materials get one draw over the whole level
+		std::vector<Draw> draws;
+	};
+
+	// Only works out the layout, nothing is copied
+	static void Pack(const Model &model, PackedIndices &packed);
+
+	// indexCount indices of indexSize bytes, straight from the model's own index lists
+	static void Write(const Model &model, const PackedIndices &packed, void *destination);
+};
@@ -0,0 +1,156 @@
+#include "stdafx.h"
+#include "MTLFile.h"
+#include <cstring>
+#include "MappedFile.h"
+#include "TextScanner.h"
+
+namespace
+{
+	inline bool IsWhitespace(char c)
+	{
+		return c == ' ' || c == '\t' || c == '\r';
+	}
+
+	inline const char *SkipWhitespace(const char *cursor, const char *end)
+	{
+		while (cursor < end && IsWhitespace(*cursor))
+		{
+			++cursor;
+		}
+		return cursor;
+	}
+
+	inline bool IsKeyword(const char *keyword, const char *keywordEnd, const char *expected)
+	{
+		size_t length = strlen(expected);
+		return static_cast<size_t>(keywordEnd - keyword) == length && memcmp(keyword, expected, length) == 0;
+	}
+
+	// Names and paths run to the end of the line and may contain spaces
+	std::string ReadName(const char *cursor, const char *end)
+	{
+		cursor = SkipWhitespace(cursor, end);
+		while (end > cursor && IsWhitespace(end[-1]))
+		{
+			--end;
+		}
+		return std::string(cursor, end);
+	}
+
+	// Map options (-bm 1, -s 1 1 1, ...) aren't supported, when there are any the path is taken to be the last token
+	std::string ReadMap(const char *cursor, const char *end)
+	{
+		std::string path = ReadName(cursor, end);
+		if (!path.empty() && path[0] == '-')
+		{
+			size_t space = path.find_last_of(" \t");
+			path = space == std::string::npos ? std::string() : path.substr(space + 1);
+		}
+		return path;
+	}
+
+	float ReadFloat(const char *cursor, const char *end, float fallback)
+	{
+		float value = fallback;
+		TextScanner::ParseFloat(SkipWhitespace(cursor, end), end, value);
+		return value;
+	}
+
+	void ReadColour(const char *cursor, const char *end, Vec3 &colour)
+	{
+		for (int i = 0; i < 3; ++i)
+		{
+			cursor = SkipWhitespace(cursor, end);
+			const char *next = TextScanner::ParseFloat(cursor, end, colour[i]);
+			if (next == cursor)
+			{
+				// A single value sets all three channels
+				if (i == 1)
+				{
+					colour.y = colour.z = colour.x;
+				}
+				return;
+			}
+			cursor = next;
+		}
+	}
+}
+
+bool MTLFile::LoadFile(const std::string &fileName, std::vector<Material> &materials)
+{
+	MappedFile file;
+	if (!file.Open(fileName))
+	{
+		return false;
+	}
+
+	const char *cursor = file.Data();
+	const char *end = cursor + file.Size();
+
+	// Skip the UTF-8 byte order mark some exporters write
+	if (file.Size() >= 3 && cursor[0] == '\xEF' && cursor[1] == '\xBB' && cursor[2] == '\xBF')
+	{
+		cursor += 3;
+	}
+
+	// Properties before the first newmtl have nothing to apply to
+	Material *material = NULL;
+
+	while (cursor < end)
+	{
+		const char *lineEnd = TextScanner::FindLineEnd(cursor, end);
+		const char *keyword = SkipWhitespace(cursor, lineEnd);
+		const char *args = TextScanner::FindWhitespace(keyword, lineEnd);
+		cursor = lineEnd + 1;
+
+		if (IsKeyword(keyword, args, "newmtl"))
+		{
+			materials.push_back(Material());
+			material = &materials.back();
+			material->name = ReadName(args, lineEnd);
+			material->library = fileName;
+		}
+		else if (material == NULL)
+		{
+			continue;
+		}
+		else if (IsKeyword(keyword, args, "Ka"))
+		{
+			ReadColour(args, lineEnd, material->ambient);
+		}
+		else if (IsKeyword(keyword, args, "Kd"))
+		{
+			ReadColour(args, lineEnd, material->diffuse);
+		}
+		else if (IsKeyword(keyword, args, "Ks"))
+		{
+			ReadColour(args, lineEnd, material->specular);
+		}
+		else if (IsKeyword(keyword, args, "Ns"))
+		{
+			material->shininess = ReadFloat(args, lineEnd, material->shininess);
+		}
+		else if (IsKeyword(keyword, args, "d"))
+		{
+			material->opacity = ReadFloat(args, lineEnd, material->opacity);
+		}
+		else if (IsKeyword(keyword, args, "Tr"))
+		{
+			material->opacity = 1.0f - ReadFloat(args, lineEnd, 1.0f - material->opacity);
+		}
+		else if (IsKeyword(keyword, args, "map_Kd"))
+		{
+			material->diffuseMap = ReadMap(args, lineEnd);
+		}
+		else if (IsKeyword(keyword, args, "map_Ks"))
+		{
+			material->specularMap = ReadMap(args, lineEnd);
+		}
+		else if (IsKeyword(keyword, args, "bump") || IsKeyword(keyword, args, "map_bump") || IsKeyword(keyword, args, "map_Bump"))
+		{
+			material->bumpMap = ReadMap(args, lineEnd);
+		}
+	}
+
+	return true;
+}
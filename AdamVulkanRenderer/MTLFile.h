@@ -0,0 +1,14 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "Material.h"
+
+// Load .mtl material libraries
+// Understands newmtl, Ka, Kd, Ks, Ns, d, Tr and the diffuse, specular and bump maps, everything else is skipped
+class MTLFile
+{
+public:
+	// Appends every newmtl in the file to materials, returns false if the file can't be opened
+	static bool LoadFile(const std::string &fileName, std::vector<Material> &materials);
+};
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <string>
+
+// Read-only view of an entire file mapped into memory
+// Lets parsers tokenize assets in place instead of copying them through streams
+class MappedFile
+{
+public:
+	MappedFile();
+	~MappedFile();
+
+	// Map the whole file, returns false if it can't be opened
+	// An empty file opens successfully with a null data pointer
+	bool Open(const std::string &fileName);
+	void Close();
+
+	const char *Data() const { return m_data; }
+	size_t Size() const { return m_size; }
+
+private:
+	// Views are released in the destructor, so don't allow copies
+	MappedFile(const MappedFile &);
+	MappedFile &operator=(const MappedFile &);
+
+	void *m_file;
+	void *m_mapping;
+	const char *m_data;
+	size_t m_size;
+};
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <string>
+#include "Vec3.h"
+
+// Surface description from a .mtl library
+// Colours default to the .mtl spec values, maps are left as written in the file
+class Material
+{
+public:
+	Material() : diffuse(1.0f, 1.0f, 1.0f), shininess(0.0f), opacity(1.0f) {}
+
+	std::string name;
+
+	// .mtl the material came from, empty for names used by usemtl that no library defines
+	// Map paths are relative to its directory
+	std::string library;
+
+	Vec3 ambient;
+	Vec3 diffuse;
+	Vec3 specular;
+	float shininess;
+	float opacity;
+
+	std::string diffuseMap;
+	std::string specularMap;
+	std::string bumpMap;
+};
+
+// Run of fileIndices drawn with one material
+struct MaterialRange
+{
+	// Index into Model::materials
+	unsigned int material;
+	unsigned int firstIndex;
+	unsigned int indexCount;
+};
@@ -0,0 +1,825 @@
+#include "stdafx.h"
+#include "MeshCache.h"
+#include "MappedFile.h"
+#include "MeshCodec.h"
+#include "MeshletBuilder.h"
+#include <fstream>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+
+namespace
+{
+	const char cacheMagic[4] = { 'A', 'V', 'M', 'C' };
+
+	// Bump whenever the layout or the loader output changes, old caches are then rebuilt
+	const uint32_t cacheVersion = 9;
+
+	// Load settings that change the output, a cache built with different ones is rebuilt
+	const uint32_t flagBatchByMaterial = 1;
+	const uint32_t flagOptimizeMeshes = 2;
+	const uint32_t flagBuildMeshlets = 4;
+	const uint32_t flagBuildLods = 8;
+	const uint32_t flagGenerateNormals = 16;
+
+	// Every array starts on this boundary so it can be copied straight out of the mapping
+	const uint64_t cacheAlignment = 16;
+
+	// A compressed sequence expands to less than 256 bytes per byte, counts a stream can't hold are caught before anything is allocated
+	const uint64_t maximumExpansion = 256;
+
+	struct CacheHeader
+	{
+		char magic[4];
+		uint32_t version;
+		uint64_t fileSize;
+
+		// Source .obj the cache was built from
+		uint64_t sourceSize;
+		uint64_t sourceWriteTime;
+		uint32_t pathLength;
+		uint32_t flags;
+		float overdrawThreshold;
+		float creaseAngle;
+
+		uint32_t modelCount;
+		uint64_t tableOffset;
+
+		// .mtl libraries the materials came from, checked like the source
+		uint64_t dependencyOffset;
+		uint64_t dependencyCount;
+	};
+
+	// Offsets are from the start of the file, counts are in elements
+	// Vertices, normals and both index arrays are stored encoded by MeshCodec, their sizes in bytes are kept next to the counts
+	struct CacheModel
+	{
+		uint64_t vertexOffset;
+		uint64_t vertexCount;
+		uint64_t vertexBytes;
+		uint64_t normalOffset;
+		uint64_t normalCount;
+		uint64_t normalBytes;
+		uint64_t indexOffset;
+		uint64_t indexCount;
+		uint64_t indexBytes;
+		uint64_t materialOffset;
+		uint64_t materialCount;
+		uint64_t rangeOffset;
+		uint64_t rangeCount;
+		uint64_t stringOffset;
+		uint64_t stringCount;
+
+		// Empty unless built with meshlets
+		uint64_t meshletOffset;
+		uint64_t meshletCount;
+		uint64_t meshletVertexOffset;
+		uint64_t meshletVertexCount;
+		uint64_t meshletTriangleOffset;
+		uint64_t meshletTriangleCount;
+
+		// Empty unless built with levels of detail
+		// Every level's indices and ranges are stored back to back, ranges index their own level's indices
+		// Each level's indices are encoded on their own so they decode straight into the level
+		uint64_t lodOffset;
+		uint64_t lodCount;
+		uint64_t lodIndexOffset;
+		uint64_t lodIndexCount;
+		uint64_t lodIndexBytes;
+		uint64_t lodRangeOffset;
+		uint64_t lodRangeCount;
+
+		// Over the encoded streams, the decoder only catches damage that breaks the stream's structure
+		uint64_t streamChecksum;
+	};
+
+	struct CacheLod
+	{
+		float error;
+		uint32_t rangeCount;
+		uint64_t indexCount;
+		uint64_t indexBytes;
+	};
+
+	// Strings for the name, library and maps are stored back to back in the model's string array
+	enum MaterialString
+	{
+		StringName,
+		StringLibrary,
+		StringDiffuseMap,
+		StringSpecularMap,
+		StringBumpMap,
+		StringCount
+	};
+
+	struct CacheMaterial
+	{
+		float ambient[3];
+		float diffuse[3];
+		float specular[3];
+		float shininess;
+		float opacity;
+		uint32_t stringLengths[StringCount];
+	};
+
+	struct CacheDependency
+	{
+		uint64_t size;
+		uint64_t writeTime;
+		uint64_t pathOffset;
+		uint64_t pathLength;
+	};
+
+	struct SourceKey
+	{
+		uint64_t size;
+		uint64_t writeTime;
+		std::string path;
+	};
+
+	inline uint64_t Align(uint64_t offset)
+	{
+		return (offset + cacheAlignment - 1) & ~(cacheAlignment - 1);
+	}
+
+	bool GetSourceKey(const std::string &fileName, SourceKey &key)
+	{
+		WIN32_FILE_ATTRIBUTE_DATA attributes;
+		if (!GetFileAttributesExA(fileName.c_str(), GetFileExInfoStandard, &attributes))
+		{
+			return false;
+		}
+
+		key.size = (static_cast<uint64_t>(attributes.nFileSizeHigh) << 32) | attributes.nFileSizeLow;
+		key.writeTime = (static_cast<uint64_t>(attributes.ftLastWriteTime.dwHighDateTime) << 32) | attributes.ftLastWriteTime.dwLowDateTime;
+
+		// Key on the full path so a cache copied next to a different source isn't picked up
+		char fullPath[MAX_PATH];
+		DWORD length = GetFullPathNameA(fileName.c_str(), MAX_PATH, fullPath, NULL);
+		key.path = (length > 0 && length < MAX_PATH) ? std::string(fullPath, length) : fileName;
+		return true;
+	}
+
+	inline uint32_t GetFlags(const OBJFile::LoadSettings &settings)
+	{
+		return (settings.batchByMaterial ? flagBatchByMaterial : 0) | (settings.optimizeMeshes ? flagOptimizeMeshes : 0) |
+			(settings.buildMeshlets ? flagBuildMeshlets : 0) | (settings.buildLods ? flagBuildLods : 0) | (settings.generateNormals ? flagGenerateNormals : 0);
+	}
+
+	// Only changes the output when the meshes are optimized
+	inline float GetOverdrawThreshold(const OBJFile::LoadSettings &settings)
+	{
+		return settings.optimizeMeshes ? settings.overdrawThreshold : 0.0f;
+	}
+
+	// Same for generated normals
+	inline float GetCreaseAngle(const OBJFile::LoadSettings &settings)
+	{
+		return settings.generateNormals ? settings.creaseAngle : 0.0f;
+	}
+
+	inline std::string *MaterialStrings(Material &material, std::string *strings[StringCount])
+	{
+		strings[StringName] = &material.name;
+		strings[StringLibrary] = &material.library;
+		strings[StringDiffuseMap] = &material.diffuseMap;
+		strings[StringSpecularMap] = &material.specularMap;
+		strings[StringBumpMap] = &material.bumpMap;
+		return strings[0];
+	}
+
+	// Range check an array against the mapped file
+	inline bool InFile(uint64_t offset, uint64_t count, uint64_t elementSize, uint64_t fileSize)
+	{
+		return offset % cacheAlignment == 0 && offset <= fileSize && count <= (fileSize - offset) / elementSize;
+	}
+
+	// Same for an encoded stream, which also has to be big enough to hold its elements
+	inline bool StreamInFile(uint64_t offset, uint64_t bytes, uint64_t count, uint64_t elementSize, uint64_t fileSize)
+	{
+		return InFile(offset, bytes, 1, fileSize) && count <= bytes * maximumExpansion / elementSize;
+	}
+
+	inline uint64_t AddChecksum(uint64_t checksum, const char *stream, uint64_t bytes)
+	{
+		return (checksum ^ MeshCodec::Checksum(stream, static_cast<size_t>(bytes))) * 0x100000001B3ull;
+	}
+
+	// Streams models into a new cache as they arrive, the table goes at the end once the count is known
+	// Written to a temporary file and swapped in by Finish, a half written cache must never look valid
+	class CacheWriter
+	{
+	public:
+		bool Begin(const std::string &fileName, const OBJFile::LoadSettings &settings)
+		{
+			if (!GetSourceKey(fileName, m_key))
+			{
+				return false;
+			}
+			m_flags = GetFlags(settings);
+			m_overdrawThreshold = GetOverdrawThreshold(settings);
+			m_creaseAngle = GetCreaseAngle(settings);
+
+			m_cacheFileName = MeshCache::CacheFileName(fileName, settings);
+			m_tempFileName = m_cacheFileName + ".tmp";
+			m_file.open(m_tempFileName.c_str(), std::ios::binary | std::ios::trunc);
+			if (!m_file.is_open())
+			{
+				return false;
+			}
+
+			// Header is rewritten once the table offset is known
+			CacheHeader header = {};
+			m_file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+			m_file.write(m_key.path.data(), static_cast<std::streamsize>(m_key.path.size()));
+			m_position = sizeof(CacheHeader) + m_key.path.size();
+			return m_file.good();
+		}
+
+		void Add(const Model &model)
+		{
+			if (!m_file.is_open())
+			{
+				return;
+			}
+
+			CacheModel entry;
+			entry.streamChecksum = 0;
+			m_encoded.clear();
+			MeshCodec::EncodeVertices(model.fileVertices.data(), model.fileVertices.size() / Model::vertexStride, Model::vertexStride * sizeof(float), m_encoded);
+			entry.vertexOffset = WriteStream(entry.vertexBytes, entry.streamChecksum);
+			entry.vertexCount = model.fileVertices.size();
+
+			m_encoded.clear();
+			MeshCodec::EncodeVertices(model.fileNormals.data(), model.fileNormals.size() / 3, 3 * sizeof(float), m_encoded);
+			entry.normalOffset = WriteStream(entry.normalBytes, entry.streamChecksum);
+			entry.normalCount = model.fileNormals.size();
+
+			m_encoded.clear();
+			MeshCodec::EncodeIndices(model.fileIndices.data(), model.fileIndices.size(), m_encoded);
+			entry.indexOffset = WriteStream(entry.indexBytes, entry.streamChecksum);
+			entry.indexCount = model.fileIndices.size();
+
+			std::vector<CacheMaterial> materials(model.materials.size());
+			std::vector<char> strings;
+			for (size_t i = 0; i < model.materials.size(); ++i)
+			{
+				const Material &material = model.materials[i];
+				for (int j = 0; j < 3; ++j)
+				{
+					materials[i].ambient[j] = material.ambient[j];
+					materials[i].diffuse[j] = material.diffuse[j];
+					materials[i].specular[j] = material.specular[j];
+				}
+				materials[i].shininess = material.shininess;
+				materials[i].opacity = material.opacity;
+
+				const std::string *materialStrings[StringCount] = { &material.name, &material.library, &material.diffuseMap, &material.specularMap, &material.bumpMap };
+				for (int j = 0; j < StringCount; ++j)
+				{
+					materials[i].stringLengths[j] = static_cast<uint32_t>(materialStrings[j]->size());
+					strings.insert(strings.end(), materialStrings[j]->begin(), materialStrings[j]->end());
+				}
+
+				AddDependency(material.library);
+			}
+
+			entry.materialOffset = WriteArray(materials, entry.materialCount);
+			entry.rangeOffset = WriteArray(model.materialRanges, entry.rangeCount);
+			entry.stringOffset = WriteArray(strings, entry.stringCount);
+			entry.meshletOffset = WriteArray(model.meshlets, entry.meshletCount);
+			entry.meshletVertexOffset = WriteArray(model.meshletVertices, entry.meshletVertexCount);
+			entry.meshletTriangleOffset = WriteArray(model.meshletTriangles, entry.meshletTriangleCount);
+
+			std::vector<CacheLod> lods(model.lods.size());
+			std::vector<MaterialRange> lodRanges;
+			m_encoded.clear();
+			entry.lodIndexCount = 0;
+			for (size_t i = 0; i < model.lods.size(); ++i)
+			{
+				const ModelLod &lod = model.lods[i];
+				size_t encodedStart = m_encoded.size();
+				MeshCodec::EncodeIndices(lod.indices.data(), lod.indices.size(), m_encoded);
+				lods[i].error = lod.error;
+				lods[i].rangeCount = static_cast<uint32_t>(lod.materialRanges.size());
+				lods[i].indexCount = lod.indices.size();
+				lods[i].indexBytes = m_encoded.size() - encodedStart;
+				entry.lodIndexCount += lod.indices.size();
+				lodRanges.insert(lodRanges.end(), lod.materialRanges.begin(), lod.materialRanges.end());
+			}
+
+			entry.lodOffset = WriteArray(lods, entry.lodCount);
+			entry.lodIndexOffset = WriteStream(entry.lodIndexBytes, entry.streamChecksum);
+			entry.lodRangeOffset = WriteArray(lodRanges, entry.lodRangeCount);
+			m_table.push_back(entry);
+		}
+
+		bool Finish()
+		{
+			if (!m_file.is_open())
+			{
+				return false;
+			}
+
+			uint64_t count = 0;
+			uint64_t tableOffset = WriteArray(m_table, count);
+
+			std::vector<char> paths;
+			for (size_t i = 0; i < m_dependencies.size(); ++i)
+			{
+				m_dependencies[i].pathOffset = paths.size();
+				paths.insert(paths.end(), m_dependencyPaths[i].begin(), m_dependencyPaths[i].end());
+			}
+
+			uint64_t pathsOffset = WriteArray(paths, count);
+			for (size_t i = 0; i < m_dependencies.size(); ++i)
+			{
+				m_dependencies[i].pathOffset += pathsOffset;
+			}
+
+			uint64_t dependencyCount = 0;
+			uint64_t dependencyOffset = WriteArray(m_dependencies, dependencyCount);
+
+			CacheHeader header = {};
+			memcpy(header.magic, cacheMagic, sizeof(cacheMagic));
+			header.version = cacheVersion;
+			header.fileSize = m_position;
+			header.sourceSize = m_key.size;
+			header.sourceWriteTime = m_key.writeTime;
+			header.pathLength = static_cast<uint32_t>(m_key.path.size());
+			header.flags = m_flags;
+			header.overdrawThreshold = m_overdrawThreshold;
+			header.creaseAngle = m_creaseAngle;
+			header.modelCount = static_cast<uint32_t>(m_table.size());
+			header.tableOffset = tableOffset;
+			header.dependencyOffset = dependencyOffset;
+			header.dependencyCount = dependencyCount;
+
+			m_file.seekp(0);
+			m_file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+			bool written = m_file.good();
+			m_file.close();
+
+			if (!written || !MoveFileExA(m_tempFileName.c_str(), m_cacheFileName.c_str(), MOVEFILE_REPLACE_EXISTING))
+			{
+				DeleteFileA(m_tempFileName.c_str());
+				return false;
+			}
+			return true;
+		}
+
+	private:
+		void AddDependency(const std::string &fileName)
+		{
+			SourceKey key;
+			if (fileName.empty() || !GetSourceKey(fileName, key))
+			{
+				return;
+			}
+
+			for (size_t i = 0; i < m_dependencyPaths.size(); ++i)
+			{
+				if (m_dependencyPaths[i] == key.path)
+				{
+					return;
+				}
+			}
+
+			CacheDependency dependency;
+			dependency.size = key.size;
+			dependency.writeTime = key.writeTime;
+			dependency.pathOffset = 0;
+			dependency.pathLength = key.path.size();
+			m_dependencies.push_back(dependency);
+			m_dependencyPaths.push_back(key.path);
+		}
+
+		// Pad up to the next aligned offset and write the array there, returns the offset
+		template <typename T>
+		uint64_t WriteArray(const std::vector<T> &data, uint64_t &count)
+		{
+			static const char padding[cacheAlignment] = {};
+			uint64_t offset = Align(m_position);
+			m_file.write(padding, static_cast<std::streamsize>(offset - m_position));
+			if (!data.empty())
+			{
+				m_file.write(reinterpret_cast<const char *>(data.data()), static_cast<std::streamsize>(data.size() * sizeof(T)));
+			}
+
+			count = data.size();
+			m_position = offset + data.size() * sizeof(T);
+			return offset;
+		}
+
+		// Write what was encoded into m_encoded and fold it into the model's checksum
+		uint64_t WriteStream(uint64_t &bytes, uint64_t &checksum)
+		{
+			checksum = AddChecksum(checksum, reinterpret_cast<const char *>(m_encoded.data()), m_encoded.size());
+			return WriteArray(m_encoded, bytes);
+		}
+
+		SourceKey m_key;
+		uint32_t m_flags;
+		float m_overdrawThreshold;
+		float m_creaseAngle;
+		std::string m_cacheFileName;
+		std::string m_tempFileName;
+		std::ofstream m_file;
+		uint64_t m_position;
+		std::vector<CacheModel> m_table;
+		std::vector<CacheDependency> m_dependencies;
+		std::vector<std::string> m_dependencyPaths;
+
+		// Reused for every stream, so encoding doesn't allocate once it has grown
+		std::vector<unsigned char> m_encoded;
+	};
+
+	template <typename T>
+	void ReadArray(const char *base, uint64_t offset, uint64_t count, std::vector<T> &data)
+	{
+		data.resize(static_cast<size_t>(count));
+		if (count > 0)
+		{
+			memcpy(data.data(), base + offset, static_cast<size_t>(count) * sizeof(T));
+		}
+	}
+
+	// Meshlet lists have to stay inside their arrays, keep to the builder's limits and only reference the model's vertices
+	bool ValidMeshlets(const char *base, const CacheModel &entry)
+	{
+		const Meshlet *meshlets = reinterpret_cast<const Meshlet *>(base + entry.meshletOffset);
+		const unsigned int *vertices = reinterpret_cast<const unsigned int *>(base + entry.meshletVertexOffset);
+		const unsigned char *triangles = reinterpret_cast<const unsigned char *>(base + entry.meshletTriangleOffset);
+		uint64_t vertexCount = entry.vertexCount / Model::vertexStride;
+		for (uint64_t i = 0; i < entry.meshletCount; ++i)
+		{
+			const Meshlet &meshlet = meshlets[i];
+			if (meshlet.material >= std::max<uint64_t>(entry.materialCount, 1) ||
+				meshlet.vertexCount > MeshletBuilder::maxVertices || meshlet.triangleCount > MeshletBuilder::maxTriangles ||
+				static_cast<uint64_t>(meshlet.vertexOffset) + meshlet.vertexCount > entry.meshletVertexCount ||
+				static_cast<uint64_t>(meshlet.triangleOffset) + static_cast<uint64_t>(meshlet.triangleCount) * 3 > entry.meshletTriangleCount)
+			{
+				return false;
+			}
+
+			for (unsigned int j = 0; j < meshlet.vertexCount; ++j)
+			{
+				if (vertices[meshlet.vertexOffset + j] >= vertexCount)
+				{
+					return false;
+				}
+			}
+
+			for (unsigned int j = 0; j < meshlet.triangleCount * 3; ++j)
+			{
+				if (triangles[meshlet.triangleOffset + j] >= meshlet.vertexCount)
+				{
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+
+	// Levels have to add up to their arrays and keep their ranges inside their own indices
+	// Their indices are encoded, so they're checked against the vertices as they're decoded
+	bool ValidLods(const char *base, const CacheModel &entry)
+	{
+		const CacheLod *lods = reinterpret_cast<const CacheLod *>(base + entry.lodOffset);
+		const MaterialRange *ranges = reinterpret_cast<const MaterialRange *>(base + entry.lodRangeOffset);
+		uint64_t indexOffset = 0;
+		uint64_t byteOffset = 0;
+		uint64_t rangeOffset = 0;
+		for (uint64_t i = 0; i < entry.lodCount; ++i)
+		{
+			const CacheLod &lod = lods[i];
+			if (lod.indexCount > entry.lodIndexCount - indexOffset || lod.indexBytes > entry.lodIndexBytes - byteOffset ||
+				lod.rangeCount > entry.lodRangeCount - rangeOffset || lod.indexCount > lod.indexBytes * maximumExpansion / sizeof(unsigned int))
+			{
+				return false;
+			}
+
+			for (uint32_t j = 0; j < lod.rangeCount; ++j)
+			{
+				const MaterialRange &range = ranges[rangeOffset + j];
+				if (range.material >= entry.materialCount || static_cast<uint64_t>(range.firstIndex) + range.indexCount > lod.indexCount)
+				{
+					return false;
+				}
+			}
+
+			indexOffset += lod.indexCount;
+			byteOffset += lod.indexBytes;
+			rangeOffset += lod.rangeCount;
+		}
+		return indexOffset == entry.lodIndexCount && byteOffset == entry.lodIndexBytes && rangeOffset == entry.lodRangeCount;
+	}
+
+	// The checksum only covers the encoded bytes, an index written out of range still has to be caught before it reaches the GPU
+	bool IndicesInRange(const std::vector<unsigned int> &indices, unsigned int vertexCount)
+	{
+		for (size_t i = 0; i < indices.size(); ++i)
+		{
+			if (indices[i] >= vertexCount)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// Decode the streams straight out of the mapping into the model
+	// False if a stream doesn't decode or an index references a vertex the model doesn't have
+	bool DecodeStreams(const char *base, const CacheModel &entry, Model &model)
+	{
+		model.fileVertices.resize(static_cast<size_t>(entry.vertexCount));
+		model.fileNormals.resize(static_cast<size_t>(entry.normalCount));
+		model.fileIndices.resize(static_cast<size_t>(entry.indexCount));
+		if (!MeshCodec::DecodeVertices(model.fileVertices.data(), model.fileVertices.size() / Model::vertexStride, Model::vertexStride * sizeof(float),
+				base + entry.vertexOffset, static_cast<size_t>(entry.vertexBytes)) ||
+			!MeshCodec::DecodeVertices(model.fileNormals.data(), model.fileNormals.size() / 3, 3 * sizeof(float), base + entry.normalOffset, static_cast<size_t>(entry.normalBytes)) ||
+			!MeshCodec::DecodeIndices(model.fileIndices.data(), model.fileIndices.size(), base + entry.indexOffset, static_cast<size_t>(entry.indexBytes)))
+		{
+			return false;
+		}
+
+		unsigned int vertexCount = static_cast<unsigned int>(entry.vertexCount / Model::vertexStride);
+		if (!IndicesInRange(model.fileIndices, vertexCount))
+		{
+			return false;
+		}
+
+		const CacheLod *lods = reinterpret_cast<const CacheLod *>(base + entry.lodOffset);
+		uint64_t streamOffset = entry.lodIndexOffset;
+		for (size_t i = 0; i < model.lods.size(); ++i)
+		{
+			std::vector<unsigned int> &indices = model.lods[i].indices;
+			indices.resize(static_cast<size_t>(lods[i].indexCount));
+			if (!MeshCodec::DecodeIndices(indices.data(), indices.size(), base + streamOffset, static_cast<size_t>(lods[i].indexBytes)) ||
+				!IndicesInRange(indices, vertexCount))
+			{
+				return false;
+			}
+			streamOffset += lods[i].indexBytes;
+		}
+		return true;
+	}
+
+	// Everything but the checks Read already did, false if a stream doesn't decode
+	bool ReadModel(const char *base, const CacheModel &entry, Model &model)
+	{
+		ReadArray(base, entry.rangeOffset, entry.rangeCount, model.materialRanges);
+		ReadArray(base, entry.meshletOffset, entry.meshletCount, model.meshlets);
+		ReadArray(base, entry.meshletVertexOffset, entry.meshletVertexCount, model.meshletVertices);
+		ReadArray(base, entry.meshletTriangleOffset, entry.meshletTriangleCount, model.meshletTriangles);
+
+		const CacheLod *lods = reinterpret_cast<const CacheLod *>(base + entry.lodOffset);
+		uint64_t lodRangeOffset = entry.lodRangeOffset;
+		model.lods.resize(static_cast<size_t>(entry.lodCount));
+		for (size_t j = 0; j < model.lods.size(); ++j)
+		{
+			model.lods[j].error = lods[j].error;
+			ReadArray(base, lodRangeOffset, lods[j].rangeCount, model.lods[j].materialRanges);
+			lodRangeOffset += lods[j].rangeCount * sizeof(MaterialRange);
+		}
+
+		if (!DecodeStreams(base, entry, model))
+		{
+			return false;
+		}
+
+		const CacheMaterial *materials = reinterpret_cast<const CacheMaterial *>(base + entry.materialOffset);
+		const char *strings = base + entry.stringOffset;
+		model.materials.resize(static_cast<size_t>(entry.materialCount));
+		for (size_t j = 0; j < model.materials.size(); ++j)
+		{
+			Material &material = model.materials[j];
+			material.ambient = Vec3(materials[j].ambient[0], materials[j].ambient[1], materials[j].ambient[2]);
+			material.diffuse = Vec3(materials[j].diffuse[0], materials[j].diffuse[1], materials[j].diffuse[2]);
+			material.specular = Vec3(materials[j].specular[0], materials[j].specular[1], materials[j].specular[2]);
+			material.shininess = materials[j].shininess;
+			material.opacity = materials[j].opacity;
+
+			std::string *materialStrings[StringCount] = { &material.name, &material.library, &material.diffuseMap, &material.specularMap, &material.bumpMap };
+			for (int k = 0; k < StringCount; ++k)
+			{
+				materialStrings[k]->assign(strings, materials[j].stringLengths[k]);
+				strings += materials[j].stringLengths[k];
+			}
+		}
+
+		return true;
+	}
+}
+
+std::string MeshCache::CacheFileName(const std::string &fileName, const OBJFile::LoadSettings &settings)
+{
+	if (settings.cacheDirectory.empty())
+	{
+		return fileName + ".meshcache";
+	}
+
+	// Sources with the same name in different directories share a cache, the path key makes whichever is loaded rebuild it
+	size_t slash = fileName.find_last_of("/\\");
+	return settings.cacheDirectory + (slash != std::string::npos ? fileName.substr(slash + 1) : fileName) + ".meshcache";
+}
+
+void MeshCache::LoadOBJ(const std::string &fileName, std::vector<Model> &models, const OBJFile::LoadSettings &settings)
+{
+	LoadOBJ(fileName, [&models](Model &model) { models.push_back(std::move(model)); }, settings);
+}
+
+void MeshCache::LoadOBJ(const std::string &fileName, const OBJFile::ModelCallback &onModel, const OBJFile::LoadSettings &settings)
+{
+	size_t handedOver = 0;
+	if (Read(fileName, onModel, settings, handedOver))
+	{
+		return;
+	}
+
+	// Each group is written out before it is handed on, so nothing has to hold on to the whole file
+	// A cache that broke partway through already handed over its first groups, they come in file order so the parse skips as many
+	CacheWriter writer;
+	writer.Begin(fileName, settings);
+	size_t parsed = 0;
+	OBJFile::LoadFile(fileName, [&writer, &onModel, &parsed, handedOver](Model &model)
+	{
+		writer.Add(model);
+		if (parsed++ >= handedOver)
+		{
+			onModel(model);
+		}
+	}, settings);
+	writer.Finish();
+}
+
+bool MeshCache::Read(const std::string &fileName, std::vector<Model> &models, const OBJFile::LoadSettings &settings)
+{
+	size_t handedOver = 0;
+	if (!Read(fileName, [&models](Model &model) { models.push_back(std::move(model)); }, settings, handedOver))
+	{
+		models.clear();
+		return false;
+	}
+	return true;
+}
+
+bool MeshCache::Read(const std::string &fileName, const OBJFile::ModelCallback &onModel, const OBJFile::LoadSettings &settings)
+{
+	size_t handedOver = 0;
+	return Read(fileName, onModel, settings, handedOver);
+}
+
+bool MeshCache::Read(const std::string &fileName, const OBJFile::ModelCallback &onModel, const OBJFile::LoadSettings &settings, size_t &handedOver)
+{
+	handedOver = 0;
+
+	SourceKey key;
+	if (!GetSourceKey(fileName, key))
+	{
+		return false;
+	}
+
+	MappedFile file;
+	if (!file.Open(CacheFileName(fileName, settings)) || file.Size() < sizeof(CacheHeader))
+	{
+		return false;
+	}
+
+	const char *base = file.Data();
+	const uint64_t fileSize = file.Size();
+
+	CacheHeader header;
+	memcpy(&header, base, sizeof(header));
+	if (memcmp(header.magic, cacheMagic, sizeof(cacheMagic)) != 0 || header.version != cacheVersion || header.fileSize != fileSize ||
+		header.flags != GetFlags(settings) || header.overdrawThreshold != GetOverdrawThreshold(settings) ||
+		header.creaseAngle != GetCreaseAngle(settings))
+	{
+		return false;
+	}
+
+	// Stale if the source changed since the cache was written
+	if (header.sourceSize != key.size || header.sourceWriteTime != key.writeTime || header.pathLength != key.path.size() ||
+		header.pathLength > fileSize - sizeof(CacheHeader) || memcmp(base + sizeof(CacheHeader), key.path.data(), key.path.size()) != 0)
+	{
+		return false;
+	}
+
+	if (!InFile(header.tableOffset, header.modelCount, sizeof(CacheModel), fileSize) ||
+		!InFile(header.dependencyOffset, header.dependencyCount, sizeof(CacheDependency), fileSize))
+	{
+		return false;
+	}
+
+	// Editing a material library makes the cache just as stale as editing the .obj
+	const CacheDependency *dependencies = reinterpret_cast<const CacheDependency *>(base + header.dependencyOffset);
+	for (uint64_t i = 0; i < header.dependencyCount; ++i)
+	{
+		if (dependencies[i].pathOffset > fileSize || dependencies[i].pathLength > fileSize - dependencies[i].pathOffset)
+		{
+			return false;
+		}
+
+		SourceKey dependencyKey;
+		std::string path(base + dependencies[i].pathOffset, static_cast<size_t>(dependencies[i].pathLength));
+		if (!GetSourceKey(path, dependencyKey) || dependencyKey.size != dependencies[i].size || dependencyKey.writeTime != dependencies[i].writeTime)
+		{
+			return false;
+		}
+	}
+
+	// Check every model before handing any over, a bad cache falls back to parsing the whole file
+	const CacheModel *table = reinterpret_cast<const CacheModel *>(base + header.tableOffset);
+	for (uint32_t i = 0; i < header.modelCount; ++i)
+	{
+		if (table[i].vertexCount % Model::vertexStride != 0 || table[i].normalCount % 3 != 0 ||
+			!StreamInFile(table[i].vertexOffset, table[i].vertexBytes, table[i].vertexCount, sizeof(float), fileSize) ||
+			!StreamInFile(table[i].normalOffset, table[i].normalBytes, table[i].normalCount, sizeof(float), fileSize) ||
+			!StreamInFile(table[i].indexOffset, table[i].indexBytes, table[i].indexCount, sizeof(unsigned int), fileSize) ||
+			!InFile(table[i].materialOffset, table[i].materialCount, sizeof(CacheMaterial), fileSize) ||
+			!InFile(table[i].rangeOffset, table[i].rangeCount, sizeof(MaterialRange), fileSize) ||
+			!InFile(table[i].stringOffset, table[i].stringCount, sizeof(char), fileSize) ||
+			!InFile(table[i].meshletOffset, table[i].meshletCount, sizeof(Meshlet), fileSize) ||
+			!InFile(table[i].meshletVertexOffset, table[i].meshletVertexCount, sizeof(unsigned int), fileSize) ||
+			!InFile(table[i].meshletTriangleOffset, table[i].meshletTriangleCount, sizeof(unsigned char), fileSize) ||
+			!InFile(table[i].lodOffset, table[i].lodCount, sizeof(CacheLod), fileSize) ||
+			!InFile(table[i].lodIndexOffset, table[i].lodIndexBytes, 1, fileSize) ||
+			!InFile(table[i].lodRangeOffset, table[i].lodRangeCount, sizeof(MaterialRange), fileSize))
+		{
+			return false;
+		}
+
+		const CacheMaterial *materials = reinterpret_cast<const CacheMaterial *>(base + table[i].materialOffset);
+		uint64_t stringLength = 0;
+		for (uint64_t j = 0; j < table[i].materialCount; ++j)
+		{
+			for (int k = 0; k < StringCount; ++k)
+			{
+				stringLength += materials[j].stringLengths[k];
+			}
+		}
+
+		if (stringLength > table[i].stringCount)
+		{
+			return false;
+		}
+
+		const MaterialRange *ranges = reinterpret_cast<const MaterialRange *>(base + table[i].rangeOffset);
+		for (uint64_t j = 0; j < table[i].rangeCount; ++j)
+		{
+			if (ranges[j].material >= table[i].materialCount ||
+				static_cast<uint64_t>(ranges[j].firstIndex) + ranges[j].indexCount > table[i].indexCount)
+			{
+				return false;
+			}
+		}
+
+		if (!ValidMeshlets(base, table[i]) || !ValidLods(base, table[i]))
+		{
+			return false;
+		}
+
+		uint64_t checksum = 0;
+		checksum = AddChecksum(checksum, base + table[i].vertexOffset, table[i].vertexBytes);
+		checksum = AddChecksum(checksum, base + table[i].normalOffset, table[i].normalBytes);
+		checksum = AddChecksum(checksum, base + table[i].indexOffset, table[i].indexBytes);
+		checksum = AddChecksum(checksum, base + table[i].lodIndexOffset, table[i].lodIndexBytes);
+		if (checksum != table[i].streamChecksum)
+		{
+			return false;
+		}
+	}
+
+	// Decoded and handed over one at a time, so only one model is ever held here and the first shows up early
+	// Streams that pass their checksum can still fail to decode, handedOver tells the caller how many already went
+	for (uint32_t i = 0; i < header.modelCount; ++i)
+	{
+		Model model;
+		if (!ReadModel(base, table[i], model))
+		{
+			return false;
+		}
+
+		onModel(model);
+		++handedOver;
+	}
+
+	return true;
+}
+
+bool MeshCache::Write(const std::string &fileName, const std::vector<Model> &models, const OBJFile::LoadSettings &settings)
+{
+	CacheWriter writer;
+	if (!writer.Begin(fileName, settings))
+	{
+		return false;
+	}
+
+	for (size_t i = 0; i < models.size(); ++i)
+	{
+		writer.Add(models[i]);
+	}
+	return writer.Finish();
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "Model.h"
+#include "OBJFile.h"
+
+// Versioned binary copy of an imported .obj, written next to the source as <name>.obj.meshcache, or to LoadSettings::cacheDirectory
+// Keyed on the source path, size and last write time (and those of its .mtl libraries), a stale or foreign cache is simply rebuilt
+// Arrays are stored exactly as Model holds them so loading is a mapped copy with no text parsing
+// Models are written as they are imported with the table at the end, so imports can stream straight through
+class MeshCache
+{
+public:
+    // Load from the cache if it matches the source, otherwise parse the .obj and write a new cache
+    static void LoadOBJ(const std::string &fileName, std::vector<Model> &models, const OBJFile::LoadSettings &settings = OBJFile::LoadSettings());
+
+    // Streaming version, models are handed over one at a time whether they come from the cache or the .obj
+    static void LoadOBJ(const std::string &fileName, const OBJFile::ModelCallback &onModel, const OBJFile::LoadSettings &settings = OBJFile::LoadSettings());
+
+    // Returns false if there is no cache for fileName, it is out of date or was built with different settings
+    // Only settings that change the loader output matter, the thread count doesn't
+    // Models are decoded and handed over one at a time, a stream that fails to decode partway also returns false
+    // after the models before it went out, LoadOBJ parses the .obj then and skips those, the vector version empties models
+    static bool Read(const std::string &fileName, std::vector<Model> &models, const OBJFile::LoadSettings &settings = OBJFile::LoadSettings());
+    static bool Read(const std::string &fileName, const OBJFile::ModelCallback &onModel, const OBJFile::LoadSettings &settings = OBJFile::LoadSettings());
+    static bool Write(const std::string &fileName, const std::vector<Model> &models, const OBJFile::LoadSettings &settings = OBJFile::LoadSettings());
+
+    static std::string CacheFileName(const std::string &fileName, const OBJFile::LoadSettings &settings = OBJFile::LoadSettings());
+
+private:
+    // Same, with how many models went to onModel, also when it returns false
+    static bool Read(const std::string &fileName, const OBJFile::ModelCallback &onModel, const OBJFile::LoadSettings &settings, size_t &handedOver);
+};
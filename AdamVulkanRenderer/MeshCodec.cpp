@@ -0,0 +1,625 @@
+#include "stdafx.h"
+#include "MeshCodec.h"
+#include "TextScanner.h"
+#include <emmintrin.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+namespace
+{
+	// Compressed stream, a series of sequences
+	// Token, high nibble is the literal count, low nibble the match length minus minimumMatch, 15 means more length bytes follow
+	// Then the literals, then a little endian 16 bit offset back into the output and the rest of the match length
+	// The last sequence is literals only and ends exactly at the end of the output
+	const size_t minimumMatch = 4;
+	const size_t maximumOffset = 65535;
+
+	// Matches stop short of the end so the last few bytes are always literals, like LZ4
+	const size_t lastLiterals = 5;
+	const size_t matchEndLimit = 12;
+
+	const int hashBits = 14;
+
+	const uint64_t checksumPrime1 = 0x9E3779B185EBCA87ull;
+	const uint64_t checksumPrime2 = 0xC2B2AE3D27D4EB4Full;
+
+	// Each block is a 32 bit payload size then the payload, a payload as big as the filtered block is stored as is
+	const size_t blockHeaderSize = sizeof(uint32_t);
+
+	inline uint32_t Read32(const unsigned char *data)
+	{
+		uint32_t value;
+		memcpy(&value, data, sizeof(value));
+		return value;
+	}
+
+	inline uint64_t Read64(const unsigned char *data)
+	{
+		uint64_t value;
+		memcpy(&value, data, sizeof(value));
+		return value;
+	}
+
+	inline uint64_t RotateLeft(uint64_t value, int bits)
+	{
+		return (value << bits) | (value >> (64 - bits));
+	}
+
+	inline uint64_t ChecksumRound(uint64_t lane, uint64_t word)
+	{
+		return RotateLeft(lane + word * checksumPrime2, 31) * checksumPrime1;
+	}
+
+	inline uint32_t HashPosition(const unsigned char *data)
+	{
+		return (Read32(data) * 2654435761u) >> (32 - hashBits);
+	}
+
+	inline unsigned char *WriteLength(unsigned char *out, size_t length)
+	{
+		for (; length >= 255; length -= 255)
+		{
+			*out++ = 255;
+		}
+		*out++ = static_cast<unsigned char>(length);
+		return out;
+	}
+
+	unsigned char *WriteSequence(unsigned char *out, const unsigned char *literals, size_t literalCount, size_t offset, size_t matchLength)
+	{
+		unsigned char *token = out++;
+		size_t matchCode = matchLength - minimumMatch;
+		*token = static_cast<unsigned char>((std::min<size_t>(literalCount, 15) << 4) | std::min<size_t>(matchCode, 15));
+		if (literalCount >= 15)
+		{
+			out = WriteLength(out, literalCount - 15);
+		}
+
+		memcpy(out, literals, literalCount);
+		out += literalCount;
+
+		out[0] = static_cast<unsigned char>(offset);
+		out[1] = static_cast<unsigned char>(offset >> 8);
+		out += 2;
+		if (matchCode >= 15)
+		{
+			out = WriteLength(out, matchCode - 15);
+		}
+		return out;
+	}
+
+	unsigned char *WriteLastLiterals(unsigned char *out, const unsigned char *literals, size_t literalCount)
+	{
+		*out++ = static_cast<unsigned char>(std::min<size_t>(literalCount, 15) << 4);
+		if (literalCount >= 15)
+		{
+			out = WriteLength(out, literalCount - 15);
+		}
+
+		memcpy(out, literals, literalCount);
+		return out + literalCount;
+	}
+
+	// Returns the end of the output, which has to have room for CompressBound bytes
+	unsigned char *CompressTo(const unsigned char *src, size_t size, unsigned char *out)
+	{
+		const unsigned char *anchor = src;
+		if (size > matchEndLimit)
+		{
+			uint32_t table[1 << hashBits] = {};
+			const unsigned char *ip = src + 1;
+			const unsigned char *matchLimit = src + size - matchEndLimit;
+			const unsigned char *extendLimit = src + size - lastLiterals;
+			while (ip < matchLimit)
+			{
+				uint32_t hash = HashPosition(ip);
+				const unsigned char *candidate = src + table[hash];
+				table[hash] = static_cast<uint32_t>(ip - src);
+				if (candidate >= ip || static_cast<size_t>(ip - candidate) > maximumOffset || Read32(candidate) != Read32(ip))
+				{
+					// Step further the longer nothing has matched, incompressible data goes through quickly
+					ip += 1 + ((ip - anchor) >> 6);
+					continue;
+				}
+
+				while (ip > anchor && candidate > src && ip[-1] == candidate[-1])
+				{
+					--ip;
+					--candidate;
+				}
+
+				size_t length = minimumMatch;
+				while (ip + length < extendLimit && ip[length] == candidate[length])
+				{
+					++length;
+				}
+
+				out = WriteSequence(out, anchor, ip - anchor, ip - candidate, length);
+				ip += length;
+				anchor = ip;
+
+				if (ip < matchLimit)
+				{
+					table[HashPosition(ip - 2)] = static_cast<uint32_t>(ip - 2 - src);
+				}
+			}
+		}
+
+		return WriteLastLiterals(out, anchor, src + size - anchor);
+	}
+
+	inline size_t CompressBound(size_t size)
+	{
+		return size + size / 255 + 16;
+	}
+
+	inline bool ReadLength(const unsigned char *&ip, const unsigned char *inEnd, size_t limit, size_t &length)
+	{
+		unsigned char byte;
+		do
+		{
+			if (ip == inEnd)
+			{
+				return false;
+			}
+			byte = *ip++;
+			length += byte;
+
+			// Longer than the output can hold, also keeps a run of 255s from overflowing
+			if (length > limit)
+			{
+				return false;
+			}
+		} while (byte == 255);
+		return true;
+	}
+
+	inline void Copy16(unsigned char *destination, const unsigned char *source)
+	{
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(destination), _mm_loadu_si128(reinterpret_cast<const __m128i *>(source)));
+	}
+
+	// Offset and length have been checked, copies go 16 bytes at a time when there's room past the end for the overshoot
+	inline void CopyMatch(unsigned char *op, size_t offset, size_t length, const unsigned char *outEnd)
+	{
+		const unsigned char *match = op - offset;
+		if (static_cast<size_t>(outEnd - op) < length + 15)
+		{
+			for (size_t i = 0; i < length; ++i)
+			{
+				op[i] = match[i];
+			}
+		}
+		else if (offset >= 16)
+		{
+			// Each step only reads bytes written before it, the offset is at least the step
+			for (size_t i = 0; i < length; i += 16)
+			{
+				Copy16(op + i, match + i);
+			}
+		}
+		else
+		{
+			// Overlapping matches repeat the last offset bytes, common with runs of zero deltas
+			// Build 16 bytes of the pattern and store it at whole multiples of the offset
+			alignas(16) unsigned char pattern[16];
+			for (size_t i = 0; i < 16; ++i)
+			{
+				pattern[i] = match[i % offset];
+			}
+			size_t step = 16 - 16 % offset;
+			for (size_t i = 0; i < length; i += step)
+			{
+				Copy16(op + i, pattern);
+			}
+		}
+	}
+
+	// Every length and offset is checked, a damaged stream fails instead of reading or writing out of bounds
+	bool DecompressTo(unsigned char *destination, size_t size, const unsigned char *ip, size_t compressedSize)
+	{
+		const unsigned char *inEnd = ip + compressedSize;
+		unsigned char *op = destination;
+		unsigned char *outEnd = destination + size;
+		for (;;)
+		{
+			if (ip == inEnd)
+			{
+				return false;
+			}
+
+			unsigned int token = *ip++;
+			size_t literalCount = token >> 4;
+			size_t length = token & 15;
+
+			// Most sequences after filtering are a few literals and a short match that doesn't overlap
+			// With room to spare on both sides that's three 16 byte copies and only the offset to check
+			if (literalCount < 15 && length < 15 && inEnd - ip >= 16 + 2 && outEnd - op >= 16 + 32)
+			{
+				Copy16(op, ip);
+				op += literalCount;
+				ip += literalCount;
+
+				size_t offset = ip[0] | (static_cast<size_t>(ip[1]) << 8);
+				ip += 2;
+				length += minimumMatch;
+				if (offset == 0 || offset > static_cast<size_t>(op - destination))
+				{
+					return false;
+				}
+
+				if (offset >= 16)
+				{
+					Copy16(op, op - offset);
+					Copy16(op + 16, op - offset + 16);
+				}
+				else
+				{
+					CopyMatch(op, offset, length, outEnd);
+				}
+				op += length;
+				continue;
+			}
+
+			if (literalCount == 15 && !ReadLength(ip, inEnd, size, literalCount))
+			{
+				return false;
+			}
+
+			if (literalCount > static_cast<size_t>(inEnd - ip) || literalCount > static_cast<size_t>(outEnd - op))
+			{
+				return false;
+			}
+
+			memcpy(op, ip, literalCount);
+			op += literalCount;
+			ip += literalCount;
+
+			if (op == outEnd)
+			{
+				return ip == inEnd;
+			}
+
+			if (inEnd - ip < 2)
+			{
+				return false;
+			}
+
+			size_t offset = ip[0] | (static_cast<size_t>(ip[1]) << 8);
+			ip += 2;
+			if (length == 15 && !ReadLength(ip, inEnd, size, length))
+			{
+				return false;
+			}
+			length += minimumMatch;
+
+			if (offset == 0 || offset > static_cast<size_t>(op - destination) || length > static_cast<size_t>(outEnd - op))
+			{
+				return false;
+			}
+
+			CopyMatch(op, offset, length, outEnd);
+			op += length;
+		}
+	}
+
+	// Elements per block, a multiple of 16 so the vector paths only hit a tail in the last block
+	inline size_t BlockElements(size_t elementSize)
+	{
+		return std::max<size_t>(16, (MeshCodec::blockBytes / elementSize) & ~size_t(15));
+	}
+
+	// Compress the filtered planes, or store them when that doesn't pay
+	void WriteBlock(const std::vector<unsigned char> &planes, size_t planeBytes, std::vector<unsigned char> &encoded)
+	{
+		size_t start = encoded.size();
+		encoded.resize(start + blockHeaderSize + CompressBound(planeBytes));
+		unsigned char *payload = &encoded[start + blockHeaderSize];
+		size_t payloadSize = CompressTo(planes.data(), planeBytes, payload) - payload;
+		if (payloadSize >= planeBytes)
+		{
+			memcpy(payload, planes.data(), planeBytes);
+			payloadSize = planeBytes;
+		}
+
+		uint32_t size = static_cast<uint32_t>(payloadSize);
+		memcpy(&encoded[start], &size, sizeof(size));
+		encoded.resize(start + blockHeaderSize + payloadSize);
+	}
+
+	// Points planes at the block's filtered bytes, either straight into the stream or decompressed into scratch
+	bool ReadBlock(const unsigned char *&ip, const unsigned char *inEnd, size_t planeBytes, unsigned char *scratch, const unsigned char *&planes)
+	{
+		if (static_cast<size_t>(inEnd - ip) < blockHeaderSize)
+		{
+			return false;
+		}
+
+		uint32_t payloadSize;
+		memcpy(&payloadSize, ip, sizeof(payloadSize));
+		ip += blockHeaderSize;
+		if (payloadSize > planeBytes || payloadSize > static_cast<size_t>(inEnd - ip))
+		{
+			return false;
+		}
+
+		if (payloadSize == planeBytes)
+		{
+			planes = ip;
+		}
+		else
+		{
+			if (!DecompressTo(scratch, planeBytes, ip, payloadSize))
+			{
+				return false;
+			}
+			planes = scratch;
+		}
+		ip += payloadSize;
+		return true;
+	}
+
+	// Running byte sum of 16 plane bytes, carry holds the last sum in every byte
+	inline __m128i PrefixSum8(__m128i x, __m128i carry)
+	{
+		x = _mm_add_epi8(x, _mm_slli_si128(x, 1));
+		x = _mm_add_epi8(x, _mm_slli_si128(x, 2));
+		x = _mm_add_epi8(x, _mm_slli_si128(x, 4));
+		x = _mm_add_epi8(x, _mm_slli_si128(x, 8));
+		return _mm_add_epi8(x, carry);
+	}
+
+	// SSE2 has no byte shuffle, widen byte 15 until it fills a 32 bit lane and broadcast that
+	inline __m128i BroadcastLastByte(__m128i x)
+	{
+		x = _mm_unpackhi_epi8(x, x);
+		x = _mm_unpackhi_epi16(x, x);
+		return _mm_shuffle_epi32(x, 0xFF);
+	}
+
+	// Sixteen vertices from the planes, assembled in a small buffer so the destination is written front to back
+	void UnfilterVerticesSSE2(unsigned char *destination, const unsigned char *planes, size_t planeStride, size_t element, size_t vertexSize, __m128i *carries)
+	{
+		alignas(16) unsigned char group[16 * MeshCodec::maximumVertexSize];
+		for (size_t component = 0; component < vertexSize / 4; ++component)
+		{
+			__m128i bytes[4];
+			for (size_t b = 0; b < 4; ++b)
+			{
+				size_t plane = component * 4 + b;
+				__m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(planes + plane * planeStride + element));
+				bytes[b] = PrefixSum8(x, carries[plane]);
+				carries[plane] = BroadcastLastByte(bytes[b]);
+			}
+
+			__m128i low01 = _mm_unpacklo_epi8(bytes[0], bytes[1]);
+			__m128i high01 = _mm_unpackhi_epi8(bytes[0], bytes[1]);
+			__m128i low23 = _mm_unpacklo_epi8(bytes[2], bytes[3]);
+			__m128i high23 = _mm_unpackhi_epi8(bytes[2], bytes[3]);
+
+			alignas(16) uint32_t values[16];
+			_mm_store_si128(reinterpret_cast<__m128i *>(values), _mm_unpacklo_epi16(low01, low23));
+			_mm_store_si128(reinterpret_cast<__m128i *>(values + 4), _mm_unpackhi_epi16(low01, low23));
+			_mm_store_si128(reinterpret_cast<__m128i *>(values + 8), _mm_unpacklo_epi16(high01, high23));
+			_mm_store_si128(reinterpret_cast<__m128i *>(values + 12), _mm_unpackhi_epi16(high01, high23));
+			for (size_t i = 0; i < 16; ++i)
+			{
+				memcpy(group + i * vertexSize + component * 4, &values[i], 4);
+			}
+		}
+		memcpy(destination, group, 16 * vertexSize);
+	}
+
+	// Sixteen indices, undo the zigzag then a running sum of the deltas
+	inline __m128i UnfilterIndicesSSE2(__m128i zigzag, __m128i carry)
+	{
+		const __m128i one = _mm_set1_epi32(1);
+		__m128i delta = _mm_xor_si128(_mm_srli_epi32(zigzag, 1), _mm_sub_epi32(_mm_setzero_si128(), _mm_and_si128(zigzag, one)));
+		delta = _mm_add_epi32(delta, _mm_slli_si128(delta, 4));
+		delta = _mm_add_epi32(delta, _mm_slli_si128(delta, 8));
+		return _mm_add_epi32(delta, carry);
+	}
+}
+
+void MeshCodec::EncodeVertices(const void *vertices, size_t count, size_t vertexSize, std::vector<unsigned char> &encoded)
+{
+	const unsigned char *source = static_cast<const unsigned char *>(vertices);
+	size_t blockElements = BlockElements(vertexSize);
+	std::vector<unsigned char> planes(blockElements * vertexSize);
+	for (size_t first = 0; first < count; first += blockElements)
+	{
+		// Every byte of a vertex gets its own plane, the difference to the same byte of the previous vertex
+		// Attributes change slowly along an optimized vertex order, so the high bytes become runs of zeroes
+		size_t elements = std::min(blockElements, count - first);
+		const unsigned char *block = source + first * vertexSize;
+		for (size_t b = 0; b < vertexSize; ++b)
+		{
+			unsigned char previous = 0;
+			unsigned char *plane = &planes[b * elements];
+			for (size_t i = 0; i < elements; ++i)
+			{
+				unsigned char value = block[i * vertexSize + b];
+				plane[i] = static_cast<unsigned char>(value - previous);
+				previous = value;
+			}
+		}
+		WriteBlock(planes, elements * vertexSize, encoded);
+	}
+}
+
+void MeshCodec::EncodeIndices(const unsigned int *indices, size_t count, std::vector<unsigned char> &encoded)
+{
+	size_t blockElements = BlockElements(sizeof(unsigned int));
+	std::vector<unsigned char> planes(blockElements * sizeof(unsigned int));
+	for (size_t first = 0; first < count; first += blockElements)
+	{
+		// Neighbouring triangles share vertices, so deltas are small either way and zigzag keeps negative ones small too
+		size_t elements = std::min(blockElements, count - first);
+		unsigned int previous = 0;
+		for (size_t i = 0; i < elements; ++i)
+		{
+			unsigned int delta = indices[first + i] - previous;
+			unsigned int zigzag = (delta << 1) ^ (0u - (delta >> 31));
+			previous = indices[first + i];
+			for (size_t b = 0; b < sizeof(unsigned int); ++b)
+			{
+				planes[b * elements + i] = static_cast<unsigned char>(zigzag >> (b * 8));
+			}
+		}
+		WriteBlock(planes, elements * sizeof(unsigned int), encoded);
+	}
+}
+
+bool MeshCodec::DecodeVertices(void *destination, size_t count, size_t vertexSize, const void *encoded, size_t encodedSize)
+{
+	if (vertexSize == 0 || vertexSize % 4 != 0 || vertexSize > maximumVertexSize)
+	{
+		return false;
+	}
+
+	const unsigned char *ip = static_cast<const unsigned char *>(encoded);
+	const unsigned char *inEnd = ip + encodedSize;
+	unsigned char *output = static_cast<unsigned char *>(destination);
+	bool vectorized = TextScanner::GetKernel() != TextScanner::KernelScalar;
+	size_t blockElements = BlockElements(vertexSize);
+
+	alignas(16) unsigned char scratch[blockBytes];
+	for (size_t first = 0; first < count; first += blockElements)
+	{
+		size_t elements = std::min(blockElements, count - first);
+		const unsigned char *planes;
+		if (!ReadBlock(ip, inEnd, elements * vertexSize, scratch, planes))
+		{
+			return false;
+		}
+
+		unsigned char *block = output + first * vertexSize;
+		size_t i = 0;
+		__m128i carries[maximumVertexSize];
+		if (vectorized)
+		{
+			for (size_t b = 0; b < vertexSize; ++b)
+			{
+				carries[b] = _mm_setzero_si128();
+			}
+			for (; elements - i >= 16; i += 16)
+			{
+				UnfilterVerticesSSE2(block + i * vertexSize, planes, elements, i, vertexSize, carries);
+			}
+		}
+
+		unsigned char previous[maximumVertexSize];
+		for (size_t b = 0; b < vertexSize; ++b)
+		{
+			previous[b] = vectorized ? static_cast<unsigned char>(_mm_cvtsi128_si32(carries[b])) : 0;
+		}
+		for (; i < elements; ++i)
+		{
+			for (size_t b = 0; b < vertexSize; ++b)
+			{
+				previous[b] = static_cast<unsigned char>(previous[b] + planes[b * elements + i]);
+			}
+			memcpy(block + i * vertexSize, previous, vertexSize);
+		}
+	}
+	return ip == inEnd;
+}
+
+bool MeshCodec::DecodeIndices(unsigned int *destination, size_t count, const void *encoded, size_t encodedSize)
+{
+	const unsigned char *ip = static_cast<const unsigned char *>(encoded);
+	const unsigned char *inEnd = ip + encodedSize;
+	bool vectorized = TextScanner::GetKernel() != TextScanner::KernelScalar;
+	size_t blockElements = BlockElements(sizeof(unsigned int));
+
+	alignas(16) unsigned char scratch[blockBytes];
+	for (size_t first = 0; first < count; first += blockElements)
+	{
+		size_t elements = std::min(blockElements, count - first);
+		const unsigned char *planes;
+		if (!ReadBlock(ip, inEnd, elements * sizeof(unsigned int), scratch, planes))
+		{
+			return false;
+		}
+
+		unsigned int *block = destination + first;
+		size_t i = 0;
+		unsigned int previous = 0;
+		if (vectorized)
+		{
+			__m128i carry = _mm_setzero_si128();
+			for (; elements - i >= 16; i += 16)
+			{
+				__m128i p0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(planes + i));
+				__m128i p1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(planes + elements + i));
+				__m128i p2 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(planes + elements * 2 + i));
+				__m128i p3 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(planes + elements * 3 + i));
+				__m128i low01 = _mm_unpacklo_epi8(p0, p1);
+				__m128i high01 = _mm_unpackhi_epi8(p0, p1);
+				__m128i low23 = _mm_unpacklo_epi8(p2, p3);
+				__m128i high23 = _mm_unpackhi_epi8(p2, p3);
+
+				__m128i zigzags[4] = { _mm_unpacklo_epi16(low01, low23), _mm_unpackhi_epi16(low01, low23), _mm_unpacklo_epi16(high01, high23), _mm_unpackhi_epi16(high01, high23) };
+				for (int k = 0; k < 4; ++k)
+				{
+					__m128i values = UnfilterIndicesSSE2(zigzags[k], carry);
+					carry = _mm_shuffle_epi32(values, 0xFF);
+					_mm_storeu_si128(reinterpret_cast<__m128i *>(block + i + k * 4), values);
+				}
+			}
+			previous = static_cast<unsigned int>(_mm_cvtsi128_si32(carry));
+		}
+
+		for (; i < elements; ++i)
+		{
+			unsigned int zigzag = planes[i] | (planes[elements + i] << 8) | (planes[elements * 2 + i] << 16) | (static_cast<unsigned int>(planes[elements * 3 + i]) << 24);
+			previous += (zigzag >> 1) ^ (0u - (zigzag & 1));
+			block[i] = previous;
+		}
+	}
+	return ip == inEnd;
+}
+
+void MeshCodec::Compress(const void *data, size_t size, std::vector<unsigned char> &compressed)
+{
+	size_t start = compressed.size();
+	compressed.resize(start + CompressBound(size));
+	unsigned char *out = compressed.data() + start;
+	compressed.resize(CompressTo(static_cast<const unsigned char *>(data), size, out) - compressed.data());
+}
+
+bool MeshCodec::Decompress(void *destination, size_t size, const void *compressed, size_t compressedSize)
+{
+	return DecompressTo(static_cast<unsigned char *>(destination), size, static_cast<const unsigned char *>(compressed), compressedSize);
+}
+
+unsigned long long MeshCodec::Checksum(const void *data, size_t size)
+{
+	// Four independent lanes over 32 bytes at a time keep it well ahead of the decoder
+	const unsigned char *bytes = static_cast<const unsigned char *>(data);
+	uint64_t lanes[4] = { checksumPrime1, checksumPrime2, 0, 0 - checksumPrime1 };
+	size_t i = 0;
+	for (; size - i >= 32; i += 32)
+	{
+		for (int k = 0; k < 4; ++k)
+		{
+			lanes[k] = ChecksumRound(lanes[k], Read64(bytes + i + k * 8));
+		}
+	}
+
+	uint64_t hash = RotateLeft(lanes[0], 1) + RotateLeft(lanes[1], 7) + RotateLeft(lanes[2], 12) + RotateLeft(lanes[3], 18) + size;
+	for (; size - i >= 8; i += 8)
+	{
+		hash = RotateLeft(hash ^ ChecksumRound(0, Read64(bytes + i)), 27) * checksumPrime1;
+	}
+	for (; i < size; ++i)
+	{
+		hash = RotateLeft(hash ^ (bytes[i] * checksumPrime2), 11) * checksumPrime1;
+	}
+
+	hash ^= hash >> 33;
+	hash *= checksumPrime2;
+	hash ^= hash >> 29;
+	return hash;
+}
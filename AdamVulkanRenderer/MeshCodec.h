@@ -0,0 +1,36 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+// Lossless compression for the vertex and index streams in the mesh cache
+// Vertices are split into byte planes, each delta coded against the previous vertex,
+// indices are delta coded against the previous index and zigzagged so small steps either way stay small,
+// then both go through an LZ compressor with no entropy coding, so decoding runs at close to memory speed
+// Streams are cut into blocks that decode on their own through a buffer that stays in cache,
+// every destination byte is written once and in order, so it can be mapped (even write combined) upload memory
+// The filters are vectorized with the kernel TextScanner picked, the output doesn't depend on it
+class MeshCodec
+{
+public:
+	// Decoded bytes per block, at most, also as far back as the compressor looks for matches
+	static const size_t blockBytes = 64 * 1024;
+
+	// vertexSize is in bytes, a multiple of 4 up to this
+	static const size_t maximumVertexSize = 64;
+
+	// Append the encoded stream to encoded
+	static void EncodeVertices(const void *vertices, size_t count, size_t vertexSize, std::vector<unsigned char> &encoded);
+	static void EncodeIndices(const unsigned int *indices, size_t count, std::vector<unsigned char> &encoded);
+
+	// False if the stream is damaged or doesn't hold exactly count elements, destination may be partly written by then
+	static bool DecodeVertices(void *destination, size_t count, size_t vertexSize, const void *encoded, size_t encodedSize);
+	static bool DecodeIndices(unsigned int *destination, size_t count, const void *encoded, size_t encodedSize);
+
+	// The byte compressor on its own, size can't be over 4GB
+	static void Compress(const void *data, size_t size, std::vector<unsigned char> &compressed);
+	static bool Decompress(void *destination, size_t size, const void *compressed, size_t compressedSize);
+
+	// 64 bit checksum for stored streams, to catch damage that still decodes
+	static unsigned long long Checksum(const void *data, size_t size);
+};
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "Model.h"
+#include "Vec3.h"
+
+// Small vector helpers shared by the passes that work on a model's positions
+
+inline Vec3 Position(const Model &model, unsigned int vertex)
+{
+	const float *position = &model.fileVertices[vertex * Model::vertexStride];
+	return Vec3(position[0], position[1], position[2]);
+}
+
+inline float Dot(const Vec3 &a, const Vec3 &b)
+{
+	return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+inline Vec3 Cross(const Vec3 &a, const Vec3 &b)
+{
+	return Vec3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+}
+
+inline Vec3 Subtract(const Vec3 &a, const Vec3 &b)
+{
+	return Vec3(a.x - b.x, a.y - b.y, a.z - b.z);
+}
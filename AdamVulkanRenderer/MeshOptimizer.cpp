@@ -0,0 +1,681 @@
+#include "stdafx.h"
+#include "MeshOptimizer.h"
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cmath>
+#include <cfloat>
+#include "MeshMath.h"
+
+namespace
+{
+	// Forsyth's scoring, against a 32 entry LRU cache
+	const unsigned int scoreCacheSize = 32;
+	const unsigned int maximumValence = 64;
+
+	// Score for a vertex at each cache position, the last triangle's three vertices get 0.75,
+	// the rest fall off as (1 - (position - 3) / 29) ^ 1.5
+	// Written out rather than computed with powf so every platform orders triangles identically
+	const float cacheScores[scoreCacheSize] =
+	{
+		0.75f, 0.75f, 0.75f, 1.0f, 0.948724329f, 0.898356378f, 0.848912716f, 0.800410926f,
+		0.752869785f, 0.706309021f, 0.660749793f, 0.616214573f, 0.572727442f, 0.530314386f, 0.489003271f, 0.448824316f,
+		0.409810394f, 0.371997386f, 0.335424721f, 0.30013597f, 0.266179651f, 0.233610317f, 0.202489734f, 0.172888756f,
+		0.144889861f, 0.118590541f, 0.0941087231f, 0.0715909302f, 0.0512262993f, 0.0332724564f, 0.0181112327f, 0.00640328741f
+	};
+
+	// Boost for vertices with few triangles left, 2 / sqrt(remaining), so lone triangles get picked up before they strand
+	const float valenceScores[maximumValence] =
+	{
+		0.0f, 2.0f, 1.41421354f, 1.15470052f, 1.0f, 0.89442718f, 0.816496611f, 0.755928934f,
+		0.707106769f, 0.666666687f, 0.632455528f, 0.603022695f, 0.577350259f, 0.554700196f, 0.534522474f, 0.516397774f,
+		0.5f, 0.485071242f, 0.471404523f, 0.458831459f, 0.44721359f, 0.436435789f, 0.426401436f, 0.417028815f,
+		0.408248305f, 0.400000006f, 0.392232269f, 0.384900182f, 0.377964467f, 0.371390671f, 0.365148365f, 0.35921061f,
+		0.353553385f, 0.34815532f, 0.342997164f, 0.33806169f, 0.333333343f, 0.328797966f, 0.324442834f, 0.320256293f,
+		0.316227764f, 0.312347531f, 0.308606714f, 0.304997146f, 0.301511347f, 0.298142403f, 0.294883907f, 0.291729987f,
+		0.288675129f, 0.285714298f, 0.282842726f, 0.28005603f, 0.277350098f, 0.274721116f, 0.272165537f, 0.269679934f,
+		0.267261237f, 0.264906466f, 0.262612879f, 0.260377824f, 0.258198887f, 0.256073773f, 0.254000247f, 0.251976311f
+	};
+
+	// FIFO post transform cache simulated with timestamps
+	// A vertex is still cached if fewer than size misses happened since it was loaded
+	struct FifoCache
+	{
+		FifoCache(size_t vertexCount, unsigned int cacheSize) : loadedAt(vertexCount, 0), time(cacheSize + 1), size(cacheSize) {}
+
+		// Returns true on a miss
+		bool Access(unsigned int vertex)
+		{
+			if (time - loadedAt[vertex] > size)
+			{
+				loadedAt[vertex] = time++;
+				return true;
+			}
+			return false;
+		}
+
+		unsigned int AccessTriangle(const unsigned int *corners)
+		{
+			return Access(corners[0]) + Access(corners[1]) + Access(corners[2]);
+		}
+
+		void Clear()
+		{
+			time += size + 1;
+		}
+
+		std::vector<unsigned int> loadedAt;
+		unsigned int time;
+		unsigned int size;
+	};
+
+	// Overdraw is judged from every face, edge and corner direction of a cube
+	// Only needs sqrt, so the cluster order comes out the same on every platform
+	const unsigned int viewDirectionCount = 26;
+
+	void ViewDirections(Vec3 directions[viewDirectionCount])
+	{
+		unsigned int count = 0;
+		for (int x = -1; x <= 1; ++x)
+		{
+			for (int y = -1; y <= 1; ++y)
+			{
+				for (int z = -1; z <= 1; ++z)
+				{
+					if (x == 0 && y == 0 && z == 0)
+					{
+						continue;
+					}
+					float length = std::sqrt(static_cast<float>(x * x + y * y + z * z));
+					directions[count++] = Vec3(x / length, y / length, z / length);
+				}
+			}
+		}
+	}
+
+	// Area weighted centre of every triangle in the model
+	Vec3 MeshCentre(const Model &model)
+	{
+		double sum[3] = { 0.0, 0.0, 0.0 };
+		double totalArea = 0.0;
+		for (size_t i = 0; i + 3 <= model.fileIndices.size(); i += 3)
+		{
+			Vec3 a = Position(model, model.fileIndices[i]);
+			Vec3 b = Position(model, model.fileIndices[i + 1]);
+			Vec3 c = Position(model, model.fileIndices[i + 2]);
+			Vec3 normal = Cross(Subtract(b, a), Subtract(c, a));
+			double area = std::sqrt(Dot(normal, normal));
+			sum[0] += area * (a.x + b.x + c.x);
+			sum[1] += area * (a.y + b.y + c.y);
+			sum[2] += area * (a.z + b.z + c.z);
+			totalArea += area;
+		}
+
+		if (totalArea <= 0.0)
+		{
+			return Vec3();
+		}
+		double scale = 1.0 / (3.0 * totalArea);
+		return Vec3(static_cast<float>(sum[0] * scale), static_cast<float>(sum[1] * scale), static_cast<float>(sum[2] * scale));
+	}
+
+	// Split a range into clusters the vertex cache order already treats as separate
+	// A hard boundary is a triangle whose three vertices all miss the cache, the order restarted there anyway
+	// Each hard cluster is cut again wherever the ACMR so far is within threshold of the whole cluster's,
+	// so reordering the pieces costs at most that much cache efficiency
+	void SplitClusters(const Model &model, size_t firstTriangle, size_t endTriangle, float threshold, FifoCache &cache, std::vector<size_t> &clusters)
+	{
+		const unsigned int *indices = model.fileIndices.data();
+
+		std::vector<size_t> hard;
+		cache.Clear();
+		for (size_t t = firstTriangle; t < endTriangle; ++t)
+		{
+			if (cache.AccessTriangle(&indices[t * 3]) == 3 || t == firstTriangle)
+			{
+				hard.push_back(t);
+			}
+		}
+		hard.push_back(endTriangle);
+
+		for (size_t h = 0; h + 1 < hard.size(); ++h)
+		{
+			size_t start = hard[h];
+			size_t end = hard[h + 1];
+
+			cache.Clear();
+			size_t clusterMisses = 0;
+			for (size_t t = start; t < end; ++t)
+			{
+				clusterMisses += cache.AccessTriangle(&indices[t * 3]);
+			}
+			double limit = static_cast<double>(clusterMisses) / (end - start) * threshold;
+
+			clusters.push_back(start);
+			cache.Clear();
+			size_t misses = 0;
+			size_t triangles = 0;
+			for (size_t t = start; t + 1 < end; ++t)
+			{
+				misses += cache.AccessTriangle(&indices[t * 3]);
+				++triangles;
+				if (misses <= limit * triangles)
+				{
+					clusters.push_back(t + 1);
+					cache.Clear();
+					misses = 0;
+					triangles = 0;
+				}
+			}
+		}
+	}
+
+	// How likely a cluster is to hide the rest of the mesh, averaged over the view directions
+	// From each direction it counts as far as it sits towards the viewer, weighted by how much of it faces that way
+	float OcclusionScore(const Model &model, size_t start, size_t end, const Vec3 &meshCentre, const Vec3 directions[viewDirectionCount])
+	{
+		double facing[viewDirectionCount] = {};
+		double centre[3] = { 0.0, 0.0, 0.0 };
+		double totalArea = 0.0;
+		for (size_t t = start; t < end; ++t)
+		{
+			Vec3 a = Position(model, model.fileIndices[t * 3]);
+			Vec3 b = Position(model, model.fileIndices[t * 3 + 1]);
+			Vec3 c = Position(model, model.fileIndices[t * 3 + 2]);
+
+			// Twice the area along the face normal
+			Vec3 normal = Cross(Subtract(b, a), Subtract(c, a));
+			double area = std::sqrt(Dot(normal, normal));
+			centre[0] += area * (a.x + b.x + c.x);
+			centre[1] += area * (a.y + b.y + c.y);
+			centre[2] += area * (a.z + b.z + c.z);
+			totalArea += area;
+
+			for (unsigned int d = 0; d < viewDirectionCount; ++d)
+			{
+				facing[d] += std::max(0.0f, Dot(normal, directions[d]));
+			}
+		}
+
+		if (totalArea <= 0.0)
+		{
+			return 0.0f;
+		}
+
+		Vec3 offset(static_cast<float>(centre[0] / (3.0 * totalArea)) - meshCentre.x,
+			static_cast<float>(centre[1] / (3.0 * totalArea)) - meshCentre.y,
+			static_cast<float>(centre[2] / (3.0 * totalArea)) - meshCentre.z);
+
+		double score = 0.0;
+		for (unsigned int d = 0; d < viewDirectionCount; ++d)
+		{
+			score += Dot(offset, directions[d]) * (facing[d] / totalArea);
+		}
+		return static_cast<float>(score / viewDirectionCount);
+	}
+
+	struct Cluster
+	{
+		size_t start;
+		size_t end;
+		float score;
+	};
+
+	inline bool DrawFirst(const Cluster &a, const Cluster &b)
+	{
+		return a.score > b.score;
+	}
+
+	// Orthographic depth tested rasterizer, counts every fragment that passes the depth test
+	// Top-left fill rule, a pixel centre right on an edge only belongs to the triangle when that's a top or left edge,
+	// so two triangles sharing the edge don't both shade it. Counter-clockwise with y up, left edges run down and top edges run left
+	inline bool IsTopLeft(const Vec3 &from, const Vec3 &to)
+	{
+		return to.y < from.y || (to.y == from.y && to.x < from.x);
+	}
+
+	// Always worked out from the same end of the edge, so the triangles either side of it get exactly opposite values
+	inline float EdgeFunction(const Vec3 &from, const Vec3 &to, float px, float py)
+	{
+		if (to.x < from.x || (to.x == from.x && to.y < from.y))
+		{
+			return -((from.x - to.x) * (py - to.y) - (from.y - to.y) * (px - to.x));
+		}
+		return (to.x - from.x) * (py - from.y) - (to.y - from.y) * (px - from.x);
+	}
+
+	inline bool InsideEdge(float w, bool topLeft)
+	{
+		return w > 0.0f || (w == 0.0f && topLeft);
+	}
+
+	struct OverdrawCounter
+	{
+		OverdrawCounter(unsigned int size) : resolution(size), depth(size * size), shaded(0) {}
+
+		void Clear()
+		{
+			std::fill(depth.begin(), depth.end(), -FLT_MAX);
+		}
+
+		// x and y in pixels, z grows towards the viewer
+		void Triangle(const Vec3 &a, const Vec3 &b, const Vec3 &c)
+		{
+			// Counter-clockwise faces the viewer, back faces are culled like the pipeline does
+			float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+			if (area <= 0.0f)
+			{
+				return;
+			}
+
+			bool topLeft0 = IsTopLeft(b, c);
+			bool topLeft1 = IsTopLeft(c, a);
+			bool topLeft2 = IsTopLeft(a, b);
+
+			int minX = std::max(0, static_cast<int>(std::floor(std::min(a.x, std::min(b.x, c.x)))));
+			int maxX = std::min(static_cast<int>(resolution) - 1, static_cast<int>(std::ceil(std::max(a.x, std::max(b.x, c.x)))));
+			int minY = std::max(0, static_cast<int>(std::floor(std::min(a.y, std::min(b.y, c.y)))));
+			int maxY = std::min(static_cast<int>(resolution) - 1, static_cast<int>(std::ceil(std::max(a.y, std::max(b.y, c.y)))));
+
+			for (int y = minY; y <= maxY; ++y)
+			{
+				for (int x = minX; x <= maxX; ++x)
+				{
+					float px = x + 0.5f;
+					float py = y + 0.5f;
+					float w0 = EdgeFunction(b, c, px, py);
+					float w1 = EdgeFunction(c, a, px, py);
+					float w2 = EdgeFunction(a, b, px, py);
+					if (!InsideEdge(w0, topLeft0) || !InsideEdge(w1, topLeft1) || !InsideEdge(w2, topLeft2))
+					{
+						continue;
+					}
+
+					float z = (w0 * a.z + w1 * b.z + w2 * c.z) / area;
+					float &stored = depth[y * resolution + x];
+					if (z > stored)
+					{
+						stored = z;
+						++shaded;
+					}
+				}
+			}
+		}
+
+		size_t Covered() const
+		{
+			size_t covered = 0;
+			for (size_t i = 0; i < depth.size(); ++i)
+			{
+				covered += depth[i] != -FLT_MAX ? 1 : 0;
+			}
+			return covered;
+		}
+
+		unsigned int resolution;
+		std::vector<float> depth;
+		size_t shaded;
+	};
+
+	inline float VertexScore(int cachePosition, unsigned int remaining)
+	{
+		// Nothing left to draw with it, never worth picking
+		if (remaining == 0)
+		{
+			return -1.0f;
+		}
+
+		float score = cachePosition >= 0 ? cacheScores[cachePosition] : 0.0f;
+		return score + valenceScores[std::min(remaining, maximumValence - 1)];
+	}
+
+	// Reorder the triangles of one material range
+	// localIds has an entry per model vertex, all UINT_MAX, and is left that way
+	void OptimizeRange(unsigned int *indices, size_t triangleCount, std::vector<unsigned int> &localIds)
+	{
+		// Number the range's vertices from 0 so the per vertex arrays only cover this range
+		std::vector<unsigned int> vertices;
+		std::vector<unsigned int> local(triangleCount * 3);
+		for (size_t i = 0; i < local.size(); ++i)
+		{
+			unsigned int &id = localIds[indices[i]];
+			if (id == UINT_MAX)
+			{
+				id = static_cast<unsigned int>(vertices.size());
+				vertices.push_back(indices[i]);
+			}
+			local[i] = id;
+		}
+		size_t vertexCount = vertices.size();
+
+		// Triangles using each vertex, the first remaining[v] entries of a vertex's list haven't been drawn yet
+		std::vector<unsigned int> remaining(vertexCount, 0);
+		for (size_t i = 0; i < local.size(); ++i)
+		{
+			++remaining[local[i]];
+		}
+
+		std::vector<unsigned int> offsets(vertexCount + 1, 0);
+		for (size_t v = 0; v < vertexCount; ++v)
+		{
+			offsets[v + 1] = offsets[v] + remaining[v];
+		}
+
+		std::vector<unsigned int> adjacency(local.size());
+		{
+			std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+			for (size_t i = 0; i < local.size(); ++i)
+			{
+				adjacency[fill[local[i]]++] = static_cast<unsigned int>(i / 3);
+			}
+		}
+
+		std::vector<int> cachePosition(vertexCount, -1);
+		std::vector<float> vertexScore(vertexCount);
+		for (size_t v = 0; v < vertexCount; ++v)
+		{
+			vertexScore[v] = VertexScore(-1, remaining[v]);
+		}
+
+		std::vector<float> triangleScore(triangleCount);
+		std::vector<unsigned char> triangleAdded(triangleCount, 0);
+		size_t best = 0;
+		for (size_t t = 0; t < triangleCount; ++t)
+		{
+			triangleScore[t] = vertexScore[local[t * 3]] + vertexScore[local[t * 3 + 1]] + vertexScore[local[t * 3 + 2]];
+			best = triangleScore[t] > triangleScore[best] ? t : best;
+		}
+
+		// The cache grows by up to three entries per triangle before the tail is dropped
+		unsigned int cache[scoreCacheSize + 3];
+		unsigned int newCache[scoreCacheSize + 3];
+		size_t cacheCount = 0;
+
+		std::vector<unsigned int> output;
+		output.reserve(local.size());
+
+		size_t scanCursor = 0;
+		for (size_t n = 0; n < triangleCount; ++n)
+		{
+			if (best == SIZE_MAX)
+			{
+				// Nothing in the cache has triangles left, carry on with the next one in the original order
+				while (triangleAdded[scanCursor])
+				{
+					++scanCursor;
+				}
+				best = scanCursor;
+			}
+
+			triangleAdded[best] = 1;
+			const unsigned int *corners = &local[best * 3];
+			size_t newCount = 0;
+			for (int c = 0; c < 3; ++c)
+			{
+				unsigned int v = corners[c];
+				output.push_back(vertices[v]);
+
+				// Take the triangle off the vertex's remaining list
+				unsigned int *list = &adjacency[offsets[v]];
+				for (unsigned int j = 0; j < remaining[v]; ++j)
+				{
+					if (list[j] == best)
+					{
+						std::swap(list[j], list[remaining[v] - 1]);
+						--remaining[v];
+						break;
+					}
+				}
+
+				// Its vertices go to the front of the cache, degenerate triangles only add a vertex once
+				if (std::find(newCache, newCache + newCount, v) == newCache + newCount)
+				{
+					newCache[newCount++] = v;
+				}
+			}
+
+			size_t triangleVertices = newCount;
+			for (size_t i = 0; i < cacheCount; ++i)
+			{
+				if (std::find(newCache, newCache + triangleVertices, cache[i]) == newCache + triangleVertices)
+				{
+					newCache[newCount++] = cache[i];
+				}
+			}
+
+			// Rescore everything that was or is in the cache, entries pushed off the end lose their cache score
+			for (size_t i = 0; i < newCount; ++i)
+			{
+				unsigned int v = newCache[i];
+				int position = i < scoreCacheSize ? static_cast<int>(i) : -1;
+				cachePosition[v] = position;
+
+				float score = VertexScore(position, remaining[v]);
+				float delta = score - vertexScore[v];
+				vertexScore[v] = score;
+
+				const unsigned int *list = &adjacency[offsets[v]];
+				for (unsigned int j = 0; j < remaining[v]; ++j)
+				{
+					triangleScore[list[j]] += delta;
+				}
+			}
+
+			// Next triangle is the best one touching the cache
+			cacheCount = std::min<size_t>(newCount, scoreCacheSize);
+			best = SIZE_MAX;
+			float bestScore = -1.0f;
+			for (size_t i = 0; i < cacheCount; ++i)
+			{
+				unsigned int v = newCache[i];
+				cache[i] = v;
+
+				const unsigned int *list = &adjacency[offsets[v]];
+				for (unsigned int j = 0; j < remaining[v]; ++j)
+				{
+					if (triangleScore[list[j]] > bestScore)
+					{
+						bestScore = triangleScore[list[j]];
+						best = list[j];
+					}
+				}
+			}
+		}
+
+		std::copy(output.begin(), output.end(), indices);
+
+		for (size_t v = 0; v < vertexCount; ++v)
+		{
+			localIds[vertices[v]] = UINT_MAX;
+		}
+	}
+}
+
+MeshOptimizer::CacheStats MeshOptimizer::AnalyzeVertexCache(const Model &model, unsigned int cacheSize)
+{
+	CacheStats stats = { model.fileIndices.size() / 3, 0, 0 };
+
+	FifoCache cache(model.fileVertices.size() / Model::vertexStride, cacheSize);
+	for (size_t i = 0; i < stats.triangles * 3; ++i)
+	{
+		// Never loaded before, count it as one of the unique vertices
+		stats.vertices += cache.loadedAt[model.fileIndices[i]] == 0 ? 1 : 0;
+		stats.misses += cache.Access(model.fileIndices[i]) ? 1 : 0;
+	}
+	return stats;
+}
+
+void MeshOptimizer::OptimizeVertexCache(Model &model)
+{
+	OptimizeVertexCache(model.fileIndices, model.materialRanges, model.fileVertices.size() / Model::vertexStride);
+}
+
+void MeshOptimizer::OptimizeVertexCache(std::vector<unsigned int> &indices, const std::vector<MaterialRange> &ranges, size_t vertexCount)
+{
+	std::vector<unsigned int> localIds(vertexCount, UINT_MAX);
+	if (ranges.empty())
+	{
+		OptimizeRange(indices.data(), indices.size() / 3, localIds);
+		return;
+	}
+
+	for (size_t i = 0; i < ranges.size(); ++i)
+	{
+		OptimizeRange(indices.data() + ranges[i].firstIndex, ranges[i].indexCount / 3, localIds);
+	}
+}
+
+void MeshOptimizer::OptimizeVertexFetch(Model &model)
+{
+	size_t vertexCount = model.fileVertices.size() / Model::vertexStride;
+	std::vector<unsigned int> remap(vertexCount, UINT_MAX);
+	unsigned int next = 0;
+	for (size_t i = 0; i < model.fileIndices.size(); ++i)
+	{
+		unsigned int &index = model.fileIndices[i];
+		if (remap[index] == UINT_MAX)
+		{
+			remap[index] = next++;
+		}
+		index = remap[index];
+	}
+
+	// Vertices no triangle uses keep their order at the end
+	for (size_t v = 0; v < vertexCount; ++v)
+	{
+		if (remap[v] == UINT_MAX)
+		{
+			remap[v] = next++;
+		}
+	}
+
+	std::vector<float> vertices(model.fileVertices.size());
+	for (size_t v = 0; v < vertexCount; ++v)
+	{
+		std::copy(&model.fileVertices[v * Model::vertexStride], &model.fileVertices[v * Model::vertexStride] + Model::vertexStride, &vertices[remap[v] * Model::vertexStride]);
+	}
+	model.fileVertices.swap(vertices);
+
+	if (model.fileNormals.size() == vertexCount * 3)
+	{
+		std::vector<float> normals(model.fileNormals.size());
+		for (size_t v = 0; v < vertexCount; ++v)
+		{
+			std::copy(&model.fileNormals[v * 3], &model.fileNormals[v * 3] + 3, &normals[remap[v] * 3]);
+		}
+		model.fileNormals.swap(normals);
+	}
+}
+
+void MeshOptimizer::OptimizeOverdraw(Model &model, float threshold)
+{
+	static const unsigned int cacheSize = 16;
+
+	Vec3 directions[viewDirectionCount];
+	ViewDirections(directions);
+	Vec3 meshCentre = MeshCentre(model);
+
+	std::vector<MaterialRange> ranges = model.materialRanges;
+	if (ranges.empty())
+	{
+		MaterialRange whole = { 0, 0, static_cast<unsigned int>(model.fileIndices.size()) };
+		ranges.push_back(whole);
+	}
+
+	FifoCache cache(model.fileVertices.size() / Model::vertexStride, cacheSize);
+	std::vector<unsigned int> sorted;
+	for (size_t r = 0; r < ranges.size(); ++r)
+	{
+		size_t firstTriangle = ranges[r].firstIndex / 3;
+		size_t endTriangle = firstTriangle + ranges[r].indexCount / 3;
+		if (endTriangle <= firstTriangle)
+		{
+			continue;
+		}
+
+		std::vector<size_t> starts;
+		SplitClusters(model, firstTriangle, endTriangle, threshold, cache, starts);
+		starts.push_back(endTriangle);
+
+		std::vector<Cluster> clusters(starts.size() - 1);
+		for (size_t i = 0; i < clusters.size(); ++i)
+		{
+			clusters[i].start = starts[i];
+			clusters[i].end = starts[i + 1];
+			clusters[i].score = OcclusionScore(model, starts[i], starts[i + 1], meshCentre, directions);
+		}
+
+		// Stable so equal scores keep the cache order
+		std::stable_sort(clusters.begin(), clusters.end(), DrawFirst);
+
+		sorted.clear();
+		for (size_t i = 0; i < clusters.size(); ++i)
+		{
+			sorted.insert(sorted.end(), model.fileIndices.begin() + clusters[i].start * 3, model.fileIndices.begin() + clusters[i].end * 3);
+		}
+		std::copy(sorted.begin(), sorted.end(), model.fileIndices.begin() + firstTriangle * 3);
+	}
+}
+
+double MeshOptimizer::EstimateOverdraw(const Model &model, unsigned int resolution)
+{
+	Vec3 directions[viewDirectionCount];
+	ViewDirections(directions);
+
+	// Fit the bounding sphere around the centre into the view
+	Vec3 centre = MeshCentre(model);
+	size_t vertexCount = model.fileVertices.size() / Model::vertexStride;
+	float radius = 0.0f;
+	for (size_t v = 0; v < vertexCount; ++v)
+	{
+		Vec3 offset = Subtract(Position(model, static_cast<unsigned int>(v)), centre);
+		radius = std::max(radius, std::sqrt(Dot(offset, offset)));
+	}
+	if (radius <= 0.0f)
+	{
+		return 0.0;
+	}
+	float scale = resolution * 0.5f / radius;
+
+	OverdrawCounter counter(resolution);
+	std::vector<Vec3> projected(vertexCount);
+	size_t shaded = 0;
+	size_t covered = 0;
+	for (unsigned int d = 0; d < viewDirectionCount; ++d)
+	{
+		// Looking down -direction, right and up complete a right handed basis so counter-clockwise stays counter-clockwise
+		const Vec3 &direction = directions[d];
+		Vec3 up = std::fabs(direction.y) < 0.99f ? Vec3(0.0f, 1.0f, 0.0f) : Vec3(1.0f, 0.0f, 0.0f);
+		Vec3 right = Cross(up, direction);
+		float length = std::sqrt(Dot(right, right));
+		right = Vec3(right.x / length, right.y / length, right.z / length);
+		up = Cross(direction, right);
+
+		for (size_t v = 0; v < vertexCount; ++v)
+		{
+			Vec3 offset = Subtract(Position(model, static_cast<unsigned int>(v)), centre);
+			projected[v] = Vec3(Dot(offset, right) * scale + resolution * 0.5f, Dot(offset, up) * scale + resolution * 0.5f, Dot(offset, direction));
+		}
+
+		counter.Clear();
+		counter.shaded = 0;
+		for (size_t i = 0; i + 3 <= model.fileIndices.size(); i += 3)
+		{
+			counter.Triangle(projected[model.fileIndices[i]], projected[model.fileIndices[i + 1]], projected[model.fileIndices[i + 2]]);
+		}
+		shaded += counter.shaded;
+		covered += counter.Covered();
+	}
+
+	return covered > 0 ? static_cast<double>(shaded) / covered : 0.0;
+}
+
+void MeshOptimizer::Optimize(Model &model, float overdrawThreshold)
+{
+	OptimizeVertexCache(model);
+	if (overdrawThreshold > 0.0f)
+	{
+		OptimizeOverdraw(model, overdrawThreshold);
+	}
+	OptimizeVertexFetch(model);
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include "Model.h"
+
+// Post import mesh optimization, only the order of triangles and vertices changes, never the geometry
+// Triangles stay inside their material range so the draws are unaffected
+class MeshOptimizer
+{
+public:
+	// Simulated FIFO post transform cache
+	struct CacheStats
+	{
+		size_t triangles;
+		size_t vertices;
+		size_t misses;
+
+		// Average cache miss ratio, vertex shader runs per triangle, 0.5 is ideal for a regular grid
+		double Acmr() const { return triangles > 0 ? static_cast<double>(misses) / triangles : 0.0; }
+
+		// Average transformed vertex ratio, vertex shader runs per unique vertex, 1 is ideal
+		double Atvr() const { return vertices > 0 ? static_cast<double>(misses) / vertices : 0.0; }
+	};
+
+	static CacheStats AnalyzeVertexCache(const Model &model, unsigned int cacheSize = 16);
+
+	// Reorder the triangles of each material range for post transform cache hits (Forsyth's linear speed algorithm)
+	static void OptimizeVertexCache(Model &model);
+
+	// Same for an index list of its own over vertexCount vertices, such as a level of detail
+	static void OptimizeVertexCache(std::vector<unsigned int> &indices, const std::vector<MaterialRange> &ranges, size_t vertexCount);
+
+	// Renumber vertices in the order the indices first use them, so fetches walk the vertex buffer forwards
+	static void OptimizeVertexFetch(Model &model);
+
+	// Split each material range into clusters along the vertex cache order and draw the likeliest occluders first
+	// threshold is roughly how much worse the ACMR may get, 1.05 allows 5%, higher means smaller clusters and less overdraw
+	// Expects OptimizeVertexCache to have run
+	static void OptimizeOverdraw(Model &model, float threshold);
+
+	// Shaded fragments over covered pixels, averaged over orthographic views from 26 directions around the mesh
+	// 1 means no overdraw, only the index order and back face culling affect it
+	static double EstimateOverdraw(const Model &model, unsigned int resolution = 256);
+
+	// Vertex cache, then overdraw if overdrawThreshold isn't 0, then vertex fetch
+	static void Optimize(Model &model, float overdrawThreshold = 0.0f);
+};
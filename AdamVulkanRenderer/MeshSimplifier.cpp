@@ -0,0 +1,969 @@
+#include "stdafx.h"
+#include "MeshSimplifier.h"
+#include "MeshOptimizer.h"
+#include <algorithm>
+#include <cfloat>
+#include <climits>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+	// Positions are scaled into the unit cube, attributes are scaled by these so both errors are on the same scale
+	const float uvWeight = 0.5f;
+	const float normalWeight = 0.25f;
+
+	// u, v and the normal
+	const unsigned int attributeCount = 5;
+
+	// Planes through open border edges keep the outline in place, weighted this much more than the faces
+	const float borderWeight = 10.0f;
+
+	// Planes through uv seam edges, so the seam keeps its shape on both sides
+	const float seamWeight = 1.0f;
+
+	// A collapse is rejected if any triangle around it turns further than this, as the cosine between its old and new normal
+	const float minimumFlipCosine = 0.25f;
+
+	// How far past the cost of the collapse that would reach the target a pass may go
+	const float passCostSlack = 1.5f;
+
+	// BuildLods keeps a level only if it drops at least a tenth of the triangles of the one before
+	const size_t minimumReductionDivisor = 10;
+
+	const unsigned int noVertex = UINT_MAX;
+
+	// How a position may collapse, all the vertices sharing it get the same kind
+	enum VertexKind
+	{
+		// Closed fan of triangles, can collapse into any neighbour
+		KindManifold,
+
+		// On an open border, only collapses along it
+		KindBorder,
+
+		// Two vertices with different attributes along a uv or normal seam, only collapse along the seam, both at once
+		KindSeam,
+
+		// Everything else, including vertices shared by two material ranges, never collapses
+		KindLocked
+	};
+
+	// Sum of weighted squared distances to a set of planes, p'Ap + 2b'p + c
+	struct Quadric
+	{
+		float a00, a11, a22, a10, a20, a21;
+		float b0, b1, b2;
+		float c;
+		float weight;
+	};
+
+	// Attribute k across a triangle is dot(gradient, p) + offset, summed with the same weights as the quadric
+	struct Gradient
+	{
+		float gradient[3];
+		float offset;
+	};
+
+	// Open edges of one vertex, by index and by position
+	// An edge is open by index if the opposite edge doesn't exist between the same vertices,
+	// it is also open by position if no vertices at the same positions have it either
+	struct VertexEdges
+	{
+		unsigned int openOut;
+		unsigned int openIn;
+		unsigned int borderOut;
+		unsigned int borderIn;
+		unsigned int openOutCount;
+		unsigned int openInCount;
+		unsigned int borderOutCount;
+		unsigned int borderInCount;
+	};
+
+	struct Collapse
+	{
+		unsigned int source;
+		unsigned int target;
+		float cost;
+	};
+
+	inline bool Cheaper(const Collapse &a, const Collapse &b)
+	{
+		return a.cost < b.cost;
+	}
+
+	inline void Cross(const float *a, const float *b, float *result)
+	{
+		result[0] = a[1] * b[2] - a[2] * b[1];
+		result[1] = a[2] * b[0] - a[0] * b[2];
+		result[2] = a[0] * b[1] - a[1] * b[0];
+	}
+
+	inline float Dot(const float *a, const float *b)
+	{
+		return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+	}
+
+	inline void Subtract(const float *a, const float *b, float *result)
+	{
+		result[0] = a[0] - b[0];
+		result[1] = a[1] - b[1];
+		result[2] = a[2] - b[2];
+	}
+
+	// Plane n.p + d = 0 with n unit length
+	void AddPlane(Quadric &q, const float *n, float d, float weight)
+	{
+		q.a00 += weight * n[0] * n[0];
+		q.a11 += weight * n[1] * n[1];
+		q.a22 += weight * n[2] * n[2];
+		q.a10 += weight * n[1] * n[0];
+		q.a20 += weight * n[2] * n[0];
+		q.a21 += weight * n[2] * n[1];
+		q.b0 += weight * n[0] * d;
+		q.b1 += weight * n[1] * d;
+		q.b2 += weight * n[2] * d;
+		q.c += weight * d * d;
+		q.weight += weight;
+	}
+
+	void AddQuadric(Quadric &q, const Quadric &other)
+	{
+		q.a00 += other.a00;
+		q.a11 += other.a11;
+		q.a22 += other.a22;
+		q.a10 += other.a10;
+		q.a20 += other.a20;
+		q.a21 += other.a21;
+		q.b0 += other.b0;
+		q.b1 += other.b1;
+		q.b2 += other.b2;
+		q.c += other.c;
+		q.weight += other.weight;
+	}
+
+	// Not divided by the weight
+	inline float Evaluate(const Quadric &q, const float *p)
+	{
+		float rx = q.a00 * p[0] + q.a10 * p[1] + q.a20 * p[2];
+		float ry = q.a10 * p[0] + q.a11 * p[1] + q.a21 * p[2];
+		float rz = q.a20 * p[0] + q.a21 * p[1] + q.a22 * p[2];
+		return rx * p[0] + ry * p[1] + rz * p[2] + 2.0f * (q.b0 * p[0] + q.b1 * p[1] + q.b2 * p[2]) + q.c;
+	}
+
+	class Simplifier
+	{
+	public:
+		explicit Simplifier(const Model &model)
+			: m_vertexCount(model.fileVertices.size() / Model::vertexStride), m_ranges(model.materialRanges), m_error(0.0f)
+		{
+			NormalizeVertices(model);
+			FindWedges();
+
+			// Triangles in range order, each remembers its range
+			if (m_ranges.empty())
+			{
+				AddTriangles(model, 0, static_cast<unsigned int>(model.fileIndices.size()), 0);
+			}
+			for (size_t r = 0; r < m_ranges.size(); ++r)
+			{
+				AddTriangles(model, m_ranges[r].firstIndex, m_ranges[r].indexCount, static_cast<unsigned int>(r));
+			}
+
+			m_collapses.resize(m_vertexCount);
+			for (size_t v = 0; v < m_vertexCount; ++v)
+			{
+				m_collapses[v] = static_cast<unsigned int>(v);
+			}
+
+			Classify();
+			BuildQuadrics();
+		}
+
+		size_t TriangleCount() const
+		{
+			return m_triangleRanges.size();
+		}
+
+		// Largest collapse so far, in model units
+		float Error() const
+		{
+			return std::sqrt(m_error) * m_scale;
+		}
+
+		float Scale() const
+		{
+			return m_scale;
+		}
+
+		// Error is relative to the largest extent, like Scale
+		void Reduce(size_t targetTriangles, float targetError)
+		{
+			float maximumCost = targetError < FLT_MAX ? targetError * targetError : FLT_MAX;
+			while (TriangleCount() > targetTriangles)
+			{
+				if (!Pass(targetTriangles, maximumCost))
+				{
+					break;
+				}
+				Classify();
+			}
+		}
+
+		void Emit(std::vector<unsigned int> &indices, std::vector<MaterialRange> &ranges) const
+		{
+			indices.clear();
+			ranges.clear();
+			indices.reserve(m_indices.size());
+
+			// Triangles never leave their range and passes keep their order, so they are still grouped by range
+			size_t t = 0;
+			while (t < m_triangleRanges.size())
+			{
+				unsigned int range = m_triangleRanges[t];
+				MaterialRange output = { m_ranges.empty() ? 0 : m_ranges[range].material, static_cast<unsigned int>(indices.size()), 0 };
+				for (; t < m_triangleRanges.size() && m_triangleRanges[t] == range; ++t)
+				{
+					indices.insert(indices.end(), &m_indices[t * 3], &m_indices[t * 3] + 3);
+				}
+				output.indexCount = static_cast<unsigned int>(indices.size()) - output.firstIndex;
+				if (!m_ranges.empty())
+				{
+					ranges.push_back(output);
+				}
+			}
+		}
+
+	private:
+		void NormalizeVertices(const Model &model)
+		{
+			float low[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+			float high[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+			for (size_t v = 0; v < m_vertexCount; ++v)
+			{
+				for (int k = 0; k < 3; ++k)
+				{
+					low[k] = std::min(low[k], model.fileVertices[v * Model::vertexStride + k]);
+					high[k] = std::max(high[k], model.fileVertices[v * Model::vertexStride + k]);
+				}
+			}
+
+			m_scale = 0.0f;
+			for (int k = 0; k < 3; ++k)
+			{
+				m_scale = std::max(m_scale, high[k] - low[k]);
+			}
+			if (m_scale <= 0.0f)
+			{
+				m_scale = 1.0f;
+			}
+
+			bool hasNormals = model.fileNormals.size() == m_vertexCount * 3;
+			m_positions.resize(m_vertexCount * 3);
+			m_attributes.resize(m_vertexCount * attributeCount);
+			for (size_t v = 0; v < m_vertexCount; ++v)
+			{
+				const float *source = &model.fileVertices[v * Model::vertexStride];
+				for (int k = 0; k < 3; ++k)
+				{
+					m_positions[v * 3 + k] = (source[k] - low[k]) / m_scale;
+				}
+
+				float *attributes = &m_attributes[v * attributeCount];
+				attributes[0] = source[4] * uvWeight;
+				attributes[1] = source[5] * uvWeight;
+				for (int k = 0; k < 3; ++k)
+				{
+					attributes[2 + k] = hasNormals ? model.fileNormals[v * 3 + k] * normalWeight : 0.0f;
+				}
+			}
+		}
+
+		// Vertices only differing in their attributes share a position, m_positionIds points each at the lowest numbered one
+		// and m_wedges links them in a loop
+		void FindWedges()
+		{
+			std::vector<unsigned int> order(m_vertexCount);
+			for (size_t v = 0; v < m_vertexCount; ++v)
+			{
+				order[v] = static_cast<unsigned int>(v);
+			}
+
+			const float *positions = m_positions.data();
+			std::sort(order.begin(), order.end(), [positions](unsigned int a, unsigned int b)
+			{
+				int compare = memcmp(positions + a * 3, positions + b * 3, 3 * sizeof(float));
+				return compare != 0 ? compare < 0 : a < b;
+			});
+
+			m_positionIds.resize(m_vertexCount);
+			m_wedges.resize(m_vertexCount);
+			size_t first = 0;
+			for (size_t i = 1; i <= m_vertexCount; ++i)
+			{
+				if (i < m_vertexCount && memcmp(positions + order[i] * 3, positions + order[first] * 3, 3 * sizeof(float)) == 0)
+				{
+					continue;
+				}
+
+				for (size_t j = first; j < i; ++j)
+				{
+					m_positionIds[order[j]] = order[first];
+					m_wedges[order[j]] = order[j + 1 < i ? j + 1 : first];
+				}
+				first = i;
+			}
+		}
+
+		// Triangles with two corners at the same position have no area and are dropped
+		void AddTriangles(const Model &model, unsigned int firstIndex, unsigned int indexCount, unsigned int range)
+		{
+			for (size_t i = firstIndex; i + 3 <= static_cast<size_t>(firstIndex) + indexCount; i += 3)
+			{
+				const unsigned int *triangle = &model.fileIndices[i];
+				if (!IsDegenerate(triangle))
+				{
+					m_indices.insert(m_indices.end(), triangle, triangle + 3);
+					m_triangleRanges.push_back(range);
+				}
+			}
+		}
+
+		inline bool IsDegenerate(const unsigned int *triangle) const
+		{
+			unsigned int a = m_positionIds[triangle[0]];
+			unsigned int b = m_positionIds[triangle[1]];
+			unsigned int c = m_positionIds[triangle[2]];
+			return a == b || b == c || c == a;
+		}
+
+		inline const float *Position(unsigned int vertex) const
+		{
+			return &m_positions[vertex * 3];
+		}
+
+		inline bool HasEdge(unsigned int from, unsigned int to) const
+		{
+			for (unsigned int i = m_edgeOffsets[from]; i < m_edgeOffsets[from + 1]; ++i)
+			{
+				if (m_edgeTargets[i] == to)
+				{
+					return true;
+				}
+			}
+			return false;
+		}
+
+		// Between any vertices at these positions
+		bool HasPositionEdge(unsigned int from, unsigned int to) const
+		{
+			unsigned int toPosition = m_positionIds[to];
+			unsigned int wedge = from;
+			do
+			{
+				for (unsigned int i = m_edgeOffsets[wedge]; i < m_edgeOffsets[wedge + 1]; ++i)
+				{
+					if (m_positionIds[m_edgeTargets[i]] == toPosition)
+					{
+						return true;
+					}
+				}
+				wedge = m_wedges[wedge];
+			} while (wedge != from);
+			return false;
+		}
+
+		// Rebuilds the edge and triangle adjacency from the current triangles and works out every vertex's kind
+		void Classify()
+		{
+			m_edgeOffsets.assign(m_vertexCount + 1, 0);
+			m_triangleOffsets.assign(m_vertexCount + 1, 0);
+			for (size_t i = 0; i < m_indices.size(); ++i)
+			{
+				++m_edgeOffsets[m_indices[i] + 1];
+				++m_triangleOffsets[m_positionIds[m_indices[i]] + 1];
+			}
+			for (size_t v = 0; v < m_vertexCount; ++v)
+			{
+				m_edgeOffsets[v + 1] += m_edgeOffsets[v];
+				m_triangleOffsets[v + 1] += m_triangleOffsets[v];
+			}
+
+			m_edgeTargets.resize(m_indices.size());
+			m_triangles.resize(m_indices.size());
+			std::vector<unsigned int> edgeFill(m_edgeOffsets.begin(), m_edgeOffsets.end() - 1);
+			std::vector<unsigned int> triangleFill(m_triangleOffsets.begin(), m_triangleOffsets.end() - 1);
+			for (size_t i = 0; i < m_indices.size(); ++i)
+			{
+				size_t next = i % 3 == 2 ? i - 2 : i + 1;
+				m_edgeTargets[edgeFill[m_indices[i]]++] = m_indices[next];
+				m_triangles[triangleFill[m_positionIds[m_indices[i]]]++] = static_cast<unsigned int>(i / 3);
+			}
+
+			VertexEdges none = { noVertex, noVertex, noVertex, noVertex, 0, 0, 0, 0 };
+			m_edges.assign(m_vertexCount, none);
+			for (size_t i = 0; i < m_indices.size(); ++i)
+			{
+				unsigned int from = m_indices[i];
+				unsigned int to = m_indices[i % 3 == 2 ? i - 2 : i + 1];
+				if (HasEdge(to, from))
+				{
+					continue;
+				}
+
+				m_edges[from].openOut = to;
+				++m_edges[from].openOutCount;
+				m_edges[to].openIn = from;
+				++m_edges[to].openInCount;
+
+				if (!HasPositionEdge(to, from))
+				{
+					m_edges[from].borderOut = to;
+					++m_edges[from].borderOutCount;
+					m_edges[to].borderIn = from;
+					++m_edges[to].borderInCount;
+				}
+			}
+
+			// Positions used by more than one range are locked so material boundaries stay where they are
+			const unsigned int mixedRanges = UINT_MAX - 1;
+			std::vector<unsigned int> positionRanges(m_vertexCount, noVertex);
+			for (size_t i = 0; i < m_indices.size(); ++i)
+			{
+				unsigned int &range = positionRanges[m_positionIds[m_indices[i]]];
+				unsigned int triangleRange = m_triangleRanges[i / 3];
+				range = range == noVertex || range == triangleRange ? triangleRange : mixedRanges;
+			}
+
+			m_kinds.assign(m_vertexCount, KindLocked);
+			for (size_t v = 0; v < m_vertexCount; ++v)
+			{
+				if (m_positionIds[v] != v || m_triangleOffsets[v] == m_triangleOffsets[v + 1])
+				{
+					continue;
+				}
+
+				VertexKind kind = positionRanges[v] == mixedRanges ? KindLocked : PositionKind(static_cast<unsigned int>(v));
+				unsigned int wedge = static_cast<unsigned int>(v);
+				do
+				{
+					m_kinds[wedge] = kind;
+					wedge = m_wedges[wedge];
+				} while (wedge != v);
+			}
+		}
+
+		VertexKind PositionKind(unsigned int position) const
+		{
+			// Wedges no triangle uses any more don't count
+			unsigned int used[2];
+			unsigned int usedCount = 0;
+			unsigned int wedge = position;
+			do
+			{
+				if (m_edgeOffsets[wedge] != m_edgeOffsets[wedge + 1])
+				{
+					if (usedCount == 2)
+					{
+						return KindLocked;
+					}
+					used[usedCount++] = wedge;
+				}
+				wedge = m_wedges[wedge];
+			} while (wedge != position);
+
+			if (usedCount == 1)
+			{
+				const VertexEdges &edges = m_edges[used[0]];
+				if (edges.borderOutCount == 0 && edges.borderInCount == 0)
+				{
+					return KindManifold;
+				}
+				return edges.borderOutCount == 1 && edges.borderInCount == 1 ? KindBorder : KindLocked;
+			}
+
+			// A seam runs through, each side has one edge along it in each direction, and they pair up by position
+			const VertexEdges &a = m_edges[used[0]];
+			const VertexEdges &b = m_edges[used[1]];
+			if (a.borderOutCount != 0 || a.borderInCount != 0 || b.borderOutCount != 0 || b.borderInCount != 0 ||
+				a.openOutCount != 1 || a.openInCount != 1 || b.openOutCount != 1 || b.openInCount != 1)
+			{
+				return KindLocked;
+			}
+			return m_positionIds[a.openOut] == m_positionIds[b.openIn] && m_positionIds[a.openIn] == m_positionIds[b.openOut] ? KindSeam : KindLocked;
+		}
+
+		void BuildQuadrics()
+		{
+			Quadric zero = {};
+			Gradient noGradient = {};
+			m_positionQuadrics.assign(m_vertexCount, zero);
+			m_attributeQuadrics.assign(m_vertexCount, zero);
+			m_gradients.assign(m_vertexCount * attributeCount, noGradient);
+
+			for (size_t t = 0; t < m_triangleRanges.size(); ++t)
+			{
+				const unsigned int *triangle = &m_indices[t * 3];
+				const float *p0 = Position(triangle[0]);
+				float edge1[3];
+				float edge2[3];
+				float normal[3];
+				Subtract(Position(triangle[1]), p0, edge1);
+				Subtract(Position(triangle[2]), p0, edge2);
+				Cross(edge1, edge2, normal);
+				float length = std::sqrt(Dot(normal, normal));
+				if (length <= 0.0f)
+				{
+					continue;
+				}
+
+				// Weighted by area so small triangles don't hold back large flat regions
+				float area = length * 0.5f;
+				for (int k = 0; k < 3; ++k)
+				{
+					normal[k] /= length;
+				}
+				Quadric plane = {};
+				AddPlane(plane, normal, -Dot(normal, p0), area);
+				for (int i = 0; i < 3; ++i)
+				{
+					AddQuadric(m_positionQuadrics[m_positionIds[triangle[i]]], plane);
+				}
+
+				AddAttributes(triangle, edge1, edge2, area);
+
+				for (int i = 0; i < 3; ++i)
+				{
+					unsigned int from = triangle[i];
+					unsigned int to = triangle[(i + 1) % 3];
+					if (HasEdge(to, from))
+					{
+						continue;
+					}
+
+					// Plane through the edge, perpendicular to the triangle
+					float weight = HasPositionEdge(to, from) ? seamWeight : borderWeight;
+					float edge[3];
+					float edgeNormal[3];
+					Subtract(Position(to), Position(from), edge);
+					Cross(edge, normal, edgeNormal);
+					float edgeLength = std::sqrt(Dot(edgeNormal, edgeNormal));
+					if (edgeLength <= 0.0f)
+					{
+						continue;
+					}
+					for (int k = 0; k < 3; ++k)
+					{
+						edgeNormal[k] /= edgeLength;
+					}
+
+					Quadric edgePlane = {};
+					AddPlane(edgePlane, edgeNormal, -Dot(edgeNormal, Position(from)), edgeLength * edgeLength * weight);
+					AddQuadric(m_positionQuadrics[m_positionIds[from]], edgePlane);
+					AddQuadric(m_positionQuadrics[m_positionIds[to]], edgePlane);
+				}
+			}
+		}
+
+		// Each attribute is linear across the triangle, the error is how far it is from the value a vertex will end up with
+		// Only the parts that depend on the position go in the quadric, the rest is kept per attribute in the gradients
+		void AddAttributes(const unsigned int *triangle, const float *edge1, const float *edge2, float area)
+		{
+			float d00 = Dot(edge1, edge1);
+			float d01 = Dot(edge1, edge2);
+			float d11 = Dot(edge2, edge2);
+			float denominator = d00 * d11 - d01 * d01;
+			float inverse = denominator != 0.0f ? 1.0f / denominator : 0.0f;
+
+			// Gradients of the second and third barycentric coordinates
+			float gradient1[3];
+			float gradient2[3];
+			for (int k = 0; k < 3; ++k)
+			{
+				gradient1[k] = (d11 * edge1[k] - d01 * edge2[k]) * inverse;
+				gradient2[k] = (d00 * edge2[k] - d01 * edge1[k]) * inverse;
+			}
+
+			const float *p0 = Position(triangle[0]);
+			const float *a0 = &m_attributes[triangle[0] * attributeCount];
+			const float *a1 = &m_attributes[triangle[1] * attributeCount];
+			const float *a2 = &m_attributes[triangle[2] * attributeCount];
+
+			Quadric quadric = {};
+			Gradient gradients[attributeCount];
+			for (unsigned int k = 0; k < attributeCount; ++k)
+			{
+				float g[3];
+				for (int j = 0; j < 3; ++j)
+				{
+					g[j] = gradient1[j] * (a1[k] - a0[k]) + gradient2[j] * (a2[k] - a0[k]);
+				}
+				float offset = a0[k] - Dot(g, p0);
+
+				quadric.a00 += area * g[0] * g[0];
+				quadric.a11 += area * g[1] * g[1];
+				quadric.a22 += area * g[2] * g[2];
+				quadric.a10 += area * g[1] * g[0];
+				quadric.a20 += area * g[2] * g[0];
+				quadric.a21 += area * g[2] * g[1];
+				quadric.b0 += area * g[0] * offset;
+				quadric.b1 += area * g[1] * offset;
+				quadric.b2 += area * g[2] * offset;
+				quadric.c += area * offset * offset;
+
+				for (int j = 0; j < 3; ++j)
+				{
+					gradients[k].gradient[j] = area * g[j];
+				}
+				gradients[k].offset = area * offset;
+			}
+			quadric.weight = area;
+
+			for (int i = 0; i < 3; ++i)
+			{
+				AddQuadric(m_attributeQuadrics[triangle[i]], quadric);
+				Gradient *target = &m_gradients[triangle[i] * attributeCount];
+				for (unsigned int k = 0; k < attributeCount; ++k)
+				{
+					for (int j = 0; j < 3; ++j)
+					{
+						target[k].gradient[j] += gradients[k].gradient[j];
+					}
+					target[k].offset += gradients[k].offset;
+				}
+			}
+		}
+
+		// Attribute error of the triangles around vertex after it takes target's position and attributes
+		float AttributeError(unsigned int vertex, unsigned int target) const
+		{
+			const Quadric &quadric = m_attributeQuadrics[vertex];
+			if (quadric.weight <= 0.0f)
+			{
+				return 0.0f;
+			}
+
+			const float *p = Position(target);
+			const float *attributes = &m_attributes[target * attributeCount];
+			const Gradient *gradients = &m_gradients[vertex * attributeCount];
+			float error = Evaluate(quadric, p);
+			for (unsigned int k = 0; k < attributeCount; ++k)
+			{
+				float a = attributes[k];
+				error += a * a * quadric.weight - 2.0f * a * (Dot(gradients[k].gradient, p) + gradients[k].offset);
+			}
+			return std::fabs(error) / quadric.weight;
+		}
+
+		// Checks the collapse is allowed and finds the second vertex pair for a seam
+		bool CanCollapse(unsigned int source, unsigned int target, unsigned int &seamSource, unsigned int &seamTarget) const
+		{
+			seamSource = noVertex;
+			seamTarget = noVertex;
+			const VertexEdges &edges = m_edges[source];
+			unsigned int targetPosition = m_positionIds[target];
+			switch (m_kinds[source])
+			{
+			case KindManifold:
+				return true;
+
+			case KindBorder:
+				return (edges.borderOut != noVertex && m_positionIds[edges.borderOut] == targetPosition) ||
+					(edges.borderIn != noVertex && m_positionIds[edges.borderIn] == targetPosition);
+
+			case KindSeam:
+			{
+				if (target != edges.openOut && target != edges.openIn)
+				{
+					return false;
+				}
+
+				// The other side of the seam goes to the vertex on its side of the same position
+				seamSource = m_wedges[source];
+				while (m_edgeOffsets[seamSource] == m_edgeOffsets[seamSource + 1])
+				{
+					seamSource = m_wedges[seamSource];
+				}
+				const VertexEdges &other = m_edges[seamSource];
+				if (m_positionIds[other.openOut] == targetPosition)
+				{
+					seamTarget = other.openOut;
+				}
+				else if (m_positionIds[other.openIn] == targetPosition)
+				{
+					seamTarget = other.openIn;
+				}
+				return seamTarget != noVertex;
+			}
+
+			default:
+				return false;
+			}
+		}
+
+		float Cost(unsigned int source, unsigned int target, unsigned int seamSource, unsigned int seamTarget) const
+		{
+			const Quadric &quadric = m_positionQuadrics[m_positionIds[source]];
+			float cost = quadric.weight > 0.0f ? std::fabs(Evaluate(quadric, Position(target))) / quadric.weight : 0.0f;
+			cost += AttributeError(source, target);
+			if (seamSource != noVertex)
+			{
+				cost += AttributeError(seamSource, seamTarget);
+			}
+			return cost;
+		}
+
+		// True if moving source onto target turns a remaining triangle around or nearly so
+		bool Flips(unsigned int source, unsigned int target) const
+		{
+			unsigned int sourcePosition = m_positionIds[source];
+			unsigned int targetPosition = m_positionIds[target];
+			for (unsigned int i = m_triangleOffsets[sourcePosition]; i < m_triangleOffsets[sourcePosition + 1]; ++i)
+			{
+				const unsigned int *triangle = &m_indices[m_triangles[i] * 3];
+				const float *before[3];
+				const float *after[3];
+				bool collapses = false;
+				for (int k = 0; k < 3; ++k)
+				{
+					unsigned int position = m_positionIds[triangle[k]];
+					collapses |= position == targetPosition;
+					before[k] = Position(triangle[k]);
+					after[k] = position == sourcePosition ? Position(target) : before[k];
+				}
+				if (collapses)
+				{
+					continue;
+				}
+
+				float edge1[3];
+				float edge2[3];
+				float normalBefore[3];
+				float normalAfter[3];
+				Subtract(before[1], before[0], edge1);
+				Subtract(before[2], before[0], edge2);
+				Cross(edge1, edge2, normalBefore);
+				Subtract(after[1], after[0], edge1);
+				Subtract(after[2], after[0], edge2);
+				Cross(edge1, edge2, normalAfter);
+
+				float lengths = std::sqrt(Dot(normalBefore, normalBefore) * Dot(normalAfter, normalAfter));
+				if (Dot(normalBefore, normalAfter) <= minimumFlipCosine * lengths)
+				{
+					return true;
+				}
+			}
+			return false;
+		}
+
+		// Triangles around source that disappear with the collapse
+		size_t RemovedTriangles(unsigned int source, unsigned int target) const
+		{
+			unsigned int sourcePosition = m_positionIds[source];
+			unsigned int targetPosition = m_positionIds[target];
+			size_t removed = 0;
+			for (unsigned int i = m_triangleOffsets[sourcePosition]; i < m_triangleOffsets[sourcePosition + 1]; ++i)
+			{
+				const unsigned int *triangle = &m_indices[m_triangles[i] * 3];
+				removed += m_positionIds[triangle[0]] == targetPosition || m_positionIds[triangle[1]] == targetPosition || m_positionIds[triangle[2]] == targetPosition ? 1 : 0;
+			}
+			return removed;
+		}
+
+		// One round of the cheapest independent collapses, returns false if none could be made
+		bool Pass(size_t targetTriangles, float maximumCost)
+		{
+			std::vector<Collapse> collapses;
+			collapses.reserve(m_indices.size());
+			for (size_t i = 0; i < m_indices.size(); ++i)
+			{
+				unsigned int a = m_indices[i];
+				unsigned int b = m_indices[i % 3 == 2 ? i - 2 : i + 1];
+
+				// Edges with both halves would show up twice
+				if (a > b && HasEdge(b, a))
+				{
+					continue;
+				}
+
+				Collapse best = { noVertex, noVertex, FLT_MAX };
+				unsigned int ends[2] = { a, b };
+				for (int direction = 0; direction < 2; ++direction)
+				{
+					unsigned int source = ends[direction];
+					unsigned int target = ends[1 - direction];
+					unsigned int seamSource;
+					unsigned int seamTarget;
+					if (!CanCollapse(source, target, seamSource, seamTarget))
+					{
+						continue;
+					}
+
+					float cost = Cost(source, target, seamSource, seamTarget);
+					if (cost < best.cost)
+					{
+						best.source = source;
+						best.target = target;
+						best.cost = cost;
+					}
+				}
+
+				if (best.source != noVertex && best.cost <= maximumCost)
+				{
+					collapses.push_back(best);
+				}
+			}
+
+			std::sort(collapses.begin(), collapses.end(), Cheaper);
+
+			// Most collapses remove two triangles, but many get skipped for sharing a position with an earlier one,
+			// so allow a little more than the cost of the one that would reach the target if none were
+			// Anything dearer waits for a later pass, where cheaper collapses may have opened up
+			size_t needed = TriangleCount() - targetTriangles;
+			size_t goal = needed / 2;
+			float costLimit = goal < collapses.size() ? std::min(maximumCost, collapses[goal].cost * passCostSlack) : maximumCost;
+
+			// A position takes part in at most one collapse per pass, so every cost and flip test is against the current mesh
+			std::vector<bool> touched(m_vertexCount, false);
+			size_t removed = 0;
+			size_t applied = 0;
+			for (size_t i = 0; i < collapses.size() && removed < needed; ++i)
+			{
+				const Collapse &collapse = collapses[i];
+				if (collapse.cost > costLimit)
+				{
+					break;
+				}
+
+				unsigned int sourcePosition = m_positionIds[collapse.source];
+				unsigned int targetPosition = m_positionIds[collapse.target];
+				if (touched[sourcePosition] || touched[targetPosition] || Flips(collapse.source, collapse.target))
+				{
+					continue;
+				}
+
+				unsigned int seamSource;
+				unsigned int seamTarget;
+				CanCollapse(collapse.source, collapse.target, seamSource, seamTarget);
+
+				m_collapses[collapse.source] = collapse.target;
+				AddQuadric(m_positionQuadrics[targetPosition], m_positionQuadrics[sourcePosition]);
+				MergeAttributes(collapse.source, collapse.target);
+				if (seamSource != noVertex)
+				{
+					m_collapses[seamSource] = seamTarget;
+					MergeAttributes(seamSource, seamTarget);
+				}
+
+				touched[sourcePosition] = true;
+				touched[targetPosition] = true;
+				removed += RemovedTriangles(collapse.source, collapse.target);
+				m_error = std::max(m_error, collapse.cost);
+				++applied;
+			}
+
+			// Point the triangles at their new vertices and drop the ones that collapsed
+			size_t kept = 0;
+			for (size_t t = 0; t < m_triangleRanges.size(); ++t)
+			{
+				unsigned int triangle[3];
+				for (int k = 0; k < 3; ++k)
+				{
+					triangle[k] = m_collapses[m_indices[t * 3 + k]];
+				}
+				if (IsDegenerate(triangle))
+				{
+					continue;
+				}
+
+				memcpy(&m_indices[kept * 3], triangle, sizeof(triangle));
+				m_triangleRanges[kept] = m_triangleRanges[t];
+				++kept;
+			}
+			m_indices.resize(kept * 3);
+			m_triangleRanges.resize(kept);
+			return applied > 0;
+		}
+
+		void MergeAttributes(unsigned int source, unsigned int target)
+		{
+			AddQuadric(m_attributeQuadrics[target], m_attributeQuadrics[source]);
+			for (unsigned int k = 0; k < attributeCount; ++k)
+			{
+				Gradient &to = m_gradients[target * attributeCount + k];
+				const Gradient &from = m_gradients[source * attributeCount + k];
+				for (int j = 0; j < 3; ++j)
+				{
+					to.gradient[j] += from.gradient[j];
+				}
+				to.offset += from.offset;
+			}
+		}
+
+		size_t m_vertexCount;
+		std::vector<MaterialRange> m_ranges;
+
+		// Squared and relative to the largest extent
+		float m_error;
+		float m_scale;
+
+		std::vector<float> m_positions;
+		std::vector<float> m_attributes;
+		std::vector<unsigned int> m_positionIds;
+		std::vector<unsigned int> m_wedges;
+
+		// Current triangles and the range each came from
+		std::vector<unsigned int> m_indices;
+		std::vector<unsigned int> m_triangleRanges;
+
+		// Where each vertex went, itself until it collapses
+		std::vector<unsigned int> m_collapses;
+
+		// Rebuilt by Classify, outgoing edges per vertex and triangles per position
+		std::vector<unsigned int> m_edgeOffsets;
+		std::vector<unsigned int> m_edgeTargets;
+		std::vector<unsigned int> m_triangleOffsets;
+		std::vector<unsigned int> m_triangles;
+		std::vector<VertexEdges> m_edges;
+		std::vector<VertexKind> m_kinds;
+
+		// Position error per position, attribute error per vertex
+		std::vector<Quadric> m_positionQuadrics;
+		std::vector<Quadric> m_attributeQuadrics;
+		std::vector<Gradient> m_gradients;
+	};
+}
+
+float MeshSimplifier::Simplify(const Model &model, size_t targetIndexCount, float targetError, std::vector<unsigned int> &indices, std::vector<MaterialRange> &ranges)
+{
+	Simplifier simplifier(model);
+	simplifier.Reduce(targetIndexCount / 3, targetError);
+	simplifier.Emit(indices, ranges);
+	return simplifier.Error() / simplifier.Scale();
+}
+
+void MeshSimplifier::BuildLods(Model &model)
+{
+	model.lods.clear();
+
+	// Quadrics keep accumulating from one level to the next, so each level's error is measured from the full model
+	Simplifier simplifier(model);
+	size_t vertexCount = model.fileVertices.size() / Model::vertexStride;
+	size_t previous = model.fileIndices.size() / 3;
+	while (model.lods.size() < maximumLods && previous / 2 >= minimumLodTriangles)
+	{
+		simplifier.Reduce(previous / 2, FLT_MAX);
+		size_t triangles = simplifier.TriangleCount();
+		if (triangles > previous - previous / minimumReductionDivisor)
+		{
+			break;
+		}
+
+		ModelLod lod;
+		lod.error = simplifier.Error();
+		simplifier.Emit(lod.indices, lod.materialRanges);
+		MeshOptimizer::OptimizeVertexCache(lod.indices, lod.materialRanges, vertexCount);
+		model.lods.push_back(std::move(lod));
+		previous = triangles;
+	}
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <vector>
+#include "Model.h"
+
+// Edge collapse simplification driven by quadric error metrics (Garland and Heckbert)
+// Each collapse merges a vertex into one of its neighbours, nothing is moved or added,
+// so every level of detail indexes the model's own vertex buffer
+// Texture coordinates and normals count towards the error as well as positions,
+// open borders and uv seams only collapse along themselves and material boundaries never move
+class MeshSimplifier
+{
+public:
+	// BuildLods stops adding levels below this many triangles
+	static const unsigned int minimumLodTriangles = 64;
+
+	// and after this many levels
+	static const unsigned int maximumLods = 8;
+
+	// Collapse until there are at most targetIndexCount indices left, or the next collapse would cost more than targetError
+	// Errors are a fraction of the model's largest bounds extent, returns the largest collapse error used
+	// indices and ranges come back grouped like Model::materialRanges, ranges is left empty for models without materials
+	static float Simplify(const Model &model, size_t targetIndexCount, float targetError, std::vector<unsigned int> &indices, std::vector<MaterialRange> &ranges);
+
+	// Fills in Model::lods, each level has about half the triangles of the one before
+	// Levels are vertex cache optimized, ends early once a level stops getting smaller
+	static void BuildLods(Model &model);
+};
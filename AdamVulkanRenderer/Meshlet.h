@@ -0,0 +1,28 @@
+#pragma once
+
+// Small cluster of a model's triangles with its own vertex list, see MeshletBuilder
+// Plain data, written to the mesh cache and uploaded as is
+struct Meshlet
+{
+	// Index into Model::materials, a meshlet never spans two material ranges
+	unsigned int material;
+
+	// First entry in Model::meshletVertices, the meshlet's vertices are numbered from there
+	unsigned int vertexOffset;
+
+	// First byte in Model::meshletTriangles, always a multiple of 4
+	unsigned int triangleOffset;
+	unsigned int vertexCount;
+	unsigned int triangleCount;
+
+	// Bounding sphere for frustum culling
+	float center[3];
+	float radius;
+
+	// Normal cone for back face culling, the whole meshlet faces away from any eye where
+	// dot(normalize(coneApex - eye), coneAxis) >= coneCutoff
+	// coneCutoff is 1 when the normals spread too far to ever cull
+	float coneApex[3];
+	float coneAxis[3];
+	float coneCutoff;
+};
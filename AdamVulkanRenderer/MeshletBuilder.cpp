@@ -0,0 +1,276 @@
+#include "stdafx.h"
+#include "MeshletBuilder.h"
+#include "MeshMath.h"
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+	// Cones wider than this are marked as never culled, a meshlet that nearly folds back on itself rarely faces away as a whole
+	const float minimumConeDot = 0.1f;
+
+	inline float Distance(const Vec3 &a, const Vec3 &b)
+	{
+		Vec3 offset = Subtract(a, b);
+		return std::sqrt(Dot(offset, offset));
+	}
+
+	// Ritter's bounding sphere, within a few percent of the smallest one and independent of vertex order past the first
+	void BoundingSphere(const Model &model, const unsigned int *vertices, unsigned int count, Meshlet &meshlet)
+	{
+		Vec3 first = Position(model, vertices[0]);
+		Vec3 a = first;
+		float farthest = -1.0f;
+		for (unsigned int i = 0; i < count; ++i)
+		{
+			Vec3 p = Position(model, vertices[i]);
+			float distance = Distance(p, first);
+			if (distance > farthest)
+			{
+				farthest = distance;
+				a = p;
+			}
+		}
+
+		Vec3 b = a;
+		farthest = -1.0f;
+		for (unsigned int i = 0; i < count; ++i)
+		{
+			Vec3 p = Position(model, vertices[i]);
+			float distance = Distance(p, a);
+			if (distance > farthest)
+			{
+				farthest = distance;
+				b = p;
+			}
+		}
+
+		Vec3 center((a.x + b.x) * 0.5f, (a.y + b.y) * 0.5f, (a.z + b.z) * 0.5f);
+		float radius = farthest * 0.5f;
+
+		// Grow towards any vertex still outside
+		for (unsigned int i = 0; i < count; ++i)
+		{
+			Vec3 p = Position(model, vertices[i]);
+			float distance = Distance(p, center);
+			if (distance > radius)
+			{
+				float grown = (radius + distance) * 0.5f;
+				float shift = (grown - radius) / distance;
+				center = Vec3(center.x + (p.x - center.x) * shift, center.y + (p.y - center.y) * shift, center.z + (p.z - center.z) * shift);
+				radius = grown;
+			}
+		}
+
+		meshlet.center[0] = center.x;
+		meshlet.center[1] = center.y;
+		meshlet.center[2] = center.z;
+		meshlet.radius = radius;
+	}
+
+	// Axis is the average face normal, the apex is pulled back along it until every triangle's plane is in front of it,
+	// so the cone test stays conservative for eyes close to the meshlet
+	void NormalCone(const Model &model, const unsigned int *indices, unsigned int triangleCount, Meshlet &meshlet)
+	{
+		Vec3 center(meshlet.center[0], meshlet.center[1], meshlet.center[2]);
+
+		std::vector<Vec3> normals;
+		normals.reserve(triangleCount);
+		Vec3 axis;
+		for (unsigned int t = 0; t < triangleCount; ++t)
+		{
+			Vec3 a = Position(model, indices[t * 3]);
+			Vec3 b = Position(model, indices[t * 3 + 1]);
+			Vec3 c = Position(model, indices[t * 3 + 2]);
+
+			// Counter-clockwise is the front face
+			Vec3 normal = Cross(Subtract(b, a), Subtract(c, a));
+			float length = std::sqrt(Dot(normal, normal));
+			if (length <= 0.0f)
+			{
+				continue;
+			}
+			normal = Vec3(normal.x / length, normal.y / length, normal.z / length);
+			normals.push_back(normal);
+			axis = Vec3(axis.x + normal.x, axis.y + normal.y, axis.z + normal.z);
+		}
+
+		for (int i = 0; i < 3; ++i)
+		{
+			meshlet.coneApex[i] = meshlet.center[i];
+			meshlet.coneAxis[i] = 0.0f;
+		}
+		meshlet.coneCutoff = 1.0f;
+
+		float axisLength = std::sqrt(Dot(axis, axis));
+		if (normals.empty() || axisLength <= 0.0f)
+		{
+			return;
+		}
+		axis = Vec3(axis.x / axisLength, axis.y / axisLength, axis.z / axisLength);
+
+		float minimumDot = 1.0f;
+		for (size_t i = 0; i < normals.size(); ++i)
+		{
+			minimumDot = std::min(minimumDot, Dot(normals[i], axis));
+		}
+
+		meshlet.coneAxis[0] = axis.x;
+		meshlet.coneAxis[1] = axis.y;
+		meshlet.coneAxis[2] = axis.z;
+		if (minimumDot <= minimumConeDot)
+		{
+			return;
+		}
+
+		// Furthest distance back along the axis from the center to a triangle plane
+		float apexDistance = 0.0f;
+		size_t normal = 0;
+		for (unsigned int t = 0; t < triangleCount; ++t)
+		{
+			Vec3 a = Position(model, indices[t * 3]);
+			Vec3 b = Position(model, indices[t * 3 + 1]);
+			Vec3 c = Position(model, indices[t * 3 + 2]);
+			Vec3 faceNormal = Cross(Subtract(b, a), Subtract(c, a));
+			if (Dot(faceNormal, faceNormal) <= 0.0f)
+			{
+				continue;
+			}
+
+			const Vec3 &n = normals[normal++];
+			apexDistance = std::max(apexDistance, Dot(Subtract(center, a), n) / Dot(axis, n));
+		}
+
+		meshlet.coneApex[0] = center.x - axis.x * apexDistance;
+		meshlet.coneApex[1] = center.y - axis.y * apexDistance;
+		meshlet.coneApex[2] = center.z - axis.z * apexDistance;
+		meshlet.coneCutoff = std::sqrt(1.0f - minimumDot * minimumDot);
+	}
+
+	// Grows one meshlet at a time, tracking which model vertices it already holds
+	struct MeshletWriter
+	{
+		MeshletWriter(Model &target) : model(&target), localIds(target.fileVertices.size() / Model::vertexStride, -1) {}
+
+		void Begin(unsigned int material)
+		{
+			current = Meshlet();
+			current.material = material;
+			current.vertexOffset = static_cast<unsigned int>(model->meshletVertices.size());
+			current.triangleOffset = static_cast<unsigned int>(model->meshletTriangles.size());
+			indices.clear();
+		}
+
+		// Returns false if the triangle doesn't fit and the meshlet has to be finished first
+		bool Add(const unsigned int *triangle)
+		{
+			// Degenerate triangles repeat a vertex, only count it once
+			unsigned int a = triangle[0];
+			unsigned int b = triangle[1];
+			unsigned int c = triangle[2];
+			unsigned int newVertices = (localIds[a] < 0 ? 1 : 0) + (localIds[b] < 0 && b != a ? 1 : 0) + (localIds[c] < 0 && c != a && c != b ? 1 : 0);
+
+			if (current.vertexCount + newVertices > MeshletBuilder::maxVertices || current.triangleCount + 1 > MeshletBuilder::maxTriangles)
+			{
+				return false;
+			}
+
+			for (int i = 0; i < 3; ++i)
+			{
+				int &local = localIds[triangle[i]];
+				if (local < 0)
+				{
+					local = static_cast<int>(current.vertexCount++);
+					model->meshletVertices.push_back(triangle[i]);
+				}
+				model->meshletTriangles.push_back(static_cast<unsigned char>(local));
+				indices.push_back(triangle[i]);
+			}
+			++current.triangleCount;
+			return true;
+		}
+
+		void Finish()
+		{
+			if (current.triangleCount == 0)
+			{
+				return;
+			}
+
+			const unsigned int *vertices = &model->meshletVertices[current.vertexOffset];
+			BoundingSphere(*model, vertices, current.vertexCount, current);
+			NormalCone(*model, indices.data(), current.triangleCount, current);
+			model->meshlets.push_back(current);
+
+			for (unsigned int i = 0; i < current.vertexCount; ++i)
+			{
+				localIds[vertices[i]] = -1;
+			}
+
+			// Keep the next meshlet's triangles 4 byte aligned so a shader can read them as uints
+			while (model->meshletTriangles.size() % 4 != 0)
+			{
+				model->meshletTriangles.push_back(0);
+			}
+		}
+
+		Model *model;
+		std::vector<int> localIds;
+		Meshlet current;
+
+		// Model indices of the current meshlet's triangles, for the culling data
+		std::vector<unsigned int> indices;
+	};
+}
+
+void MeshletBuilder::Build(Model &model)
+{
+	model.meshlets.clear();
+	model.meshletVertices.clear();
+	model.meshletTriangles.clear();
+
+	std::vector<MaterialRange> ranges = model.materialRanges;
+	if (ranges.empty())
+	{
+		MaterialRange whole = { 0, 0, static_cast<unsigned int>(model.fileIndices.size()) };
+		ranges.push_back(whole);
+	}
+
+	MeshletWriter writer(model);
+	for (size_t r = 0; r < ranges.size(); ++r)
+	{
+		writer.Begin(ranges[r].material);
+		size_t end = static_cast<size_t>(ranges[r].firstIndex) + ranges[r].indexCount;
+		for (size_t i = ranges[r].firstIndex; i + 3 <= end; i += 3)
+		{
+			if (!writer.Add(&model.fileIndices[i]))
+			{
+				writer.Finish();
+				writer.Begin(ranges[r].material);
+				writer.Add(&model.fileIndices[i]);
+			}
+		}
+		writer.Finish();
+	}
+}
+
+bool MeshletBuilder::IsBackFacing(const Meshlet &meshlet, const Vec3 &eye)
+{
+	Vec3 view(meshlet.coneApex[0] - eye.x, meshlet.coneApex[1] - eye.y, meshlet.coneApex[2] - eye.z);
+	Vec3 axis(meshlet.coneAxis[0], meshlet.coneAxis[1], meshlet.coneAxis[2]);
+	float length = std::sqrt(Dot(view, view));
+	return meshlet.coneCutoff < 1.0f && Dot(view, axis) >= meshlet.coneCutoff * length;
+}
+
+bool MeshletBuilder::IsOutsideFrustum(const Meshlet &meshlet, const Vec4 planes[6])
+{
+	for (int i = 0; i < 6; ++i)
+	{
+		const Vec4 &plane = planes[i];
+		if (plane.x * meshlet.center[0] + plane.y * meshlet.center[1] + plane.z * meshlet.center[2] + plane.w < -meshlet.radius)
+		{
+			return true;
+		}
+	}
+	return false;
+}
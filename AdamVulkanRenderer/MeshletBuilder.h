@@ -0,0 +1,25 @@
+#pragma once
+
+#include "Model.h"
+#include "Vec3.h"
+#include "Vec4.h"
+
+// Splits a model's triangles into meshlets of at most maxVertices vertices and maxTriangles triangles
+// Triangles are taken in index order, so run it after MeshOptimizer to get tightly packed meshlets
+class MeshletBuilder
+{
+public:
+	static const unsigned int maxVertices = 64;
+
+	// 124 keeps each meshlet's triangle bytes a multiple of 4
+	static const unsigned int maxTriangles = 124;
+
+	// Fills in Model::meshlets, meshletVertices and meshletTriangles, fileIndices are left as they are
+	static void Build(Model &model);
+
+	// Every triangle in the meshlet faces away from eye
+	static bool IsBackFacing(const Meshlet &meshlet, const Vec3 &eye);
+
+	// The bounding sphere is entirely behind one of the planes, each plane is (normal, distance) with the normal pointing inwards
+	static bool IsOutsideFrustum(const Meshlet &meshlet, const Vec4 planes[6]);
+};
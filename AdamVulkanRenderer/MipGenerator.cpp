@@ -0,0 +1,317 @@
+#include "stdafx.h"
+#include "MipGenerator.h"
+#include "TextScanner.h"
+#include <emmintrin.h>
+#include <immintrin.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+	// Linear light is kept as 16 bit fixed point, four of them still fit a 32 bit lane with room to round
+	const uint32_t linearOne = 65535;
+
+	// Alpha goes through the same lookups as color, from the second half of each table
+	const uint32_t alphaDecodeOffset = 256;
+	const uint32_t alphaEncodeOffset = linearOne + 1;
+
+	struct Tables
+	{
+		// sRGB code to linear, then alpha code to the same scale
+		uint32_t toLinear[512];
+
+		// Linear back to the nearest sRGB code, then back to the nearest alpha code
+		// The vectorized lookup reads a dword at a time, so there's a little padding on the end
+		uint8_t fromLinear[2 * (linearOne + 1) + 4];
+
+		Tables()
+		{
+			for (uint32_t code = 0; code < 256; ++code)
+			{
+				double encoded = code / 255.0;
+				double linear = encoded <= 0.04045 ? encoded / 12.92 : std::pow((encoded + 0.055) / 1.055, 2.4);
+				toLinear[code] = static_cast<uint32_t>(linear * linearOne + 0.5);
+				toLinear[alphaDecodeOffset + code] = code * 257;
+			}
+
+			for (uint32_t value = 0; value <= linearOne; ++value)
+			{
+				double linear = value / double(linearOne);
+				double encoded = linear <= 0.0031308 ? linear * 12.92 : 1.055 * std::pow(linear, 1.0 / 2.4) - 0.055;
+				fromLinear[value] = static_cast<uint8_t>(std::min(255.0, encoded * 255.0 + 0.5));
+				fromLinear[alphaEncodeOffset + value] = static_cast<uint8_t>((value + 128) / 257);
+			}
+			memset(fromLinear + 2 * (linearOne + 1), 0, 4);
+		}
+	};
+
+	// Built on first use, about 130KB
+	const Tables &GetTables()
+	{
+		static const Tables tables;
+		return tables;
+	}
+
+	// One level's worth of filtering, chunks own disjoint destination rows
+	struct Context
+	{
+		const unsigned char *source;
+		uint32_t sourceWidth;
+		uint32_t sourceHeight;
+
+		unsigned char *destination;
+		uint32_t width;
+
+		// NULL for plain averaging
+		const Tables *tables;
+		TextScanner::Kernel kernel;
+	};
+
+	struct Chunk
+	{
+		Context *context;
+		uint32_t firstRow;
+		uint32_t endRow;
+	};
+
+	// A 1 texel wide source has no second column, it reads the first one twice
+	void FilterRowScalar(const unsigned char *row0, const unsigned char *row1, unsigned char *destination, uint32_t sourceWidth, uint32_t first, uint32_t end)
+	{
+		for (uint32_t x = first; x < end; ++x)
+		{
+			size_t left = size_t(x) * 8;
+			size_t right = std::min(x * 2 + 1, sourceWidth - 1) * size_t(4);
+			for (int c = 0; c < 4; ++c)
+			{
+				destination[x * 4 + c] = static_cast<unsigned char>((row0[left + c] + row0[right + c] + row1[left + c] + row1[right + c] + 2) >> 2);
+			}
+		}
+	}
+
+	void FilterRowSRGBScalar(const unsigned char *row0, const unsigned char *row1, unsigned char *destination, uint32_t sourceWidth, uint32_t first, uint32_t end, const Tables &tables)
+	{
+		for (uint32_t x = first; x < end; ++x)
+		{
+			size_t left = size_t(x) * 8;
+			size_t right = std::min(x * 2 + 1, sourceWidth - 1) * size_t(4);
+			for (uint32_t c = 0; c < 4; ++c)
+			{
+				const uint32_t *toLinear = tables.toLinear + (c == 3 ? alphaDecodeOffset : 0);
+				uint32_t sum = toLinear[row0[left + c]] + toLinear[row0[right + c]] + toLinear[row1[left + c]] + toLinear[row1[right + c]];
+				destination[x * 4 + c] = tables.fromLinear[((sum + 2) >> 2) + (c == 3 ? alphaEncodeOffset : 0)];
+			}
+		}
+	}
+
+	// Four source texels from each row to two destination texels as 16 bit channels
+	inline __m128i AverageSSE2(const unsigned char *row0, const unsigned char *row1, __m128i zero, __m128i two)
+	{
+		__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row0));
+		__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row1));
+		__m128i low = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+		__m128i high = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+		low = _mm_add_epi16(low, _mm_srli_si128(low, 8));
+		high = _mm_add_epi16(high, _mm_srli_si128(high, 8));
+		return _mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi64(low, high), two), 2);
+	}
+
+	// Four destination texels a step, returns how far it got
+	uint32_t FilterRowSSE2(const unsigned char *row0, const unsigned char *row1, unsigned char *destination, uint32_t width)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i two = _mm_set1_epi16(2);
+		uint32_t x = 0;
+		for (; x + 4 <= width; x += 4)
+		{
+			size_t source = size_t(x) * 8;
+			__m128i result = _mm_packus_epi16(AverageSSE2(row0 + source, row1 + source, zero, two), AverageSSE2(row0 + source + 16, row1 + source + 16, zero, two));
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(destination + x * 4), result);
+		}
+		return x;
+	}
+
+	// Same as SSE2 with each 128 bit half doing its own pair, so the halves come out interleaved
+	inline __m256i AverageAVX2(const unsigned char *row0, const unsigned char *row1, __m256i zero, __m256i two)
+	{
+		__m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(row0));
+		__m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(row1));
+		__m256i low = _mm256_add_epi16(_mm256_unpacklo_epi8(a, zero), _mm256_unpacklo_epi8(b, zero));
+		__m256i high = _mm256_add_epi16(_mm256_unpackhi_epi8(a, zero), _mm256_unpackhi_epi8(b, zero));
+		low = _mm256_add_epi16(low, _mm256_srli_si256(low, 8));
+		high = _mm256_add_epi16(high, _mm256_srli_si256(high, 8));
+		return _mm256_srli_epi16(_mm256_add_epi16(_mm256_unpacklo_epi64(low, high), two), 2);
+	}
+
+	// Eight destination texels a step
+	uint32_t FilterRowAVX2(const unsigned char *row0, const unsigned char *row1, unsigned char *destination, uint32_t width)
+	{
+		const __m256i zero = _mm256_setzero_si256();
+		const __m256i two = _mm256_set1_epi16(2);
+		uint32_t x = 0;
+		for (; x + 8 <= width; x += 8)
+		{
+			size_t source = size_t(x) * 8;
+			__m256i result = _mm256_packus_epi16(AverageAVX2(row0 + source, row1 + source, zero, two), AverageAVX2(row0 + source + 32, row1 + source + 32, zero, two));
+			result = _mm256_permute4x64_epi64(result, _MM_SHUFFLE(3, 1, 2, 0));
+			_mm256_storeu_si256(reinterpret_cast<__m256i *>(destination + x * 4), result);
+		}
+		return x;
+	}
+
+	// Two texels' channels looked up to linear, one per 32 bit lane
+	inline __m256i GatherLinear(const unsigned char *texels, const Tables &tables, __m256i alphaOffset)
+	{
+		__m256i codes = _mm256_add_epi32(_mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(texels))), alphaOffset);
+		return _mm256_i32gather_epi32(reinterpret_cast<const int *>(tables.toLinear), codes, 4);
+	}
+
+	// Both table lookups are gathers, two destination texels a step
+	uint32_t FilterRowSRGBAVX2(const unsigned char *row0, const unsigned char *row1, unsigned char *destination, uint32_t width, const Tables &tables)
+	{
+		const __m256i decodeOffset = _mm256_setr_epi32(0, 0, 0, alphaDecodeOffset, 0, 0, 0, alphaDecodeOffset);
+		const __m256i encodeOffset = _mm256_setr_epi32(0, 0, 0, alphaEncodeOffset, 0, 0, 0, alphaEncodeOffset);
+		const __m256i two = _mm256_set1_epi32(2);
+		const __m256i firstBytes = _mm256_setr_epi8(0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+		const __m256i joinHalves = _mm256_setr_epi32(0, 4, 0, 0, 0, 0, 0, 0);
+		uint32_t x = 0;
+		for (; x + 2 <= width; x += 2)
+		{
+			size_t source = size_t(x) * 8;
+			__m256i left = _mm256_add_epi32(GatherLinear(row0 + source, tables, decodeOffset), GatherLinear(row1 + source, tables, decodeOffset));
+			__m256i right = _mm256_add_epi32(GatherLinear(row0 + source + 8, tables, decodeOffset), GatherLinear(row1 + source + 8, tables, decodeOffset));
+			__m256i sum = _mm256_add_epi32(_mm256_permute2x128_si256(left, right, 0x20), _mm256_permute2x128_si256(left, right, 0x31));
+			__m256i linear = _mm256_add_epi32(_mm256_srli_epi32(_mm256_add_epi32(sum, two), 2), encodeOffset);
+
+			// Byte lookups come back in the low byte of each lane
+			__m256i codes = _mm256_i32gather_epi32(reinterpret_cast<const int *>(tables.fromLinear), linear, 1);
+			codes = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(codes, firstBytes), joinHalves);
+			_mm_storel_epi64(reinterpret_cast<__m128i *>(destination + x * 4), _mm256_castsi256_si128(codes));
+		}
+		return x;
+	}
+
+	VOID CALLBACK FilterCallback(PTP_CALLBACK_INSTANCE instance, PVOID parameter, PTP_WORK work)
+	{
+		Chunk *chunk = static_cast<Chunk *>(parameter);
+		const Context &context = *chunk->context;
+		size_t sourcePitch = size_t(context.sourceWidth) * 4;
+
+		// A 1 texel wide source only has the one column, leave it to the scalar code
+		// sRGB lookups are only vectorized with AVX2 gathers, SSE2 does them one at a time like scalar
+		bool vectorize = context.sourceWidth > 1 && context.kernel != TextScanner::KernelScalar;
+		for (uint32_t y = chunk->firstRow; y < chunk->endRow; ++y)
+		{
+			const unsigned char *row0 = context.source + size_t(y) * 2 * sourcePitch;
+			const unsigned char *row1 = context.source + std::min(y * 2 + 1, context.sourceHeight - 1) * sourcePitch;
+			unsigned char *destination = context.destination + size_t(y) * context.width * 4;
+
+			uint32_t x = 0;
+			if (context.tables != NULL)
+			{
+				if (vectorize && context.kernel == TextScanner::KernelAVX2)
+				{
+					x = FilterRowSRGBAVX2(row0, row1, destination, context.width, *context.tables);
+				}
+				FilterRowSRGBScalar(row0, row1, destination, context.sourceWidth, x, context.width, *context.tables);
+			}
+			else
+			{
+				if (vectorize && context.kernel == TextScanner::KernelAVX2)
+				{
+					x = FilterRowAVX2(row0, row1, destination, context.width);
+				}
+				if (vectorize)
+				{
+					x += FilterRowSSE2(row0 + size_t(x) * 8, row1 + size_t(x) * 8, destination + size_t(x) * 4, context.width - x);
+				}
+				FilterRowScalar(row0, row1, destination, context.sourceWidth, x, context.width);
+			}
+		}
+		UNREFERENCED_PARAMETER(instance);
+		UNREFERENCED_PARAMETER(work);
+	}
+
+	// Same as the .obj loader, the calling thread takes the last chunk
+	void RunChunks(PTP_WORK_CALLBACK callback, std::vector<Chunk> &chunks)
+	{
+		std::vector<PTP_WORK> works(chunks.size() - 1);
+		for (size_t i = 0; i < works.size(); ++i)
+		{
+			works[i] = CreateThreadpoolWork(callback, &chunks[i], NULL);
+			SubmitThreadpoolWork(works[i]);
+		}
+
+		callback(NULL, &chunks.back(), NULL);
+
+		for (size_t i = 0; i < works.size(); ++i)
+		{
+			WaitForThreadpoolWorkCallbacks(works[i], FALSE);
+			CloseThreadpoolWork(works[i]);
+		}
+	}
+}
+
+size_t MipGenerator::Layout(uint32_t width, uint32_t height, std::vector<Level> &levels)
+{
+	levels.clear();
+	size_t size = 0;
+	for (;;)
+	{
+		Level level;
+		level.width = width;
+		level.height = height;
+		level.offset = size;
+		levels.push_back(level);
+
+		size += (size_t(width) * height * 4 + 15) & ~size_t(15);
+		if (width == 1 && height == 1)
+		{
+			break;
+		}
+		width = std::max<uint32_t>(1, width / 2);
+		height = std::max<uint32_t>(1, height / 2);
+	}
+	return size;
+}
+
+// Each level is one pass over the level above it, split by destination rows
+void MipGenerator::Generate(unsigned char *chain, const std::vector<Level> &levels, const Settings &settings)
+{
+	// Zero threads means one per logical core
+	unsigned int threadCount = settings.threadCount;
+	if (threadCount == 0)
+	{
+		SYSTEM_INFO systemInfo;
+		GetSystemInfo(&systemInfo);
+		threadCount = systemInfo.dwNumberOfProcessors;
+	}
+
+	Context context;
+	context.tables = settings.srgb ? &GetTables() : NULL;
+	context.kernel = TextScanner::GetKernel();
+
+	std::vector<Chunk> chunks;
+	for (size_t i = 1; i < levels.size(); ++i)
+	{
+		const Level &source = levels[i - 1];
+		const Level &level = levels[i];
+		context.source = chain + source.offset;
+		context.sourceWidth = source.width;
+		context.sourceHeight = source.height;
+		context.destination = chain + level.offset;
+		context.width = level.width;
+
+		size_t chunkCount = size_t(level.width) * level.height / minimumChunkTexels;
+		chunkCount = std::max<size_t>(1, std::min<size_t>(std::min<size_t>(chunkCount, threadCount), level.height));
+
+		chunks.resize(chunkCount);
+		for (size_t c = 0; c < chunkCount; ++c)
+		{
+			chunks[c].context = &context;
+			chunks[c].firstRow = static_cast<uint32_t>(level.height * c / chunkCount);
+			chunks[c].endRow = static_cast<uint32_t>(level.height * (c + 1) / chunkCount);
+		}
+		RunChunks(FilterCallback, chunks);
+	}
+}
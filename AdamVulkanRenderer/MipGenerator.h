@@ -0,0 +1,45 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// Full mip chains for RGBA8 textures, every level a 2x2 box filter of the one above
+// sRGB encoded colors are averaged in linear light and encoded again, alpha is always averaged as it is
+// Odd sizes round down and drop the last row or column, like most box filters
+// Rows of a level are split across threads, the filter is vectorized with the kernel TextScanner picked
+class MipGenerator
+{
+public:
+	struct Level
+	{
+		uint32_t width;
+		uint32_t height;
+
+		// Bytes from the start of the chain, rows are tightly packed
+		size_t offset;
+	};
+
+	struct Settings
+	{
+		// Color channels hold sRGB encoded values, as photos and painted textures do
+		bool srgb;
+
+		// 0 uses one per logical core, small levels are always done on the calling thread
+		unsigned int threadCount;
+
+		Settings() : srgb(true), threadCount(0) {}
+	};
+
+	// Don't bother splitting fewer destination texels than this across threads
+	static const size_t minimumChunkTexels = 64 * 1024;
+
+	// Every level down to 1x1, one after another, returns the bytes the whole chain needs
+	// Offsets are multiples of 16, which also covers the 4 byte alignment buffer to image copies want
+	static size_t Layout(uint32_t width, uint32_t height, std::vector<Level> &levels);
+
+	// Level 0 has to be in place already, fills in the rest
+	// Reads the levels it writes, so chain shouldn't be mapped write combined memory
+	// The result doesn't depend on the thread count or kernel
+	static void Generate(unsigned char *chain, const std::vector<Level> &levels, const Settings &settings = Settings());
+};
@@ -1,11 +1,55 @@
 #pragma once
 
 #include <vector>
+#include "Material.h"
+#include "Meshlet.h"
 
+// A coarser version of a model over the same vertices, see MeshSimplifier
+struct ModelLod
+{
+    // How far the surface may be from the full model, in model units, attribute error included
+    float error;
+
+    std::vector<unsigned int> indices;
+
+    // Ranges into this level's indices, empty for models without materials
+    std::vector<MaterialRange> materialRanges;
+};
+
+// Meshes can run to hundreds of megabytes, so models are moved from the loader to the upload and never copied by accident
+// Clone when a second copy really is wanted
 class Model
 {
 public: 
+    Model() {}
+    Model(Model &&other) = default;
+    Model &operator=(Model &&other) = default;
+
+    Model Clone() const { return Model(*this); }
+
+    // Floats per vertex in fileVertices
+    static const unsigned int vertexStride = 6;
+
+    // Interleaved x, y, z, w, u, v, the same layout as VertexUV so it uploads as is
     std::vector<float> fileVertices;
     std::vector<float> fileNormals;
     std::vector<unsigned int> fileIndices;
-};
\ No newline at end of file
+
+    // Faces are grouped by material, one range per material the model uses, in order of first use
+    std::vector<Material> materials;
+    std::vector<MaterialRange> materialRanges;
+
+    // Only filled in by MeshletBuilder, empty otherwise
+    // Each meshlet's vertices index fileVertices, its triangles are 3 bytes each indexing its own vertices
+    std::vector<Meshlet> meshlets;
+    std::vector<unsigned int> meshletVertices;
+    std::vector<unsigned char> meshletTriangles;
+
+    // Only filled in by MeshSimplifier::BuildLods, finest first
+    std::vector<ModelLod> lods;
+
+private:
+    // Only for Clone
+    Model(const Model &other) = default;
+    Model &operator=(const Model &other) = delete;
+};
@@ -0,0 +1,951 @@
+#include "stdafx.h"
+#include "NormalGenerator.h"
+#include "TextScanner.h"
+#include <emmintrin.h>
+#include <immintrin.h>
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+namespace
+{
+	const float degreesToRadians = 0.0174532925f;
+	const float pi = 3.14159265f;
+
+	const unsigned int noVertex = UINT_MAX;
+
+	// Per triangle, the unit face normal then the weight at each of its corners
+	const size_t faceStride = 6;
+
+	// Positions are welded in partitions of about this many vertices, so each partition's table stays in cache
+	const size_t weldPartitionSize = 4096;
+
+	// Abramowitz and Stegun 4.4.45, acos(x) = sqrt(1 - x) * polynomial for x in [0, 1], off by at most 7e-5 radians
+	// Plenty for a weight, and cheap to vectorize
+	const float acos0 = 1.5707288f;
+	const float acos1 = -0.2121144f;
+	const float acos2 = 0.0742610f;
+	const float acos3 = -0.0187293f;
+
+	struct Chunk;
+
+	// The hash travels with the vertex, so welding reads its partition front to back and
+	// only looks at positions when two hashes match
+	struct WeldEntry
+	{
+		uint32_t hash;
+		unsigned int vertex;
+	};
+
+	// Everything the stages share, each stage only writes to the parts its chunk owns
+	struct Context
+	{
+		const float *vertices;
+		unsigned int *indices;
+		size_t vertexCount;
+		size_t triangleCount;
+
+		NormalGenerator::Weighting weighting;
+		bool crease;
+		float creaseCosine;
+
+		// Faces this close to the average around a position can't be a crease angle apart, with some slack for rounding
+		float smoothCosine;
+		TextScanner::Kernel kernel;
+		unsigned int chunkCount;
+
+		// Hash of each vertex's position, and the first vertex with the same position
+		std::vector<uint32_t> hashes;
+		std::vector<unsigned int> positions;
+
+		// Every vertex grouped by the weld partition its hash falls in, in vertex order within each
+		unsigned int partitionCount;
+		std::vector<size_t> partitionStarts;
+		std::vector<WeldEntry> partitioned;
+
+		std::vector<float> faces;
+
+		Chunk *chunks;
+
+		float *normals;
+
+		// With creases, set for positions with a face too far from the average, whose corners are looked at one by one
+		std::vector<unsigned char> creased;
+
+		// With creases, set once a vertex has picked up its first normal
+		std::vector<unsigned char> assigned;
+	};
+
+	// A vertex that needs a second normal, it gets copied onto the end of the vertex buffer
+	struct Split
+	{
+		unsigned int vertex;
+		float normal[3];
+	};
+
+	// The hash is kept next to the vertex so most probes don't have to look at the position
+	struct WeldSlot
+	{
+		WeldSlot() : hash(0), vertex(noVertex) {}
+
+		uint32_t hash;
+		unsigned int vertex;
+	};
+
+	struct Remap
+	{
+		unsigned int corner;
+		unsigned int split;
+	};
+
+	// A slice of the vertices and of the triangles worked on by one thread
+	struct Chunk
+	{
+		Context *context;
+
+		// Also which bin it sums
+		unsigned int index;
+		size_t firstVertex;
+		size_t endVertex;
+		size_t firstTriangle;
+		size_t endTriangle;
+
+		// Weld partitions this chunk welds
+		unsigned int firstPartition;
+		unsigned int endPartition;
+
+		// How many of the vertex range's vertices fall in each weld partition,
+		// then where the next of them goes in Context::partitioned
+		std::vector<size_t> partitionOffsets;
+
+		// Corners of this chunk's triangles, by the chunk whose vertex range their position falls in
+		std::vector<std::vector<unsigned int>> bins;
+
+		// With creases, the corners around each position in the vertex range, offsets are from firstVertex
+		std::vector<unsigned int> cornerOffsets;
+		std::vector<unsigned int> corners;
+
+		// Splits are numbered per chunk, they are put in place once every chunk is done
+		std::vector<Split> splits;
+		std::vector<Remap> remaps;
+
+		// Normals at each corner around the current position
+		std::vector<float> scratch;
+	};
+
+	// -0 and +0 are the same position, compare the bits so NaNs weld too
+	inline void PositionKey(const float *position, uint32_t key[3])
+	{
+		for (int k = 0; k < 3; ++k)
+		{
+			float value = position[k] + 0.0f;
+			memcpy(&key[k], &value, sizeof(value));
+		}
+	}
+
+	inline uint32_t HashPosition(const uint32_t key[3])
+	{
+		uint64_t hash = key[0] * 0x9E3779B97F4A7C15ull;
+		hash ^= (key[1] + 0x7F4A7C15ull) * 0xC2B2AE3D27D4EB4Full;
+		hash ^= (key[2] + 0x165667B1ull) * 0x165667B19E3779F9ull;
+		hash ^= hash >> 29;
+		return static_cast<uint32_t>(hash ^ (hash >> 32));
+	}
+
+	// The top bits pick the partition, the table inside it uses the low bits
+	inline unsigned int Partition(uint32_t hash, unsigned int partitionCount)
+	{
+		return static_cast<unsigned int>((static_cast<uint64_t>(hash) * partitionCount) >> 32);
+	}
+
+	inline float AcosApproximation(float x)
+	{
+		float a = std::fabs(x);
+		float angle = std::sqrt(1.0f - a) * (acos0 + a * (acos1 + a * (acos2 + a * acos3)));
+		return x < 0.0f ? pi - angle : angle;
+	}
+
+	inline float Dot(const float *a, const float *b)
+	{
+		return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+	}
+
+	inline void Normalize(float *n)
+	{
+		float length = std::sqrt(Dot(n, n));
+		if (length > 0.0f)
+		{
+			n[0] /= length;
+			n[1] /= length;
+			n[2] /= length;
+		}
+	}
+
+	inline float Clamp(float cosine)
+	{
+		return std::max(-1.0f, std::min(1.0f, cosine));
+	}
+
+	// Face stage -----------------------------------------------------------------
+	// Every kernel does the same operations in the same order, so they all produce the same bits
+
+	void FaceScalar(Context &context, size_t triangle)
+	{
+		const unsigned int *corners = &context.indices[triangle * 3];
+		const float *p0 = &context.vertices[static_cast<size_t>(corners[0]) * Model::vertexStride];
+		const float *p1 = &context.vertices[static_cast<size_t>(corners[1]) * Model::vertexStride];
+		const float *p2 = &context.vertices[static_cast<size_t>(corners[2]) * Model::vertexStride];
+
+		float e01[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+		float e02[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+		float e12[3] = { p2[0] - p1[0], p2[1] - p1[1], p2[2] - p1[2] };
+
+		float cross[3] = { e01[1] * e02[2] - e01[2] * e02[1], e01[2] * e02[0] - e01[0] * e02[2], e01[0] * e02[1] - e01[1] * e02[0] };
+		float length = std::sqrt(Dot(cross, cross));
+
+		float *face = &context.faces[triangle * faceStride];
+		if (!(length > 0.0f))
+		{
+			// Degenerate, adds nothing anywhere
+			memset(face, 0, faceStride * sizeof(float));
+			return;
+		}
+
+		face[0] = cross[0] / length;
+		face[1] = cross[1] / length;
+		face[2] = cross[2] / length;
+
+		float l01 = Dot(e01, e01);
+		float l02 = Dot(e02, e02);
+		float l12 = Dot(e12, e12);
+		float angles[3] =
+		{
+			AcosApproximation(Clamp(Dot(e01, e02) / std::sqrt(l01 * l02))),
+			AcosApproximation(Clamp(-Dot(e01, e12) / std::sqrt(l01 * l12))),
+			AcosApproximation(Clamp(Dot(e02, e12) / std::sqrt(l02 * l12)))
+		};
+
+		for (int k = 0; k < 3; ++k)
+		{
+			face[3 + k] = context.weighting == NormalGenerator::WeightArea ? length :
+				context.weighting == NormalGenerator::WeightAngle ? angles[k] : length * angles[k];
+		}
+	}
+
+	// SSE2, 4 triangles at a time -------------------------------------------------
+	// There is no gather, the corners are loaded one float at a time
+
+	inline __m128 DotSSE2(const __m128 *a, const __m128 *b)
+	{
+		return _mm_add_ps(_mm_add_ps(_mm_mul_ps(a[0], b[0]), _mm_mul_ps(a[1], b[1])), _mm_mul_ps(a[2], b[2]));
+	}
+
+	inline __m128 AcosSSE2(__m128 x)
+	{
+		const __m128 signBit = _mm_set1_ps(-0.0f);
+		__m128 a = _mm_andnot_ps(signBit, x);
+		__m128 polynomial = _mm_add_ps(_mm_set1_ps(acos2), _mm_mul_ps(a, _mm_set1_ps(acos3)));
+		polynomial = _mm_add_ps(_mm_set1_ps(acos1), _mm_mul_ps(a, polynomial));
+		polynomial = _mm_add_ps(_mm_set1_ps(acos0), _mm_mul_ps(a, polynomial));
+		__m128 angle = _mm_mul_ps(_mm_sqrt_ps(_mm_sub_ps(_mm_set1_ps(1.0f), a)), polynomial);
+		__m128 negative = _mm_cmplt_ps(x, _mm_setzero_ps());
+		return _mm_or_ps(_mm_and_ps(negative, _mm_sub_ps(_mm_set1_ps(pi), angle)), _mm_andnot_ps(negative, angle));
+	}
+
+	inline __m128 ClampSSE2(__m128 cosine)
+	{
+		return _mm_max_ps(_mm_set1_ps(-1.0f), _mm_min_ps(_mm_set1_ps(1.0f), cosine));
+	}
+
+	inline __m128 SelectWeightSSE2(NormalGenerator::Weighting weighting, __m128 length, __m128 angle)
+	{
+		return weighting == NormalGenerator::WeightArea ? length : weighting == NormalGenerator::WeightAngle ? angle : _mm_mul_ps(length, angle);
+	}
+
+	void FacesSSE2(Context &context, size_t triangle)
+	{
+		const float *vertices = context.vertices;
+		const unsigned int *indices = &context.indices[triangle * 3];
+
+		__m128 p[3][3];
+		for (int corner = 0; corner < 3; ++corner)
+		{
+			const float *v0 = &vertices[static_cast<size_t>(indices[corner]) * Model::vertexStride];
+			const float *v1 = &vertices[static_cast<size_t>(indices[3 + corner]) * Model::vertexStride];
+			const float *v2 = &vertices[static_cast<size_t>(indices[6 + corner]) * Model::vertexStride];
+			const float *v3 = &vertices[static_cast<size_t>(indices[9 + corner]) * Model::vertexStride];
+			for (int k = 0; k < 3; ++k)
+			{
+				p[corner][k] = _mm_setr_ps(v0[k], v1[k], v2[k], v3[k]);
+			}
+		}
+
+		__m128 e01[3], e02[3], e12[3];
+		for (int k = 0; k < 3; ++k)
+		{
+			e01[k] = _mm_sub_ps(p[1][k], p[0][k]);
+			e02[k] = _mm_sub_ps(p[2][k], p[0][k]);
+			e12[k] = _mm_sub_ps(p[2][k], p[1][k]);
+		}
+
+		__m128 cross[3] =
+		{
+			_mm_sub_ps(_mm_mul_ps(e01[1], e02[2]), _mm_mul_ps(e01[2], e02[1])),
+			_mm_sub_ps(_mm_mul_ps(e01[2], e02[0]), _mm_mul_ps(e01[0], e02[2])),
+			_mm_sub_ps(_mm_mul_ps(e01[0], e02[1]), _mm_mul_ps(e01[1], e02[0]))
+		};
+		__m128 length = _mm_sqrt_ps(DotSSE2(cross, cross));
+
+		// Degenerate lanes divide by zero here, the mask turns them into zeroes
+		__m128 valid = _mm_cmpgt_ps(length, _mm_setzero_ps());
+
+		__m128 l01 = DotSSE2(e01, e01);
+		__m128 l02 = DotSSE2(e02, e02);
+		__m128 l12 = DotSSE2(e12, e12);
+		__m128 angle0 = AcosSSE2(ClampSSE2(_mm_div_ps(DotSSE2(e01, e02), _mm_sqrt_ps(_mm_mul_ps(l01, l02)))));
+		__m128 angle1 = AcosSSE2(ClampSSE2(_mm_div_ps(_mm_xor_ps(DotSSE2(e01, e12), _mm_set1_ps(-0.0f)), _mm_sqrt_ps(_mm_mul_ps(l01, l12)))));
+		__m128 angle2 = AcosSSE2(ClampSSE2(_mm_div_ps(DotSSE2(e02, e12), _mm_sqrt_ps(_mm_mul_ps(l02, l12)))));
+
+		__m128 results[faceStride] =
+		{
+			_mm_and_ps(valid, _mm_div_ps(cross[0], length)),
+			_mm_and_ps(valid, _mm_div_ps(cross[1], length)),
+			_mm_and_ps(valid, _mm_div_ps(cross[2], length)),
+			_mm_and_ps(valid, SelectWeightSSE2(context.weighting, length, angle0)),
+			_mm_and_ps(valid, SelectWeightSSE2(context.weighting, length, angle1)),
+			_mm_and_ps(valid, SelectWeightSSE2(context.weighting, length, angle2))
+		};
+
+		// Back to one triangle after another
+		float lanes[faceStride][4];
+		for (size_t k = 0; k < faceStride; ++k)
+		{
+			_mm_storeu_ps(lanes[k], results[k]);
+		}
+
+		float *face = &context.faces[triangle * faceStride];
+		for (size_t i = 0; i < 4; ++i)
+		{
+			for (size_t k = 0; k < faceStride; ++k)
+			{
+				face[i * faceStride + k] = lanes[k][i];
+			}
+		}
+	}
+
+	// AVX2, 8 triangles at a time --------------------------------------------------
+	// Indices and positions are gathered, offsets are 32 bit so very large vertex buffers stay on SSE2
+
+	inline __m256 DotAVX2(const __m256 *a, const __m256 *b)
+	{
+		return _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(a[0], b[0]), _mm256_mul_ps(a[1], b[1])), _mm256_mul_ps(a[2], b[2]));
+	}
+
+	inline __m256 AcosAVX2(__m256 x)
+	{
+		const __m256 signBit = _mm256_set1_ps(-0.0f);
+		__m256 a = _mm256_andnot_ps(signBit, x);
+		__m256 polynomial = _mm256_add_ps(_mm256_set1_ps(acos2), _mm256_mul_ps(a, _mm256_set1_ps(acos3)));
+		polynomial = _mm256_add_ps(_mm256_set1_ps(acos1), _mm256_mul_ps(a, polynomial));
+		polynomial = _mm256_add_ps(_mm256_set1_ps(acos0), _mm256_mul_ps(a, polynomial));
+		__m256 angle = _mm256_mul_ps(_mm256_sqrt_ps(_mm256_sub_ps(_mm256_set1_ps(1.0f), a)), polynomial);
+		__m256 negative = _mm256_cmp_ps(x, _mm256_setzero_ps(), _CMP_LT_OQ);
+		return _mm256_blendv_ps(angle, _mm256_sub_ps(_mm256_set1_ps(pi), angle), negative);
+	}
+
+	inline __m256 ClampAVX2(__m256 cosine)
+	{
+		return _mm256_max_ps(_mm256_set1_ps(-1.0f), _mm256_min_ps(_mm256_set1_ps(1.0f), cosine));
+	}
+
+	inline __m256 SelectWeightAVX2(NormalGenerator::Weighting weighting, __m256 length, __m256 angle)
+	{
+		return weighting == NormalGenerator::WeightArea ? length : weighting == NormalGenerator::WeightAngle ? angle : _mm256_mul_ps(length, angle);
+	}
+
+	void FacesAVX2(Context &context, size_t triangle)
+	{
+		const int *indices = reinterpret_cast<const int *>(&context.indices[triangle * 3]);
+		const __m256i cornerOffsets = _mm256_setr_epi32(0, 3, 6, 9, 12, 15, 18, 21);
+
+		__m256 p[3][3];
+		for (int corner = 0; corner < 3; ++corner)
+		{
+			// Index times the vertex stride of 6
+			__m256i index = _mm256_i32gather_epi32(indices + corner, cornerOffsets, 4);
+			__m256i offset = _mm256_add_epi32(_mm256_slli_epi32(index, 2), _mm256_slli_epi32(index, 1));
+			for (int k = 0; k < 3; ++k)
+			{
+				p[corner][k] = _mm256_i32gather_ps(context.vertices + k, offset, 4);
+			}
+		}
+
+		__m256 e01[3], e02[3], e12[3];
+		for (int k = 0; k < 3; ++k)
+		{
+			e01[k] = _mm256_sub_ps(p[1][k], p[0][k]);
+			e02[k] = _mm256_sub_ps(p[2][k], p[0][k]);
+			e12[k] = _mm256_sub_ps(p[2][k], p[1][k]);
+		}
+
+		__m256 cross[3] =
+		{
+			_mm256_sub_ps(_mm256_mul_ps(e01[1], e02[2]), _mm256_mul_ps(e01[2], e02[1])),
+			_mm256_sub_ps(_mm256_mul_ps(e01[2], e02[0]), _mm256_mul_ps(e01[0], e02[2])),
+			_mm256_sub_ps(_mm256_mul_ps(e01[0], e02[1]), _mm256_mul_ps(e01[1], e02[0]))
+		};
+		__m256 length = _mm256_sqrt_ps(DotAVX2(cross, cross));
+		__m256 valid = _mm256_cmp_ps(length, _mm256_setzero_ps(), _CMP_GT_OQ);
+
+		__m256 l01 = DotAVX2(e01, e01);
+		__m256 l02 = DotAVX2(e02, e02);
+		__m256 l12 = DotAVX2(e12, e12);
+		__m256 angle0 = AcosAVX2(ClampAVX2(_mm256_div_ps(DotAVX2(e01, e02), _mm256_sqrt_ps(_mm256_mul_ps(l01, l02)))));
+		__m256 angle1 = AcosAVX2(ClampAVX2(_mm256_div_ps(_mm256_xor_ps(DotAVX2(e01, e12), _mm256_set1_ps(-0.0f)), _mm256_sqrt_ps(_mm256_mul_ps(l01, l12)))));
+		__m256 angle2 = AcosAVX2(ClampAVX2(_mm256_div_ps(DotAVX2(e02, e12), _mm256_sqrt_ps(_mm256_mul_ps(l02, l12)))));
+
+		__m256 results[faceStride] =
+		{
+			_mm256_and_ps(valid, _mm256_div_ps(cross[0], length)),
+			_mm256_and_ps(valid, _mm256_div_ps(cross[1], length)),
+			_mm256_and_ps(valid, _mm256_div_ps(cross[2], length)),
+			_mm256_and_ps(valid, SelectWeightAVX2(context.weighting, length, angle0)),
+			_mm256_and_ps(valid, SelectWeightAVX2(context.weighting, length, angle1)),
+			_mm256_and_ps(valid, SelectWeightAVX2(context.weighting, length, angle2))
+		};
+
+		float lanes[faceStride][8];
+		for (size_t k = 0; k < faceStride; ++k)
+		{
+			_mm256_storeu_ps(lanes[k], results[k]);
+		}
+
+		float *face = &context.faces[triangle * faceStride];
+		for (size_t i = 0; i < 8; ++i)
+		{
+			for (size_t k = 0; k < faceStride; ++k)
+			{
+				face[i * faceStride + k] = lanes[k][i];
+			}
+		}
+	}
+
+	// Stages -----------------------------------------------------------------------
+
+	VOID CALLBACK HashCallback(PTP_CALLBACK_INSTANCE instance, PVOID parameter, PTP_WORK work)
+	{
+		Chunk *chunk = static_cast<Chunk *>(parameter);
+		Context &context = *chunk->context;
+		chunk->partitionOffsets.assign(context.partitionCount, 0);
+		for (size_t v = chunk->firstVertex; v < chunk->endVertex; ++v)
+		{
+			uint32_t key[3];
+			PositionKey(&context.vertices[v * Model::vertexStride], key);
+			uint32_t hash = HashPosition(key);
+			context.hashes[v] = hash;
+			++chunk->partitionOffsets[Partition(hash, context.partitionCount)];
+		}
+		UNREFERENCED_PARAMETER(instance);
+		UNREFERENCED_PARAMETER(work);
+	}
+
+	// Scatter the vertex range into the weld partitions, Generate already turned the counts into offsets
+	VOID CALLBACK PartitionCallback(PTP_CALLBACK_INSTANCE instance, PVOID parameter, PTP_WORK work)
+	{
+		Chunk *chunk = static_cast<Chunk *>(parameter);
+		Context &context = *chunk->context;
+		for (size_t v = chunk->firstVertex; v < chunk->endVertex; ++v)
+		{
+			uint32_t hash = context.hashes[v];
+			WeldEntry &entry = context.partitioned[chunk->partitionOffsets[Partition(hash, context.partitionCount)]++];
+			entry.hash = hash;
+			entry.vertex = static_cast<unsigned int>(v);
+		}
+		UNREFERENCED_PARAMETER(instance);
+		UNREFERENCED_PARAMETER(work);
+	}
+
+	// Each chunk welds only its own partitions, whose vertices are in vertex order,
+	// so every position maps to its first vertex however the work is split
+	VOID CALLBACK WeldCallback(PTP_CALLBACK_INSTANCE instance, PVOID parameter, PTP_WORK work)
+	{
+		Chunk *chunk = static_cast<Chunk *>(parameter);
+		Context &context = *chunk->context;
+
+		std::vector<WeldSlot> table;
+		for (unsigned int partition = chunk->firstPartition; partition < chunk->endPartition; ++partition)
+		{
+			size_t first = context.partitionStarts[partition];
+			size_t end = context.partitionStarts[partition + 1];
+
+			size_t capacity = 16;
+			while (capacity < (end - first) * 2)
+			{
+				capacity <<= 1;
+			}
+			table.assign(capacity, WeldSlot());
+			size_t mask = capacity - 1;
+
+			for (size_t i = first; i < end; ++i)
+			{
+				unsigned int v = context.partitioned[i].vertex;
+				uint32_t hash = context.partitioned[i].hash;
+				for (size_t slot = hash & mask;; slot = (slot + 1) & mask)
+				{
+					WeldSlot &entry = table[slot];
+					if (entry.vertex == noVertex)
+					{
+						entry.hash = hash;
+						entry.vertex = v;
+						context.positions[v] = v;
+						break;
+					}
+
+					if (entry.hash != hash)
+					{
+						continue;
+					}
+
+					uint32_t key[3];
+					uint32_t otherKey[3];
+					PositionKey(&context.vertices[static_cast<size_t>(v) * Model::vertexStride], key);
+					PositionKey(&context.vertices[static_cast<size_t>(entry.vertex) * Model::vertexStride], otherKey);
+					if (memcmp(key, otherKey, sizeof(key)) == 0)
+					{
+						context.positions[v] = entry.vertex;
+						break;
+					}
+				}
+			}
+		}
+		UNREFERENCED_PARAMETER(instance);
+		UNREFERENCED_PARAMETER(work);
+	}
+
+	VOID CALLBACK FaceCallback(PTP_CALLBACK_INSTANCE instance, PVOID parameter, PTP_WORK work)
+	{
+		Chunk *chunk = static_cast<Chunk *>(parameter);
+		Context &context = *chunk->context;
+
+		size_t triangle = chunk->firstTriangle;
+		if (context.kernel == TextScanner::KernelAVX2)
+		{
+			for (; chunk->endTriangle - triangle >= 8; triangle += 8)
+			{
+				FacesAVX2(context, triangle);
+			}
+		}
+		if (context.kernel != TextScanner::KernelScalar)
+		{
+			for (; chunk->endTriangle - triangle >= 4; triangle += 4)
+			{
+				FacesSSE2(context, triangle);
+			}
+		}
+		for (; triangle < chunk->endTriangle; ++triangle)
+		{
+			FaceScalar(context, triangle);
+		}
+		UNREFERENCED_PARAMETER(instance);
+		UNREFERENCED_PARAMETER(work);
+	}
+
+	// Inverse of the vertex ranges handed out in Generate
+	inline size_t Owner(const Context &context, size_t vertex)
+	{
+		return static_cast<size_t>(((static_cast<uint64_t>(vertex) + 1) * context.chunkCount - 1) / context.vertexCount);
+	}
+
+	// Sort the corners by who owns their position, so no two threads ever add to the same normal
+	VOID CALLBACK BinCallback(PTP_CALLBACK_INSTANCE instance, PVOID parameter, PTP_WORK work)
+	{
+		Chunk *chunk = static_cast<Chunk *>(parameter);
+		const Context &context = *chunk->context;
+
+		// A single chunk owns every corner, VisitOwnedCorners walks them in place
+		if (context.chunkCount == 1)
+		{
+			return;
+		}
+
+		// Meshes usually have enough locality that most corners stay with their own chunk,
+		// which makes checking the chunk's own range first cheaper than working out the owner every time
+		chunk->bins.resize(context.chunkCount);
+		chunk->bins[chunk->index].reserve((chunk->endTriangle - chunk->firstTriangle) * 3);
+
+		for (size_t corner = chunk->firstTriangle * 3; corner < chunk->endTriangle * 3; ++corner)
+		{
+			size_t position = context.positions[context.indices[corner]];
+			size_t owner = position >= chunk->firstVertex && position < chunk->endVertex ? chunk->index : Owner(context, position);
+			chunk->bins[owner].push_back(static_cast<unsigned int>(corner));
+		}
+		UNREFERENCED_PARAMETER(instance);
+		UNREFERENCED_PARAMETER(work);
+	}
+
+	// Corners whose position the chunk owns, in corner order
+	template <typename Visitor>
+	inline void VisitOwnedCorners(const Context &context, const Chunk &chunk, Visitor visit)
+	{
+		if (context.chunkCount == 1)
+		{
+			for (size_t corner = 0; corner < context.triangleCount * 3; ++corner)
+			{
+				visit(static_cast<unsigned int>(corner));
+			}
+			return;
+		}
+
+		for (unsigned int i = 0; i < context.chunkCount; ++i)
+		{
+			const std::vector<unsigned int> &bin = context.chunks[i].bins[chunk.index];
+			for (size_t j = 0; j < bin.size(); ++j)
+			{
+				visit(bin[j]);
+			}
+		}
+	}
+
+	// Sum of the weighted face normals at these corners, only counting faces within the crease angle of normal
+	// Pass NULL for normal to take them all
+	void SumCorners(const Context &context, const unsigned int *corners, size_t count, const float *normal, float *sum)
+	{
+		sum[0] = sum[1] = sum[2] = 0.0f;
+		for (size_t i = 0; i < count; ++i)
+		{
+			const float *face = &context.faces[(corners[i] / 3) * faceStride];
+			if (normal != NULL && Dot(normal, face) < context.creaseCosine)
+			{
+				continue;
+			}
+
+			float weight = face[3 + corners[i] % 3];
+			sum[0] += face[0] * weight;
+			sum[1] += face[1] * weight;
+			sum[2] += face[2] * weight;
+		}
+		Normalize(sum);
+	}
+
+	// Give the vertex at a corner a normal, or split it off if it already has a different one
+	void AssignCorner(Chunk &chunk, unsigned int corner, const float *normal, size_t firstSplit)
+	{
+		Context &context = *chunk.context;
+		unsigned int vertex = context.indices[corner];
+		float *current = &context.normals[static_cast<size_t>(vertex) * 3];
+
+		if (!context.assigned[vertex])
+		{
+			memcpy(current, normal, 3 * sizeof(float));
+			context.assigned[vertex] = 1;
+			return;
+		}
+
+		if (memcmp(current, normal, 3 * sizeof(float)) == 0)
+		{
+			return;
+		}
+
+		// Splits only ever match corners around the same position
+		size_t split = firstSplit;
+		while (split < chunk.splits.size() && (chunk.splits[split].vertex != vertex || memcmp(chunk.splits[split].normal, normal, 3 * sizeof(float)) != 0))
+		{
+			++split;
+		}
+
+		if (split == chunk.splits.size())
+		{
+			Split added;
+			added.vertex = vertex;
+			memcpy(added.normal, normal, sizeof(added.normal));
+			chunk.splits.push_back(added);
+		}
+
+		Remap remap = { corner, static_cast<unsigned int>(split) };
+		chunk.remaps.push_back(remap);
+	}
+
+	// Add every weighted face normal to its position, in corner order however the work was split
+	VOID CALLBACK AccumulateCallback(PTP_CALLBACK_INSTANCE instance, PVOID parameter, PTP_WORK work)
+	{
+		Chunk *chunk = static_cast<Chunk *>(parameter);
+		Context &context = *chunk->context;
+
+		VisitOwnedCorners(context, *chunk, [&context](unsigned int corner)
+		{
+			const float *face = &context.faces[(corner / 3) * faceStride];
+			float weight = face[3 + corner % 3];
+			float *normal = &context.normals[static_cast<size_t>(context.positions[context.indices[corner]]) * 3];
+			normal[0] += face[0] * weight;
+			normal[1] += face[1] * weight;
+			normal[2] += face[2] * weight;
+		});
+
+		for (size_t v = chunk->firstVertex; v < chunk->endVertex; ++v)
+		{
+			Normalize(&context.normals[v * 3]);
+		}
+		UNREFERENCED_PARAMETER(instance);
+		UNREFERENCED_PARAMETER(work);
+	}
+
+	// With creases, most positions still have every face within half the crease angle of the accumulated average,
+	// so within the crease angle of each other. Each corner would sum all of them in corner order, which is the average itself
+	// Only the other positions need every corner to see the others, so group those corners first
+	VOID CALLBACK GatherCallback(PTP_CALLBACK_INSTANCE instance, PVOID parameter, PTP_WORK work)
+	{
+		Chunk *chunk = static_cast<Chunk *>(parameter);
+		Context &context = *chunk->context;
+
+		VisitOwnedCorners(context, *chunk, [&context](unsigned int corner)
+		{
+			size_t position = context.positions[context.indices[corner]];
+			if (Dot(&context.normals[position * 3], &context.faces[(corner / 3) * faceStride]) < context.smoothCosine)
+			{
+				context.creased[position] = 1;
+			}
+		});
+
+		std::vector<unsigned int> &offsets = chunk->cornerOffsets;
+		offsets.assign(chunk->endVertex - chunk->firstVertex + 1, 0);
+		size_t firstVertex = chunk->firstVertex;
+		VisitOwnedCorners(context, *chunk, [&context, &offsets, firstVertex](unsigned int corner)
+		{
+			size_t position = context.positions[context.indices[corner]];
+			if (context.creased[position])
+			{
+				++offsets[position - firstVertex + 1];
+			}
+		});
+		for (size_t v = 1; v < offsets.size(); ++v)
+		{
+			offsets[v] += offsets[v - 1];
+		}
+
+		// Visited in corner order, so each position's list comes out sorted
+		chunk->corners.resize(offsets.back());
+		std::vector<unsigned int> &sorted = chunk->corners;
+		VisitOwnedCorners(context, *chunk, [&context, &offsets, &sorted, firstVertex](unsigned int corner)
+		{
+			size_t position = context.positions[context.indices[corner]];
+			if (context.creased[position])
+			{
+				sorted[offsets[position - firstVertex]++] = corner;
+			}
+		});
+
+		// Filling moved each offset up to where the next position starts
+		for (size_t v = chunk->firstVertex; v < chunk->endVertex; ++v)
+		{
+			size_t first = v > chunk->firstVertex ? offsets[v - chunk->firstVertex - 1] : 0;
+			size_t count = offsets[v - chunk->firstVertex] - first;
+			if (count == 0)
+			{
+				continue;
+			}
+			const unsigned int *corners = &chunk->corners[first];
+
+			// Each corner smooths over the faces within the crease angle of its own
+			// Corners with the same set of faces add them up in the same order, so their normals match exactly
+			chunk->scratch.resize(count * 3);
+			for (size_t i = 0; i < count; ++i)
+			{
+				const float *face = &context.faces[(corners[i] / 3) * faceStride];
+				SumCorners(context, corners, count, face, &chunk->scratch[i * 3]);
+			}
+
+			// Degenerate faces have no say, their vertices only use the plain average if nothing else claimed them
+			size_t firstSplit = chunk->splits.size();
+			for (size_t i = 0; i < count; ++i)
+			{
+				const float *face = &context.faces[(corners[i] / 3) * faceStride];
+				if (face[0] != 0.0f || face[1] != 0.0f || face[2] != 0.0f)
+				{
+					AssignCorner(*chunk, corners[i], &chunk->scratch[i * 3], firstSplit);
+				}
+			}
+			for (size_t i = 0; i < count; ++i)
+			{
+				unsigned int vertex = context.indices[corners[i]];
+				if (!context.assigned[vertex])
+				{
+					SumCorners(context, corners, count, NULL, &context.normals[static_cast<size_t>(vertex) * 3]);
+					context.assigned[vertex] = 1;
+				}
+			}
+		}
+		UNREFERENCED_PARAMETER(instance);
+		UNREFERENCED_PARAMETER(work);
+	}
+
+	// Vertices take the normal of their position, unless it was creased and they got their own
+	VOID CALLBACK CopyCallback(PTP_CALLBACK_INSTANCE instance, PVOID parameter, PTP_WORK work)
+	{
+		Chunk *chunk = static_cast<Chunk *>(parameter);
+		Context &context = *chunk->context;
+		for (size_t v = chunk->firstVertex; v < chunk->endVertex; ++v)
+		{
+			size_t position = context.positions[v];
+			if (position != v && (!context.crease || !context.creased[position]))
+			{
+				memcpy(&context.normals[v * 3], &context.normals[position * 3], 3 * sizeof(float));
+			}
+		}
+		UNREFERENCED_PARAMETER(instance);
+		UNREFERENCED_PARAMETER(work);
+	}
+
+	// Same as the .obj loader, the calling thread takes the last chunk
+	void RunChunks(PTP_WORK_CALLBACK callback, std::vector<Chunk> &chunks)
+	{
+		std::vector<PTP_WORK> works(chunks.size() - 1);
+		for (size_t i = 0; i < works.size(); ++i)
+		{
+			works[i] = CreateThreadpoolWork(callback, &chunks[i], NULL);
+			SubmitThreadpoolWork(works[i]);
+		}
+
+		callback(NULL, &chunks.back(), NULL);
+
+		for (size_t i = 0; i < works.size(); ++i)
+		{
+			WaitForThreadpoolWorkCallbacks(works[i], FALSE);
+			CloseThreadpoolWork(works[i]);
+		}
+	}
+}
+
+// Weld positions, compute every face's normal and corner weights, hand each corner to the chunk
+// owning its position, then sum each position's corners, all in parallel and without any locking
+void NormalGenerator::Generate(Model &model, const Settings &settings)
+{
+	size_t vertexCount = model.fileVertices.size() / Model::vertexStride;
+	size_t triangleCount = model.fileIndices.size() / 3;
+	model.fileNormals.assign(vertexCount * 3, 0.0f);
+	if (vertexCount == 0 || triangleCount == 0)
+	{
+		return;
+	}
+
+	// Zero threads means one per logical core
+	unsigned int threadCount = settings.threadCount;
+	if (threadCount == 0)
+	{
+		SYSTEM_INFO systemInfo;
+		GetSystemInfo(&systemInfo);
+		threadCount = systemInfo.dwNumberOfProcessors;
+	}
+
+	size_t chunkCount = triangleCount / minimumChunkTriangles;
+	chunkCount = std::max<size_t>(1, std::min<size_t>(chunkCount, threadCount));
+
+	Context context;
+	context.vertices = &model.fileVertices[0];
+	context.indices = &model.fileIndices[0];
+	context.vertexCount = vertexCount;
+	context.triangleCount = triangleCount;
+	context.weighting = settings.weighting;
+	context.crease = settings.creaseAngle < 180.0f;
+	context.creaseCosine = std::cos(std::max(0.0f, settings.creaseAngle) * degreesToRadians);
+	float smoothAngle = settings.creaseAngle * 0.5f - 0.5f;
+	context.smoothCosine = smoothAngle > 0.0f ? std::cos(smoothAngle * degreesToRadians) : 2.0f;
+	context.kernel = TextScanner::GetKernel();
+	context.chunkCount = static_cast<unsigned int>(chunkCount);
+	context.partitionCount = static_cast<unsigned int>(std::max(chunkCount, vertexCount / weldPartitionSize));
+	context.normals = &model.fileNormals[0];
+
+	if (context.kernel == TextScanner::KernelAVX2 && vertexCount * Model::vertexStride > INT_MAX)
+	{
+		context.kernel = TextScanner::KernelSSE2;
+	}
+
+	std::vector<Chunk> chunks(chunkCount);
+	for (size_t i = 0; i < chunkCount; ++i)
+	{
+		chunks[i].context = &context;
+		chunks[i].index = static_cast<unsigned int>(i);
+		chunks[i].firstVertex = vertexCount * i / chunkCount;
+		chunks[i].endVertex = vertexCount * (i + 1) / chunkCount;
+		chunks[i].firstTriangle = triangleCount * i / chunkCount;
+		chunks[i].endTriangle = triangleCount * (i + 1) / chunkCount;
+		chunks[i].firstPartition = static_cast<unsigned int>(context.partitionCount * i / chunkCount);
+		chunks[i].endPartition = static_cast<unsigned int>(context.partitionCount * (i + 1) / chunkCount);
+	}
+
+	// Hashing counts each chunk's vertices per partition, a partition takes them chunk by chunk so they stay in vertex order
+	context.hashes.resize(vertexCount);
+	context.positions.resize(vertexCount);
+	RunChunks(HashCallback, chunks);
+
+	context.partitionStarts.resize(context.partitionCount + 1);
+	size_t offset = 0;
+	for (unsigned int partition = 0; partition < context.partitionCount; ++partition)
+	{
+		context.partitionStarts[partition] = offset;
+		for (size_t i = 0; i < chunkCount; ++i)
+		{
+			size_t count = chunks[i].partitionOffsets[partition];
+			chunks[i].partitionOffsets[partition] = offset;
+			offset += count;
+		}
+	}
+	context.partitionStarts[context.partitionCount] = offset;
+
+	context.partitioned.resize(vertexCount);
+	RunChunks(PartitionCallback, chunks);
+	RunChunks(WeldCallback, chunks);
+	std::vector<uint32_t>().swap(context.hashes);
+	std::vector<WeldEntry>().swap(context.partitioned);
+
+	context.faces.resize(triangleCount * faceStride);
+	RunChunks(FaceCallback, chunks);
+
+	context.chunks = &chunks[0];
+	RunChunks(BinCallback, chunks);
+
+	RunChunks(AccumulateCallback, chunks);
+	if (!context.crease)
+	{
+		RunChunks(CopyCallback, chunks);
+		return;
+	}
+
+	// Creased positions are settled before the others are copied, copying only reads the smooth ones
+	context.creased.assign(vertexCount, 0);
+	context.assigned.assign(vertexCount, 0);
+	RunChunks(GatherCallback, chunks);
+	RunChunks(CopyCallback, chunks);
+
+	// Put the split vertices on the end in chunk order, which is position order
+	size_t splitCount = 0;
+	for (size_t i = 0; i < chunkCount; ++i)
+	{
+		splitCount += chunks[i].splits.size();
+	}
+	if (splitCount == 0)
+	{
+		return;
+	}
+
+	model.fileVertices.resize((vertexCount + splitCount) * Model::vertexStride);
+	model.fileNormals.resize((vertexCount + splitCount) * 3);
+
+	size_t next = vertexCount;
+	for (size_t i = 0; i < chunkCount; ++i)
+	{
+		const Chunk &chunk = chunks[i];
+		for (size_t j = 0; j < chunk.remaps.size(); ++j)
+		{
+			model.fileIndices[chunk.remaps[j].corner] = static_cast<unsigned int>(next + chunk.remaps[j].split);
+		}
+
+		for (size_t j = 0; j < chunk.splits.size(); ++j, ++next)
+		{
+			memcpy(&model.fileVertices[next * Model::vertexStride], &model.fileVertices[static_cast<size_t>(chunk.splits[j].vertex) * Model::vertexStride],
+				Model::vertexStride * sizeof(float));
+			memcpy(&model.fileNormals[next * 3], chunk.splits[j].normal, 3 * sizeof(float));
+		}
+	}
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <vector>
+#include "Model.h"
+
+// Smooth vertex normals for meshes that come without any
+// Each face adds its normal to the positions it touches, weighted by its area, its angle at the corner or both,
+// vertices sharing a position get the same normal even across uv seams
+// Faces are processed in parallel and the per face math is vectorized with the kernel TextScanner picked
+class NormalGenerator
+{
+public:
+	enum Weighting
+	{
+		// Big faces pull harder, cheapest, but long thin triangles skew the result
+		WeightArea,
+
+		// Angle of the face at the corner, independent of how the surface is tessellated
+		WeightAngle,
+
+		// Both multiplied together
+		WeightAreaAngle
+	};
+
+	struct Settings
+	{
+		Weighting weighting;
+
+		// Faces meeting at more than this many degrees keep a hard edge, 180 smooths everything
+		float creaseAngle;
+
+		// 0 uses one per logical core, small meshes are always done on the calling thread
+		unsigned int threadCount;
+
+		Settings() : weighting(WeightAngle), creaseAngle(180.0f), threadCount(0) {}
+	};
+
+	// Don't bother splitting fewer triangles than this across threads
+	static const size_t minimumChunkTriangles = 32 * 1024;
+
+	// Replaces Model::fileNormals, the result doesn't depend on the thread count or kernel
+	// Below 180 degrees a vertex whose corners end up with different normals is split,
+	// the copies go on the end of fileVertices and fileIndices is pointed at them
+	// Run before anything that depends on the vertex buffer, like optimizing, meshlets or lods
+	static void Generate(Model &model, const Settings &settings = Settings());
+};
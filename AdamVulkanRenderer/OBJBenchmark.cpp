@@ -0,0 +1,1638 @@
+#include "stdafx.h"
+#include "OBJBenchmark.h"
+#include "OBJFile.h"
+#include "MeshCache.h"
+#include "MeshCodec.h"
+#include "MeshOptimizer.h"
+#include "MeshletBuilder.h"
+#include "MeshSimplifier.h"
+#include "NormalGenerator.h"
+#include "VertexQuantizer.h"
+#include "MappedFile.h"
+#include "PPMFile.h"
+#include "DDSFile.h"
+#include "TextureCompressor.h"
+#include "TextScanner.h"
+#include "AllocationCounter.h"
+#include "ScratchArena.h"
+#include <psapi.h>
+#include <chrono>
+#include <charconv>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cfloat>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <functional>
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <utility>
+
+namespace
+{
+	// Returns false if the loader couldn't read the file
+	typedef std::function<bool(const std::string &fileName, std::vector<Model> &models)> LoadFunction;
+
+	// Minimal streaming JSON output, keys and values are written in order with commas and indents filled in
+	class JsonWriter
+	{
+	public:
+		JsonWriter() : m_first(true), m_depth(0)
+		{
+			m_stream << std::fixed << std::setprecision(3);
+		}
+
+		void BeginObject(const char *key = NULL) { Separator(key); m_stream << "{"; Open(); }
+		void EndObject() { Close(); m_stream << "}"; }
+		void BeginArray(const char *key = NULL) { Separator(key); m_stream << "["; Open(); }
+		void EndArray() { Close(); m_stream << "]"; }
+
+		void Value(const char *key, const std::string &value) { Separator(key); WriteString(value); }
+		void Value(const char *key, const char *value) { Separator(key); WriteString(value); }
+		void Value(const char *key, double value) { Separator(key); m_stream << value; }
+		void Value(const char *key, size_t value) { Separator(key); m_stream << value; }
+		void Value(const char *key, bool value) { Separator(key); m_stream << (value ? "true" : "false"); }
+
+		std::string String() const { return m_stream.str() + "\n"; }
+
+	private:
+		void Separator(const char *key)
+		{
+			if (m_depth > 0)
+			{
+				m_stream << (m_first ? "\n" : ",\n") << std::string(m_depth * 2, ' ');
+			}
+			m_first = false;
+
+			if (key != NULL)
+			{
+				WriteString(key);
+				m_stream << ": ";
+			}
+		}
+
+		void Open()
+		{
+			++m_depth;
+			m_first = true;
+		}
+
+		void Close()
+		{
+			--m_depth;
+			if (!m_first)
+			{
+				m_stream << "\n" << std::string(m_depth * 2, ' ');
+			}
+			m_first = false;
+		}
+
+		void WriteString(const std::string &value)
+		{
+			m_stream << '"';
+			for (size_t i = 0; i < value.size(); ++i)
+			{
+				if (value[i] == '"' || value[i] == '\\')
+				{
+					m_stream << '\\';
+				}
+				m_stream << value[i];
+			}
+			m_stream << '"';
+		}
+
+		std::ostringstream m_stream;
+		bool m_first;
+		int m_depth;
+	};
+
+	// 64 bit FNV-1a over everything a loader hands back, so any change to the output shows up
+	class Checksum
+	{
+	public:
+		Checksum() : m_hash(14695981039346656037ULL) {}
+
+		void Add(const void *data, size_t size)
+		{
+			const unsigned char *bytes = static_cast<const unsigned char *>(data);
+			for (size_t i = 0; i < size; ++i)
+			{
+				m_hash = (m_hash ^ bytes[i]) * 1099511628211ULL;
+			}
+		}
+
+		template <typename T>
+		void Add(const std::vector<T> &data)
+		{
+			uint64_t count = data.size();
+			Add(&count, sizeof(count));
+			if (!data.empty())
+			{
+				Add(data.data(), data.size() * sizeof(T));
+			}
+		}
+
+		void Add(const std::string &text)
+		{
+			uint64_t length = text.size();
+			Add(&length, sizeof(length));
+			Add(text.data(), text.size());
+		}
+
+		void Add(const Model &model)
+		{
+			Add(model.fileVertices);
+			Add(model.fileNormals);
+			Add(model.fileIndices);
+			Add(model.materialRanges);
+			for (size_t i = 0; i < model.materials.size(); ++i)
+			{
+				Add(model.materials[i].name);
+			}
+
+			// Only models built with meshlets, so the other loaders keep their checksums
+			if (!model.meshlets.empty())
+			{
+				Add(model.meshlets);
+				Add(model.meshletVertices);
+				Add(model.meshletTriangles);
+			}
+		}
+
+		std::string Hex() const
+		{
+			std::ostringstream text;
+			text << std::hex << std::setw(16) << std::setfill('0') << m_hash;
+			return text.str();
+		}
+
+	private:
+		uint64_t m_hash;
+	};
+
+	// Expected checksums keyed by file and output kind, one "key checksum" pair per line
+	// A key the file doesn't have fails like a mismatch, unless the run was asked to record it
+	class GoldenTable
+	{
+	public:
+		GoldenTable() : m_changed(false) {}
+
+		void Load(const std::string &fileName)
+		{
+			std::ifstream file(fileName.c_str());
+			std::string line;
+			while (std::getline(file, line))
+			{
+				std::istringstream fields(line);
+				std::string key;
+				std::string checksum;
+				if (line.empty() || line[0] == '#' || !(fields >> key >> checksum))
+				{
+					continue;
+				}
+				m_checksums[key] = checksum;
+			}
+		}
+
+		bool Save(const std::string &fileName) const
+		{
+			if (!m_changed)
+			{
+				return true;
+			}
+
+			std::ofstream file(fileName.c_str());
+			file << "# Expected loader output, written by OBJBenchmark -record\n";
+			file << "# Delete a line when its output is meant to change and run with -record to write the new checksum\n";
+			for (std::map<std::string, std::string>::const_iterator i = m_checksums.begin(); i != m_checksums.end(); ++i)
+			{
+				file << i->first << " " << i->second << "\n";
+			}
+			return file.good();
+		}
+
+		// Returns "match", "mismatch", "missing", or "recorded" for a missing key when record is set
+		const char *Check(const std::string &key, const std::string &checksum, bool record)
+		{
+			std::map<std::string, std::string>::iterator found = m_checksums.find(key);
+			if (found == m_checksums.end())
+			{
+				if (!record)
+				{
+					return "missing";
+				}
+				m_checksums[key] = checksum;
+				m_changed = true;
+				return "recorded";
+			}
+			return found->second == checksum ? "match" : "mismatch";
+		}
+
+	private:
+		std::map<std::string, std::string> m_checksums;
+		bool m_changed;
+	};
+
+	// Generated files and caches go here rather than next to the bundled assets
+	std::string TempDirectory()
+	{
+		char tempPath[MAX_PATH];
+		DWORD length = GetTempPathA(MAX_PATH, tempPath);
+		return length > 0 && length < MAX_PATH ? std::string(tempPath, length) : std::string();
+	}
+
+	size_t PeakWorkingSet()
+	{
+		PROCESS_MEMORY_COUNTERS counters;
+		if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		{
+			return 0;
+		}
+		return counters.PeakWorkingSetSize;
+	}
+
+	// One loader configuration to time
+	struct Loader
+	{
+		std::string name;
+
+		// Loaders producing the same output share a golden checksum
+		std::string output;
+
+		// Floats per vertex in fileVertices
+		unsigned int vertexStride;
+
+		// Set for loaders fast enough to run on the generated grids
+		bool scales;
+
+		LoadFunction load;
+	};
+
+	// Time a loader over a number of runs, keep the best and the average
+	// Memory and allocations are measured for the last run, the output is checksummed against the golden table
+	// A loader that fails or hands back no models fails the row without touching the table
+	bool TimeLoader(JsonWriter &json, GoldenTable &golden, bool record, const std::string &fileKey, const Loader &loader, const std::string &fileName, size_t fileBytes, int runs)
+	{
+		double best = 0.0;
+		double total = 0.0;
+		AllocationCounter::Stats allocations = {};
+		size_t vertexCount = 0;
+		size_t indexCount = 0;
+		size_t modelCount = 0;
+		bool loaded = true;
+		Checksum checksum;
+
+		for (int run = 0; run < runs; ++run)
+		{
+			std::vector<Model> models;
+			AllocationCounter::Reset();
+			std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+			loaded &= loader.load(fileName, models);
+			std::chrono::high_resolution_clock::time_point stop = std::chrono::high_resolution_clock::now();
+			allocations = AllocationCounter::Get();
+
+			double ms = std::chrono::duration<double, std::milli>(stop - start).count();
+			best = (run == 0 || ms < best) ? ms : best;
+			total += ms;
+
+			if (run + 1 == runs)
+			{
+				modelCount = models.size();
+				for (size_t i = 0; i < models.size(); ++i)
+				{
+					vertexCount += models[i].fileVertices.size() / loader.vertexStride;
+					indexCount += models[i].fileIndices.size();
+					checksum.Add(models[i]);
+				}
+			}
+		}
+
+		const char *status = !loaded ? "failed" : modelCount == 0 ? "empty" : golden.Check(fileKey + ":" + loader.output, checksum.Hex(), record);
+
+		json.BeginObject();
+		json.Value("name", loader.name);
+		json.Value("output", loader.output);
+		json.Value("runs", static_cast<size_t>(runs));
+		json.Value("bestMs", best);
+		json.Value("averageMs", total / runs);
+		json.Value("bytesPerSecond", best > 0.0 ? fileBytes / (best / 1000.0) : 0.0);
+		json.Value("peakRssBytes", PeakWorkingSet());
+		json.Value("peakHeapBytes", allocations.peakBytes);
+		json.Value("allocations", allocations.allocations);
+		json.Value("allocatedBytes", allocations.bytes);
+		json.Value("models", modelCount);
+		json.Value("vertices", vertexCount);
+		json.Value("indices", indexCount);
+		json.Value("checksum", checksum.Hex());
+		json.Value("golden", status);
+		json.EndObject();
+
+		return strcmp(status, "match") == 0 || strcmp(status, "recorded") == 0;
+	}
+
+	// Time one scanner or parser kernel over the same bytes a number of times, the result keeps the work from being optimized out
+	void TimeKernel(JsonWriter &json, const std::string &name, const std::function<size_t()> &kernel, size_t bytes, int runs)
+	{
+		double best = 0.0;
+		size_t result = 0;
+		for (int run = 0; run < runs; ++run)
+		{
+			std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+			result = kernel();
+			std::chrono::high_resolution_clock::time_point stop = std::chrono::high_resolution_clock::now();
+
+			double ms = std::chrono::duration<double, std::milli>(stop - start).count();
+			best = (run == 0 || ms < best) ? ms : best;
+		}
+
+		json.BeginObject();
+		json.Value("name", name);
+		json.Value("bestMs", best);
+		json.Value("bytesPerSecond", best > 0.0 ? bytes / (best / 1000.0) : 0.0);
+		json.Value("count", result);
+		json.EndObject();
+	}
+
+	// Bytes per second for each TextScanner kernel the CPU supports, plus the number parsers
+	void TimeScannerKernels(JsonWriter &json, const std::string &fileName, int runs)
+	{
+		MappedFile file;
+		if (!file.Open(fileName) || file.Size() == 0)
+		{
+			return;
+		}
+
+		const char *begin = file.Data();
+		const char *end = begin + file.Size();
+
+		// Pull out the numbers once up front so the parsers are timed on their own
+		std::vector<std::pair<const char *, const char *> > floats;
+		std::vector<std::pair<const char *, const char *> > ints;
+		size_t floatBytes = 0;
+		size_t intBytes = 0;
+		for (const char *line = begin; line < end;)
+		{
+			const char *lineEnd = std::find(line, end, '\n');
+			bool face = line[0] == 'f' && line + 1 < lineEnd && line[1] == ' ';
+			bool vertex = line[0] == 'v' && line + 1 < lineEnd && (line[1] == ' ' || line[1] == 'n' || line[1] == 't');
+
+			const char *token = std::find(line, lineEnd, ' ');
+			while ((face || vertex) && token < lineEnd)
+			{
+				while (token < lineEnd && (*token == ' ' || *token == '/' || *token == '\r'))
+				{
+					++token;
+				}
+
+				const char *tokenEnd = token;
+				while (tokenEnd < lineEnd && *tokenEnd != ' ' && *tokenEnd != '/' && *tokenEnd != '\r')
+				{
+					++tokenEnd;
+				}
+
+				if (tokenEnd > token)
+				{
+					(face ? ints : floats).push_back(std::make_pair(token, tokenEnd));
+					(face ? intBytes : floatBytes) += tokenEnd - token;
+				}
+				token = tokenEnd;
+			}
+			line = lineEnd + 1;
+		}
+
+		json.BeginArray("kernels");
+		TextScanner::Kernel detected = TextScanner::GetKernel();
+		for (int k = 0; k < TextScanner::KernelCount; ++k)
+		{
+			TextScanner::Kernel kernel = static_cast<TextScanner::Kernel>(k);
+			if (!TextScanner::IsSupported(kernel))
+			{
+				continue;
+			}
+			TextScanner::SetKernel(kernel);
+
+			TimeKernel(json, std::string("lines ") + TextScanner::KernelName(kernel), [begin, end]()
+			{
+				size_t lines = 0;
+				for (const char *cursor = begin; cursor < end; cursor = TextScanner::FindLineEnd(cursor, end) + 1)
+				{
+					++lines;
+				}
+				return lines;
+			}, file.Size(), runs);
+
+			TimeKernel(json, std::string("tokens ") + TextScanner::KernelName(kernel), [begin, end]()
+			{
+				size_t tokens = 0;
+				for (const char *cursor = begin; cursor < end;)
+				{
+					cursor = TextScanner::FindWhitespace(cursor, end);
+					while (cursor < end && (*cursor == ' ' || *cursor == '\t' || *cursor == '\r' || *cursor == '\n'))
+					{
+						++cursor;
+					}
+					++tokens;
+				}
+				return tokens;
+			}, file.Size(), runs);
+		}
+		TextScanner::SetKernel(detected);
+
+		TimeKernel(json, "float", [&floats]()
+		{
+			// Sum the bits so every parse has to happen
+			size_t sum = 0;
+			for (size_t i = 0; i < floats.size(); ++i)
+			{
+				float value = 0.0f;
+				TextScanner::ParseFloat(floats[i].first, floats[i].second, value);
+				sum += static_cast<size_t>(value != 0.0f);
+			}
+			return sum;
+		}, floatBytes, runs);
+
+		TimeKernel(json, "int", [&ints]()
+		{
+			size_t sum = 0;
+			for (size_t i = 0; i < ints.size(); ++i)
+			{
+				int value = 0;
+				TextScanner::ParseInt(ints[i].first, ints[i].second, value);
+				sum += value;
+			}
+			return sum;
+		}, intBytes, runs);
+		json.EndArray();
+	}
+
+	// Buffered text output for the generated meshes, numbers are formatted without locales or streams
+	class ObjWriter
+	{
+	public:
+		explicit ObjWriter(const std::string &fileName) : m_file(fileName.c_str(), std::ios::binary | std::ios::trunc), m_used(0)
+		{
+			m_buffer.resize(1 << 20);
+		}
+
+		~ObjWriter()
+		{
+			Flush();
+		}
+
+		bool Good() const { return m_file.good(); }
+
+		ObjWriter &operator<<(const char *text)
+		{
+			Reserve(strlen(text));
+			memcpy(&m_buffer[m_used], text, strlen(text));
+			m_used += strlen(text);
+			return *this;
+		}
+
+		ObjWriter &operator<<(size_t value)
+		{
+			Reserve(32);
+			m_used = std::to_chars(&m_buffer[m_used], &m_buffer[m_used] + 32, value).ptr - &m_buffer[0];
+			return *this;
+		}
+
+		ObjWriter &operator<<(float value)
+		{
+			Reserve(32);
+			m_used = std::to_chars(&m_buffer[m_used], &m_buffer[m_used] + 32, value).ptr - &m_buffer[0];
+			return *this;
+		}
+
+		void Flush()
+		{
+			m_file.write(m_buffer.data(), static_cast<std::streamsize>(m_used));
+			m_used = 0;
+		}
+
+	private:
+		void Reserve(size_t size)
+		{
+			if (m_used + size > m_buffer.size())
+			{
+				Flush();
+			}
+		}
+
+		std::ofstream m_file;
+		std::vector<char> m_buffer;
+		size_t m_used;
+	};
+
+	// Flat grid of quads split into triangles, with uvs, a shared normal, a few g groups and two materials
+	// Written to the temp directory the first time and reused after that, the content only depends on faces
+	std::string SyntheticFile(size_t faces)
+	{
+		static const size_t columns = 1000;
+		static const size_t groupCount = 8;
+
+		std::ostringstream name;
+		name << TempDirectory() << "synthetic_" << faces << ".obj";
+		if (GetFileAttributesA(name.str().c_str()) != INVALID_FILE_ATTRIBUTES)
+		{
+			return name.str();
+		}
+
+		size_t rows = (faces / 2 + columns - 1) / columns;
+		std::string tempName = name.str() + ".tmp";
+		{
+			ObjWriter obj(tempName);
+			obj << "# Generated by OBJBenchmark, " << rows * columns * 2 << " triangles\n";
+			for (size_t y = 0; y <= rows; ++y)
+			{
+				for (size_t x = 0; x <= columns; ++x)
+				{
+					obj << "v " << static_cast<float>(x) * 0.01f << " " << static_cast<float>(y) * 0.01f << " " << static_cast<float>((x * 7 + y * 13) % 17) * 0.001f << "\n";
+				}
+			}
+			for (size_t y = 0; y <= rows; ++y)
+			{
+				for (size_t x = 0; x <= columns; ++x)
+				{
+					obj << "vt " << static_cast<float>(x) / columns << " " << static_cast<float>(y) / rows << "\n";
+				}
+			}
+			obj << "vn 0 0 1\n";
+
+			size_t rowsPerGroup = (rows + groupCount - 1) / groupCount;
+			for (size_t y = 0; y < rows; ++y)
+			{
+				if (y % rowsPerGroup == 0)
+				{
+					obj << "g band" << y / rowsPerGroup << "\nusemtl " << ((y / rowsPerGroup) % 2 == 0 ? "even" : "odd") << "\n";
+				}
+
+				for (size_t x = 0; x < columns; ++x)
+				{
+					size_t corner = y * (columns + 1) + x + 1;
+					size_t above = corner + columns + 1;
+					obj << "f " << corner << "/" << corner << "/1 " << corner + 1 << "/" << corner + 1 << "/1 " << above + 1 << "/" << above + 1 << "/1\n";
+					obj << "f " << corner << "/" << corner << "/1 " << above + 1 << "/" << above + 1 << "/1 " << above << "/" << above << "/1\n";
+				}
+			}
+			obj.Flush();
+			if (!obj.Good())
+			{
+				DeleteFileA(tempName.c_str());
+				return std::string();
+			}
+		}
+
+		if (!MoveFileExA(tempName.c_str(), name.str().c_str(), MOVEFILE_REPLACE_EXISTING))
+		{
+			DeleteFileA(tempName.c_str());
+			return std::string();
+		}
+		return name.str();
+	}
+
+	// Every loader configuration worth comparing, add new loaders here
+	// cacheSettings is where the cache loader finds the caches BenchmarkFile brings up to date
+	std::vector<Loader> Loaders(const OBJFile::LoadSettings &cacheSettings)
+	{
+		std::vector<Loader> loaders;
+
+		// Its vertex dedup is quadratic, so it only gets the bundled files
+		Loader legacy = { "legacy", "legacy", 3, false, OBJFile::LoadFileLegacy };
+		loaders.push_back(legacy);
+
+		// Scale from one thread up to one per logical core
+		SYSTEM_INFO systemInfo;
+		GetSystemInfo(&systemInfo);
+		unsigned int coreCount = systemInfo.dwNumberOfProcessors;
+
+		std::vector<unsigned int> threadCounts;
+		for (unsigned int threads = 1; threads < coreCount; threads *= 2)
+		{
+			threadCounts.push_back(threads);
+		}
+		threadCounts.push_back(coreCount);
+
+		for (size_t i = 0; i < threadCounts.size(); ++i)
+		{
+			OBJFile::LoadSettings settings;
+			settings.threadCount = threadCounts[i];
+
+			std::ostringstream name;
+			name << "mapped x" << threadCounts[i];
+			Loader mapped = { name.str(), "groups", Model::vertexStride, true, [settings](const std::string &fileName, std::vector<Model> &models) { return OBJFile::LoadFile(fileName, models, settings); } };
+			loaders.push_back(mapped);
+		}
+
+		// Same as the first and last mapped loaders with the scratch arena kept between runs,
+		// the allocations of the last run show what a loader that's called again saves
+		for (size_t i = 0; i < threadCounts.size(); i += std::max<size_t>(threadCounts.size() - 1, 1))
+		{
+			OBJFile::LoadSettings settings;
+			settings.threadCount = threadCounts[i];
+			std::shared_ptr<ScratchArena> arena(new ScratchArena());
+			settings.arena = arena.get();
+
+			std::ostringstream name;
+			name << "mapped arena x" << threadCounts[i];
+			Loader reused = { name.str(), "groups", Model::vertexStride, true, [settings, arena](const std::string &fileName, std::vector<Model> &models) { return OBJFile::LoadFile(fileName, models, settings); } };
+			loaders.push_back(reused);
+		}
+
+		OBJFile::LoadSettings batchSettings;
+		batchSettings.threadCount = 0;
+		batchSettings.batchByMaterial = true;
+		Loader batched = { "batched", "batched", Model::vertexStride, true, [batchSettings](const std::string &fileName, std::vector<Model> &models) { return OBJFile::LoadFile(fileName, models, batchSettings); } };
+		loaders.push_back(batched);
+
+		OBJFile::LoadSettings optimizeSettings;
+		optimizeSettings.threadCount = 0;
+		optimizeSettings.optimizeMeshes = true;
+		Loader optimized = { "optimized", "optimized", Model::vertexStride, true, [optimizeSettings](const std::string &fileName, std::vector<Model> &models) { return OBJFile::LoadFile(fileName, models, optimizeSettings); } };
+		loaders.push_back(optimized);
+
+		OBJFile::LoadSettings meshletSettings = optimizeSettings;
+		meshletSettings.buildMeshlets = true;
+		Loader meshlets = { "meshlets", "meshlets", Model::vertexStride, true, [meshletSettings](const std::string &fileName, std::vector<Model> &models) { return OBJFile::LoadFile(fileName, models, meshletSettings); } };
+		loaders.push_back(meshlets);
+
+		// The cache is brought up to date before this one runs
+		Loader cache = { "cache", "groups", Model::vertexStride, true, [cacheSettings](const std::string &fileName, std::vector<Model> &models) { return MeshCache::Read(fileName, models, cacheSettings); } };
+		loaders.push_back(cache);
+
+		return loaders;
+	}
+
+	// Models are move only, analyses that compare several orders of the same models work on clones
+	std::vector<Model> CloneModels(const std::vector<Model> &models)
+	{
+		std::vector<Model> clones;
+		clones.reserve(models.size());
+		for (size_t i = 0; i < models.size(); ++i)
+		{
+			clones.push_back(models[i].Clone());
+		}
+		return clones;
+	}
+
+	// Post transform cache efficiency of the imported order and after MeshOptimizer, and what the optimization costs
+	void AnalyzeVertexCache(JsonWriter &json, const std::string &fileName)
+	{
+		static const unsigned int cacheSize = 16;
+
+		std::vector<Model> models;
+		OBJFile::LoadFile(fileName, models);
+
+		MeshOptimizer::CacheStats before = {};
+		MeshOptimizer::CacheStats after = {};
+		double ms = 0.0;
+		for (size_t i = 0; i < models.size(); ++i)
+		{
+			MeshOptimizer::CacheStats stats = MeshOptimizer::AnalyzeVertexCache(models[i], cacheSize);
+			before.triangles += stats.triangles;
+			before.vertices += stats.vertices;
+			before.misses += stats.misses;
+
+			std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+			MeshOptimizer::Optimize(models[i]);
+			std::chrono::high_resolution_clock::time_point stop = std::chrono::high_resolution_clock::now();
+			ms += std::chrono::duration<double, std::milli>(stop - start).count();
+
+			stats = MeshOptimizer::AnalyzeVertexCache(models[i], cacheSize);
+			after.triangles += stats.triangles;
+			after.vertices += stats.vertices;
+			after.misses += stats.misses;
+		}
+
+		json.BeginObject("vertexCache");
+		json.Value("cacheSize", static_cast<size_t>(cacheSize));
+		json.Value("acmrBefore", before.Acmr());
+		json.Value("atvrBefore", before.Atvr());
+		json.Value("acmrAfter", after.Acmr());
+		json.Value("atvrAfter", after.Atvr());
+		json.Value("optimizeMs", ms);
+		json.EndObject();
+	}
+
+	// Overdraw and cache efficiency averaged over the models for one triangle order
+	void WriteOverdrawOrder(JsonWriter &json, const char *name, const std::vector<Model> &models, double ms)
+	{
+		double overdraw = 0.0;
+		MeshOptimizer::CacheStats cache = {};
+		for (size_t i = 0; i < models.size(); ++i)
+		{
+			overdraw += MeshOptimizer::EstimateOverdraw(models[i]);
+			MeshOptimizer::CacheStats stats = MeshOptimizer::AnalyzeVertexCache(models[i]);
+			cache.triangles += stats.triangles;
+			cache.vertices += stats.vertices;
+			cache.misses += stats.misses;
+		}
+
+		json.BeginObject();
+		json.Value("order", name);
+		json.Value("overdraw", models.empty() ? 0.0 : overdraw / models.size());
+		json.Value("acmr", cache.Acmr());
+		json.Value("optimizeMs", ms);
+		json.EndObject();
+	}
+
+	// What the overdraw pass buys over the vertex cache order and what it costs in cache misses
+	// Rasterizes every model from 26 directions, so only run on the bundled files
+	void AnalyzeOverdraw(JsonWriter &json, const std::string &fileName)
+	{
+		static const float threshold = 1.05f;
+
+		std::vector<Model> imported;
+		OBJFile::LoadFile(fileName, imported);
+		std::vector<Model> cacheOrder = CloneModels(imported);
+		std::vector<Model> overdrawOrder = CloneModels(imported);
+
+		double cacheMs = 0.0;
+		double overdrawMs = 0.0;
+		for (size_t i = 0; i < imported.size(); ++i)
+		{
+			std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+			MeshOptimizer::Optimize(cacheOrder[i]);
+			std::chrono::high_resolution_clock::time_point stop = std::chrono::high_resolution_clock::now();
+			cacheMs += std::chrono::duration<double, std::milli>(stop - start).count();
+
+			start = std::chrono::high_resolution_clock::now();
+			MeshOptimizer::Optimize(overdrawOrder[i], threshold);
+			stop = std::chrono::high_resolution_clock::now();
+			overdrawMs += std::chrono::duration<double, std::milli>(stop - start).count();
+		}
+
+		json.BeginObject("overdraw");
+		json.Value("threshold", static_cast<double>(threshold));
+		json.BeginArray("orders");
+		WriteOverdrawOrder(json, "imported", imported, 0.0);
+		WriteOverdrawOrder(json, "vertexCache", cacheOrder, cacheMs);
+		WriteOverdrawOrder(json, "overdraw", overdrawOrder, overdrawMs);
+		json.EndArray();
+		json.EndObject();
+	}
+
+	// Vertex buffer size per format and the worst error quantizing costs
+	void AnalyzeVertexFormats(JsonWriter &json, const std::string &fileName)
+	{
+		std::vector<Model> models;
+		OBJFile::LoadFile(fileName, models);
+
+		size_t vertexCount = 0;
+		VertexQuantizer::Error error = {};
+		double ms = 0.0;
+		for (size_t i = 0; i < models.size(); ++i)
+		{
+			VertexQuantizer::QuantizedMesh mesh;
+			std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+			VertexQuantizer::Quantize(models[i], mesh);
+			std::chrono::high_resolution_clock::time_point stop = std::chrono::high_resolution_clock::now();
+			ms += std::chrono::duration<double, std::milli>(stop - start).count();
+
+			vertexCount += mesh.vertices.size();
+			error.position = std::max(error.position, mesh.error.position);
+			error.relativePosition = std::max(error.relativePosition, mesh.error.relativePosition);
+			error.normalDegrees = std::max(error.normalDegrees, mesh.error.normalDegrees);
+			error.uv = std::max(error.uv, mesh.error.uv);
+		}
+
+		size_t floatBytes = vertexCount * VertexQuantizer::VertexSize(VertexQuantizer::FormatFloat);
+		size_t quantizedBytes = vertexCount * VertexQuantizer::VertexSize(VertexQuantizer::FormatQuantized);
+
+		// What the float layout would take carrying normals as well
+		size_t floatNormalBytes = floatBytes + vertexCount * 3 * sizeof(float);
+
+		json.BeginObject("vertexFormats");
+		json.Value("floatBytes", floatBytes);
+		json.Value("floatWithNormalsBytes", floatNormalBytes);
+		json.Value("quantizedBytes", quantizedBytes);
+		json.Value("reduction", quantizedBytes > 0 ? static_cast<double>(floatNormalBytes) / quantizedBytes : 0.0);
+		json.Value("maxPositionError", static_cast<double>(error.position));
+		// Of the largest bounds extent, rounding alone gives 0.5 / 65535, about 7.6
+		json.Value("maxPositionErrorPpm", error.relativePosition * 1e6);
+		json.Value("maxNormalErrorDegrees", static_cast<double>(error.normalDegrees));
+		json.Value("maxUvError", static_cast<double>(error.uv));
+		json.Value("quantizeMs", ms);
+		json.EndObject();
+	}
+
+	// Every meshlet triangle maps back to the model's triangle at the same position
+	bool MeshletsMatch(const Model &model)
+	{
+		size_t index = 0;
+		for (size_t i = 0; i < model.meshlets.size(); ++i)
+		{
+			const Meshlet &meshlet = model.meshlets[i];
+			if (meshlet.vertexCount > MeshletBuilder::maxVertices || meshlet.triangleCount > MeshletBuilder::maxTriangles || meshlet.triangleOffset % 4 != 0)
+			{
+				return false;
+			}
+
+			for (unsigned int j = 0; j < meshlet.triangleCount * 3; ++j, ++index)
+			{
+				unsigned char local = model.meshletTriangles[meshlet.triangleOffset + j];
+				if (local >= meshlet.vertexCount || index >= model.fileIndices.size() ||
+					model.meshletVertices[meshlet.vertexOffset + local] != model.fileIndices[index])
+				{
+					return false;
+				}
+			}
+		}
+		return index == model.fileIndices.size();
+	}
+
+	// Meshlet sizes, how long building them takes, that they reproduce the index buffer,
+	// and how many the normal cones reject from eyes around the model
+	bool AnalyzeMeshlets(JsonWriter &json, const std::string &fileName)
+	{
+		OBJFile::LoadSettings settings;
+		settings.threadCount = 0;
+		settings.optimizeMeshes = true;
+
+		std::vector<Model> models;
+		OBJFile::LoadFile(fileName, models, settings);
+
+		size_t meshletCount = 0;
+		size_t vertexCount = 0;
+		size_t triangleCount = 0;
+		size_t bytes = 0;
+		size_t tests = 0;
+		size_t culled = 0;
+		bool valid = true;
+		double ms = 0.0;
+		for (size_t i = 0; i < models.size(); ++i)
+		{
+			Model &model = models[i];
+			std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+			MeshletBuilder::Build(model);
+			std::chrono::high_resolution_clock::time_point stop = std::chrono::high_resolution_clock::now();
+			ms += std::chrono::duration<double, std::milli>(stop - start).count();
+
+			valid &= MeshletsMatch(model);
+			meshletCount += model.meshlets.size();
+			bytes += model.meshlets.size() * sizeof(Meshlet) + model.meshletVertices.size() * sizeof(unsigned int) + model.meshletTriangles.size();
+			for (size_t j = 0; j < model.meshlets.size(); ++j)
+			{
+				vertexCount += model.meshlets[j].vertexCount;
+				triangleCount += model.meshlets[j].triangleCount;
+			}
+
+			// Eyes on the corners, edges and faces of a cube around the model, twice its largest extent across
+			float low[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+			float high[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+			for (size_t v = 0; v < model.fileVertices.size(); v += Model::vertexStride)
+			{
+				for (int k = 0; k < 3; ++k)
+				{
+					low[k] = std::min(low[k], model.fileVertices[v + k]);
+					high[k] = std::max(high[k], model.fileVertices[v + k]);
+				}
+			}
+
+			float extent = std::max(high[0] - low[0], std::max(high[1] - low[1], high[2] - low[2]));
+			for (int x = -1; x <= 1; ++x)
+			{
+				for (int y = -1; y <= 1; ++y)
+				{
+					for (int z = -1; z <= 1; ++z)
+					{
+						if (x == 0 && y == 0 && z == 0)
+						{
+							continue;
+						}
+						int offsets[3] = { x, y, z };
+						Vec3 eye;
+						for (int k = 0; k < 3; ++k)
+						{
+							eye[k] = (low[k] + high[k]) * 0.5f + offsets[k] * extent;
+						}
+						for (size_t j = 0; j < model.meshlets.size(); ++j)
+						{
+							culled += MeshletBuilder::IsBackFacing(model.meshlets[j], eye) ? 1 : 0;
+						}
+						tests += model.meshlets.size();
+					}
+				}
+			}
+		}
+
+		json.BeginObject("meshlets");
+		json.Value("count", meshletCount);
+		json.Value("averageVertices", meshletCount > 0 ? static_cast<double>(vertexCount) / meshletCount : 0.0);
+		json.Value("averageTriangles", meshletCount > 0 ? static_cast<double>(triangleCount) / meshletCount : 0.0);
+		json.Value("bytes", bytes);
+		json.Value("buildMs", ms);
+		json.Value("coneCulled", tests > 0 ? static_cast<double>(culled) / tests : 0.0);
+		json.Value("valid", valid);
+		json.EndObject();
+		return valid;
+	}
+
+	// Every level indexes the model's vertices, covers its ranges exactly and has fewer triangles than the one before
+	bool LodsValid(const Model &model)
+	{
+		size_t vertexCount = model.fileVertices.size() / Model::vertexStride;
+		size_t previous = model.fileIndices.size();
+		for (size_t i = 0; i < model.lods.size(); ++i)
+		{
+			const ModelLod &lod = model.lods[i];
+			if (lod.indices.size() % 3 != 0 || lod.indices.size() >= previous)
+			{
+				return false;
+			}
+
+			for (size_t j = 0; j < lod.indices.size(); ++j)
+			{
+				if (lod.indices[j] >= vertexCount)
+				{
+					return false;
+				}
+			}
+
+			size_t covered = 0;
+			for (size_t j = 0; j < lod.materialRanges.size(); ++j)
+			{
+				if (lod.materialRanges[j].firstIndex != covered)
+				{
+					return false;
+				}
+				covered += lod.materialRanges[j].indexCount;
+			}
+			if (!lod.materialRanges.empty() && covered != lod.indices.size())
+			{
+				return false;
+			}
+			previous = lod.indices.size();
+		}
+		return true;
+	}
+
+	// Triangles and error of each level of detail summed over the models, and what building them costs
+	// Simplifying is far slower than loading, so only run on the bundled files
+	bool AnalyzeLods(JsonWriter &json, const std::string &fileName)
+	{
+		OBJFile::LoadSettings settings;
+		settings.threadCount = 0;
+		settings.optimizeMeshes = true;
+
+		std::vector<Model> models;
+		OBJFile::LoadFile(fileName, models, settings);
+
+		size_t levelCount = 1;
+		bool valid = true;
+		double ms = 0.0;
+		for (size_t i = 0; i < models.size(); ++i)
+		{
+			std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+			MeshSimplifier::BuildLods(models[i]);
+			std::chrono::high_resolution_clock::time_point stop = std::chrono::high_resolution_clock::now();
+			ms += std::chrono::duration<double, std::milli>(stop - start).count();
+
+			valid &= LodsValid(models[i]);
+			levelCount = std::max(levelCount, models[i].lods.size() + 1);
+		}
+
+		// Models without a level this coarse are counted at their coarsest
+		std::vector<size_t> triangles(levelCount, 0);
+		std::vector<double> errors(levelCount, 0.0);
+		for (size_t i = 0; i < models.size(); ++i)
+		{
+			const Model &model = models[i];
+			for (size_t level = 0; level < levelCount; ++level)
+			{
+				size_t lod = std::min(level, model.lods.size());
+				triangles[level] += (lod == 0 ? model.fileIndices.size() : model.lods[lod - 1].indices.size()) / 3;
+				errors[level] = std::max(errors[level], lod == 0 ? 0.0 : static_cast<double>(model.lods[lod - 1].error));
+			}
+		}
+
+		json.BeginObject("lods");
+		json.BeginArray("levels");
+		for (size_t level = 0; level < triangles.size(); ++level)
+		{
+			json.BeginObject();
+			json.Value("triangles", triangles[level]);
+			json.Value("maxError", errors[level]);
+			json.EndObject();
+		}
+		json.EndArray();
+		json.Value("buildMs", ms);
+		json.Value("valid", valid);
+		json.EndObject();
+		return valid;
+	}
+
+	// Degrees between two normals, or -1 if either is zero
+	double NormalDegrees(const float *a, const float *b)
+	{
+		double lengths = std::sqrt(static_cast<double>(a[0] * a[0] + a[1] * a[1] + a[2] * a[2]) * (b[0] * b[0] + b[1] * b[1] + b[2] * b[2]));
+		if (lengths <= 0.0)
+		{
+			return -1.0;
+		}
+		double cosine = (a[0] * b[0] + a[1] * b[1] + a[2] * b[2]) / lengths;
+		return std::acos(std::max(-1.0, std::min(1.0, cosine))) * 57.29577951;
+	}
+
+	// Generating smooth normals with each kernel, which all have to agree, how far the result is from the file's own normals,
+	// and how many vertices a 60 degree crease angle splits off
+	bool AnalyzeNormals(JsonWriter &json, const std::string &fileName, int runs)
+	{
+		OBJFile::LoadSettings settings;
+		settings.threadCount = 0;
+
+		std::vector<Model> models;
+		OBJFile::LoadFile(fileName, models, settings);
+
+		size_t triangleCount = 0;
+		size_t vertexCount = 0;
+		for (size_t i = 0; i < models.size(); ++i)
+		{
+			triangleCount += models[i].fileIndices.size() / 3;
+			vertexCount += models[i].fileVertices.size() / Model::vertexStride;
+		}
+
+		json.BeginObject("normals");
+		json.BeginArray("kernels");
+
+		std::vector<Model> reference;
+		bool valid = true;
+		TextScanner::Kernel detected = TextScanner::GetKernel();
+		for (int k = 0; k < TextScanner::KernelCount; ++k)
+		{
+			TextScanner::Kernel kernel = static_cast<TextScanner::Kernel>(k);
+			if (!TextScanner::IsSupported(kernel))
+			{
+				continue;
+			}
+			TextScanner::SetKernel(kernel);
+
+			double best = 0.0;
+			std::vector<Model> generated;
+			for (int run = 0; run < runs; ++run)
+			{
+				generated = CloneModels(models);
+				std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+				for (size_t i = 0; i < generated.size(); ++i)
+				{
+					NormalGenerator::Generate(generated[i]);
+				}
+				std::chrono::high_resolution_clock::time_point stop = std::chrono::high_resolution_clock::now();
+
+				double ms = std::chrono::duration<double, std::milli>(stop - start).count();
+				best = (run == 0 || ms < best) ? ms : best;
+			}
+
+			bool matches = true;
+			if (reference.empty())
+			{
+				reference.swap(generated);
+			}
+			else
+			{
+				for (size_t i = 0; i < models.size(); ++i)
+				{
+					matches &= generated[i].fileNormals == reference[i].fileNormals;
+				}
+			}
+			valid &= matches;
+
+			json.BeginObject();
+			json.Value("name", TextScanner::KernelName(kernel));
+			json.Value("bestMs", best);
+			json.Value("trianglesPerSecond", best > 0.0 ? triangleCount / (best / 1000.0) : 0.0);
+			json.Value("matches", matches);
+			json.EndObject();
+		}
+		TextScanner::SetKernel(detected);
+		json.EndArray();
+
+		// Vertices without a file normal are left out, hard edges in the file count against the smooth result
+		size_t compared = 0;
+		double total = 0.0;
+		double worst = 0.0;
+		for (size_t i = 0; i < models.size() && !reference.empty(); ++i)
+		{
+			for (size_t v = 0; v + 2 < models[i].fileNormals.size(); v += 3)
+			{
+				const float *normal = &reference[i].fileNormals[v];
+				valid &= normal[0] == normal[0] && normal[1] == normal[1] && normal[2] == normal[2];
+
+				double degrees = NormalDegrees(&models[i].fileNormals[v], normal);
+				if (degrees >= 0.0)
+				{
+					total += degrees;
+					worst = std::max(worst, degrees);
+					++compared;
+				}
+			}
+		}
+
+		size_t creaseVertices = 0;
+		NormalGenerator::Settings crease;
+		crease.creaseAngle = 60.0f;
+		for (size_t i = 0; i < models.size(); ++i)
+		{
+			NormalGenerator::Generate(models[i], crease);
+			creaseVertices += models[i].fileVertices.size() / Model::vertexStride;
+		}
+
+		json.Value("triangles", triangleCount);
+		json.Value("comparedVertices", compared);
+		json.Value("averageDegreesFromFile", compared > 0 ? total / compared : 0.0);
+		json.Value("maxDegreesFromFile", worst);
+		json.Value("creaseSplitVertices", creaseVertices - vertexCount);
+		json.Value("valid", valid);
+		json.EndObject();
+		return valid;
+	}
+
+	// Cache stream encoding on optimized meshes, the order the cache stores them in
+	// How much the filters add over compressing the raw bytes, and decode speed with each kernel, which all have to agree
+	bool AnalyzeCodec(JsonWriter &json, const std::string &fileName, int runs)
+	{
+		OBJFile::LoadSettings settings;
+		settings.threadCount = 0;
+		settings.optimizeMeshes = true;
+
+		std::vector<Model> models;
+		OBJFile::LoadFile(fileName, models, settings);
+
+		const size_t vertexSize = Model::vertexStride * sizeof(float);
+		size_t rawBytes = 0;
+		std::vector<unsigned char> unfiltered;
+		std::vector<unsigned char> encoded;
+		std::vector<size_t> streamEnds;
+		std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+		for (size_t i = 0; i < models.size(); ++i)
+		{
+			MeshCodec::EncodeVertices(models[i].fileVertices.data(), models[i].fileVertices.size() / Model::vertexStride, vertexSize, encoded);
+			streamEnds.push_back(encoded.size());
+			MeshCodec::EncodeIndices(models[i].fileIndices.data(), models[i].fileIndices.size(), encoded);
+			streamEnds.push_back(encoded.size());
+		}
+		std::chrono::high_resolution_clock::time_point stop = std::chrono::high_resolution_clock::now();
+		double encodeMs = std::chrono::duration<double, std::milli>(stop - start).count();
+
+		for (size_t i = 0; i < models.size(); ++i)
+		{
+			rawBytes += models[i].fileVertices.size() * sizeof(float) + models[i].fileIndices.size() * sizeof(unsigned int);
+			MeshCodec::Compress(models[i].fileVertices.data(), models[i].fileVertices.size() * sizeof(float), unfiltered);
+			MeshCodec::Compress(models[i].fileIndices.data(), models[i].fileIndices.size() * sizeof(unsigned int), unfiltered);
+		}
+
+		json.BeginObject("codec");
+		json.Value("rawBytes", rawBytes);
+		json.Value("encodedBytes", encoded.size());
+		json.Value("ratio", encoded.empty() ? 0.0 : double(rawBytes) / encoded.size());
+		json.Value("unfilteredBytes", unfiltered.size());
+		json.Value("encodeMs", encodeMs);
+		json.BeginArray("kernels");
+
+		// One buffer for everything, decoded like the cache does it, stream after stream
+		std::vector<unsigned char> decoded(rawBytes);
+		bool valid = true;
+		TextScanner::Kernel detected = TextScanner::GetKernel();
+		for (int k = 0; k < TextScanner::KernelCount; ++k)
+		{
+			TextScanner::Kernel kernel = static_cast<TextScanner::Kernel>(k);
+			if (!TextScanner::IsSupported(kernel))
+			{
+				continue;
+			}
+			TextScanner::SetKernel(kernel);
+
+			double best = 0.0;
+			bool decodes = true;
+			for (int run = 0; run < runs; ++run)
+			{
+				start = std::chrono::high_resolution_clock::now();
+				unsigned char *output = decoded.data();
+				size_t streamStart = 0;
+				for (size_t i = 0; i < models.size(); ++i)
+				{
+					size_t vertexCount = models[i].fileVertices.size() / Model::vertexStride;
+					decodes &= MeshCodec::DecodeVertices(output, vertexCount, vertexSize, encoded.data() + streamStart, streamEnds[i * 2] - streamStart);
+					output += vertexCount * vertexSize;
+					streamStart = streamEnds[i * 2];
+
+					size_t indexCount = models[i].fileIndices.size();
+					decodes &= MeshCodec::DecodeIndices(reinterpret_cast<unsigned int *>(output), indexCount, encoded.data() + streamStart, streamEnds[i * 2 + 1] - streamStart);
+					output += indexCount * sizeof(unsigned int);
+					streamStart = streamEnds[i * 2 + 1];
+				}
+				stop = std::chrono::high_resolution_clock::now();
+
+				double ms = std::chrono::duration<double, std::milli>(stop - start).count();
+				best = (run == 0 || ms < best) ? ms : best;
+			}
+
+			// Bit exact, floats are compared as bytes
+			bool matches = decodes;
+			const unsigned char *output = decoded.data();
+			for (size_t i = 0; i < models.size() && matches; ++i)
+			{
+				size_t vertexBytes = models[i].fileVertices.size() * sizeof(float);
+				size_t indexBytes = models[i].fileIndices.size() * sizeof(unsigned int);
+				matches &= vertexBytes == 0 || memcmp(output, models[i].fileVertices.data(), vertexBytes) == 0;
+				matches &= indexBytes == 0 || memcmp(output + vertexBytes, models[i].fileIndices.data(), indexBytes) == 0;
+				output += vertexBytes + indexBytes;
+			}
+			valid &= matches;
+
+			json.BeginObject();
+			json.Value("name", TextScanner::KernelName(kernel));
+			json.Value("bestMs", best);
+			json.Value("bytesPerSecond", best > 0.0 ? rawBytes / (best / 1000.0) : 0.0);
+			json.Value("matches", matches);
+			json.EndObject();
+		}
+		TextScanner::SetKernel(detected);
+		json.EndArray();
+
+		json.Value("valid", valid);
+		json.EndObject();
+		return valid;
+	}
+
+	// The .ppm reader PPMFile replaced, a fread per texel, kept as the baseline for the texture timings
+	bool LegacyReadPPM(const std::string &fileName, int &width, int &height, std::vector<unsigned char> &pixels)
+	{
+		FILE *file = NULL;
+		if (fopen_s(&file, fileName.c_str(), "rb") != 0 || file == NULL)
+		{
+			return false;
+		}
+
+		char magic[3] = {};
+		char widthText[6] = {};
+		char heightText[6] = {};
+		char maxText[6] = {};
+		fscanf_s(file, "%s %s %s %s ", magic, 3, widthText, 6, heightText, 6, maxText, 6);
+		width = atoi(widthText);
+		height = atoi(heightText);
+		if (strncmp(magic, "P6", sizeof(magic)) != 0 || width <= 0 || height <= 0)
+		{
+			fclose(file);
+			return false;
+		}
+
+		pixels.resize(size_t(width) * height * 4);
+		unsigned char *texel = pixels.data();
+		for (size_t i = 0; i < size_t(width) * height; ++i, texel += 4)
+		{
+			fread(texel, 3, 1, file);
+			texel[3] = 255;
+		}
+		fclose(file);
+		return true;
+	}
+
+	double BestMs(const std::function<void()> &work, int runs)
+	{
+		double best = 0.0;
+		for (int run = 0; run < runs; ++run)
+		{
+			std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+			work();
+			std::chrono::high_resolution_clock::time_point stop = std::chrono::high_resolution_clock::now();
+
+			double ms = std::chrono::duration<double, std::milli>(stop - start).count();
+			best = (run == 0 || ms < best) ? ms : best;
+		}
+		return best;
+	}
+
+	void WriteDecoder(JsonWriter &json, const std::string &name, double ms, double legacyMs, double megapixels, bool matches)
+	{
+		json.BeginObject();
+		json.Value("name", name);
+		json.Value("bestMs", ms);
+		json.Value("megapixelsPerSecond", ms > 0.0 ? megapixels / (ms / 1000.0) : 0.0);
+		json.Value("speedup", ms > 0.0 ? legacyMs / ms : 0.0);
+		json.Value("matches", matches);
+		json.EndObject();
+	}
+
+	// .ppm decoding per kernel against the old fread loop
+	// "load" is the whole file into packed rows, "expand" is only the RGB to RGBA pass from the mapping into rows padded like a linear image's
+	// "encoders" is level 0 compressed to each block format per kernel, with its PSNR against the source
+	bool BenchmarkTexture(JsonWriter &json, const std::string &fileName, int runs)
+	{
+		int width = 0;
+		int height = 0;
+		std::vector<unsigned char> expected;
+		if (!LegacyReadPPM(fileName, width, height, expected))
+		{
+			json.BeginObject();
+			json.Value("file", fileName);
+			json.Value("error", "not found");
+			json.EndObject();
+			return true;
+		}
+
+		MappedFile file;
+		PPMFile::Header header;
+		if (!file.Open(fileName) || !PPMFile::ParseHeader(file.Data(), file.Size(), header))
+		{
+			json.BeginObject();
+			json.Value("file", fileName);
+			json.Value("error", "unhandled");
+			json.EndObject();
+			return false;
+		}
+		const unsigned char *rgb = reinterpret_cast<const unsigned char *>(file.Data()) + header.dataOffset;
+
+		const size_t packedPitch = size_t(width) * 4;
+		const size_t paddedPitch = (packedPitch + 64 + 255) & ~size_t(255);
+		const double megapixels = double(width) * height / 1000000.0;
+
+		json.BeginObject();
+		json.Value("file", fileName);
+		json.Value("width", static_cast<size_t>(width));
+		json.Value("height", static_cast<size_t>(height));
+		json.BeginArray("decoders");
+
+		std::vector<unsigned char> pixels;
+		double legacyMs = BestMs([&]()
+		{
+			int legacyWidth = 0;
+			int legacyHeight = 0;
+			LegacyReadPPM(fileName, legacyWidth, legacyHeight, pixels);
+		}, runs);
+		WriteDecoder(json, "legacy", legacyMs, legacyMs, megapixels, pixels == expected);
+
+		bool valid = true;
+		std::vector<unsigned char> padded(paddedPitch * height);
+		TextScanner::Kernel detected = TextScanner::GetKernel();
+		for (int k = 0; k < TextScanner::KernelCount; ++k)
+		{
+			TextScanner::Kernel kernel = static_cast<TextScanner::Kernel>(k);
+			if (!TextScanner::IsSupported(kernel))
+			{
+				continue;
+			}
+			TextScanner::SetKernel(kernel);
+
+			pixels.clear();
+			double loadMs = BestMs([&]()
+			{
+				int loadedWidth = 0;
+				int loadedHeight = 0;
+				PPMFile::Load(fileName, loadedWidth, loadedHeight, pixels);
+			}, runs);
+			bool matches = pixels == expected;
+			WriteDecoder(json, std::string("load ") + TextScanner::KernelName(kernel), loadMs, legacyMs, megapixels, matches);
+			valid &= matches;
+
+			double expandMs = BestMs([&]()
+			{
+				PPMFile::ExpandRGB(rgb, width, height, padded.data(), paddedPitch);
+			}, runs);
+			matches = true;
+			for (int y = 0; y < height && matches; ++y)
+			{
+				matches = memcmp(padded.data() + y * paddedPitch, expected.data() + y * packedPitch, packedPitch) == 0;
+			}
+			WriteDecoder(json, std::string("expand ") + TextScanner::KernelName(kernel), expandMs, legacyMs, megapixels, matches);
+			valid &= matches;
+		}
+		TextScanner::SetKernel(detected);
+		json.EndArray();
+
+		// Level 0 through every block format, each kernel has to write the same blocks as the scalar one
+		json.BeginArray("encoders");
+		std::vector<unsigned char> decoded(expected.size());
+		for (int f = 0; f < TextureCompressor::FormatCount; ++f)
+		{
+			TextureCompressor::Settings compressSettings;
+			compressSettings.format = static_cast<TextureCompressor::Format>(f);
+
+			size_t blockCount = size_t((width + 3) / 4) * ((height + 3) / 4);
+			std::vector<unsigned char> reference(blockCount * TextureCompressor::BlockBytes(compressSettings.format));
+			std::vector<unsigned char> blocks(reference.size());
+			double scalarMs = 0.0;
+			for (int k = 0; k < TextScanner::KernelCount; ++k)
+			{
+				TextScanner::Kernel kernel = static_cast<TextScanner::Kernel>(k);
+				if (!TextScanner::IsSupported(kernel))
+				{
+					continue;
+				}
+				TextScanner::SetKernel(kernel);
+
+				double ms = BestMs([&]()
+				{
+					TextureCompressor::Compress(expected.data(), width, height, blocks.data(), compressSettings);
+				}, runs);
+				if (kernel == TextScanner::KernelScalar)
+				{
+					reference = blocks;
+					scalarMs = ms;
+				}
+				bool matches = blocks == reference;
+				valid &= matches;
+
+				// Peak signal to noise of the color channels, BC1 drops alpha so it isn't counted anywhere
+				TextureCompressor::Decompress(blocks.data(), compressSettings.format, width, height, decoded.data());
+				double squaredError = 0.0;
+				for (size_t i = 0; i < expected.size(); ++i)
+				{
+					if ((i & 3) != 3)
+					{
+						double difference = double(decoded[i]) - double(expected[i]);
+						squaredError += difference * difference;
+					}
+				}
+				double meanError = squaredError / (double(width) * height * 3);
+
+				json.BeginObject();
+				json.Value("name", std::string(TextureCompressor::FormatName(compressSettings.format)) + " " + TextScanner::KernelName(kernel));
+				json.Value("bestMs", ms);
+				json.Value("megapixelsPerSecond", ms > 0.0 ? megapixels / (ms / 1000.0) : 0.0);
+				json.Value("speedup", ms > 0.0 ? scalarMs / ms : 0.0);
+				json.Value("psnr", meanError > 0.0 ? 10.0 * log10(255.0 * 255.0 / meanError) : 99.0);
+				json.Value("matches", matches);
+				json.EndObject();
+			}
+		}
+		TextScanner::SetKernel(detected);
+		json.EndArray();
+
+		json.Value("valid", valid);
+		json.EndObject();
+		return valid;
+	}
+
+	// .dds header parsing, and the one copy of its levels the streamed upload makes from the mapping into staging
+	// The parsed format, levels and payload are checksummed against the golden table
+	bool BenchmarkDDS(JsonWriter &json, GoldenTable &golden, bool record, const std::string &fileName, int runs)
+	{
+		MappedFile file;
+		DDSFile::Header header;
+		if (!file.Open(fileName) || !DDSFile::ParseHeader(file.Data(), file.Size(), header))
+		{
+			json.BeginObject();
+			json.Value("file", fileName);
+			json.Value("error", "unhandled");
+			json.EndObject();
+			return false;
+		}
+
+		// Every run has to agree with the first parse, which also keeps the work from being optimized out
+		bool parsesMatch = true;
+		double parseMs = BestMs([&]()
+		{
+			DDSFile::Header parsed;
+			parsesMatch &= DDSFile::ParseHeader(file.Data(), file.Size(), parsed) && parsed.dataSize == header.dataSize && parsed.levels.size() == header.levels.size();
+		}, runs);
+
+		std::vector<unsigned char> staging(header.dataSize);
+		double copyMs = BestMs([&]()
+		{
+			memcpy(staging.data(), file.Data() + header.dataOffset, header.dataSize);
+		}, runs);
+
+		// The streamed upload expects every level down to 1x1
+		const MipGenerator::Level &smallest = header.levels.back();
+		bool valid = parsesMatch && smallest.width == 1 && smallest.height == 1;
+
+		Checksum checksum;
+		uint32_t format = header.format;
+		uint32_t srgb = header.srgb ? 1 : 0;
+		checksum.Add(&format, sizeof(format));
+		checksum.Add(&srgb, sizeof(srgb));
+		checksum.Add(header.levels);
+		checksum.Add(staging);
+		const char *status = valid ? golden.Check(fileName + ":levels", checksum.Hex(), record) : "invalid";
+
+		json.BeginObject();
+		json.Value("file", fileName);
+		json.Value("width", static_cast<size_t>(header.levels[0].width));
+		json.Value("height", static_cast<size_t>(header.levels[0].height));
+		json.Value("levels", header.levels.size());
+		json.Value("dataBytes", header.dataSize);
+		// Both are far under a millisecond, which the writer would round to 0
+		json.Value("parseUs", parseMs * 1000.0);
+		json.Value("copyUs", copyMs * 1000.0);
+		json.Value("copyBytesPerSecond", copyMs > 0.0 ? header.dataSize / (copyMs / 1000.0) : 0.0);
+		json.Value("checksum", checksum.Hex());
+		json.Value("golden", status);
+		json.EndObject();
+
+		return strcmp(status, "match") == 0 || strcmp(status, "recorded") == 0;
+	}
+
+	bool BenchmarkFile(JsonWriter &json, GoldenTable &golden, bool record, const std::vector<Loader> &loaders, const OBJFile::LoadSettings &cacheSettings,
+		const std::string &key, const std::string &fileName, int runs, bool synthetic)
+	{
+		MappedFile file;
+		if (!file.Open(fileName))
+		{
+			json.BeginObject();
+			json.Value("file", key);
+			json.Value("error", "not found");
+			json.EndObject();
+			return true;
+		}
+		size_t fileBytes = file.Size();
+		file.Close();
+
+		{
+			std::vector<Model> models;
+			MeshCache::LoadOBJ(fileName, models, cacheSettings);
+		}
+
+		json.BeginObject();
+		json.Value("file", key);
+		json.Value("bytes", fileBytes);
+
+		bool passed = true;
+		json.BeginArray("loaders");
+		for (size_t i = 0; i < loaders.size(); ++i)
+		{
+			if (synthetic && !loaders[i].scales)
+			{
+				continue;
+			}
+			passed &= TimeLoader(json, golden, record, key, loaders[i], fileName, fileBytes, runs);
+		}
+		json.EndArray();
+
+		AnalyzeVertexCache(json, fileName);
+		passed &= AnalyzeMeshlets(json, fileName);
+		AnalyzeVertexFormats(json, fileName);
+		passed &= AnalyzeNormals(json, fileName, runs);
+		passed &= AnalyzeCodec(json, fileName, runs);
+
+		if (!synthetic)
+		{
+			AnalyzeOverdraw(json, fileName);
+			passed &= AnalyzeLods(json, fileName);
+			TimeScannerKernels(json, fileName, runs);
+		}
+		json.EndObject();
+		return passed;
+	}
+}
+
+bool OBJBenchmark::Run(const Settings &settings)
+{
+	static const char *files[] = { "box.obj", "sword.obj", "sword_old.obj", "test.obj", "murdock.obj" };
+	static const char *textures[] = { "lunarg.ppm", "adam.ppm" };
+	static const char *ddsTextures[] = { "adam.dds" };
+	static const int runs = 10;
+	static const int syntheticRuns = 3;
+
+	GoldenTable golden;
+	golden.Load(settings.goldenFile);
+
+	OBJFile::LoadSettings cacheSettings;
+	cacheSettings.cacheDirectory = TempDirectory();
+
+	std::vector<Loader> loaders = Loaders(cacheSettings);
+	bool passed = true;
+
+	JsonWriter json;
+	json.BeginObject();
+	json.Value("scanner", TextScanner::KernelName(TextScanner::GetKernel()));
+	json.BeginArray("files");
+	for (size_t i = 0; i < sizeof(files) / sizeof(files[0]); ++i)
+	{
+		passed &= BenchmarkFile(json, golden, settings.recordGolden, loaders, cacheSettings, files[i], files[i], runs, false);
+	}
+
+	for (size_t i = 0; i < settings.syntheticFaces.size(); ++i)
+	{
+		std::ostringstream key;
+		key << "synthetic_" << settings.syntheticFaces[i];
+		passed &= BenchmarkFile(json, golden, settings.recordGolden, loaders, cacheSettings, key.str(), SyntheticFile(settings.syntheticFaces[i]), syntheticRuns, true);
+	}
+	json.EndArray();
+
+	json.BeginArray("textures");
+	for (size_t i = 0; i < sizeof(textures) / sizeof(textures[0]); ++i)
+	{
+		passed &= BenchmarkTexture(json, textures[i], runs);
+	}
+	json.EndArray();
+
+	json.BeginArray("dds");
+	for (size_t i = 0; i < sizeof(ddsTextures) / sizeof(ddsTextures[0]); ++i)
+	{
+		passed &= BenchmarkDDS(json, golden, settings.recordGolden, ddsTextures[i], runs);
+	}
+	json.EndArray();
+	json.Value("passed", passed);
+	json.EndObject();
+
+	golden.Save(settings.goldenFile);
+
+	std::ofstream output(settings.outputFile.c_str());
+	output << json.String();
+	return passed;
+}
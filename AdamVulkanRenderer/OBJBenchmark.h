@@ -0,0 +1,33 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// GPU-free timing and regression checks for the .obj loaders
+// Runs every loader over the bundled models and generated grids of 1M faces and up
+// Built as its own console program, OBJBenchmark.exe, see OBJBenchmarkMain.cpp for its command line
+// Results are written as JSON, wall time, peak memory, allocations, throughput and output sizes per loader
+// The .ppm textures are timed too, each PPMFile kernel against the fread loop it replaced, and each block compression format
+// Bundled .dds files are parsed and their levels checked against the golden table like the loaders' output
+class OBJBenchmark
+{
+public:
+	struct Settings
+	{
+		std::string outputFile;
+
+		// Checksums of the expected loader output
+		std::string goldenFile;
+
+		// Write checksums for keys the golden file doesn't have yet instead of failing on them
+		bool recordGolden;
+
+		// Triangle counts of the generated grids, written to the temp directory once and reused
+		std::vector<size_t> syntheticFaces;
+
+		Settings() : outputFile("obj_benchmark.json"), goldenFile("obj_benchmark_golden.txt"), recordGolden(false), syntheticFaces(1, 1000000) {}
+	};
+
+	// Returns false if any loader failed, came back empty or didn't match its golden checksum
+	static bool Run(const Settings &settings);
+};
@@ -0,0 +1,35 @@
+// OBJBenchmarkMain.cpp : Defines the entry point for the loader benchmark.
+// A console program of its own, so the allocation counting it links in never replaces operator new in the renderer
+#include "stdafx.h"
+#include "OBJBenchmark.h"
+#include <cstdio>
+#include <cstring>
+
+// -full adds the 10M and 50M face grids, several GB of generated text
+// -record writes checksums for outputs the golden file doesn't have yet, instead of failing on them
+// Run from the directory with the bundled assets, the exit code is non-zero when any loader fails its check
+int main(int argc, char *argv[])
+{
+	OBJBenchmark::Settings settings;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "-full") == 0)
+		{
+			settings.syntheticFaces.push_back(10000000);
+			settings.syntheticFaces.push_back(50000000);
+		}
+		else if (strcmp(argv[i], "-record") == 0)
+		{
+			settings.recordGolden = true;
+		}
+		else
+		{
+			fprintf(stderr, "usage: OBJBenchmark [-full] [-record]\n");
+			return 2;
+		}
+	}
+
+	bool passed = OBJBenchmark::Run(settings);
+	printf("%s, results written to %s\n", passed ? "passed" : "failed", settings.outputFile.c_str());
+	return passed ? 0 : 1;
+}
@@ -6,8 +6,956 @@
 #include <iostream>
 #include <stdio.h>
 #include <map>
+#include <cstring>
+#include <algorithm>
+#include <utility>
+#include <memory>
+#include <unordered_map>
+#include "MappedFile.h"
+#include "MTLFile.h"
+#include "MeshOptimizer.h"
+#include "MeshletBuilder.h"
+#include "MeshSimplifier.h"
+#include "NormalGenerator.h"
+#include "VertexDedupTable.h"
+#include "ScratchArena.h"
+#include "TextScanner.h"
 
-void OBJFile::LoadFile(std::string fileName, std::vector<Model> &models)
+namespace
+{
+	// Don't bother splitting work smaller than this across threads
+	const size_t minimumChunkSize = 64 * 1024;
+
+	inline bool IsWhitespace(char c)
+	{
+		return c == ' ' || c == '\t' || c == '\r';
+	}
+
+	inline const char *SkipWhitespace(const char *cursor, const char *end)
+	{
+		while (cursor < end && IsWhitespace(*cursor))
+		{
+			++cursor;
+		}
+		return cursor;
+	}
+
+	// Tokens and lines are found with the vectorized scanner, whitespace runs are short enough to walk
+	inline const char *SkipToken(const char *cursor, const char *end)
+	{
+		return TextScanner::FindWhitespace(cursor, end);
+	}
+
+	inline const char *FindLineEnd(const char *cursor, const char *end)
+	{
+		return TextScanner::FindLineEnd(cursor, end);
+	}
+
+	// Parse a float in place, anything that isn't a number reads as 0
+	inline const char *ParseFloat(const char *cursor, const char *end, float &value)
+	{
+		cursor = SkipWhitespace(cursor, end);
+		const char *next = TextScanner::ParseFloat(cursor, end, value);
+		if (next == cursor)
+		{
+			value = 0.0f;
+			return SkipToken(cursor, end);
+		}
+		return next;
+	}
+
+	inline void ParseVec3(const char *cursor, const char *end, Vec3 &entry)
+	{
+		cursor = ParseFloat(cursor, end, entry.x);
+		cursor = ParseFloat(cursor, end, entry.y);
+		ParseFloat(cursor, end, entry.z);
+	}
+
+	// Parse a 1 based (or negative relative) .obj index and convert it to a 0 based one
+	// Missing indices (v//vn) come back as -1
+	inline const char *ParseIndex(const char *cursor, const char *end, size_t count, int &index)
+	{
+		int value = 0;
+		const char *next = TextScanner::ParseInt(cursor, end, value);
+		if (next == cursor || value == 0)
+		{
+			index = -1;
+			return next;
+		}
+
+		index = value > 0 ? value - 1 : static_cast<int>(count) + value;
+		return next;
+	}
+
+	enum RecordType
+	{
+		RecordOther,
+		RecordVertex,
+		RecordNormal,
+		RecordUV,
+		RecordFace,
+		RecordGroup,
+		RecordMaterial,
+		RecordLibrary
+	};
+
+	// Identify a line by its keyword, args is left pointing just past it
+	inline RecordType ReadRecordType(const char *line, const char *lineEnd, const char *&args)
+	{
+		const char *keyword = SkipWhitespace(line, lineEnd);
+		args = SkipToken(keyword, lineEnd);
+
+		switch (args - keyword)
+		{
+		case 1:
+			return keyword[0] == 'v' ? RecordVertex : keyword[0] == 'f' ? RecordFace : keyword[0] == 'g' ? RecordGroup : RecordOther;
+		case 2:
+			return keyword[0] != 'v' ? RecordOther : keyword[1] == 'n' ? RecordNormal : keyword[1] == 't' ? RecordUV : RecordOther;
+		case 6:
+			return memcmp(keyword, "usemtl", 6) == 0 ? RecordMaterial : memcmp(keyword, "mtllib", 6) == 0 ? RecordLibrary : RecordOther;
+		default:
+			return RecordOther;
+		}
+	}
+
+	// Material and library names run to the end of the line and may contain spaces
+	std::string ReadName(const char *cursor, const char *end)
+	{
+		cursor = SkipWhitespace(cursor, end);
+		while (end > cursor && IsWhitespace(end[-1]))
+		{
+			--end;
+		}
+		return std::string(cursor, end);
+	}
+
+	// Every material the file can refer to, by name
+	// Filled from the mtllib libraries, usemtl names no library defines get a default material
+	struct MaterialTable
+	{
+		// Libraries are looked up relative to the .obj
+		std::string directory;
+
+		std::vector<Material> materials;
+		std::unordered_map<std::string, unsigned int> lookup;
+		std::vector<std::string> libraries;
+
+		// By id, the number of the last usemtl naming the material counting from 1, 0 when none does
+		std::vector<size_t> lastUse;
+
+		unsigned int Find(const std::string &name)
+		{
+			std::unordered_map<std::string, unsigned int>::iterator found = lookup.find(name);
+			if (found != lookup.end())
+			{
+				return found->second;
+			}
+
+			unsigned int id = static_cast<unsigned int>(materials.size());
+			materials.push_back(Material());
+			materials.back().name = name;
+			lookup[name] = id;
+			return id;
+		}
+
+		void LoadLibrary(const std::string &name)
+		{
+			for (size_t i = 0; i < libraries.size(); ++i)
+			{
+				if (libraries[i] == name)
+				{
+					return;
+				}
+			}
+			libraries.push_back(name);
+
+			// A later definition of a name replaces the earlier one but keeps its id
+			std::vector<Material> loaded;
+			MTLFile::LoadFile(directory + name, loaded);
+			for (size_t i = 0; i < loaded.size(); ++i)
+			{
+				materials[Find(loaded[i].name)] = loaded[i];
+			}
+		}
+
+		// names are every usemtl in the file, in order
+		void CountUses(const std::vector<std::string> &names)
+		{
+			for (size_t i = 0; i < names.size(); ++i)
+			{
+				unsigned int id = Find(names[i]);
+				if (id >= lastUse.size())
+				{
+					lastUse.resize(id + 1, 0);
+				}
+				lastUse[id] = i + 1;
+			}
+		}
+
+		// Whether a usemtl after the useCount'th still names the material
+		bool UsedAfter(unsigned int id, size_t useCount) const
+		{
+			return id < lastUse.size() && lastUse[id] > useCount;
+		}
+	};
+
+	struct RecordCounts
+	{
+		size_t vertices;
+		size_t normals;
+		size_t uvs;
+		size_t faces;
+	};
+
+	// mtllib and usemtl names in file order, so materials can be settled before any face is assembled
+	struct Directives
+	{
+		std::vector<std::string> libraries;
+		std::vector<std::string> materials;
+	};
+
+	// Count the records up front so the raw arrays and dedup table are sized once
+	// The few mtllib and usemtl records are collected on the way
+	RecordCounts CountRecords(const char *cursor, const char *end, Directives &directives)
+	{
+		RecordCounts counts = { 0, 0, 0, 0 };
+		while (cursor < end)
+		{
+			const char *lineEnd = FindLineEnd(cursor, end);
+			const char *args;
+			switch (ReadRecordType(cursor, lineEnd, args))
+			{
+			case RecordVertex:
+				++counts.vertices;
+				break;
+			case RecordNormal:
+				++counts.normals;
+				break;
+			case RecordUV:
+				++counts.uvs;
+				break;
+			case RecordFace:
+				++counts.faces;
+				break;
+			case RecordMaterial:
+				directives.materials.push_back(ReadName(args, lineEnd));
+				break;
+			case RecordLibrary:
+				directives.libraries.push_back(ReadName(args, lineEnd));
+				break;
+			default:
+				break;
+			}
+			cursor = lineEnd + 1;
+		}
+		return counts;
+	}
+
+	// Every library is loaded before the first face in both paths, so a usemtl resolves
+	// to the same material wherever its mtllib sits in the file, a later definition of a name wins
+	void LoadMaterials(MaterialTable &materials, const Directives &directives)
+	{
+		for (size_t i = 0; i < directives.libraries.size(); ++i)
+		{
+			materials.LoadLibrary(directives.libraries[i]);
+		}
+		materials.CountUses(directives.materials);
+	}
+
+	// Raw per file attribute arrays, faces index into these
+	// UVs keep the optional w so they can share the Vec3 parsing
+	// Sized from the record counts up front and taken from the load's arena
+	struct RawAttributes
+	{
+		RawAttributes(ScratchArena &arena, const RecordCounts &counts) :
+			vertices(arena.AllocateArray<Vec3>(counts.vertices)),
+			normals(arena.AllocateArray<Vec3>(counts.normals)),
+			uvs(arena.AllocateArray<Vec3>(counts.uvs))
+		{
+		}
+
+		Vec3 *vertices;
+		Vec3 *normals;
+		Vec3 *uvs;
+	};
+
+	// Face corner with all indices resolved to 0 based, -1 when missing
+	struct FaceCorner
+	{
+		int v;
+		int vt;
+		int vn;
+	};
+
+	// Each corner is v, v/vt, v//vn or v/vt/vn
+	// counts holds how many of each record came before this face, anything past that is dropped
+	void ParseFace(const char *cursor, const char *end, const RecordCounts &counts, std::vector<FaceCorner> &corners)
+	{
+		cursor = SkipWhitespace(cursor, end);
+		while (cursor < end)
+		{
+			FaceCorner corner = { -1, -1, -1 };
+			cursor = ParseIndex(cursor, end, counts.vertices, corner.v);
+			if (cursor < end && *cursor == '/')
+			{
+				cursor = ParseIndex(cursor + 1, end, counts.uvs, corner.vt);
+				if (cursor < end && *cursor == '/')
+				{
+					cursor = ParseIndex(cursor + 1, end, counts.normals, corner.vn);
+				}
+			}
+			cursor = SkipWhitespace(SkipToken(cursor, end), end);
+
+			if (corner.v >= 0 && corner.v < static_cast<int>(counts.vertices) &&
+				corner.vt < static_cast<int>(counts.uvs) && corner.vn < static_cast<int>(counts.normals))
+			{
+				corners.push_back(corner);
+			}
+		}
+	}
+
+	// Triangulate a face as a fan, 0 1 2 3 becomes 0 1 2 and 0 2 3
+	// Vertices are stored in a counter-clockwise order by default
+	inline void AppendFan(const std::vector<unsigned int> &faceIndices, std::vector<unsigned int> &indices)
+	{
+		for (size_t i = 2; i < faceIndices.size(); ++i)
+		{
+			indices.push_back(faceIndices[0]);
+			indices.push_back(faceIndices[i - 1]);
+			indices.push_back(faceIndices[i]);
+		}
+	}
+
+	// Faces of one group and material within a chunk
+	// Corners are deduplicated per chunk so the serial merge only has to look up each unique corner once
+	struct ChunkSegment
+	{
+		ChunkSegment() : startsGroup(false), startsMaterial(false) {}
+
+		// Set when a g record started this segment
+		bool startsGroup;
+
+		// Set when a usemtl record started this segment
+		bool startsMaterial;
+		std::string material;
+
+		// Unique corners in order of first use, indices point into this
+		std::vector<FaceCorner> corners;
+		std::vector<unsigned int> indices;
+	};
+
+	// Builds models one face at a time
+	// Only introduce new vertices when a new (v, vt, vn) triple shows up
+	// Split by g group there is one model in progress, batched by material there is one per material
+	struct ModelBuilder
+	{
+		// A model still taking faces
+		struct Pending
+		{
+			explicit Pending(ScratchArena &arena) : vertexTable(&arena), hasNormals(false) {}
+
+			Model model;
+			VertexDedupTable vertexTable;
+
+			// Set once any corner of the model has a vn
+			bool hasNormals;
+		};
+
+		ModelBuilder(MaterialTable &table, const OBJFile::LoadSettings &settings, ScratchArena &scratch) : arena(&scratch), materials(&table), splitGroups(!settings.batchByMaterial),
+			optimize(settings.optimizeMeshes), overdrawThreshold(settings.overdrawThreshold), meshlets(settings.buildMeshlets), lods(settings.buildLods),
+			generateNormals(settings.generateNormals), materialUses(0)
+		{
+			normalSettings.creaseAngle = settings.creaseAngle;
+			normalSettings.threadCount = settings.threadCount;
+
+			// Faces before the first usemtl get an unnamed default material
+			currentMaterial = materials->Find(std::string());
+		}
+
+		ScratchArena *arena;
+
+		// The group's model when splitting, indexed by material id when batching
+		std::vector<std::unique_ptr<Pending>> pending;
+
+		MaterialTable *materials;
+		bool splitGroups;
+		bool optimize;
+		float overdrawThreshold;
+		bool meshlets;
+		bool lods;
+		bool generateNormals;
+		NormalGenerator::Settings normalSettings;
+
+		// Triangles by material id, finished models join their materials' triangles into fileIndices
+		// Materials are kept in order of first use so the output doesn't depend on the table's ids
+		unsigned int currentMaterial;
+		std::vector<std::vector<unsigned int>> materialIndices;
+		std::vector<unsigned int> usedMaterials;
+
+		// usemtl records seen so far
+		size_t materialUses;
+
+		// Scratch reused between faces and segments
+		std::vector<unsigned int> faceIndices;
+		std::vector<unsigned int> remap;
+
+		// Size the group model's table, batched models split the faces between them and grow to fit
+		void Reserve(size_t faceCount)
+		{
+			if (splitGroups)
+			{
+				Current().vertexTable.Reserve(faceCount);
+			}
+		}
+
+		Pending &Current()
+		{
+			size_t slot = splitGroups ? 0 : currentMaterial;
+			if (slot >= pending.size())
+			{
+				pending.resize(slot + 1);
+			}
+			if (!pending[slot])
+			{
+				pending[slot].reset(new Pending(*arena));
+			}
+
+			return *pending[slot];
+		}
+
+		// When batching, a material that no later usemtl names has all of its faces and goes out right away
+		void UseMaterial(const std::string &name, const OBJFile::ModelCallback &onModel)
+		{
+			unsigned int previous = currentMaterial;
+			currentMaterial = materials->Find(name);
+			++materialUses;
+
+			if (!splitGroups && currentMaterial != previous && !materials->UsedAfter(previous, materialUses))
+			{
+				FlushMaterial(previous, onModel);
+			}
+		}
+
+		std::vector<unsigned int> &MaterialIndices()
+		{
+			if (currentMaterial >= materialIndices.size())
+			{
+				materialIndices.resize(currentMaterial + 1);
+			}
+
+			return materialIndices[currentMaterial];
+		}
+
+		// Call once triangles were added to an empty material, its range goes after the ones already used
+		void MarkUsed(size_t previousCount)
+		{
+			if (previousCount == 0 && !materialIndices[currentMaterial].empty())
+			{
+				usedMaterials.push_back(currentMaterial);
+			}
+		}
+
+		unsigned int AddCorner(Pending &target, const RawAttributes &raw, const FaceCorner &corner)
+		{
+			Model &model = target.model;
+			bool inserted = false;
+			unsigned int index = target.vertexTable.FindOrInsert(corner.v, corner.vt, corner.vn, static_cast<unsigned int>(model.fileVertices.size() / Model::vertexStride), inserted);
+
+			if (inserted)
+			{
+				// Interleaved to match VertexUV, x y z 1 u v
+				const Vec3 &vertex = raw.vertices[corner.v];
+				model.fileVertices.push_back(vertex.x);
+				model.fileVertices.push_back(vertex.y);
+				model.fileVertices.push_back(vertex.z);
+				model.fileVertices.push_back(1.0f);
+
+				// .obj puts v = 0 at the bottom and vertex.vs flips both axes,
+				// so only pre-flip u to end up with the usual (u, 1 - v)
+				Vec3 uv = corner.vt >= 0 ? raw.uvs[corner.vt] : Vec3();
+				model.fileVertices.push_back(1.0f - uv.x);
+				model.fileVertices.push_back(uv.y);
+
+				// Files without normals still get a (zeroed) normal stream, unless the model generates one when it's done
+				Vec3 normal = corner.vn >= 0 ? raw.normals[corner.vn] : Vec3();
+				target.hasNormals |= corner.vn >= 0;
+				model.fileNormals.push_back(normal.x);
+				model.fileNormals.push_back(normal.y);
+				model.fileNormals.push_back(normal.z);
+			}
+
+			return index;
+		}
+
+		void AddFace(const RawAttributes &raw, const std::vector<FaceCorner> &corners)
+		{
+			Pending &target = Current();
+			faceIndices.clear();
+			for (size_t i = 0; i < corners.size(); ++i)
+			{
+				faceIndices.push_back(AddCorner(target, raw, corners[i]));
+			}
+			std::vector<unsigned int> &indices = MaterialIndices();
+			size_t previousCount = indices.size();
+			AppendFan(faceIndices, indices);
+			MarkUsed(previousCount);
+		}
+
+		// Add an already triangulated segment, corners are visited in the same order AddFace would have
+		void AddSegment(const RawAttributes &raw, const ChunkSegment &segment)
+		{
+			if (segment.corners.empty())
+			{
+				return;
+			}
+
+			Pending &target = Current();
+			remap.resize(segment.corners.size());
+			for (size_t i = 0; i < segment.corners.size(); ++i)
+			{
+				remap[i] = AddCorner(target, raw, segment.corners[i]);
+			}
+
+			std::vector<unsigned int> &indices = MaterialIndices();
+			size_t previousCount = indices.size();
+			for (size_t i = 0; i < segment.indices.size(); ++i)
+			{
+				indices.push_back(remap[segment.indices[i]]);
+			}
+			MarkUsed(previousCount);
+		}
+
+		// g signals a new object, unless faces are being batched by material
+		void StartGroup(const OBJFile::ModelCallback &onModel)
+		{
+			if (splitGroups)
+			{
+				Emit(Current(), usedMaterials, onModel);
+				usedMaterials.clear();
+			}
+		}
+
+		// Hand off one material's batched model
+		void FlushMaterial(unsigned int id, const OBJFile::ModelCallback &onModel)
+		{
+			if (id >= pending.size() || !pending[id])
+			{
+				return;
+			}
+
+			std::vector<unsigned int> ids(1, id);
+			Emit(*pending[id], ids, onModel);
+			pending[id].reset();
+			usedMaterials.erase(std::remove(usedMaterials.begin(), usedMaterials.end(), id), usedMaterials.end());
+		}
+
+		// End of the file, hand off whatever is left, batched materials in order of first use
+		void Finish(const OBJFile::ModelCallback &onModel)
+		{
+			if (splitGroups)
+			{
+				StartGroup(onModel);
+				return;
+			}
+
+			std::vector<unsigned int> remaining(usedMaterials);
+			for (size_t i = 0; i < remaining.size(); ++i)
+			{
+				FlushMaterial(remaining[i], onModel);
+			}
+		}
+
+		// Join the listed materials' triangles into the model, finish it, hand it off and start over
+		void Emit(Pending &target, const std::vector<unsigned int> &ids, const OBJFile::ModelCallback &onModel)
+		{
+			Model &model = target.model;
+			if (!model.fileVertices.empty())
+			{
+				for (size_t i = 0; i < ids.size(); ++i)
+				{
+					std::vector<unsigned int> &indices = materialIndices[ids[i]];
+					MaterialRange range;
+					range.material = static_cast<unsigned int>(model.materials.size());
+					range.firstIndex = static_cast<unsigned int>(model.fileIndices.size());
+					range.indexCount = static_cast<unsigned int>(indices.size());
+					model.materialRanges.push_back(range);
+					model.materials.push_back(materials->materials[ids[i]]);
+
+					// The usual single material model takes its indices without a copy
+					if (model.fileIndices.empty())
+					{
+						model.fileIndices.swap(indices);
+					}
+					else
+					{
+						model.fileIndices.insert(model.fileIndices.end(), indices.begin(), indices.end());
+					}
+				}
+
+				// Only when there's nothing at all to go on, a partly normaled model keeps what it has
+				if (generateNormals && !target.hasNormals)
+				{
+					NormalGenerator::Generate(model, normalSettings);
+				}
+				if (optimize)
+				{
+					MeshOptimizer::Optimize(model, overdrawThreshold);
+				}
+				if (meshlets)
+				{
+					MeshletBuilder::Build(model);
+				}
+				if (lods)
+				{
+					MeshSimplifier::BuildLods(model);
+				}
+				onModel(model);
+			}
+
+			// Whatever onModel didn't move out goes too
+			model = Model();
+			target.vertexTable.Clear();
+			target.hasNormals = false;
+
+			for (size_t i = 0; i < ids.size(); ++i)
+			{
+				materialIndices[ids[i]].clear();
+			}
+		}
+	};
+
+	// A newline aligned slice of the file parsed by one worker
+	// Raw attributes go straight into the shared arrays at the chunk's base offset,
+	// faces are kept per chunk until the merge
+	struct ParsedChunk
+	{
+		const char *begin;
+		const char *end;
+
+		RecordCounts counts;
+		RecordCounts base;
+
+		RawAttributes *raw;
+		ScratchArena *arena;
+
+		std::vector<ChunkSegment> segments;
+
+		// Found by the count pass, so materials are settled before the first chunk is merged
+		Directives directives;
+	};
+
+	VOID CALLBACK CountChunkCallback(PTP_CALLBACK_INSTANCE instance, PVOID parameter, PTP_WORK work)
+	{
+		ParsedChunk *chunk = static_cast<ParsedChunk *>(parameter);
+		chunk->counts = CountRecords(chunk->begin, chunk->end, chunk->directives);
+		UNREFERENCED_PARAMETER(instance);
+		UNREFERENCED_PARAMETER(work);
+	}
+
+	VOID CALLBACK ParseChunkCallback(PTP_CALLBACK_INSTANCE instance, PVOID parameter, PTP_WORK work)
+	{
+		ParsedChunk *chunk = static_cast<ParsedChunk *>(parameter);
+
+		VertexDedupTable cornerTable(chunk->arena);
+		cornerTable.Reserve(chunk->counts.faces);
+
+		std::vector<FaceCorner> corners;
+		std::vector<unsigned int> faceIndices;
+
+		chunk->segments.push_back(ChunkSegment());
+
+		// Running totals, the global index of the next record of each type
+		RecordCounts seen = chunk->base;
+
+		const char *cursor = chunk->begin;
+		while (cursor < chunk->end)
+		{
+			const char *lineEnd = FindLineEnd(cursor, chunk->end);
+			const char *args;
+			switch (ReadRecordType(cursor, lineEnd, args))
+			{
+			case RecordVertex:
+				ParseVec3(args, lineEnd, chunk->raw->vertices[seen.vertices++]);
+				break;
+			case RecordNormal:
+				ParseVec3(args, lineEnd, chunk->raw->normals[seen.normals++]);
+				break;
+			case RecordUV:
+				ParseVec3(args, lineEnd, chunk->raw->uvs[seen.uvs++]);
+				break;
+			case RecordFace:
+			{
+				ChunkSegment &segment = chunk->segments.back();
+				corners.clear();
+				ParseFace(args, lineEnd, seen, corners);
+
+				faceIndices.clear();
+				for (size_t i = 0; i < corners.size(); ++i)
+				{
+					bool inserted = false;
+					faceIndices.push_back(cornerTable.FindOrInsert(corners[i].v, corners[i].vt, corners[i].vn, static_cast<unsigned int>(segment.corners.size()), inserted));
+					if (inserted)
+					{
+						segment.corners.push_back(corners[i]);
+					}
+				}
+				AppendFan(faceIndices, segment.indices);
+				break;
+			}
+			case RecordGroup:
+				chunk->segments.push_back(ChunkSegment());
+				chunk->segments.back().startsGroup = true;
+				cornerTable.Clear();
+				break;
+			case RecordMaterial:
+				chunk->segments.push_back(ChunkSegment());
+				chunk->segments.back().startsMaterial = true;
+				chunk->segments.back().material = ReadName(args, lineEnd);
+				cornerTable.Clear();
+				break;
+			default:
+				break;
+			}
+			cursor = lineEnd + 1;
+		}
+
+		UNREFERENCED_PARAMETER(instance);
+		UNREFERENCED_PARAMETER(work);
+	}
+
+	// Run a callback once per chunk on the default thread pool
+	// The calling thread takes the last chunk instead of sitting idle
+	void RunChunks(PTP_WORK_CALLBACK callback, std::vector<ParsedChunk> &chunks)
+	{
+		std::vector<PTP_WORK> works(chunks.size() - 1);
+		for (size_t i = 0; i < works.size(); ++i)
+		{
+			works[i] = CreateThreadpoolWork(callback, &chunks[i], NULL);
+			SubmitThreadpoolWork(works[i]);
+		}
+
+		callback(NULL, &chunks.back(), NULL);
+
+		for (size_t i = 0; i < works.size(); ++i)
+		{
+			WaitForThreadpoolWorkCallbacks(works[i], FALSE);
+			CloseThreadpoolWork(works[i]);
+		}
+	}
+
+	// Single pass, faces are assembled as soon as they are parsed
+	void LoadSingleThreaded(const char *cursor, const char *end, MaterialTable &materials, const OBJFile::LoadSettings &settings, ScratchArena &arena, const OBJFile::ModelCallback &onModel)
+	{
+		// Unique vertices usually land between 0.5 and 1 per face, the table grows if we guessed low
+		Directives directives;
+		RecordCounts counts = CountRecords(cursor, end, directives);
+		RawAttributes raw(arena, counts);
+		LoadMaterials(materials, directives);
+
+		ModelBuilder builder(materials, settings, arena);
+		builder.Reserve(counts.faces);
+
+		RecordCounts seen = { 0, 0, 0, 0 };
+		std::vector<FaceCorner> corners;
+
+		while (cursor < end)
+		{
+			const char *lineEnd = FindLineEnd(cursor, end);
+			const char *args;
+			switch (ReadRecordType(cursor, lineEnd, args))
+			{
+			case RecordVertex:
+				ParseVec3(args, lineEnd, raw.vertices[seen.vertices++]);
+				break;
+			case RecordNormal:
+				ParseVec3(args, lineEnd, raw.normals[seen.normals++]);
+				break;
+			case RecordUV:
+				ParseVec3(args, lineEnd, raw.uvs[seen.uvs++]);
+				break;
+			case RecordFace:
+				corners.clear();
+				ParseFace(args, lineEnd, seen, corners);
+				builder.AddFace(raw, corners);
+				break;
+			case RecordGroup:
+				builder.StartGroup(onModel);
+				break;
+			case RecordMaterial:
+				builder.UseMaterial(ReadName(args, lineEnd), onModel);
+				break;
+			default:
+				break;
+			}
+			cursor = lineEnd + 1;
+		}
+
+		builder.Finish(onModel);
+	}
+
+	// Split at newlines and parse the chunks in parallel, merging the segments in file order as the chunks finish
+	// Unique corners are merged in order of first use, so the output matches the single threaded path exactly
+	void LoadMultiThreaded(const char *begin, const char *end, unsigned int chunkCount, MaterialTable &materials, const OBJFile::LoadSettings &settings, ScratchArena &arena, const OBJFile::ModelCallback &onModel)
+	{
+		std::vector<ParsedChunk> chunks(chunkCount);
+		const char *cursor = begin;
+		for (unsigned int i = 0; i < chunkCount; ++i)
+		{
+			const char *chunkEnd = (i + 1 == chunkCount) ? end : begin + (end - begin) * (i + 1) / chunkCount;
+			if (chunkEnd < cursor)
+			{
+				chunkEnd = cursor;
+			}
+			else if (chunkEnd < end)
+			{
+				chunkEnd = FindLineEnd(chunkEnd, end);
+				chunkEnd = chunkEnd < end ? chunkEnd + 1 : end;
+			}
+
+			chunks[i].begin = cursor;
+			chunks[i].end = chunkEnd;
+			cursor = chunkEnd;
+		}
+
+		// Pass one counts records per chunk so every chunk knows its global base indices
+		RunChunks(CountChunkCallback, chunks);
+
+		RecordCounts total = { 0, 0, 0, 0 };
+		for (unsigned int i = 0; i < chunkCount; ++i)
+		{
+			chunks[i].base = total;
+			total.vertices += chunks[i].counts.vertices;
+			total.normals += chunks[i].counts.normals;
+			total.uvs += chunks[i].counts.uvs;
+			total.faces += chunks[i].counts.faces;
+		}
+
+		RawAttributes raw(arena, total);
+		for (unsigned int i = 0; i < chunkCount; ++i)
+		{
+			chunks[i].raw = &raw;
+			chunks[i].arena = &arena;
+		}
+
+		// Materials are settled before the merge, usemtl only ever looks them up by name
+		Directives directives;
+		for (unsigned int i = 0; i < chunkCount; ++i)
+		{
+			const Directives &found = chunks[i].directives;
+			directives.libraries.insert(directives.libraries.end(), found.libraries.begin(), found.libraries.end());
+			directives.materials.insert(directives.materials.end(), found.materials.begin(), found.materials.end());
+		}
+		LoadMaterials(materials, directives);
+
+		// Pass two parses every chunk on the pool, indices are already global
+		std::vector<PTP_WORK> works(chunkCount);
+		for (unsigned int i = 0; i < chunkCount; ++i)
+		{
+			works[i] = CreateThreadpoolWork(ParseChunkCallback, &chunks[i], NULL);
+			SubmitThreadpoolWork(works[i]);
+		}
+
+		// Merge pass, walk the segments in file order and split at the g records
+		// Each chunk is merged as soon as it's parsed, so its groups go out while the later chunks are still being read
+		ModelBuilder builder(materials, settings, arena);
+		builder.Reserve(total.faces);
+
+		for (unsigned int i = 0; i < chunkCount; ++i)
+		{
+			WaitForThreadpoolWorkCallbacks(works[i], FALSE);
+			CloseThreadpoolWork(works[i]);
+
+			for (size_t j = 0; j < chunks[i].segments.size(); ++j)
+			{
+				const ChunkSegment &segment = chunks[i].segments[j];
+				if (segment.startsGroup)
+				{
+					builder.StartGroup(onModel);
+				}
+				if (segment.startsMaterial)
+				{
+					builder.UseMaterial(segment.material, onModel);
+				}
+				builder.AddSegment(raw, segment);
+			}
+
+			// Free each chunk's faces as soon as they are merged
+			std::vector<ChunkSegment>().swap(chunks[i].segments);
+		}
+
+		builder.Finish(onModel);
+	}
+}
+
+// Memory-mapped parser
+// Tokenizes the file in place, nothing is allocated per line or per token
+bool OBJFile::LoadFile(std::string fileName, std::vector<Model> &models, const LoadSettings &settings)
+{
+	return LoadFile(fileName, [&models](Model &model) { models.push_back(std::move(model)); }, settings);
+}
+
+// Groups are handed to onModel as soon as the next g record (or the end of the file) is reached
+// Batching by material hands over each material's model once the usemtl records are done with it
+bool OBJFile::LoadFile(std::string fileName, const ModelCallback &onModel, const LoadSettings &settings)
+{
+	MappedFile file;
+	if (!file.Open(fileName))
+	{
+		return false;
+	}
+
+	const char *begin = file.Data();
+	const char *end = begin + file.Size();
+
+	// Skip the UTF-8 byte order mark some exporters write
+	if (file.Size() >= 3 && begin[0] == '\xEF' && begin[1] == '\xBB' && begin[2] == '\xBF')
+	{
+		begin += 3;
+	}
+
+	// Zero threads means one per logical core
+	unsigned int threadCount = settings.threadCount;
+	if (threadCount == 0)
+	{
+		SYSTEM_INFO systemInfo;
+		GetSystemInfo(&systemInfo);
+		threadCount = systemInfo.dwNumberOfProcessors;
+	}
+
+	size_t chunkCount = static_cast<size_t>(end - begin) / minimumChunkSize;
+	if (chunkCount > threadCount)
+	{
+		chunkCount = threadCount;
+	}
+
+	MaterialTable materials;
+	size_t slash = fileName.find_last_of("/\\");
+	if (slash != std::string::npos)
+	{
+		materials.directory = fileName.substr(0, slash + 1);
+	}
+
+	// Scratch only has to outlive the load
+	ScratchArena localArena;
+	ScratchArena &arena = settings.arena != NULL ? *settings.arena : localArena;
+
+	if (chunkCount <= 1)
+	{
+		LoadSingleThreaded(begin, end, materials, settings, arena, onModel);
+	}
+	else
+	{
+		LoadMultiThreaded(begin, end, static_cast<unsigned int>(chunkCount), materials, settings, arena, onModel);
+	}
+
+	arena.Reset();
+	return true;
+}
+
+// Original std::getline/substr parser
+// Kept around so the benchmark can compare against the mapped parser
+// Still produces the old 3 float positions, don't hand its output to AddModel
+bool OBJFile::LoadFileLegacy(std::string fileName, std::vector<Model> &models)
 {
     // Store the raw vertices, normals, uvs per face
     std::vector<Vec3> vertices;
@@ -28,7 +976,8 @@ void OBJFile::LoadFile(std::string fileName, std::vector<Model> &models)
     std::string fileData;
     std::string line;
 
-    if (objFile.is_open())
+    bool opened = objFile.is_open();
+    if (opened)
     {
         while (std::getline(objFile, line))
         {
@@ -49,7 +998,7 @@ void OBJFile::LoadFile(std::string fileName, std::vector<Model> &models)
 			{
 				if (model.fileVertices.size() > 0)
 				{
-					models.push_back(model);
+					models.push_back(std::move(model));
 				}
 				model.fileIndices.clear();
 				model.fileNormals.clear();
@@ -242,8 +1191,7 @@ void OBJFile::LoadFile(std::string fileName, std::vector<Model> &models)
         objFile.close();
     }
 
-    // TODO: Cleanup so we don't have to create a normals buffer when no normals present
-    // Requires some sort of flag in the render pipeline
+    // Zeroed normals keep the streams the same length, the mapped parser can generate real ones, see LoadSettings::generateNormals
     if (normals.empty())
     {
         for (unsigned int i = 0; i < vertices.size(); ++i)
@@ -257,6 +1205,12 @@ void OBJFile::LoadFile(std::string fileName, std::vector<Model> &models)
         }
     }
 
+    // The last group has no g after it to push it
+    if (model.fileVertices.size() > 0)
+    {
+        models.push_back(std::move(model));
+    }
+
     // Need to do find replace \r to \n for windows->android(linux)
 	// TODO: Re-enable when porting to Android
 /*    size_t pos;
@@ -264,4 +1218,5 @@ void OBJFile::LoadFile(std::string fileName, std::vector<Model> &models)
     {
         fileData.replace(pos, std::string("\r").length(), "\n");
     }    */        
+    return opened;
 }
@@ -2,11 +2,69 @@
 
 #include <string>
 #include <vector>
+#include <functional>
 #include "Model.h"
 
+class ScratchArena;
+
 // Load .obj files
+// Materials come from the mtllib libraries, looked up next to the .obj
+// All of them are loaded before the first face, so where an mtllib sits in the file doesn't matter
 class OBJFile
 {
 public:
-    static void LoadFile(std::string fileName, std::vector<Model> &models);
+    struct LoadSettings
+    {
+        // Threads used to parse the file, 0 uses one per logical core
+        // Small files are always parsed on the calling thread
+        unsigned int threadCount;
+
+        // Ignore g groups and merge every face sharing a material into one model
+        // Each material's model is handed over once no later usemtl names it
+        bool batchByMaterial;
+
+        // Reorder each finished model's triangles and vertices for the GPU's vertex cache and fetch, see MeshOptimizer
+        bool optimizeMeshes;
+
+        // With optimizeMeshes, also sort triangle clusters to cut overdraw, see MeshOptimizer::OptimizeOverdraw
+        // How much worse the vertex cache may get for it, 1.05 allows 5%, 0 leaves the cache order alone
+        float overdrawThreshold;
+
+        // Split each finished model into meshlets with culling data, after optimizing if that's on, see MeshletBuilder
+        bool buildMeshlets;
+
+        // Build a chain of simplified levels of detail for each finished model, see MeshSimplifier::BuildLods
+        bool buildLods;
+
+        // Give models without any vn records smooth normals instead of zeroes, see NormalGenerator
+        // Uses threadCount threads, done before anything else touches the finished model
+        bool generateNormals;
+
+        // With generateNormals, faces meeting at more than this many degrees keep a hard edge, 180 smooths everything
+        float creaseAngle;
+
+        // Where the raw attribute arrays and vertex dedup tables come from, NULL uses an arena just for the call
+        // It's reset once the load is done, so a reused arena has the memory ready for the next file
+        // Loads sharing an arena can't run at the same time
+        ScratchArena *arena;
+
+        // Where MeshCache keeps its .meshcache files, with a trailing slash, empty puts them next to the .obj
+        std::string cacheDirectory;
+
+        LoadSettings() : threadCount(1), batchByMaterial(false), optimizeMeshes(false), overdrawThreshold(0.0f), buildMeshlets(false), buildLods(false),
+            generateNormals(false), creaseAngle(180.0f), arena(NULL) {}
+    };
+
+    // Called with each completed g group (or material when batching by material), the model can be moved from
+    typedef std::function<void(Model &model)> ModelCallback;
+
+    // Returns false if the file couldn't be opened
+    static bool LoadFile(std::string fileName, std::vector<Model> &models, const LoadSettings &settings = LoadSettings());
+
+    // Streaming version, groups are handed over one at a time instead of collecting the whole file
+    // With more than one thread each chunk's groups arrive once it and every chunk before it are parsed
+    static bool LoadFile(std::string fileName, const ModelCallback &onModel, const LoadSettings &settings = LoadSettings());
+
+    // Original stream based parser, only used to benchmark against
+    static bool LoadFileLegacy(std::string fileName, std::vector<Model> &models);
 };
\ No newline at end of file
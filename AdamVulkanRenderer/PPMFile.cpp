@@ -0,0 +1,171 @@
+#include "stdafx.h"
+#include "PPMFile.h"
+#include "MappedFile.h"
+#include "TextScanner.h"
+#include <emmintrin.h>
+#include <immintrin.h>
+#include <cstdio>
+#include <cstring>
+
+namespace
+{
+	const int saneDimension = 99999;
+
+	inline bool IsWhitespace(char c)
+	{
+		return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\v' || c == '\f';
+	}
+
+	// Whitespace and # comments, which run to the end of the line, can go between header fields
+	const char *SkipSeparators(const char *cursor, const char *end)
+	{
+		while (cursor < end)
+		{
+			if (*cursor == '#')
+			{
+				cursor = TextScanner::FindLineEnd(cursor, end);
+			}
+			else if (IsWhitespace(*cursor))
+			{
+				++cursor;
+			}
+			else
+			{
+				break;
+			}
+		}
+		return cursor;
+	}
+
+	const char *ParseField(const char *cursor, const char *end, int &value)
+	{
+		cursor = SkipSeparators(cursor, end);
+		if (cursor == end || *cursor < '0' || *cursor > '9')
+		{
+			return NULL;
+		}
+
+		const char *fieldEnd = TextScanner::ParseInt(cursor, end, value);
+		return fieldEnd == cursor ? NULL : fieldEnd;
+	}
+
+	void ExpandRowScalar(const unsigned char *rgb, unsigned char *rgba, int count)
+	{
+		for (int x = 0; x < count; ++x)
+		{
+			rgba[0] = rgb[0];
+			rgba[1] = rgb[1];
+			rgba[2] = rgb[2];
+			rgba[3] = 255;
+			rgb += 3;
+			rgba += 4;
+		}
+	}
+
+	// SSE2 has no byte shuffle, so each pixel's three bytes are shifted to the bottom of a copy of the load
+	// and the copies interleaved a dword at a time, the stray fourth byte is then overwritten with alpha
+	// Reads 16 bytes for 12
+	inline __m128i ExpandSSE2(const unsigned char *rgb, __m128i alpha)
+	{
+		__m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(rgb));
+		__m128i first = _mm_unpacklo_epi32(x, _mm_srli_si128(x, 3));
+		__m128i second = _mm_unpacklo_epi32(_mm_srli_si128(x, 6), _mm_srli_si128(x, 9));
+		return _mm_or_si128(_mm_unpacklo_epi64(first, second), alpha);
+	}
+
+	// Each 128 bit half takes four pixels, the dword permute lines them up so one shuffle spreads both halves
+	// Reads 32 bytes for 24
+	inline __m256i ExpandAVX2(const unsigned char *rgb, __m256i spread, __m256i shuffle, __m256i alpha)
+	{
+		__m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(rgb));
+		x = _mm256_permutevar8x32_epi32(x, spread);
+		return _mm256_or_si256(_mm256_shuffle_epi8(x, shuffle), alpha);
+	}
+}
+
+bool PPMFile::ParseHeader(const char *data, size_t size, Header &header)
+{
+	// PPM format from http://netpbm.sourceforge.net/doc/ppm.html
+	// Magic number, width, height and max color value separated by whitespace, then exactly one whitespace byte and the pixels
+	const char *end = data + size;
+	if (size < 2 || data[0] != 'P' || data[1] != '6')
+	{
+		return false;
+	}
+
+	int maxValue = 0;
+	const char *cursor = data + 2;
+	if ((cursor = ParseField(cursor, end, header.width)) == NULL ||
+		(cursor = ParseField(cursor, end, header.height)) == NULL ||
+		(cursor = ParseField(cursor, end, maxValue)) == NULL ||
+		cursor == end || !IsWhitespace(*cursor))
+	{
+		return false;
+	}
+
+	// Only one byte per channel is supported, values are used as they are without scaling to the max
+	if (header.width <= 0 || header.width > saneDimension || header.height <= 0 || header.height > saneDimension || maxValue <= 0 || maxValue > 255)
+	{
+		return false;
+	}
+
+	header.dataOffset = cursor + 1 - data;
+	return size - header.dataOffset >= size_t(header.width) * header.height * 3;
+}
+
+void PPMFile::ExpandRGB(const unsigned char *rgb, int width, int height, unsigned char *rgba, size_t rowPitch)
+{
+	TextScanner::Kernel kernel = TextScanner::GetKernel();
+	const __m128i alpha = _mm_set1_epi32(0xFF000000);
+	const __m256i wideAlpha = _mm256_set1_epi32(0xFF000000);
+	const __m256i spread = _mm256_setr_epi32(0, 1, 2, 0, 3, 4, 5, 0);
+	const __m256i shuffle = _mm256_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+
+	for (int y = 0; y < height; ++y)
+	{
+		const unsigned char *source = rgb + size_t(y) * width * 3;
+		unsigned char *destination = rgba + size_t(y) * rowPitch;
+
+		// Loads read past the pixels they use, keep them inside the row
+		// Stores go front to back, so write combined image memory sees whole lines
+		int x = 0;
+		if (kernel == TextScanner::KernelAVX2)
+		{
+			for (; width - x >= 11; x += 8)
+			{
+				_mm256_storeu_si256(reinterpret_cast<__m256i *>(destination + x * 4), ExpandAVX2(source + x * 3, spread, shuffle, wideAlpha));
+			}
+		}
+		if (kernel != TextScanner::KernelScalar)
+		{
+			for (; width - x >= 6; x += 4)
+			{
+				_mm_storeu_si128(reinterpret_cast<__m128i *>(destination + x * 4), ExpandSSE2(source + x * 3, alpha));
+			}
+		}
+		ExpandRowScalar(source + x * 3, destination + x * 4, width - x);
+	}
+}
+
+bool PPMFile::Load(const std::string &fileName, int &width, int &height, std::vector<unsigned char> &pixels)
+{
+	MappedFile file;
+	if (!file.Open(fileName))
+	{
+		printf("Bad filename in read_ppm: %s\n", fileName.c_str());
+		return false;
+	}
+
+	Header header;
+	if (!ParseHeader(file.Data(), file.Size(), header))
+	{
+		printf("Unhandled PPM file: %s\n", fileName.c_str());
+		return false;
+	}
+
+	width = header.width;
+	height = header.height;
+	pixels.resize(size_t(width) * height * 4);
+	ExpandRGB(reinterpret_cast<const unsigned char *>(file.Data()) + header.dataOffset, width, height, pixels.data(), size_t(width) * 4);
+	return true;
+}
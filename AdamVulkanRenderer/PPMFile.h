@@ -0,0 +1,31 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+// Binary (P6) .ppm reading, 8 bits per channel
+// The file is mapped and its pixels expanded from RGB to RGBA8 in one pass, straight into wherever they're going
+// Expansion is vectorized with the kernel TextScanner picked
+class PPMFile
+{
+public:
+	struct Header
+	{
+		int width;
+		int height;
+
+		// Where the RGB rows start, they're tightly packed
+		size_t dataOffset;
+	};
+
+	// Parse the header at the start of a mapped file
+	// False for anything but P6 with one byte per channel, or if the file is too short for its pixels
+	static bool ParseHeader(const char *data, size_t size, Header &header);
+
+	// RGB rows to RGBA8 rows with opaque alpha, rowPitch bytes apart, e.g. into a mapped linear image
+	static void ExpandRGB(const unsigned char *rgb, int width, int height, unsigned char *rgba, size_t rowPitch);
+
+	// Whole file into tightly packed RGBA8 rows
+	static bool Load(const std::string &fileName, int &width, int &height, std::vector<unsigned char> &pixels);
+};
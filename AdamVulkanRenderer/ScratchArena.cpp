@@ -0,0 +1,80 @@
+#include "stdafx.h"
+#include "ScratchArena.h"
+#include <algorithm>
+
+ScratchArena::ScratchArena()
+{
+}
+
+ScratchArena::~ScratchArena()
+{
+	for (size_t i = 0; i < m_blocks.size(); ++i)
+	{
+		::operator delete(m_blocks[i].data);
+	}
+}
+
+void *ScratchArena::Allocate(size_t bytes, size_t alignment)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	// Only the newest block is bumped, whatever is left in older ones is small next to a new block
+	if (!m_blocks.empty())
+	{
+		Block &block = m_blocks.back();
+		size_t offset = (reinterpret_cast<size_t>(block.data) + block.used + alignment - 1) & ~(alignment - 1);
+		offset -= reinterpret_cast<size_t>(block.data);
+		if (offset + bytes <= block.size)
+		{
+			block.used = offset + bytes;
+			return block.data + offset;
+		}
+	}
+
+	// operator new is aligned for anything the loaders store, so a fresh block needs no padding
+	AddBlock(std::max(bytes, minimumBlockSize));
+	Block &block = m_blocks.back();
+	block.used = bytes;
+	return block.data;
+}
+
+void ScratchArena::Reset()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_blocks.size() > 1)
+	{
+		size_t total = 0;
+		for (size_t i = 0; i < m_blocks.size(); ++i)
+		{
+			total += m_blocks[i].size;
+			::operator delete(m_blocks[i].data);
+		}
+		m_blocks.clear();
+		AddBlock(total);
+	}
+
+	if (!m_blocks.empty())
+	{
+		m_blocks.back().used = 0;
+	}
+}
+
+size_t ScratchArena::Capacity() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	size_t total = 0;
+	for (size_t i = 0; i < m_blocks.size(); ++i)
+	{
+		total += m_blocks[i].size;
+	}
+	return total;
+}
+
+void ScratchArena::AddBlock(size_t size)
+{
+	Block block;
+	block.data = static_cast<char *>(::operator new(size));
+	block.size = size;
+	block.used = 0;
+	m_blocks.push_back(block);
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <vector>
+#include <mutex>
+#include <new>
+#include <type_traits>
+
+// Bump allocator for scratch memory that only lives as long as one load, like the raw .obj attributes and dedup tables
+// Nothing is freed on its own, Reset drops everything at once and keeps the memory for the next load,
+// so an arena reused across loads stops allocating once it has grown to fit
+// Allocations are rare and large, a lock makes it safe to share between the parse workers
+class ScratchArena
+{
+public:
+	// Blocks are at least this big, larger requests get a block of their own
+	static const size_t minimumBlockSize = 64 * 1024;
+
+	ScratchArena();
+	~ScratchArena();
+
+	void *Allocate(size_t bytes, size_t alignment = 16);
+
+	// Default constructed elements, they're never destroyed so only trivially destructible types are allowed
+	template <typename T>
+	T *AllocateArray(size_t count)
+	{
+		static_assert(std::is_trivially_destructible<T>::value, "Arena memory is dropped without running destructors");
+		T *elements = static_cast<T *>(Allocate(count * sizeof(T), alignof(T)));
+		for (size_t i = 0; i < count; ++i)
+		{
+			new (&elements[i]) T();
+		}
+		return elements;
+	}
+
+	// Forget every allocation
+	// Blocks from a load that outgrew the first one are merged, so the next load of the same size takes a single block
+	void Reset();
+
+	// Bytes held, whether or not they're in use
+	size_t Capacity() const;
+
+private:
+	struct Block
+	{
+		char *data;
+		size_t size;
+		size_t used;
+	};
+
+	// Blocks are freed in the destructor, so don't allow copies
+	ScratchArena(const ScratchArena &);
+	ScratchArena &operator=(const ScratchArena &);
+
+	void AddBlock(size_t size);
+
+	mutable std::mutex m_mutex;
+	std::vector<Block> m_blocks;
+};
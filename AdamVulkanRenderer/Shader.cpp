@@ -1,21 +1,29 @@
 #include "stdafx.h"
 #include "Shader.h"
 #include <string>
-#include <fstream>
+#include "MappedFile.h"
+#include "TextScanner.h"
 
 // TODO: Remember to remove \n when porting to android
+// Mapped and copied in one go, carriage returns are dropped like the text mode stream this replaced did
 void Shader::LoadFile(std::string fileName, std::string& fileContents)
 {
-	std::ifstream objFile(fileName.c_str());
-
-	if (objFile.is_open())
+	MappedFile file;
+	if (!file.Open(fileName))
 	{
-		objFile.seekg(0, std::ios::end);
-		fileContents.reserve(objFile.tellg());
-		objFile.seekg(0, std::ios::beg);
+		return;
+	}
 
-		fileContents.assign((std::istreambuf_iterator<char>(objFile)),
-			std::istreambuf_iterator<char>());
+	const char *cursor = file.Data();
+	const char *end = cursor + file.Size();
+
+	fileContents.clear();
+	fileContents.reserve(file.Size());
+	while (cursor < end)
+	{
+		const char *carriageReturn = TextScanner::FindByte(cursor, end, '\r');
+		fileContents.append(cursor, carriageReturn);
+		cursor = carriageReturn + 1;
 	}
 }
 
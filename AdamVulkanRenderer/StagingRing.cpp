@@ -0,0 +1,262 @@
+#include "stdafx.h"
+#include "StagingRing.h"
+#include "VulkanCommon.h"
+#include <assert.h>
+
+namespace
+{
+	// Region starts stay aligned for anything a copy asks for
+	const VkDeviceSize regionAlignment = 256;
+}
+
+StagingRing::StagingRing() :
+	m_device(VK_NULL_HANDLE),
+	m_queue(VK_NULL_HANDLE),
+	m_commandPool(VK_NULL_HANDLE),
+	m_buffer(VK_NULL_HANDLE),
+	m_memory(VK_NULL_HANDLE),
+	m_data(NULL),
+	m_cached(false),
+	m_regionSize(0),
+	m_current(0)
+{
+}
+
+void StagingRing::Initialize(const VkDevice &device, uint32_t queueFamilyIndex, const VkQueue &queue, VkDeviceSize size, uint32_t regionCount)
+{
+	VkResult result;
+	m_device = device;
+	m_queue = queue;
+
+	// Command buffers are reset one region at a time
+	VkCommandPoolCreateInfo commandPoolInfo = {};
+	commandPoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	commandPoolInfo.pNext = NULL;
+	commandPoolInfo.queueFamilyIndex = queueFamilyIndex;
+	commandPoolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT | VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+	result = vkCreateCommandPool(m_device, &commandPoolInfo, NULL, &m_commandPool);
+	assert(result == VK_SUCCESS);
+
+	std::vector<VkCommandBuffer> commandBuffers(regionCount);
+	VkCommandBufferAllocateInfo commandBufferInfo = {};
+	commandBufferInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	commandBufferInfo.pNext = NULL;
+	commandBufferInfo.commandPool = m_commandPool;
+	commandBufferInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	commandBufferInfo.commandBufferCount = regionCount;
+
+	result = vkAllocateCommandBuffers(m_device, &commandBufferInfo, commandBuffers.data());
+	assert(result == VK_SUCCESS);
+
+	m_regionSize = size / regionCount / regionAlignment * regionAlignment;
+	CreateMappedBuffer(m_regionSize * regionCount, m_buffer, m_memory, m_data, m_cached);
+
+	// Fences start signalled, so the first wait on each region goes straight through
+	VkFenceCreateInfo fenceInfo;
+	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	fenceInfo.pNext = NULL;
+	fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+	m_regions.resize(regionCount);
+	for (uint32_t i = 0; i < regionCount; ++i)
+	{
+		m_regions[i].start = m_regionSize * i;
+		m_regions[i].used = 0;
+		m_regions[i].commandBuffer = commandBuffers[i];
+		m_regions[i].recorded = false;
+
+		result = vkCreateFence(m_device, &fenceInfo, NULL, &m_regions[i].fence);
+		assert(result == VK_SUCCESS);
+	}
+
+	m_current = 0;
+	Begin(m_regions[m_current]);
+}
+
+void StagingRing::Destroy()
+{
+	// The current region is still recording and has nothing in flight
+	for (size_t i = 0; i < m_regions.size(); ++i)
+	{
+		Region &region = m_regions[i];
+		VkResult result;
+		do
+		{
+			result = vkWaitForFences(m_device, 1, &region.fence, VK_TRUE, FENCE_TIMEOUT);
+		} while (result == VK_TIMEOUT);
+		assert(result == VK_SUCCESS);
+
+		for (size_t j = 0; j < region.oversizeBuffers.size(); ++j)
+		{
+			vkDestroyBuffer(m_device, region.oversizeBuffers[j], NULL);
+			vkFreeMemory(m_device, region.oversizeMemory[j], NULL);
+		}
+		vkDestroyFence(m_device, region.fence, NULL);
+		vkFreeCommandBuffers(m_device, m_commandPool, 1, &region.commandBuffer);
+	}
+	m_regions.clear();
+
+	vkDestroyCommandPool(m_device, m_commandPool, NULL);
+	vkUnmapMemory(m_device, m_memory);
+	vkDestroyBuffer(m_device, m_buffer, NULL);
+	vkFreeMemory(m_device, m_memory, NULL);
+	m_commandPool = VK_NULL_HANDLE;
+	m_buffer = VK_NULL_HANDLE;
+	m_memory = VK_NULL_HANDLE;
+	m_data = NULL;
+}
+
+StagingRing::Allocation StagingRing::Allocate(VkDeviceSize size, VkDeviceSize alignment)
+{
+	Region &region = m_regions[m_current];
+	region.recorded = true;
+
+	Allocation allocation;
+	if (size > m_regionSize)
+	{
+		// Rare enough, e.g. one huge texture, that a dedicated buffer beats sizing the ring for it
+		VkBuffer buffer;
+		VkDeviceMemory memory;
+		CreateMappedBuffer(size, buffer, memory, allocation.data, allocation.cached);
+		region.oversizeBuffers.push_back(buffer);
+		region.oversizeMemory.push_back(memory);
+
+		allocation.buffer = buffer;
+		allocation.offset = 0;
+		return allocation;
+	}
+
+	VkDeviceSize offset = (region.used + alignment - 1) / alignment * alignment;
+	if (offset + size > m_regionSize)
+	{
+		Submit();
+		return Allocate(size, alignment);
+	}
+	region.used = offset + size;
+
+	allocation.buffer = m_buffer;
+	allocation.offset = region.start + offset;
+	allocation.data = m_data + allocation.offset;
+	allocation.cached = m_cached;
+	return allocation;
+}
+
+VkCommandBuffer StagingRing::CommandBuffer()
+{
+	Region &region = m_regions[m_current];
+	region.recorded = true;
+	return region.commandBuffer;
+}
+
+void StagingRing::Submit()
+{
+	Region &region = m_regions[m_current];
+	if (!region.recorded)
+	{
+		return;
+	}
+
+	VkResult result = vkEndCommandBuffer(region.commandBuffer);
+	assert(result == VK_SUCCESS);
+
+	result = vkResetFences(m_device, 1, &region.fence);
+	assert(result == VK_SUCCESS);
+
+	VkSubmitInfo submitInfo[1] = {};
+	submitInfo[0].pNext = NULL;
+	submitInfo[0].sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo[0].waitSemaphoreCount = 0;
+	submitInfo[0].pWaitSemaphores = NULL;
+	submitInfo[0].pWaitDstStageMask = NULL;
+	submitInfo[0].commandBufferCount = 1;
+	submitInfo[0].pCommandBuffers = &region.commandBuffer;
+	submitInfo[0].signalSemaphoreCount = 0;
+	submitInfo[0].pSignalSemaphores = NULL;
+
+	result = vkQueueSubmit(m_queue, 1, submitInfo, region.fence);
+	assert(result == VK_SUCCESS);
+
+	m_current = (m_current + 1) % m_regions.size();
+	Begin(m_regions[m_current]);
+}
+
+void StagingRing::Begin(Region &region)
+{
+	// Submitted a whole lap of the ring ago, so this hardly ever has to wait
+	VkResult result;
+	do
+	{
+		result = vkWaitForFences(m_device, 1, &region.fence, VK_TRUE, FENCE_TIMEOUT);
+	} while (result == VK_TIMEOUT);
+	assert(result == VK_SUCCESS);
+
+	for (size_t i = 0; i < region.oversizeBuffers.size(); ++i)
+	{
+		vkDestroyBuffer(m_device, region.oversizeBuffers[i], NULL);
+		vkFreeMemory(m_device, region.oversizeMemory[i], NULL);
+	}
+	region.oversizeBuffers.clear();
+	region.oversizeMemory.clear();
+	region.used = 0;
+	region.recorded = false;
+
+	result = vkResetCommandBuffer(region.commandBuffer, 0);
+	assert(result == VK_SUCCESS);
+
+	VkCommandBufferBeginInfo cmdBufInfo = {};
+	cmdBufInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	cmdBufInfo.pNext = NULL;
+	cmdBufInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	cmdBufInfo.pInheritanceInfo = NULL;
+
+	result = vkBeginCommandBuffer(region.commandBuffer, &cmdBufInfo);
+	assert(result == VK_SUCCESS);
+}
+
+void StagingRing::CreateMappedBuffer(VkDeviceSize size, VkBuffer &buffer, VkDeviceMemory &memory, unsigned char *&data, bool &cached)
+{
+	VkResult result;
+
+	VkBufferCreateInfo bufferInfo = {};
+	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferInfo.pNext = NULL;
+	bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+	bufferInfo.size = size;
+	bufferInfo.queueFamilyIndexCount = 0;
+	bufferInfo.pQueueFamilyIndices = NULL;
+	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	bufferInfo.flags = 0;
+
+	result = vkCreateBuffer(m_device, &bufferInfo, NULL, &buffer);
+	assert(result == VK_SUCCESS);
+
+	VkMemoryRequirements mem_reqs;
+	vkGetBufferMemoryRequirements(m_device, buffer, &mem_reqs);
+
+	VkMemoryAllocateInfo mem_alloc = {};
+	mem_alloc.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	mem_alloc.pNext = NULL;
+	mem_alloc.allocationSize = mem_reqs.size;
+	mem_alloc.memoryTypeIndex = 0;
+
+	// Cached when there is some, so the CPU can read back what it wrote, e.g. the mip filter
+	cached = VulkanCommon::GetMemoryType(mem_reqs.memoryTypeBits, VkMemoryPropertyFlagBits(VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT), mem_alloc.memoryTypeIndex);
+	if (!cached)
+	{
+		bool pass = VulkanCommon::GetMemoryType(mem_reqs.memoryTypeBits, VkMemoryPropertyFlagBits(VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT), mem_alloc.memoryTypeIndex);
+		assert(pass);
+	}
+
+	result = vkAllocateMemory(m_device, &mem_alloc, NULL, &memory);
+	assert(result == VK_SUCCESS);
+
+	result = vkBindBufferMemory(m_device, buffer, memory, 0);
+	assert(result == VK_SUCCESS);
+
+	// Mapped for as long as the buffer lives
+	void *mapped;
+	result = vkMapMemory(m_device, memory, 0, size, 0, &mapped);
+	assert(result == VK_SUCCESS);
+	data = static_cast<unsigned char *>(mapped);
+}
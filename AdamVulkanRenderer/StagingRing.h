@@ -0,0 +1,89 @@
+#pragma once
+
+#include "vulkan/vulkan.h"
+#include <vector>
+
+// Fence timeout constant for Vulkan fences
+#define FENCE_TIMEOUT 100000000
+
+// One large persistently mapped buffer that every upload is staged in
+// It's split into regions, each with a command buffer and a fence. Uploads take space in the current region
+// and record their copies into its command buffer, Submit sends them all in one batch and moves on to the next region
+// A region is only written again once its fence has signalled, which was normally frames ago, so uploads don't wait on the GPU
+class StagingRing
+{
+public:
+	struct Allocation
+	{
+		VkBuffer buffer;
+		VkDeviceSize offset;
+
+		// Mapped, already at offset
+		unsigned char *data;
+
+		// Reads from data are as quick as from any other memory
+		bool cached;
+	};
+
+	StagingRing();
+
+	// size is split evenly between regionCount regions
+	void Initialize(const VkDevice &device, uint32_t queueFamilyIndex, const VkQueue &queue, VkDeviceSize size, uint32_t regionCount);
+
+	// Waits for the copies still in flight, the rest of the queue doesn't have to be idle
+	void Destroy();
+
+	// size bytes in the current region at a multiple of alignment
+	// A region without room is submitted early for the next one, anything bigger than a whole region
+	// gets a buffer of its own that's freed along with the region
+	// Allocating can move on to another command buffer, so get CommandBuffer after it
+	Allocation Allocate(VkDeviceSize size, VkDeviceSize alignment);
+
+	// Recording, the copies out of the current region's allocations and their barriers go here
+	VkCommandBuffer CommandBuffer();
+
+	// Submit the current region's commands, if it has any, and move on to the next
+	// Copies finish before later submissions on the queue use what they wrote, as long as their barriers were recorded too
+	void Submit();
+
+private:
+	// Waits for the GPU to be done with the command buffer, so don't allow copies
+	StagingRing(const StagingRing &);
+	StagingRing &operator=(const StagingRing &);
+
+	struct Region
+	{
+		// Bytes from the start of the buffer
+		VkDeviceSize start;
+		VkDeviceSize used;
+
+		VkCommandBuffer commandBuffer;
+		VkFence fence;
+
+		// Something was allocated or recorded since the region was started
+		bool recorded;
+
+		// Allocations too big for a region, freed once the fence signals
+		std::vector<VkBuffer> oversizeBuffers;
+		std::vector<VkDeviceMemory> oversizeMemory;
+	};
+
+	// Wait for the region's last batch, free what it held and start recording again
+	void Begin(Region &region);
+
+	// Host visible and coherent, cached as well when there's such memory
+	void CreateMappedBuffer(VkDeviceSize size, VkBuffer &buffer, VkDeviceMemory &memory, unsigned char *&data, bool &cached);
+
+	VkDevice m_device;
+	VkQueue m_queue;
+	VkCommandPool m_commandPool;
+
+	VkBuffer m_buffer;
+	VkDeviceMemory m_memory;
+	unsigned char *m_data;
+	bool m_cached;
+
+	VkDeviceSize m_regionSize;
+	std::vector<Region> m_regions;
+	size_t m_current;
+};
@@ -0,0 +1,377 @@
+#include "stdafx.h"
+#include "TextScanner.h"
+#include <intrin.h>
+#include <emmintrin.h>
+#include <immintrin.h>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <cfloat>
+
+namespace
+{
+	typedef const char *(*FindByteFunction)(const char *cursor, const char *end, char c);
+	typedef const char *(*FindWhitespaceFunction)(const char *cursor, const char *end);
+
+	struct KernelTable
+	{
+		FindByteFunction findByte;
+		FindWhitespaceFunction findWhitespace;
+	};
+
+	inline bool IsWhitespace(char c)
+	{
+		return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+	}
+
+	inline unsigned long FirstSetBit(unsigned int mask)
+	{
+		unsigned long index;
+		_BitScanForward(&index, mask);
+		return index;
+	}
+
+	// Scalar -----------------------------------------------------------------
+
+	const char *FindByteScalar(const char *cursor, const char *end, char c)
+	{
+		const char *found = static_cast<const char *>(memchr(cursor, c, end - cursor));
+		return found == NULL ? end : found;
+	}
+
+	const char *FindWhitespaceScalar(const char *cursor, const char *end)
+	{
+		while (cursor < end && !IsWhitespace(*cursor))
+		{
+			++cursor;
+		}
+		return cursor;
+	}
+
+	// SSE2, 16 bytes at a time ------------------------------------------------
+	// Unaligned loads never run past end, the last partial block goes to the scalar code
+
+	const char *FindByteSSE2(const char *cursor, const char *end, char c)
+	{
+		const __m128i needle = _mm_set1_epi8(c);
+		while (end - cursor >= 16)
+		{
+			__m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(cursor));
+			unsigned int mask = static_cast<unsigned int>(_mm_movemask_epi8(_mm_cmpeq_epi8(block, needle)));
+			if (mask != 0)
+			{
+				return cursor + FirstSetBit(mask);
+			}
+			cursor += 16;
+		}
+		return FindByteScalar(cursor, end, c);
+	}
+
+	const char *FindWhitespaceSSE2(const char *cursor, const char *end)
+	{
+		const __m128i space = _mm_set1_epi8(' ');
+		const __m128i tab = _mm_set1_epi8('\t');
+		const __m128i carriageReturn = _mm_set1_epi8('\r');
+		const __m128i newline = _mm_set1_epi8('\n');
+		while (end - cursor >= 16)
+		{
+			__m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(cursor));
+			__m128i found = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(block, space), _mm_cmpeq_epi8(block, tab)),
+				_mm_or_si128(_mm_cmpeq_epi8(block, carriageReturn), _mm_cmpeq_epi8(block, newline)));
+			unsigned int mask = static_cast<unsigned int>(_mm_movemask_epi8(found));
+			if (mask != 0)
+			{
+				return cursor + FirstSetBit(mask);
+			}
+			cursor += 16;
+		}
+		return FindWhitespaceScalar(cursor, end);
+	}
+
+	// AVX2, 32 bytes at a time ------------------------------------------------
+
+	const char *FindByteAVX2(const char *cursor, const char *end, char c)
+	{
+		const __m256i needle = _mm256_set1_epi8(c);
+		while (end - cursor >= 32)
+		{
+			__m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(cursor));
+			unsigned int mask = static_cast<unsigned int>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, needle)));
+			if (mask != 0)
+			{
+				return cursor + FirstSetBit(mask);
+			}
+			cursor += 32;
+		}
+		return FindByteSSE2(cursor, end, c);
+	}
+
+	const char *FindWhitespaceAVX2(const char *cursor, const char *end)
+	{
+		const __m256i space = _mm256_set1_epi8(' ');
+		const __m256i tab = _mm256_set1_epi8('\t');
+		const __m256i carriageReturn = _mm256_set1_epi8('\r');
+		const __m256i newline = _mm256_set1_epi8('\n');
+		while (end - cursor >= 32)
+		{
+			__m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(cursor));
+			__m256i found = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(block, space), _mm256_cmpeq_epi8(block, tab)),
+				_mm256_or_si256(_mm256_cmpeq_epi8(block, carriageReturn), _mm256_cmpeq_epi8(block, newline)));
+			unsigned int mask = static_cast<unsigned int>(_mm256_movemask_epi8(found));
+			if (mask != 0)
+			{
+				return cursor + FirstSetBit(mask);
+			}
+			cursor += 32;
+		}
+		return FindWhitespaceSSE2(cursor, end);
+	}
+
+	const KernelTable kernelTables[TextScanner::KernelCount] =
+	{
+		{ FindByteScalar, FindWhitespaceScalar },
+		{ FindByteSSE2, FindWhitespaceSSE2 },
+		{ FindByteAVX2, FindWhitespaceAVX2 },
+	};
+
+	bool supportedKernels[TextScanner::KernelCount];
+
+	TextScanner::Kernel DetectSupport()
+	{
+		int info[4];
+		__cpuid(info, 0);
+		int maxLeaf = info[0];
+
+		__cpuid(info, 1);
+		bool sse2 = (info[3] & (1 << 26)) != 0;
+		bool osxsave = (info[2] & (1 << 27)) != 0;
+		bool avx = (info[2] & (1 << 28)) != 0;
+
+		bool avx2 = false;
+		if (maxLeaf >= 7)
+		{
+			__cpuidex(info, 7, 0);
+			avx2 = (info[1] & (1 << 5)) != 0;
+		}
+
+		// The OS also has to save the upper halves of the ymm registers on a context switch
+		bool osSavesYmm = osxsave && avx && (_xgetbv(0) & 6) == 6;
+
+		supportedKernels[TextScanner::KernelScalar] = true;
+		supportedKernels[TextScanner::KernelSSE2] = sse2;
+		supportedKernels[TextScanner::KernelAVX2] = sse2 && avx2 && osSavesYmm;
+
+		return supportedKernels[TextScanner::KernelAVX2] ? TextScanner::KernelAVX2 : sse2 ? TextScanner::KernelSSE2 : TextScanner::KernelScalar;
+	}
+
+	const TextScanner::Kernel detectedKernel = DetectSupport();
+	TextScanner::Kernel activeKernel = detectedKernel;
+	const KernelTable *activeTable = &kernelTables[detectedKernel];
+
+	// Exact powers of ten, every one of these is representable so one multiply or divide rounds correctly
+	const float floatPowers[] = { 1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f };
+	const double doublePowers[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+	inline bool IsDigit(char c)
+	{
+		return static_cast<unsigned char>(c - '0') < 10;
+	}
+
+	// Anything the fast paths can't prove exact goes through from_chars
+	// number is past any leading +, failure returns the untouched original cursor
+	const char *ParseFloatSlow(const char *original, const char *number, const char *end, float &value)
+	{
+		std::from_chars_result result = std::from_chars(number, end, value);
+		return result.ec == std::errc() ? result.ptr : original;
+	}
+}
+
+TextScanner::Kernel TextScanner::DetectKernel()
+{
+	return detectedKernel;
+}
+
+bool TextScanner::IsSupported(Kernel kernel)
+{
+	return kernel >= 0 && kernel < KernelCount && supportedKernels[kernel];
+}
+
+const char *TextScanner::KernelName(Kernel kernel)
+{
+	static const char *names[KernelCount] = { "scalar", "sse2", "avx2" };
+	return (kernel >= 0 && kernel < KernelCount) ? names[kernel] : "unknown";
+}
+
+void TextScanner::SetKernel(Kernel kernel)
+{
+	if (IsSupported(kernel))
+	{
+		activeKernel = kernel;
+		activeTable = &kernelTables[kernel];
+	}
+}
+
+TextScanner::Kernel TextScanner::GetKernel()
+{
+	return activeKernel;
+}
+
+const char *TextScanner::FindByte(const char *cursor, const char *end, char c)
+{
+	return activeTable->findByte(cursor, end, c);
+}
+
+const char *TextScanner::FindWhitespace(const char *cursor, const char *end)
+{
+	return activeTable->findWhitespace(cursor, end);
+}
+
+const char *TextScanner::ParseFloat(const char *cursor, const char *end, float &value)
+{
+	const char *original = cursor;
+	const char *start = cursor;
+	if (cursor < end && *cursor == '+')
+	{
+		start = ++cursor;
+	}
+
+	bool negative = cursor < end && *cursor == '-';
+	if (negative)
+	{
+		++cursor;
+	}
+
+	// Accumulate every digit, anything over 19 digits may have wrapped and takes the slow path
+	uint64_t mantissa = 0;
+	int exponent = 0;
+
+	const char *digitsStart = cursor;
+	for (; cursor < end && IsDigit(*cursor); ++cursor)
+	{
+		mantissa = mantissa * 10 + (*cursor - '0');
+	}
+	ptrdiff_t digits = cursor - digitsStart;
+
+	if (cursor < end && *cursor == '.')
+	{
+		const char *fractionStart = ++cursor;
+		for (; cursor < end && IsDigit(*cursor); ++cursor)
+		{
+			mantissa = mantissa * 10 + (*cursor - '0');
+		}
+		exponent = -static_cast<int>(cursor - fractionStart);
+		digits += cursor - fractionStart;
+	}
+
+	// No digits at all could still be inf or nan
+	if (digits == 0 || digits > 19)
+	{
+		return ParseFloatSlow(original, start, end, value);
+	}
+
+	if (cursor < end && (*cursor == 'e' || *cursor == 'E'))
+	{
+		const char *exponentCursor = cursor + 1;
+		bool negativeExponent = false;
+		if (exponentCursor < end && (*exponentCursor == '-' || *exponentCursor == '+'))
+		{
+			negativeExponent = *exponentCursor == '-';
+			++exponentCursor;
+		}
+
+		// Only an exponent with digits is part of the number, "1e" parses as 1
+		if (exponentCursor < end && IsDigit(*exponentCursor))
+		{
+			int exponentValue = 0;
+			for (; exponentCursor < end && IsDigit(*exponentCursor); ++exponentCursor)
+			{
+				if (exponentValue > 1000)
+				{
+					return ParseFloatSlow(original, start, end, value);
+				}
+				exponentValue = exponentValue * 10 + (*exponentCursor - '0');
+			}
+			exponent += negativeExponent ? -exponentValue : exponentValue;
+			cursor = exponentCursor;
+		}
+	}
+
+	if (mantissa == 0)
+	{
+		value = negative ? -0.0f : 0.0f;
+		return cursor;
+	}
+
+	// Exporters love trailing zeros, dropping them keeps far more numbers on the fast paths
+	while (mantissa % 10 == 0 && (mantissa > (1ull << 24) || exponent < -10))
+	{
+		mantissa /= 10;
+		++exponent;
+	}
+
+	// Mantissa and power of ten are both exact floats, so one operation gives the correctly rounded result
+	if (mantissa <= (1ull << 24) && exponent >= -10 && exponent <= 10)
+	{
+		float result = static_cast<float>(mantissa);
+		result = exponent < 0 ? result / floatPowers[-exponent] : result * floatPowers[exponent];
+		value = negative ? -result : result;
+		return cursor;
+	}
+
+	// Same again in double, then round to float
+	// Rounding twice is only wrong when the double lands exactly halfway between two floats
+	if (mantissa <= (1ull << 53) && exponent >= -22 && exponent <= 22)
+	{
+		double result = static_cast<double>(mantissa);
+		result = exponent < 0 ? result / doublePowers[-exponent] : result * doublePowers[exponent];
+
+		uint64_t bits;
+		memcpy(&bits, &result, sizeof(bits));
+		if (result >= FLT_MIN && result <= FLT_MAX && (bits & 0x1FFFFFFFull) != 0x10000000ull)
+		{
+			float rounded = static_cast<float>(result);
+			value = negative ? -rounded : rounded;
+			return cursor;
+		}
+	}
+
+	return ParseFloatSlow(original, start, end, value);
+}
+
+const char *TextScanner::ParseInt(const char *cursor, const char *end, int &value)
+{
+	const char *original = cursor;
+	const char *start = cursor;
+	if (cursor < end && *cursor == '+')
+	{
+		start = ++cursor;
+	}
+
+	bool negative = cursor < end && *cursor == '-';
+	if (negative)
+	{
+		++cursor;
+	}
+
+	// Nine digits can't overflow, anything longer takes the checked path
+	int result = 0;
+	const char *digitsStart = cursor;
+	for (; cursor < end && IsDigit(*cursor); ++cursor)
+	{
+		if (cursor - digitsStart == 9)
+		{
+			std::from_chars_result checked = std::from_chars(start, end, value);
+			return checked.ec == std::errc() ? checked.ptr : original;
+		}
+		result = result * 10 + (*cursor - '0');
+	}
+
+	if (cursor == digitsStart)
+	{
+		return original;
+	}
+
+	value = negative ? -result : result;
+	return cursor;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+
+// Vectorized scanning and number parsing shared by the text asset loaders
+// The scanning kernel is picked at runtime, AVX2 then SSE2 then plain scalar code
+class TextScanner
+{
+public:
+	enum Kernel
+	{
+		KernelScalar,
+		KernelSSE2,
+		KernelAVX2,
+		KernelCount
+	};
+
+	// Best kernel this CPU (and OS) supports, used by default
+	static Kernel DetectKernel();
+	static bool IsSupported(Kernel kernel);
+	static const char *KernelName(Kernel kernel);
+
+	// Force a kernel, only meant for benchmarking, unsupported kernels are ignored
+	// Not thread safe, don't switch while anything is parsing
+	static void SetKernel(Kernel kernel);
+	static Kernel GetKernel();
+
+	// First c in [cursor, end), or end if there isn't one
+	static const char *FindByte(const char *cursor, const char *end, char c);
+	static const char *FindLineEnd(const char *cursor, const char *end) { return FindByte(cursor, end, '\n'); }
+
+	// First space, tab, carriage return or newline in [cursor, end), or end
+	static const char *FindWhitespace(const char *cursor, const char *end);
+
+	// Decimal number parsing without locales, allocation or string copies
+	// An optional leading + is accepted, returns cursor unchanged if there is no number
+	// Floats are correctly rounded, the common short cases never leave the fast path
+	static const char *ParseFloat(const char *cursor, const char *end, float &value);
+	static const char *ParseInt(const char *cursor, const char *end, int &value);
+};
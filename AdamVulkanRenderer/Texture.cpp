@@ -4,429 +4,262 @@
 #include <vulkan/vulkan.h>
 #include <assert.h>
 #include "VulkanCommon.h"
+#include "PPMFile.h"
+#include "DDSFile.h"
+#include "MipGenerator.h"
+#include "MappedFile.h"
 
-bool Texture::ReadPPM(std::string filename, int &width, int &height, VkDeviceSize rowPitch, unsigned char *data)
+namespace
 {
-	// PPM format expected from http://netpbm.sourceforge.net/doc/ppm.html
-	//  1. magic number
-	//  2. whitespace
-	//  3. width
-	//  4. whitespace
-	//  5. height
-	//  6. whitespace
-	//  7. max color value
-	//  8. whitespace
-	//  7. data
-
-	// Comments are not supported, but are detected
-	// Only 8 bits per channel is supported
-
-	char magicStr[3] = {};
-	char heightStr[6] = {};
-	char widthStr[6] = {};
-	char formatStr[6] = {};
-
-	FILE *fPtr;
-	errno_t errorNum = fopen_s(&fPtr, filename.c_str(), "rb");
-
-	if (!fPtr)
+	// Level offsets are multiples of 16 from the start of an allocation, which suits every format's texel or block size
+	const VkDeviceSize levelAlignment = 16;
+}
+
+void Texture::InitTextureFromFile(const VkDevice &device, 
+	const VkPhysicalDevice &physical, 
+	StagingRing &ring,
+	const std::string &filename)
+{
+	if (filename.size() >= 4 && _stricmp(filename.c_str() + filename.size() - 4, ".dds") == 0)
 	{
-		printf("Error fopen %i\n", errorNum);
-		printf("Bad filename in read_ppm: %s\nb", filename.c_str());
+		InitTextureFromDDS(device, physical, ring, filename);
+		return;
 	}
 
-	// Sizes from array size
-
-	// TODO: Add error checking here
-	fscanf_s(fPtr, "%s %s %s %s ", magicStr, 3, widthStr, 6, heightStr, 6, formatStr, 6);
-
-	if (magicStr[0] == '#' ||
-		widthStr[0] == '#' ||
-		heightStr[0] == '#' ||
-		formatStr[0] == '#')
+	// Block compressed when the device can sample it, the encode is cached next to the file
+	if (SupportsFormat(physical, VK_FORMAT_BC7_UNORM_BLOCK))
 	{
-		printf("Unhandled comment in PPM file\n");
-		return false;
+		TextureCache::Image blocks;
+		if (!TextureCache::LoadPPM(filename, TextureCompressor::FormatBC7, blocks))
+		{
+			std::cout << "Could not read texture file";
+			exit(-1);
+		}
+
+		InitTextureFromBlocks(device, physical, ring, blocks);
+		return;
 	}
 
-	if (strncmp(magicStr, "P6", sizeof(magicStr)))
+	// The RGB payload is expanded straight from the file mapping into the mip chain, there's no copy in between
+	MappedFile file;
+	PPMFile::Header header;
+	if (!file.Open(filename) || !PPMFile::ParseHeader(file.Data(), file.Size(), header))
 	{
-		printf("Unhandled PPM magic number: %s\n", magicStr);
-		return false;
+		std::cout << "Could not read texture file";
+		exit(-1);
 	}
 
-	width = atoi(widthStr);
-	height = atoi(heightStr);
+	InitTextureFromRows(device, physical, ring, header.width, header.height, reinterpret_cast<const unsigned char *>(file.Data()) + header.dataOffset, true);
+}
+
+void Texture::InitTextureFromPixels(const VkDevice &device,
+	const VkPhysicalDevice &physical,
+	StagingRing &ring,
+	int width,
+	int height,
+	const unsigned char *pixels)
+{
+	InitTextureFromRows(device, physical, ring, width, height, pixels, false);
+}
 
-	static const int saneDimension = 99999;
-	if (width <= 0 || width > saneDimension)
+void Texture::InitTextureFromRows(const VkDevice &device,
+	const VkPhysicalDevice &physical,
+	StagingRing &ring,
+	int width,
+	int height,
+	const unsigned char *pixels,
+	bool rgb)
+{
+	// Every mip level goes in one staging buffer, tightly packed one after another
+	std::vector<MipGenerator::Level> levels;
+	VkDeviceSize chainSize = MipGenerator::Layout(static_cast<uint32_t>(width), static_cast<uint32_t>(height), levels);
+
+	StagingRing::Allocation staging = ring.Allocate(chainSize, levelAlignment);
+
+	// The mip filter reads back the levels it writes, which is slow from uncached memory
+	// Without cached staging memory the chain is built on the side and copied in
+	std::vector<unsigned char> scratch;
+	unsigned char *chain = staging.data;
+	if (!staging.cached)
 	{
-		printf("Width outside acceptable bounds. Update PPM file.");
-		return false;
+		scratch.resize(static_cast<size_t>(chainSize));
+		chain = scratch.data();
 	}
-	if (height <= 0 || height > saneDimension)
+
+	if (rgb)
 	{
-		printf("Height outside acceptable bounds. Update PPM file.");
-		return false;
+		PPMFile::ExpandRGB(pixels, width, height, chain, size_t(width) * 4);
 	}
-
-	if (data == nullptr)
+	else
 	{
-		// Caller only wanted dimensions, no data read
-		return true;
+		memcpy(chain, pixels, size_t(width) * height * 4);
 	}
+	MipGenerator::Generate(chain, levels);
 
-	for (int y = 0; y < height; y++)
+	if (!staging.cached)
 	{
-		unsigned char *rowPtr = data;
-		for (int x = 0; x < width; x++)
-		{
-			fread(rowPtr, 3, 1, fPtr);
-			rowPtr[3] = 255; /* Alpha of 1. TODO: Support alpha */
-			rowPtr += 4;
-		}
-		data += rowPitch; // why would we change pitch? Examples never do...
+		memcpy(staging.data, chain, static_cast<size_t>(chainSize));
 	}
 
-	fclose(fPtr);
+	InitImage(device, physical, ring, VK_FORMAT_R8G8B8A8_UNORM, levels, staging);
+}
 
-	return true;
+void Texture::InitTextureFromLevels(const VkDevice &device,
+	const VkPhysicalDevice &physical,
+	StagingRing &ring,
+	VkFormat format,
+	const std::vector<MipGenerator::Level> &levels,
+	const unsigned char *data,
+	size_t size)
+{
+	StagingRing::Allocation staging = ring.Allocate(size, levelAlignment);
+	memcpy(staging.data, data, size);
+	InitImage(device, physical, ring, format, levels, staging);
 }
 
-void Texture::InitTextureFromFile(const VkDevice &device, 
-	const VkPhysicalDevice &physical, 
-	const VkCommandBuffer &cmdBuf,
-	const VkQueue &queue,
-	const std::string &filename)
-{	
-	VkResult result;
+void Texture::InitTextureFromBlocks(const VkDevice &device,
+	const VkPhysicalDevice &physical,
+	StagingRing &ring,
+	const TextureCache::Image &image)
+{
+	static const VkFormat formats[TextureCompressor::FormatCount] = { VK_FORMAT_BC1_RGB_UNORM_BLOCK, VK_FORMAT_BC3_UNORM_BLOCK, VK_FORMAT_BC7_UNORM_BLOCK };
+
+	StagingRing::Allocation staging = ring.Allocate(image.blocks.size(), levelAlignment);
+	memcpy(staging.data, image.blocks.data(), image.blocks.size());
+	InitImage(device, physical, ring, formats[image.format], image.levels, staging);
+}
 
-	int width = 0;
-	int height = 0;
-	if (!ReadPPM(filename.c_str(), width, height, 0, NULL))
+void Texture::InitTextureFromDDS(const VkDevice &device,
+	const VkPhysicalDevice &physical,
+	StagingRing &ring,
+	const std::string &filename)
+{
+	MappedFile file;
+	DDSFile::Header header;
+	if (!file.Open(filename) || !DDSFile::ParseHeader(file.Data(), file.Size(), header))
 	{
 		std::cout << "Could not read texture file";
 		exit(-1);
 	}
 
-	VkFormatProperties formatProps;
-	vkGetPhysicalDeviceFormatProperties(physical, VK_FORMAT_R8G8B8A8_UNORM, &formatProps);
+	// The payloads are already in the device's layout, there's nothing to decode or fall back to
+	VkFormat format = ImageFormat(header.format, header.srgb);
+	if (!SupportsFormat(physical, format))
+	{
+		std::cout << "Texture format not supported by the device";
+		exit(-1);
+	}
 
-	VkFormatFeatureFlags allFeatures = (VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT);
-	bool needStaging = ((formatProps.linearTilingFeatures & allFeatures) != allFeatures) ? true : false;
+	// Every level in one copy out of the mapping, the level offsets stay relative to the first
+	StagingRing::Allocation staging = ring.Allocate(header.dataSize, levelAlignment);
+	memcpy(staging.data, file.Data() + header.dataOffset, header.dataSize);
+	file.Close();
 
-	if (needStaging)
+	InitImage(device, physical, ring, format, header.levels, staging);
+}
+
+bool Texture::SupportsFormat(const VkPhysicalDevice &physical, VkFormat format)
+{
+	// The block compressed formats also need their feature, which device creation turns on when it's there
+	if (format >= VK_FORMAT_BC1_RGB_UNORM_BLOCK && format <= VK_FORMAT_BC7_SRGB_BLOCK)
 	{
-		assert((formatProps.optimalTilingFeatures & allFeatures) == allFeatures);
+		VkPhysicalDeviceFeatures features;
+		vkGetPhysicalDeviceFeatures(physical, &features);
+		if (!features.textureCompressionBC)
+		{
+			return false;
+		}
 	}
 
+	VkFormatProperties formatProps;
+	vkGetPhysicalDeviceFormatProperties(physical, format, &formatProps);
+	return (formatProps.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT) == VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT;
+}
+
+VkFormat Texture::ImageFormat(DDSFile::Format format, bool srgb)
+{
+	static const VkFormat formats[DDSFile::FormatCount][2] =
+	{
+		{ VK_FORMAT_R8G8B8A8_UNORM, VK_FORMAT_R8G8B8A8_SRGB },
+		{ VK_FORMAT_BC1_RGBA_UNORM_BLOCK, VK_FORMAT_BC1_RGBA_SRGB_BLOCK },
+		{ VK_FORMAT_BC3_UNORM_BLOCK, VK_FORMAT_BC3_SRGB_BLOCK },
+		{ VK_FORMAT_BC7_UNORM_BLOCK, VK_FORMAT_BC7_SRGB_BLOCK }
+	};
+	return formats[format][srgb ? 1 : 0];
+}
+
+void Texture::InitImage(const VkDevice &device,
+	const VkPhysicalDevice &physical,
+	StagingRing &ring,
+	VkFormat format,
+	const std::vector<MipGenerator::Level> &levels,
+	const StagingRing::Allocation &staging)
+{
+	VkResult result;
+	uint32_t levelCount = static_cast<uint32_t>(levels.size());
+
+	assert(SupportsFormat(physical, format));
+
 	// begin init of image
 	VkImageCreateInfo imageCreateInfo = {};
 	imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
 	imageCreateInfo.pNext = NULL;
 	imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
-	imageCreateInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
-	imageCreateInfo.extent.width = width;
-	imageCreateInfo.extent.height = height;
+	imageCreateInfo.format = format;
+	imageCreateInfo.extent.width = levels[0].width;
+	imageCreateInfo.extent.height = levels[0].height;
 	imageCreateInfo.extent.depth = 1;
-	imageCreateInfo.mipLevels = 1;
+	imageCreateInfo.mipLevels = levelCount;
 	imageCreateInfo.arrayLayers = 1;
 	imageCreateInfo.samples = NUM_SAMPLES;
-	imageCreateInfo.tiling = VK_IMAGE_TILING_LINEAR;
-	imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_PREINITIALIZED;
-	imageCreateInfo.usage = needStaging ? (VK_IMAGE_USAGE_TRANSFER_SRC_BIT) : (VK_IMAGE_USAGE_SAMPLED_BIT);
+	imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	imageCreateInfo.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
 	imageCreateInfo.queueFamilyIndexCount = 0;
 	imageCreateInfo.pQueueFamilyIndices = NULL;
 	imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 	imageCreateInfo.flags = 0;
 
-	VkMemoryAllocateInfo mem_alloc = {};
-	mem_alloc.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	mem_alloc.pNext = NULL;
-	mem_alloc.allocationSize = 0;
-	mem_alloc.memoryTypeIndex = 0;
-
-	VkImage mappableImage;
-	VkDeviceMemory mappableMemory;
-
-	VkMemoryRequirements mem_reqs;
-
-	result = vkCreateImage(device, &imageCreateInfo, NULL, &mappableImage);
+	result = vkCreateImage(device, &imageCreateInfo, NULL, &this->image);
 	assert(result == VK_SUCCESS);
 
-	vkGetImageMemoryRequirements(device, mappableImage, &mem_reqs);
-	assert(result == VK_SUCCESS);
+	VkMemoryRequirements mem_reqs;
+	vkGetImageMemoryRequirements(device, this->image, &mem_reqs);
 
+	VkMemoryAllocateInfo mem_alloc = {};
+	mem_alloc.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	mem_alloc.pNext = NULL;
 	mem_alloc.allocationSize = mem_reqs.size;
+	mem_alloc.memoryTypeIndex = 0;
 
-	bool pass = VulkanCommon::GetMemoryType(mem_reqs.memoryTypeBits, VkMemoryPropertyFlagBits(VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT), mem_alloc.memoryTypeIndex);
+	bool pass = VulkanCommon::GetMemoryType(mem_reqs.memoryTypeBits, VkMemoryPropertyFlagBits(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT), mem_alloc.memoryTypeIndex);
 	assert(pass);
 
-	result = vkAllocateMemory(device, &mem_alloc, NULL, &(mappableMemory));
-	assert(result == VK_SUCCESS);
-
-	result = vkBindImageMemory(device, mappableImage, mappableMemory, 0);
+	result = vkAllocateMemory(device, &mem_alloc, NULL, &this->memory);
 	assert(result == VK_SUCCESS);
 
-	// Begin set image layout
-	VkImageMemoryBarrier imageMemoryBarrier;
-	imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-	imageMemoryBarrier.pNext = NULL;
-	imageMemoryBarrier.srcAccessMask = 0;
-	imageMemoryBarrier.dstAccessMask = 0;
-	imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_PREINITIALIZED;
-	imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
-	imageMemoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-	imageMemoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-	imageMemoryBarrier.image = mappableImage;
-	imageMemoryBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	imageMemoryBarrier.subresourceRange.baseMipLevel = 0;
-	imageMemoryBarrier.subresourceRange.levelCount = 1;
-	imageMemoryBarrier.subresourceRange.baseArrayLayer = 0;
-	imageMemoryBarrier.subresourceRange.layerCount = 1;
-
-	imageMemoryBarrier.srcAccessMask = VK_ACCESS_HOST_WRITE_BIT;
-
-	VkPipelineStageFlags src_stages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-	VkPipelineStageFlags dest_stages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-
-	vkCmdPipelineBarrier(cmdBuf, src_stages, dest_stages, 0, 0, NULL, 0, NULL, 1, &imageMemoryBarrier);
-	// end set image layout
-
-	result = vkEndCommandBuffer(cmdBuf);
-	assert(result == VK_SUCCESS);
-	const VkCommandBuffer cmdBufs[] = { cmdBuf };
-	VkFenceCreateInfo fenceInfo;
-	VkFence cmdFence;
-	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-	fenceInfo.pNext = NULL;
-	fenceInfo.flags = 0;
-	vkCreateFence(device, &fenceInfo, NULL, &cmdFence);
-
-	VkSubmitInfo submitInfo[1] = {};
-	submitInfo[0].pNext = NULL;
-	submitInfo[0].sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submitInfo[0].waitSemaphoreCount = 0;
-	submitInfo[0].pWaitSemaphores = NULL;
-	submitInfo[0].pWaitDstStageMask = NULL;
-	submitInfo[0].commandBufferCount = 1;
-	submitInfo[0].pCommandBuffers = cmdBufs;
-	submitInfo[0].signalSemaphoreCount = 0;
-	submitInfo[0].pSignalSemaphores = NULL;
-
-	result = vkQueueSubmit(queue, 1, submitInfo, cmdFence);
-	assert(result == VK_SUCCESS);
-
-	VkImageSubresource subres = {};
-	subres.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	subres.mipLevel = 0;
-	subres.arrayLayer = 0;
-
-	VkSubresourceLayout layout;
-	void *data;
-
-	/* Get the subresource layout so we know what the row pitch is */
-	vkGetImageSubresourceLayout(device, mappableImage, &subres, &layout);
-
-	do
-	{
-		result = vkWaitForFences(device, 1, &cmdFence, VK_TRUE, FENCE_TIMEOUT);
-	} while (result == VK_TIMEOUT);
-	assert(result == VK_SUCCESS);
-
-	vkDestroyFence(device, cmdFence, NULL);
-
-	result = vkMapMemory(device, mappableMemory, 0, mem_reqs.size, 0, &data);
+	result = vkBindImageMemory(device, this->image, this->memory, 0);
 	assert(result == VK_SUCCESS);
 
-	if (!ReadPPM(filename.c_str(), width, height, layout.rowPitch, (unsigned char*)data))
-	{
-		std::cout << "Could not load texture file " << filename.c_str();
-		exit(-1);
-	}
-
-	vkUnmapMemory(device, mappableMemory);
-
-	VkCommandBufferBeginInfo cmdBufInfo = {};
-	cmdBufInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-	cmdBufInfo.pNext = NULL;
-	cmdBufInfo.flags = 0;
-	cmdBufInfo.pInheritanceInfo = NULL;
-
-	result = vkResetCommandBuffer(cmdBuf, 0);
-	result = vkBeginCommandBuffer(cmdBuf, &cmdBufInfo);
-	assert(result == VK_SUCCESS);
-
-	if (!needStaging)
-	{
-		this->image = mappableImage;
-		this->memory = mappableMemory;
-		this->imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-
-		// set image layout
-
-		imageMemoryBarrier;
-		imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-		imageMemoryBarrier.pNext = NULL;
-		imageMemoryBarrier.srcAccessMask = 0;
-		imageMemoryBarrier.dstAccessMask = 0;
-		imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
-		imageMemoryBarrier.newLayout = this->imageLayout;
-		imageMemoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-		imageMemoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-		imageMemoryBarrier.image = mappableImage;
-		imageMemoryBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		imageMemoryBarrier.subresourceRange.baseMipLevel = 0;
-		imageMemoryBarrier.subresourceRange.levelCount = 1;
-		imageMemoryBarrier.subresourceRange.baseArrayLayer = 0;
-		imageMemoryBarrier.subresourceRange.layerCount = 1;
-
-		// Depends on new lyout
-		imageMemoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-
-
-		src_stages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-		dest_stages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-
-		vkCmdPipelineBarrier(cmdBuf, src_stages, dest_stages, 0, 0, NULL, 0, NULL, 1, &imageMemoryBarrier);
-		//end set image layout
-	}
-	else
-	{
-		// Mappable image cannot be texture, so create optimally tiled image and blit to it */
-		imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
-		imageCreateInfo.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
-		imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-
-		result = vkCreateImage(device, &imageCreateInfo, NULL, &this->image);
-		assert(result == VK_SUCCESS);
-
-		vkGetImageMemoryRequirements(device, this->image, &mem_reqs);
-
-		mem_alloc.allocationSize = mem_reqs.size;
-
-		bool pass = VulkanCommon::GetMemoryType(mem_reqs.memoryTypeBits, VkMemoryPropertyFlagBits(VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT), mem_alloc.memoryTypeIndex);
-		assert(pass);
+	this->texWidth = levels[0].width;
+	this->texHeight = levels[0].height;
 
-		result = vkAllocateMemory(device, &mem_alloc, NULL, &this->memory);
-		assert(result == VK_SUCCESS);
-
-		result = vkBindImageMemory(device, this->image, this->memory, 0);
-		assert(result == VK_SUCCESS);
-
-		/* Blit from mappable image and set layout to source optimal */
-		imageMemoryBarrier;
-		imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-		imageMemoryBarrier.pNext = NULL;
-		imageMemoryBarrier.srcAccessMask = 0;
-		imageMemoryBarrier.dstAccessMask = 0;
-		imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
-		imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-		imageMemoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-		imageMemoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-		imageMemoryBarrier.image = mappableImage;
-		imageMemoryBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		imageMemoryBarrier.subresourceRange.baseMipLevel = 0;
-		imageMemoryBarrier.subresourceRange.levelCount = 1;
-		imageMemoryBarrier.subresourceRange.baseArrayLayer = 0;
-		imageMemoryBarrier.subresourceRange.layerCount = 1;
-
-		imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-
-		src_stages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-		dest_stages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-
-		vkCmdPipelineBarrier(cmdBuf, src_stages, dest_stages, 0, 0, NULL, 0, NULL, 1, &imageMemoryBarrier);
-		/* end set layout */
-
-		/* Blit to texture, set destination optimal layout*/
-		imageMemoryBarrier;
-		imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-		imageMemoryBarrier.pNext = NULL;
-		imageMemoryBarrier.srcAccessMask = 0;
-		imageMemoryBarrier.dstAccessMask = 0;
-		imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-		imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-		imageMemoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-		imageMemoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-		imageMemoryBarrier.image = mappableImage;
-		imageMemoryBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		imageMemoryBarrier.subresourceRange.baseMipLevel = 0;
-		imageMemoryBarrier.subresourceRange.levelCount = 1;
-		imageMemoryBarrier.subresourceRange.baseArrayLayer = 0;
-		imageMemoryBarrier.subresourceRange.layerCount = 1;
-
-		imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-
-		src_stages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-		dest_stages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-
-		vkCmdPipelineBarrier(cmdBuf, src_stages, dest_stages, 0, 0, NULL, 0, NULL, 1, &imageMemoryBarrier);
-		/* end set layout */
-
-		VkImageCopy copyRegion;
-		copyRegion.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		copyRegion.srcSubresource.mipLevel = 0;
-		copyRegion.srcSubresource.baseArrayLayer = 0;
-		copyRegion.srcSubresource.layerCount = 1;
-		copyRegion.srcOffset.x = 0;
-		copyRegion.srcOffset.y = 0;
-		copyRegion.srcOffset.z = 0;
-		copyRegion.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		copyRegion.dstSubresource.mipLevel = 0;
-		copyRegion.dstSubresource.baseArrayLayer = 0;
-		copyRegion.dstSubresource.layerCount = 1;
-		copyRegion.dstOffset.x = 0;
-		copyRegion.dstOffset.y = 0;
-		copyRegion.dstOffset.z = 0;
-		copyRegion.extent.width = width;
-		copyRegion.extent.height = height;
-		copyRegion.extent.depth = 1;
-
-		// Put copy command into commabd buffer
-		vkCmdCopyImage(cmdBuf, mappableImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, this->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copyRegion);
-
-		// Set layout for texture image form destination optimal to shader read only
-		this->imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-		imageMemoryBarrier;
-		imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-		imageMemoryBarrier.pNext = NULL;
-		imageMemoryBarrier.srcAccessMask = 0;
-		imageMemoryBarrier.dstAccessMask = 0;
-		imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-		imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-		imageMemoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-		imageMemoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-		imageMemoryBarrier.image = mappableImage;
-		imageMemoryBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		imageMemoryBarrier.subresourceRange.baseMipLevel = 0;
-		imageMemoryBarrier.subresourceRange.levelCount = 1;
-		imageMemoryBarrier.subresourceRange.baseArrayLayer = 0;
-		imageMemoryBarrier.subresourceRange.layerCount = 1;
-
-		imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-		imageMemoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-
-		src_stages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-		dest_stages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-
-		vkCmdPipelineBarrier(cmdBuf, src_stages, dest_stages, 0, 0, NULL, 0, NULL, 1, &imageMemoryBarrier);
-		// end set image layout
-	}
+	// Goes out with the ring's next submission, which is before anything that draws with the texture
+	CopyBufferToImage(ring.CommandBuffer(), staging.buffer, staging.offset, levels);
 
 	VkImageViewCreateInfo viewInfo = {};
 	viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
 	viewInfo.pNext = NULL;
 	viewInfo.image = VK_NULL_HANDLE;
 	viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
-	viewInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
+	viewInfo.format = format;
 	viewInfo.components.r = VK_COMPONENT_SWIZZLE_R;
 	viewInfo.components.g = VK_COMPONENT_SWIZZLE_G;
 	viewInfo.components.b = VK_COMPONENT_SWIZZLE_B;
 	viewInfo.components.a = VK_COMPONENT_SWIZZLE_A;
 	viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
 	viewInfo.subresourceRange.baseMipLevel = 0;
-	viewInfo.subresourceRange.levelCount = 1;
+	viewInfo.subresourceRange.levelCount = levelCount;
 	viewInfo.subresourceRange.baseArrayLayer = 0;
 	viewInfo.subresourceRange.layerCount = 1;
 
@@ -436,11 +269,12 @@ void Texture::InitTextureFromFile(const VkDevice &device,
 	// END INIT IMAGE
 
 	// BEGIN CREATE SAMPLER
+	// Trilinear, distant surfaces read the small levels instead of skipping across the big one
 	VkSamplerCreateInfo samplerCreateInfo = {};
 	samplerCreateInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
-	samplerCreateInfo.magFilter = VK_FILTER_NEAREST;
-	samplerCreateInfo.minFilter = VK_FILTER_NEAREST;
-	samplerCreateInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	samplerCreateInfo.magFilter = VK_FILTER_LINEAR;
+	samplerCreateInfo.minFilter = VK_FILTER_LINEAR;
+	samplerCreateInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
 	samplerCreateInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
 	samplerCreateInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
 	samplerCreateInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
@@ -449,7 +283,7 @@ void Texture::InitTextureFromFile(const VkDevice &device,
 		samplerCreateInfo.maxAnisotropy = 1;
 	samplerCreateInfo.compareOp = VK_COMPARE_OP_NEVER;
 	samplerCreateInfo.minLod = 0.0;
-	samplerCreateInfo.maxLod = 0.0;
+	samplerCreateInfo.maxLod = static_cast<float>(levelCount);
 	samplerCreateInfo.compareEnable = VK_FALSE;
 	samplerCreateInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
 
@@ -459,7 +293,7 @@ void Texture::InitTextureFromFile(const VkDevice &device,
 	// ENd create sampler	
 }
 
-void Texture::InitTexture(const VkDevice &device, const VkPhysicalDevice &physical, const VkCommandBuffer &cmdBuf, const VkQueue &queue, VkImageType type, VkFormat format, bool writeable, int width, int height, int depth)
+void Texture::InitTexture(const VkDevice &device, const VkPhysicalDevice &physical, StagingRing &ring, VkImageType type, VkFormat format, bool writeable, int width, int height, int depth)
 {
 	VkResult result;
 
@@ -564,52 +398,10 @@ void Texture::InitTexture(const VkDevice &device, const VkPhysicalDevice &physic
 	VkPipelineStageFlags src_stages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
 	VkPipelineStageFlags dest_stages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
 
-	vkCmdPipelineBarrier(cmdBuf, src_stages, dest_stages, 0, 0, NULL, 0, NULL, 1, &imageMemoryBarrier);
+	// Goes out with the ring's next submission, nothing waits for it here
+	vkCmdPipelineBarrier(ring.CommandBuffer(), src_stages, dest_stages, 0, 0, NULL, 0, NULL, 1, &imageMemoryBarrier);
 	// end set image layout
 
-	result = vkEndCommandBuffer(cmdBuf);
-	assert(result == VK_SUCCESS);
-	const VkCommandBuffer cmdBufs[] = { cmdBuf };
-	VkFenceCreateInfo fenceInfo;
-	VkFence cmdFence;
-	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-	fenceInfo.pNext = NULL;
-	fenceInfo.flags = 0;
-	vkCreateFence(device, &fenceInfo, NULL, &cmdFence);
-
-	VkSubmitInfo submitInfo[1] = {};
-	submitInfo[0].pNext = NULL;
-	submitInfo[0].sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submitInfo[0].waitSemaphoreCount = 0;
-	submitInfo[0].pWaitSemaphores = NULL;
-	submitInfo[0].pWaitDstStageMask = NULL;
-	submitInfo[0].commandBufferCount = 1;
-	submitInfo[0].pCommandBuffers = cmdBufs;
-	submitInfo[0].signalSemaphoreCount = 0;
-	submitInfo[0].pSignalSemaphores = NULL;
-
-	result = vkQueueSubmit(queue, 1, submitInfo, cmdFence);
-	assert(result == VK_SUCCESS);
-
-	VkImageSubresource subres = {};
-	subres.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	subres.mipLevel = 0;
-	subres.arrayLayer = 0;
-
-	VkSubresourceLayout layout;
-	void *data;
-
-	/* Get the subresource layout so we know what the row pitch is */
-	vkGetImageSubresourceLayout(device, mappableImage, &subres, &layout);
-
-	do
-	{
-		result = vkWaitForFences(device, 1, &cmdFence, VK_TRUE, FENCE_TIMEOUT);
-	} while (result == VK_TIMEOUT);
-	assert(result == VK_SUCCESS);
-
-	vkDestroyFence(device, cmdFence, NULL);
-
 	this->image = mappableImage;
 	this->memory = mappableMemory;
 	this->imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
@@ -667,23 +459,69 @@ void Texture::InitTexture(const VkDevice &device, const VkPhysicalDevice &physic
 	// ENd create sampler	
 }
 
-void Texture::CopyBufferToImage(const VkDevice &device, const VkPhysicalDevice &physical, const VkCommandBuffer &cmdBuf)
+void Texture::CopyBufferToImage(const VkCommandBuffer &cmdBuf, const VkBuffer &buffer, VkDeviceSize bufferOffset, const std::vector<MipGenerator::Level> &levels)
 {
-	uint32_t *data = new uint32_t[5 * 5 * 5]; // change to input width, heigh, depth
+	uint32_t levelCount = static_cast<uint32_t>(levels.size());
 
-	
-	VkBuffer srcBuffer;
-	VkImage dstImage;
-	VkImageLayout dstImageLayout;
-
-	VkBufferImageCopy copyRegion;
-	//copyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	//copyRegion.imageSubresource.mipLevel = 0;
-	//copyRegion.imageSubresource.baseArrayLayer = 0;
-	//copyRegion.imageSubresource.layerCount = 1;
-	//copyRegion.imageExtent.width = texture.width;
-	//copyRegion.imageExtent.height = texture.height;
-	//copyRegion.imageExtent.depth = texture.depth;
-
-//	vkCmdCopyBufferToImage(cmdBuf, srcBuffer, dstImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copyRegion);
+	// Set every level to destination optimal, what was there before is thrown away
+	VkImageMemoryBarrier imageMemoryBarrier;
+	imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	imageMemoryBarrier.pNext = NULL;
+	imageMemoryBarrier.srcAccessMask = 0;
+	imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	imageMemoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	imageMemoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	imageMemoryBarrier.image = this->image;
+	imageMemoryBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	imageMemoryBarrier.subresourceRange.baseMipLevel = 0;
+	imageMemoryBarrier.subresourceRange.levelCount = levelCount;
+	imageMemoryBarrier.subresourceRange.baseArrayLayer = 0;
+	imageMemoryBarrier.subresourceRange.layerCount = 1;
+
+	vkCmdPipelineBarrier(cmdBuf, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0, NULL, 1, &imageMemoryBarrier);
+
+	// One copy for the whole chain, a region per level
+	// Rows and block rows are tightly packed, so the buffer layout follows from the extent
+	std::vector<VkBufferImageCopy> copyRegions(levelCount);
+	for (uint32_t i = 0; i < levelCount; ++i)
+	{
+		copyRegions[i].bufferOffset = bufferOffset + levels[i].offset;
+		copyRegions[i].bufferRowLength = 0;
+		copyRegions[i].bufferImageHeight = 0;
+		copyRegions[i].imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		copyRegions[i].imageSubresource.mipLevel = i;
+		copyRegions[i].imageSubresource.baseArrayLayer = 0;
+		copyRegions[i].imageSubresource.layerCount = 1;
+		copyRegions[i].imageOffset.x = 0;
+		copyRegions[i].imageOffset.y = 0;
+		copyRegions[i].imageOffset.z = 0;
+		copyRegions[i].imageExtent.width = levels[i].width;
+		copyRegions[i].imageExtent.height = levels[i].height;
+		copyRegions[i].imageExtent.depth = 1;
+	}
+	vkCmdCopyBufferToImage(cmdBuf, buffer, this->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, levelCount, copyRegions.data());
+
+	// Set layout for texture image form destination optimal to shader read only
+	// Barriers reach later submissions too, so draws submitted after this see the copy
+	this->imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	imageMemoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	imageMemoryBarrier.newLayout = this->imageLayout;
+
+	vkCmdPipelineBarrier(cmdBuf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, NULL, 0, NULL, 1, &imageMemoryBarrier);
+}
+
+void Texture::Destroy(const VkDevice &device)
+{
+	vkDestroySampler(device, sampler, NULL);
+	vkDestroyImageView(device, view, NULL);
+	vkDestroyImage(device, image, NULL);
+	vkFreeMemory(device, memory, NULL);
+	sampler = VK_NULL_HANDLE;
+	view = VK_NULL_HANDLE;
+	image = VK_NULL_HANDLE;
+	memory = VK_NULL_HANDLE;
 }
\ No newline at end of file
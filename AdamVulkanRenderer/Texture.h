@@ -2,22 +2,55 @@
 
 #include "vulkan/vulkan.h"
 #include <string>
+#include <vector>
+#include "MipGenerator.h"
+#include "TextureCache.h"
+#include "DDSFile.h"
+#include "StagingRing.h"
 
 #define NUM_SAMPLES VK_SAMPLE_COUNT_1_BIT
-#define FENCE_TIMEOUT 100000000
 
 class Texture
 {
 public:
-	void InitTextureFromFile(const VkDevice &device, const VkPhysicalDevice &physical, const VkCommandBuffer &cmdBuf, const VkQueue &queue,	const std::string &filename);
-	void InitTexture(const VkDevice &device, const VkPhysicalDevice &physical, const VkCommandBuffer &cmdBuf, const VkQueue &queue, VkImageType type, VkFormat format, bool writeable, int width, int height, int depth);
-	void CopyBufferToImage(const VkDevice &device, const VkPhysicalDevice &physical, const VkCommandBuffer &cmdBuf);
+	// .dds files are uploaded as they are, .ppm files are block compressed if the device can sample BC7
+	void InitTextureFromFile(const VkDevice &device, const VkPhysicalDevice &physical, StagingRing &ring, const std::string &filename);
+
+	// Upload tightly packed RGBA8 rows, the mip chain is filtered here on the calling thread
+	void InitTextureFromPixels(const VkDevice &device, const VkPhysicalDevice &physical, StagingRing &ring, int width, int height, const unsigned char *pixels);
+	// Upload a finished mip chain as it is, e.g. one AssetLoader built on another thread
+	// Level offsets are into data, the device has to be able to sample format
+	void InitTextureFromLevels(const VkDevice &device, const VkPhysicalDevice &physical, StagingRing &ring, VkFormat format, const std::vector<MipGenerator::Level> &levels, const unsigned char *data, size_t size);
+	// Upload a block compressed mip chain as it is, e.g. from TextureCache
+	void InitTextureFromBlocks(const VkDevice &device, const VkPhysicalDevice &physical, StagingRing &ring, const TextureCache::Image &image);
+	void InitTexture(const VkDevice &device, const VkPhysicalDevice &physical, StagingRing &ring, VkImageType type, VkFormat format, bool writeable, int width, int height, int depth);
+
+	// Record copies of every level from buffer into the image, with the layout transitions around them
+	// Level offsets are from bufferOffset, the image is shader read only afterwards
+	void CopyBufferToImage(const VkCommandBuffer &cmdBuf, const VkBuffer &buffer, VkDeviceSize bufferOffset, const std::vector<MipGenerator::Level> &levels);
+
+	// Free what the Init functions created, the GPU has to be done with it
+	void Destroy(const VkDevice &device);
+
+	// Optimal tiling images of format can be sampled, block compressed formats also need the device feature
+	static bool SupportsFormat(const VkPhysicalDevice &physical, VkFormat format);
+
+	// The Vulkan format for texels or blocks stored as format, e.g. in a .dds or an AssetLoader result
+	static VkFormat ImageFormat(DDSFile::Format format, bool srgb);
 
 	VkImageView view;
 	VkSampler sampler;
 
 private:
-	bool ReadPPM(std::string filename, int &width, int &height, VkDeviceSize rowPitch, unsigned char *data);
+	// Tightly packed RGBA8 rows, or RGB rows straight out of a .ppm, into a new image with a full mip chain
+	// The colors are taken as sRGB encoded, so the smaller levels are filtered in linear light
+	void InitTextureFromRows(const VkDevice &device, const VkPhysicalDevice &physical, StagingRing &ring, int width, int height, const unsigned char *pixels, bool rgb);
+
+	// Level payloads go from the mapped file to staging untouched, the device has to support the format
+	void InitTextureFromDDS(const VkDevice &device, const VkPhysicalDevice &physical, StagingRing &ring, const std::string &filename);
+
+	// A new image with a view and sampler, its levels are copied out of staging with the ring's next submission
+	void InitImage(const VkDevice &device, const VkPhysicalDevice &physical, StagingRing &ring, VkFormat format, const std::vector<MipGenerator::Level> &levels, const StagingRing::Allocation &staging);
 
 	VkImage image;
 	VkImageLayout imageLayout;
@@ -0,0 +1,221 @@
+#include "stdafx.h"
+#include "TextureCache.h"
+#include "MappedFile.h"
+#include "MeshCodec.h"
+#include "PPMFile.h"
+#include <fstream>
+#include <cstdint>
+#include <cstring>
+
+namespace
+{
+	const char cacheMagic[4] = { 'A', 'V', 'T', 'C' };
+
+	// Bump whenever the layout or the encoder output changes, old caches are then rebuilt
+	const uint32_t cacheVersion = 1;
+
+	// Blocks start on this boundary, like the levels inside them
+	const uint64_t cacheAlignment = 16;
+
+	struct CacheHeader
+	{
+		char magic[4];
+		uint32_t version;
+		uint64_t fileSize;
+
+		// Source .ppm the cache was built from
+		uint64_t sourceSize;
+		uint64_t sourceWriteTime;
+		uint32_t pathLength;
+
+		// Level 0, the rest of the chain and where each level's blocks go follow from it
+		uint32_t format;
+		uint32_t width;
+		uint32_t height;
+
+		uint64_t blockOffset;
+		uint64_t blockBytes;
+
+		// Over the blocks, damage there would otherwise just show up on screen
+		uint64_t checksum;
+	};
+
+	struct SourceKey
+	{
+		uint64_t size;
+		uint64_t writeTime;
+		std::string path;
+	};
+
+	inline uint64_t Align(uint64_t offset)
+	{
+		return (offset + cacheAlignment - 1) & ~(cacheAlignment - 1);
+	}
+
+	// Same key as the mesh cache
+	bool GetSourceKey(const std::string &fileName, SourceKey &key)
+	{
+		WIN32_FILE_ATTRIBUTE_DATA attributes;
+		if (!GetFileAttributesExA(fileName.c_str(), GetFileExInfoStandard, &attributes))
+		{
+			return false;
+		}
+
+		key.size = (static_cast<uint64_t>(attributes.nFileSizeHigh) << 32) | attributes.nFileSizeLow;
+		key.writeTime = (static_cast<uint64_t>(attributes.ftLastWriteTime.dwHighDateTime) << 32) | attributes.ftLastWriteTime.dwLowDateTime;
+
+		char fullPath[MAX_PATH];
+		DWORD length = GetFullPathNameA(fileName.c_str(), MAX_PATH, fullPath, NULL);
+		key.path = (length > 0 && length < MAX_PATH) ? std::string(fullPath, length) : fileName;
+		return true;
+	}
+
+	// Where every level's blocks go for an image of this size
+	size_t BlockLayout(TextureCompressor::Format format, uint32_t width, uint32_t height, std::vector<MipGenerator::Level> &levels)
+	{
+		std::vector<MipGenerator::Level> texelLevels;
+		MipGenerator::Layout(width, height, texelLevels);
+		return TextureCompressor::Layout(format, texelLevels, levels);
+	}
+}
+
+std::string TextureCache::CacheFileName(const std::string &fileName)
+{
+	return fileName + ".texcache";
+}
+
+bool TextureCache::LoadPPM(const std::string &fileName, TextureCompressor::Format format, Image &image)
+{
+	if (Read(fileName, format, image))
+	{
+		return true;
+	}
+
+	int width = 0;
+	int height = 0;
+	std::vector<unsigned char> pixels;
+	if (!PPMFile::Load(fileName, width, height, pixels))
+	{
+		return false;
+	}
+
+	// The whole chain at 8 bits, then each level compressed in turn
+	std::vector<MipGenerator::Level> texelLevels;
+	std::vector<unsigned char> chain(MipGenerator::Layout(static_cast<uint32_t>(width), static_cast<uint32_t>(height), texelLevels));
+	memcpy(chain.data(), pixels.data(), pixels.size());
+	std::vector<unsigned char>().swap(pixels);
+	MipGenerator::Generate(chain.data(), texelLevels);
+
+	TextureCompressor::Settings settings;
+	settings.format = format;
+	image.format = format;
+	image.blocks.resize(TextureCompressor::Layout(format, texelLevels, image.levels));
+	for (size_t i = 0; i < texelLevels.size(); ++i)
+	{
+		TextureCompressor::Compress(chain.data() + texelLevels[i].offset, texelLevels[i].width, texelLevels[i].height, image.blocks.data() + image.levels[i].offset, settings);
+	}
+
+	// Still usable if the cache can't be written, it's just encoded again next time
+	Write(fileName, image);
+	return true;
+}
+
+bool TextureCache::Read(const std::string &fileName, TextureCompressor::Format format, Image &image)
+{
+	SourceKey key;
+	if (!GetSourceKey(fileName, key))
+	{
+		return false;
+	}
+
+	MappedFile file;
+	if (!file.Open(CacheFileName(fileName)) || file.Size() < sizeof(CacheHeader))
+	{
+		return false;
+	}
+
+	const char *base = file.Data();
+	const uint64_t fileSize = file.Size();
+
+	CacheHeader header;
+	memcpy(&header, base, sizeof(header));
+	if (memcmp(header.magic, cacheMagic, sizeof(cacheMagic)) != 0 || header.version != cacheVersion || header.fileSize != fileSize ||
+		header.format != static_cast<uint32_t>(format) || header.width == 0 || header.height == 0)
+	{
+		return false;
+	}
+
+	// Stale if the source changed since the cache was written
+	if (header.sourceSize != key.size || header.sourceWriteTime != key.writeTime || header.pathLength != key.path.size() ||
+		header.pathLength > fileSize - sizeof(CacheHeader) || memcmp(base + sizeof(CacheHeader), key.path.data(), key.path.size()) != 0)
+	{
+		return false;
+	}
+
+	std::vector<MipGenerator::Level> levels;
+	size_t blockBytes = BlockLayout(format, header.width, header.height, levels);
+	if (header.blockBytes != blockBytes || header.blockOffset % cacheAlignment != 0 || header.blockOffset > fileSize ||
+		header.blockBytes > fileSize - header.blockOffset)
+	{
+		return false;
+	}
+
+	const char *blocks = base + header.blockOffset;
+	if (MeshCodec::Checksum(blocks, blockBytes) != header.checksum)
+	{
+		return false;
+	}
+
+	image.format = format;
+	image.levels.swap(levels);
+	image.blocks.assign(blocks, blocks + blockBytes);
+	return true;
+}
+
+// Written to a temporary file and swapped in, a half written cache must never look valid
+bool TextureCache::Write(const std::string &fileName, const Image &image)
+{
+	SourceKey key;
+	if (image.levels.empty() || !GetSourceKey(fileName, key))
+	{
+		return false;
+	}
+
+	std::string cacheFileName = CacheFileName(fileName);
+	std::string tempFileName = cacheFileName + ".tmp";
+	std::ofstream file(tempFileName.c_str(), std::ios::binary | std::ios::trunc);
+	if (!file.is_open())
+	{
+		return false;
+	}
+
+	CacheHeader header = {};
+	memcpy(header.magic, cacheMagic, sizeof(cacheMagic));
+	header.version = cacheVersion;
+	header.sourceSize = key.size;
+	header.sourceWriteTime = key.writeTime;
+	header.pathLength = static_cast<uint32_t>(key.path.size());
+	header.format = static_cast<uint32_t>(image.format);
+	header.width = image.levels[0].width;
+	header.height = image.levels[0].height;
+	header.blockOffset = Align(sizeof(CacheHeader) + key.path.size());
+	header.blockBytes = image.blocks.size();
+	header.fileSize = header.blockOffset + header.blockBytes;
+	header.checksum = MeshCodec::Checksum(image.blocks.data(), image.blocks.size());
+
+	const char padding[cacheAlignment] = {};
+	file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+	file.write(key.path.data(), static_cast<std::streamsize>(key.path.size()));
+	file.write(padding, static_cast<std::streamsize>(header.blockOffset - sizeof(CacheHeader) - key.path.size()));
+	file.write(reinterpret_cast<const char *>(image.blocks.data()), static_cast<std::streamsize>(image.blocks.size()));
+
+	bool written = file.good();
+	file.close();
+
+	if (!written || !MoveFileExA(tempFileName.c_str(), cacheFileName.c_str(), MOVEFILE_REPLACE_EXISTING))
+	{
+		DeleteFileA(tempFileName.c_str());
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "MipGenerator.h"
+#include "TextureCompressor.h"
+
+// Block compressed mip chains of .ppm textures, written next to the source as <name>.ppm.texcache
+// Keyed on the source path, size and last write time and the format, so each version of a file is only encoded once
+// Blocks are stored exactly as the GPU takes them, nothing is decoded on a cached load
+// Read checks them and copies them out of the mapping into Image::blocks, the upload copies them once more into staging
+class TextureCache
+{
+public:
+	struct Image
+	{
+		TextureCompressor::Format format;
+
+		// Level 0 is the full image, offsets are into blocks
+		std::vector<MipGenerator::Level> levels;
+		std::vector<unsigned char> blocks;
+	};
+
+	// Load from the cache if it matches the source, otherwise decode the .ppm, build its mips, compress them and write a new cache
+	// Colors are taken as sRGB encoded when filtering the mips
+	// Returns false only if the .ppm can't be read
+	static bool LoadPPM(const std::string &fileName, TextureCompressor::Format format, Image &image);
+
+	// Returns false if there is no cache for fileName, it is out of date, damaged or holds another format
+	static bool Read(const std::string &fileName, TextureCompressor::Format format, Image &image);
+	static bool Write(const std::string &fileName, const Image &image);
+
+	static std::string CacheFileName(const std::string &fileName);
+};
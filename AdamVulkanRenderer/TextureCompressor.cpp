@@ -0,0 +1,822 @@
+#include "stdafx.h"
+#include "TextureCompressor.h"
+#include "TextScanner.h"
+#include <emmintrin.h>
+#include <immintrin.h>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+	// Refinement rounds after the principal axis fit, each one is kept only if it lowers the error
+	const int refinements = 2;
+
+	// BC7 interpolation weights for 4 bit indices, out of 64
+	const int bc7Weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+	// BC1 and BC3 store palette entries out of order, index of each step from the first endpoint to the second
+	const int bc1Order[4] = { 0, 2, 3, 1 };
+	const int bc3Order[8] = { 0, 2, 3, 4, 5, 6, 7, 1 };
+
+	// 16 texels channel by channel, so the projections can take several texels at a time
+	struct Block
+	{
+		alignas(32) float texels[4][16];
+	};
+
+	// One block's worth of texels at 8 bits, the last row and column repeat past the edge
+	void LoadBlock(const unsigned char *rgba, uint32_t width, uint32_t height, uint32_t blockX, uint32_t blockY, Block &block)
+	{
+		for (uint32_t y = 0; y < 4; ++y)
+		{
+			const unsigned char *row = rgba + size_t(std::min(blockY * 4 + y, height - 1)) * width * 4;
+			for (uint32_t x = 0; x < 4; ++x)
+			{
+				const unsigned char *texel = row + size_t(std::min(blockX * 4 + x, width - 1)) * 4;
+				for (int c = 0; c < 4; ++c)
+				{
+					block.texels[c][y * 4 + x] = texel[c];
+				}
+			}
+		}
+	}
+
+	// Ends of the line through the mean along the direction the texels spread most, by power iteration on the covariance
+	void FitAxis(const Block &block, int first, int count, float *e0, float *e1)
+	{
+		float mean[4] = {};
+		for (int c = 0; c < count; ++c)
+		{
+			for (int i = 0; i < 16; ++i)
+			{
+				mean[c] += block.texels[first + c][i];
+			}
+			mean[c] /= 16.0f;
+		}
+
+		float covariance[4][4] = {};
+		for (int i = 0; i < 16; ++i)
+		{
+			for (int c = 0; c < count; ++c)
+			{
+				for (int d = 0; d < count; ++d)
+				{
+					covariance[c][d] += (block.texels[first + c][i] - mean[c]) * (block.texels[first + d][i] - mean[d]);
+				}
+			}
+		}
+
+		// The row of the widest channel can't be orthogonal to the answer, unlike a fixed start
+		int widest = 0;
+		for (int c = 1; c < count; ++c)
+		{
+			widest = covariance[c][c] > covariance[widest][widest] ? c : widest;
+		}
+
+		float axis[4] = {};
+		for (int c = 0; c < count; ++c)
+		{
+			axis[c] = covariance[widest][c];
+		}
+
+		for (int iteration = 0; iteration < 8; ++iteration)
+		{
+			float next[4] = {};
+			float largest = 0.0f;
+			for (int c = 0; c < count; ++c)
+			{
+				for (int d = 0; d < count; ++d)
+				{
+					next[c] += covariance[c][d] * axis[d];
+				}
+				largest = std::max(largest, std::fabs(next[c]));
+			}
+			if (largest == 0.0f)
+			{
+				break;
+			}
+			for (int c = 0; c < count; ++c)
+			{
+				axis[c] = next[c] / largest;
+			}
+		}
+
+		float length = 0.0f;
+		for (int c = 0; c < count; ++c)
+		{
+			length += axis[c] * axis[c];
+		}
+
+		// Flat block, both ends on the mean
+		float low = 0.0f;
+		float high = 0.0f;
+		for (int i = 0; length > 0.0f && i < 16; ++i)
+		{
+			float t = 0.0f;
+			for (int c = 0; c < count; ++c)
+			{
+				t += (block.texels[first + c][i] - mean[c]) * axis[c];
+			}
+			low = std::min(low, t / length);
+			high = std::max(high, t / length);
+		}
+
+		for (int c = 0; c < count; ++c)
+		{
+			e0[c] = std::min(255.0f, std::max(0.0f, mean[c] + axis[c] * low));
+			e1[c] = std::min(255.0f, std::max(0.0f, mean[c] + axis[c] * high));
+		}
+	}
+
+	// Step from e0 of every texel, the nearest of steps evenly spaced points on the line to e1
+	// scale is (steps - 1) / |e1 - e0|^2 and top is steps - 1
+	void ProjectScalar(const Block &block, int first, int count, const float *e0, const float *direction, float scale, float top, int *indices)
+	{
+		for (int i = 0; i < 16; ++i)
+		{
+			float dot = 0.0f;
+			for (int c = 0; c < count; ++c)
+			{
+				dot = dot + (block.texels[first + c][i] - e0[c]) * direction[c];
+			}
+			float t = std::min(std::max(dot * scale, 0.0f), top);
+			indices[i] = static_cast<int>(t + 0.5f);
+		}
+	}
+
+	// Same math four texels at a time, so it rounds the same way
+	void ProjectSSE2(const Block &block, int first, int count, const float *e0, const float *direction, float scale, float top, int *indices)
+	{
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 half = _mm_set1_ps(0.5f);
+		for (int i = 0; i < 16; i += 4)
+		{
+			__m128 dot = zero;
+			for (int c = 0; c < count; ++c)
+			{
+				__m128 offset = _mm_sub_ps(_mm_load_ps(&block.texels[first + c][i]), _mm_set1_ps(e0[c]));
+				dot = _mm_add_ps(dot, _mm_mul_ps(offset, _mm_set1_ps(direction[c])));
+			}
+			__m128 t = _mm_min_ps(_mm_max_ps(_mm_mul_ps(dot, _mm_set1_ps(scale)), zero), _mm_set1_ps(top));
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(indices + i), _mm_cvttps_epi32(_mm_add_ps(t, half)));
+		}
+	}
+
+	void ProjectAVX2(const Block &block, int first, int count, const float *e0, const float *direction, float scale, float top, int *indices)
+	{
+		const __m256 zero = _mm256_setzero_ps();
+		const __m256 half = _mm256_set1_ps(0.5f);
+		for (int i = 0; i < 16; i += 8)
+		{
+			__m256 dot = zero;
+			for (int c = 0; c < count; ++c)
+			{
+				__m256 offset = _mm256_sub_ps(_mm256_load_ps(&block.texels[first + c][i]), _mm256_set1_ps(e0[c]));
+				dot = _mm256_add_ps(dot, _mm256_mul_ps(offset, _mm256_set1_ps(direction[c])));
+			}
+			__m256 t = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(dot, _mm256_set1_ps(scale)), zero), _mm256_set1_ps(top));
+			_mm256_storeu_si256(reinterpret_cast<__m256i *>(indices + i), _mm256_cvttps_epi32(_mm256_add_ps(t, half)));
+		}
+	}
+
+	void Project(const Block &block, int first, int count, const float *e0, const float *e1, int steps, TextScanner::Kernel kernel, int *indices)
+	{
+		float direction[4] = {};
+		float length = 0.0f;
+		for (int c = 0; c < count; ++c)
+		{
+			direction[c] = e1[c] - e0[c];
+			length += direction[c] * direction[c];
+		}
+
+		if (length == 0.0f)
+		{
+			memset(indices, 0, 16 * sizeof(int));
+			return;
+		}
+
+		float scale = (steps - 1) / length;
+		float top = static_cast<float>(steps - 1);
+		if (kernel == TextScanner::KernelAVX2)
+		{
+			ProjectAVX2(block, first, count, e0, direction, scale, top, indices);
+		}
+		else if (kernel == TextScanner::KernelSSE2)
+		{
+			ProjectSSE2(block, first, count, e0, direction, scale, top, indices);
+		}
+		else
+		{
+			ProjectScalar(block, first, count, e0, direction, scale, top, indices);
+		}
+	}
+
+	// Endpoints that best fit the texels for the steps they were given, false if the steps don't pin them down
+	bool LeastSquares(const Block &block, int first, int count, const int *indices, int steps, float *e0, float *e1)
+	{
+		float aa = 0.0f;
+		float ab = 0.0f;
+		float bb = 0.0f;
+		float ax[4] = {};
+		float bx[4] = {};
+		for (int i = 0; i < 16; ++i)
+		{
+			float b = indices[i] / float(steps - 1);
+			float a = 1.0f - b;
+			aa += a * a;
+			ab += a * b;
+			bb += b * b;
+			for (int c = 0; c < count; ++c)
+			{
+				ax[c] += a * block.texels[first + c][i];
+				bx[c] += b * block.texels[first + c][i];
+			}
+		}
+
+		float determinant = aa * bb - ab * ab;
+		if (std::fabs(determinant) < 1e-6f)
+		{
+			return false;
+		}
+
+		for (int c = 0; c < count; ++c)
+		{
+			e0[c] = std::min(255.0f, std::max(0.0f, (bb * ax[c] - ab * bx[c]) / determinant));
+			e1[c] = std::min(255.0f, std::max(0.0f, (aa * bx[c] - ab * ax[c]) / determinant));
+		}
+		return true;
+	}
+
+	// Squared error of texels against palette entries picked by step
+	float PaletteError(const Block &block, int first, int count, const int *indices, const float palette[][4])
+	{
+		float error = 0.0f;
+		for (int i = 0; i < 16; ++i)
+		{
+			for (int c = 0; c < count; ++c)
+			{
+				float difference = block.texels[first + c][i] - palette[indices[i]][c];
+				error += difference * difference;
+			}
+		}
+		return error;
+	}
+
+	inline int Quantize(float value, int maximum)
+	{
+		return std::min(maximum, std::max(0, static_cast<int>(value * maximum / 255.0f + 0.5f)));
+	}
+
+	inline uint16_t To565(const float *color)
+	{
+		return static_cast<uint16_t>((Quantize(color[0], 31) << 11) | (Quantize(color[1], 63) << 5) | Quantize(color[2], 31));
+	}
+
+	inline void From565(uint16_t packed, float *color)
+	{
+		int r = packed >> 11;
+		int g = (packed >> 5) & 63;
+		int b = packed & 31;
+		color[0] = static_cast<float>((r << 3) | (r >> 2));
+		color[1] = static_cast<float>((g << 2) | (g >> 4));
+		color[2] = static_cast<float>((b << 3) | (b >> 2));
+	}
+
+	// Four color BC1 block, always four colors so it also serves BC3
+	void EncodeColor(const Block &block, TextScanner::Kernel kernel, unsigned char *output)
+	{
+		float e0[4];
+		float e1[4];
+		FitAxis(block, 0, 3, e0, e1);
+
+		float bestError = FLT_MAX;
+		uint16_t best0 = 0;
+		uint16_t best1 = 0;
+		int bestIndices[16] = {};
+		for (int round = 0; round <= refinements; ++round)
+		{
+			uint16_t packed0 = To565(e0);
+			uint16_t packed1 = To565(e1);
+			float palette[4][4];
+			From565(packed0, palette[0]);
+			From565(packed1, palette[3]);
+			for (int c = 0; c < 3; ++c)
+			{
+				palette[1][c] = (2.0f * palette[0][c] + palette[3][c]) / 3.0f;
+				palette[2][c] = (palette[0][c] + 2.0f * palette[3][c]) / 3.0f;
+			}
+
+			int indices[16];
+			Project(block, 0, 3, palette[0], palette[3], 4, kernel, indices);
+			float error = PaletteError(block, 0, 3, indices, palette);
+			if (error < bestError)
+			{
+				bestError = error;
+				best0 = packed0;
+				best1 = packed1;
+				memcpy(bestIndices, indices, sizeof(indices));
+			}
+
+			if (error == 0.0f || !LeastSquares(block, 0, 3, indices, 4, e0, e1))
+			{
+				break;
+			}
+		}
+
+		// Four color mode needs the first endpoint to be the larger one
+		if (best0 < best1)
+		{
+			std::swap(best0, best1);
+			for (int i = 0; i < 16; ++i)
+			{
+				bestIndices[i] = 3 - bestIndices[i];
+			}
+		}
+
+		uint32_t bits = 0;
+		for (int i = 0; best0 != best1 && i < 16; ++i)
+		{
+			bits |= uint32_t(bc1Order[bestIndices[i]]) << (i * 2);
+		}
+		memcpy(output, &best0, 2);
+		memcpy(output + 2, &best1, 2);
+		memcpy(output + 4, &bits, 4);
+	}
+
+	// Eight step BC3 alpha block
+	void EncodeAlpha(const Block &block, TextScanner::Kernel kernel, unsigned char *output)
+	{
+		float e0 = *std::max_element(block.texels[3], block.texels[3] + 16);
+		float e1 = *std::min_element(block.texels[3], block.texels[3] + 16);
+
+		float bestError = FLT_MAX;
+		int best0 = 0;
+		int best1 = 0;
+		int bestIndices[16] = {};
+		for (int round = 0; round <= refinements; ++round)
+		{
+			int alpha0 = Quantize(e0, 255);
+			int alpha1 = Quantize(e1, 255);
+			float palette[8][4];
+			for (int step = 0; step < 8; ++step)
+			{
+				palette[step][0] = static_cast<float>(((7 - step) * alpha0 + step * alpha1) / 7);
+			}
+
+			int indices[16];
+			Project(block, 3, 1, palette[0], palette[7], 8, kernel, indices);
+			float error = PaletteError(block, 3, 1, indices, palette);
+			if (error < bestError)
+			{
+				bestError = error;
+				best0 = alpha0;
+				best1 = alpha1;
+				memcpy(bestIndices, indices, sizeof(indices));
+			}
+
+			if (error == 0.0f || !LeastSquares(block, 3, 1, indices, 8, &e0, &e1))
+			{
+				break;
+			}
+		}
+
+		// Eight step mode needs the first endpoint to be the larger one
+		if (best0 < best1)
+		{
+			std::swap(best0, best1);
+			for (int i = 0; i < 16; ++i)
+			{
+				bestIndices[i] = 7 - bestIndices[i];
+			}
+		}
+
+		uint64_t bits = 0;
+		for (int i = 0; best0 != best1 && i < 16; ++i)
+		{
+			bits |= uint64_t(bc3Order[bestIndices[i]]) << (i * 3);
+		}
+		output[0] = static_cast<unsigned char>(best0);
+		output[1] = static_cast<unsigned char>(best1);
+		memcpy(output + 2, &bits, 6);
+	}
+
+	// 7 bits per channel plus a low bit shared by the endpoint's channels, whichever bit lands closer
+	void QuantizeBC7(const float *endpoint, int *quantized, int &pBit)
+	{
+		float bestError = FLT_MAX;
+		for (int p = 0; p < 2; ++p)
+		{
+			int candidate[4];
+			float error = 0.0f;
+			for (int c = 0; c < 4; ++c)
+			{
+				candidate[c] = std::min(127, std::max(0, static_cast<int>((endpoint[c] - p) / 2.0f + 0.5f)));
+				float difference = endpoint[c] - (candidate[c] * 2 + p);
+				error += difference * difference;
+			}
+			if (error < bestError)
+			{
+				bestError = error;
+				pBit = p;
+				memcpy(quantized, candidate, sizeof(candidate));
+			}
+		}
+	}
+
+	// Fills a 128 bit block from the lowest bit up
+	class BitWriter
+	{
+	public:
+		explicit BitWriter(unsigned char *output) : m_output(output), m_position(0)
+		{
+			memset(output, 0, 16);
+		}
+
+		void Write(uint32_t value, int bits)
+		{
+			for (int i = 0; i < bits; ++i, ++m_position)
+			{
+				m_output[m_position >> 3] |= static_cast<unsigned char>(((value >> i) & 1) << (m_position & 7));
+			}
+		}
+
+	private:
+		unsigned char *m_output;
+		int m_position;
+	};
+
+	// BC7 mode 6
+	void EncodeBC7(const Block &block, TextScanner::Kernel kernel, unsigned char *output)
+	{
+		float e0[4];
+		float e1[4];
+		FitAxis(block, 0, 4, e0, e1);
+
+		float bestError = FLT_MAX;
+		int best[2][4] = {};
+		int bestP[2] = {};
+		int bestIndices[16] = {};
+		for (int round = 0; round <= refinements; ++round)
+		{
+			int quantized[2][4];
+			int pBits[2];
+			QuantizeBC7(e0, quantized[0], pBits[0]);
+			QuantizeBC7(e1, quantized[1], pBits[1]);
+
+			float ends[2][4];
+			for (int c = 0; c < 4; ++c)
+			{
+				ends[0][c] = static_cast<float>(quantized[0][c] * 2 + pBits[0]);
+				ends[1][c] = static_cast<float>(quantized[1][c] * 2 + pBits[1]);
+			}
+
+			float palette[16][4];
+			for (int step = 0; step < 16; ++step)
+			{
+				for (int c = 0; c < 4; ++c)
+				{
+					int low = static_cast<int>(ends[0][c]);
+					int high = static_cast<int>(ends[1][c]);
+					palette[step][c] = static_cast<float>(((64 - bc7Weights[step]) * low + bc7Weights[step] * high + 32) >> 6);
+				}
+			}
+
+			int indices[16];
+			Project(block, 0, 4, ends[0], ends[1], 16, kernel, indices);
+			float error = PaletteError(block, 0, 4, indices, palette);
+			if (error < bestError)
+			{
+				bestError = error;
+				memcpy(best, quantized, sizeof(quantized));
+				memcpy(bestP, pBits, sizeof(pBits));
+				memcpy(bestIndices, indices, sizeof(indices));
+			}
+
+			if (error == 0.0f || !LeastSquares(block, 0, 4, indices, 16, e0, e1))
+			{
+				break;
+			}
+		}
+
+		// The first texel's index is stored without its top bit, swap the ends if it would be set
+		if (bestIndices[0] >= 8)
+		{
+			for (int c = 0; c < 4; ++c)
+			{
+				std::swap(best[0][c], best[1][c]);
+			}
+			std::swap(bestP[0], bestP[1]);
+			for (int i = 0; i < 16; ++i)
+			{
+				bestIndices[i] = 15 - bestIndices[i];
+			}
+		}
+
+		BitWriter writer(output);
+		writer.Write(1 << 6, 7);
+		for (int c = 0; c < 4; ++c)
+		{
+			writer.Write(best[0][c], 7);
+			writer.Write(best[1][c], 7);
+		}
+		writer.Write(bestP[0], 1);
+		writer.Write(bestP[1], 1);
+		writer.Write(bestIndices[0], 3);
+		for (int i = 1; i < 16; ++i)
+		{
+			writer.Write(bestIndices[i], 4);
+		}
+	}
+
+	// Rows of blocks, chunks own disjoint rows
+	struct Context
+	{
+		const unsigned char *rgba;
+		uint32_t width;
+		uint32_t height;
+		uint32_t blocksWide;
+		unsigned char *blocks;
+		TextureCompressor::Format format;
+		TextScanner::Kernel kernel;
+	};
+
+	struct Chunk
+	{
+		Context *context;
+		uint32_t firstRow;
+		uint32_t endRow;
+	};
+
+	VOID CALLBACK CompressCallback(PTP_CALLBACK_INSTANCE instance, PVOID parameter, PTP_WORK work)
+	{
+		Chunk *chunk = static_cast<Chunk *>(parameter);
+		const Context &context = *chunk->context;
+		size_t blockBytes = TextureCompressor::BlockBytes(context.format);
+
+		Block block;
+		for (uint32_t y = chunk->firstRow; y < chunk->endRow; ++y)
+		{
+			unsigned char *output = context.blocks + size_t(y) * context.blocksWide * blockBytes;
+			for (uint32_t x = 0; x < context.blocksWide; ++x, output += blockBytes)
+			{
+				LoadBlock(context.rgba, context.width, context.height, x, y, block);
+				if (context.format == TextureCompressor::FormatBC1)
+				{
+					EncodeColor(block, context.kernel, output);
+				}
+				else if (context.format == TextureCompressor::FormatBC3)
+				{
+					EncodeAlpha(block, context.kernel, output);
+					EncodeColor(block, context.kernel, output + 8);
+				}
+				else
+				{
+					EncodeBC7(block, context.kernel, output);
+				}
+			}
+		}
+		UNREFERENCED_PARAMETER(instance);
+		UNREFERENCED_PARAMETER(work);
+	}
+
+	// Same as the .obj loader, the calling thread takes the last chunk
+	void RunChunks(PTP_WORK_CALLBACK callback, std::vector<Chunk> &chunks)
+	{
+		std::vector<PTP_WORK> works(chunks.size() - 1);
+		for (size_t i = 0; i < works.size(); ++i)
+		{
+			works[i] = CreateThreadpoolWork(callback, &chunks[i], NULL);
+			SubmitThreadpoolWork(works[i]);
+		}
+
+		callback(NULL, &chunks.back(), NULL);
+
+		for (size_t i = 0; i < works.size(); ++i)
+		{
+			WaitForThreadpoolWorkCallbacks(works[i], FALSE);
+			CloseThreadpoolWork(works[i]);
+		}
+	}
+
+	void DecodeColor(const unsigned char *input, bool alwaysFour, unsigned char texels[16][4])
+	{
+		uint16_t packed0;
+		uint16_t packed1;
+		uint32_t bits;
+		memcpy(&packed0, input, 2);
+		memcpy(&packed1, input + 2, 2);
+		memcpy(&bits, input + 4, 4);
+
+		float ends[2][4];
+		From565(packed0, ends[0]);
+		From565(packed1, ends[1]);
+
+		int palette[4][4];
+		for (int c = 0; c < 3; ++c)
+		{
+			int low = static_cast<int>(ends[0][c]);
+			int high = static_cast<int>(ends[1][c]);
+			palette[0][c] = low;
+			palette[1][c] = high;
+			if (alwaysFour || packed0 > packed1)
+			{
+				palette[2][c] = (2 * low + high) / 3;
+				palette[3][c] = (low + 2 * high) / 3;
+			}
+			else
+			{
+				palette[2][c] = (low + high) / 2;
+				palette[3][c] = 0;
+			}
+		}
+		palette[0][3] = palette[1][3] = palette[2][3] = 255;
+		palette[3][3] = (alwaysFour || packed0 > packed1) ? 255 : 0;
+
+		for (int i = 0; i < 16; ++i)
+		{
+			int index = (bits >> (i * 2)) & 3;
+			for (int c = 0; c < 4; ++c)
+			{
+				texels[i][c] = static_cast<unsigned char>(palette[index][c]);
+			}
+		}
+	}
+
+	void DecodeAlpha(const unsigned char *input, unsigned char texels[16][4])
+	{
+		int alpha0 = input[0];
+		int alpha1 = input[1];
+		uint64_t bits = 0;
+		memcpy(&bits, input + 2, 6);
+
+		int palette[8] = { alpha0, alpha1 };
+		for (int step = 1; step < 7; ++step)
+		{
+			palette[step + 1] = alpha0 > alpha1 ? ((7 - step) * alpha0 + step * alpha1) / 7 : ((5 - step) * alpha0 + step * alpha1) / 5;
+		}
+		if (alpha0 <= alpha1)
+		{
+			palette[6] = 0;
+			palette[7] = 255;
+		}
+
+		for (int i = 0; i < 16; ++i)
+		{
+			texels[i][3] = static_cast<unsigned char>(palette[(bits >> (i * 3)) & 7]);
+		}
+	}
+
+	inline uint32_t ReadBits(const unsigned char *input, int &position, int bits)
+	{
+		uint32_t value = 0;
+		for (int i = 0; i < bits; ++i, ++position)
+		{
+			value |= uint32_t((input[position >> 3] >> (position & 7)) & 1) << i;
+		}
+		return value;
+	}
+
+	void DecodeBC7(const unsigned char *input, unsigned char texels[16][4])
+	{
+		// Anything but mode 6 decodes to magenta
+		int position = 0;
+		if (ReadBits(input, position, 7) != (1 << 6))
+		{
+			for (int i = 0; i < 16; ++i)
+			{
+				texels[i][0] = texels[i][2] = texels[i][3] = 255;
+				texels[i][1] = 0;
+			}
+			return;
+		}
+
+		int ends[2][4];
+		for (int c = 0; c < 4; ++c)
+		{
+			ends[0][c] = ReadBits(input, position, 7) << 1;
+			ends[1][c] = ReadBits(input, position, 7) << 1;
+		}
+		uint32_t p0 = ReadBits(input, position, 1);
+		uint32_t p1 = ReadBits(input, position, 1);
+		for (int c = 0; c < 4; ++c)
+		{
+			ends[0][c] |= p0;
+			ends[1][c] |= p1;
+		}
+
+		for (int i = 0; i < 16; ++i)
+		{
+			int weight = bc7Weights[ReadBits(input, position, i == 0 ? 3 : 4)];
+			for (int c = 0; c < 4; ++c)
+			{
+				texels[i][c] = static_cast<unsigned char>(((64 - weight) * ends[0][c] + weight * ends[1][c] + 32) >> 6);
+			}
+		}
+	}
+}
+
+size_t TextureCompressor::BlockBytes(Format format)
+{
+	return format == FormatBC1 ? 8 : 16;
+}
+
+const char *TextureCompressor::FormatName(Format format)
+{
+	static const char *names[FormatCount] = { "bc1", "bc3", "bc7" };
+	return format < FormatCount ? names[format] : "unknown";
+}
+
+size_t TextureCompressor::Layout(Format format, const std::vector<MipGenerator::Level> &levels, std::vector<MipGenerator::Level> &blockLevels)
+{
+	blockLevels.resize(levels.size());
+	size_t size = 0;
+	for (size_t i = 0; i < levels.size(); ++i)
+	{
+		blockLevels[i].width = levels[i].width;
+		blockLevels[i].height = levels[i].height;
+		blockLevels[i].offset = size;
+
+		size_t blocks = size_t((levels[i].width + 3) / 4) * ((levels[i].height + 3) / 4);
+		size += (blocks * BlockBytes(format) + 15) & ~size_t(15);
+	}
+	return size;
+}
+
+// Rows of blocks are split across the thread pool, every block is encoded on its own
+void TextureCompressor::Compress(const unsigned char *rgba, uint32_t width, uint32_t height, unsigned char *blocks, const Settings &settings)
+{
+	if (width == 0 || height == 0)
+	{
+		return;
+	}
+
+	// Zero threads means one per logical core
+	unsigned int threadCount = settings.threadCount;
+	if (threadCount == 0)
+	{
+		SYSTEM_INFO systemInfo;
+		GetSystemInfo(&systemInfo);
+		threadCount = systemInfo.dwNumberOfProcessors;
+	}
+
+	Context context;
+	context.rgba = rgba;
+	context.width = width;
+	context.height = height;
+	context.blocksWide = (width + 3) / 4;
+	context.blocks = blocks;
+	context.format = settings.format;
+	context.kernel = TextScanner::GetKernel();
+
+	uint32_t blocksHigh = (height + 3) / 4;
+	size_t chunkCount = size_t(context.blocksWide) * blocksHigh / minimumChunkBlocks;
+	chunkCount = std::max<size_t>(1, std::min<size_t>(std::min<size_t>(chunkCount, threadCount), blocksHigh));
+
+	std::vector<Chunk> chunks(chunkCount);
+	for (size_t i = 0; i < chunkCount; ++i)
+	{
+		chunks[i].context = &context;
+		chunks[i].firstRow = static_cast<uint32_t>(blocksHigh * i / chunkCount);
+		chunks[i].endRow = static_cast<uint32_t>(blocksHigh * (i + 1) / chunkCount);
+	}
+	RunChunks(CompressCallback, chunks);
+}
+
+void TextureCompressor::Decompress(const unsigned char *blocks, Format format, uint32_t width, uint32_t height, unsigned char *rgba)
+{
+	size_t blockBytes = BlockBytes(format);
+	uint32_t blocksWide = (width + 3) / 4;
+	uint32_t blocksHigh = (height + 3) / 4;
+	for (uint32_t blockY = 0; blockY < blocksHigh; ++blockY)
+	{
+		for (uint32_t blockX = 0; blockX < blocksWide; ++blockX)
+		{
+			const unsigned char *input = blocks + (size_t(blockY) * blocksWide + blockX) * blockBytes;
+			unsigned char texels[16][4];
+			if (format == FormatBC1)
+			{
+				DecodeColor(input, false, texels);
+			}
+			else if (format == FormatBC3)
+			{
+				DecodeColor(input + 8, true, texels);
+				DecodeAlpha(input, texels);
+			}
+			else
+			{
+				DecodeBC7(input, texels);
+			}
+
+			// Only the part of the block inside the image
+			for (uint32_t y = 0; y < 4 && blockY * 4 + y < height; ++y)
+			{
+				for (uint32_t x = 0; x < 4 && blockX * 4 + x < width; ++x)
+				{
+					memcpy(rgba + ((size_t(blockY) * 4 + y) * width + blockX * 4 + x) * 4, texels[y * 4 + x], 4);
+				}
+			}
+		}
+	}
+}
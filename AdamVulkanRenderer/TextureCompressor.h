@@ -0,0 +1,57 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include "MipGenerator.h"
+
+// Block compression for RGBA8 textures, 4x4 texel blocks in the BC1, BC3 or BC7 layouts the GPU samples directly
+// Every block's endpoints start at the ends of its principal axis and are refined by least squares,
+// texels take the palette entry nearest their projection onto the line between them
+// BC7 only uses mode 6, one RGBA endpoint pair with 16 steps, which is the best single mode for opaque and soft alpha textures
+// Blocks are split across threads, the projections are vectorized with the kernel TextScanner picked
+class TextureCompressor
+{
+public:
+	enum Format
+	{
+		// RGB at 4 bits per texel, alpha is dropped
+		FormatBC1,
+
+		// BC1 color plus its own block for alpha, 8 bits per texel
+		FormatBC3,
+
+		// 8 bits per texel, a lot closer to the source than BC1 on gradients
+		FormatBC7,
+
+		FormatCount
+	};
+
+	struct Settings
+	{
+		Format format;
+
+		// 0 uses one per logical core, small images are always done on the calling thread
+		unsigned int threadCount;
+
+		Settings() : format(FormatBC7), threadCount(0) {}
+	};
+
+	// Don't bother splitting fewer blocks than this across threads
+	static const size_t minimumChunkBlocks = 512;
+
+	static size_t BlockBytes(Format format);
+	static const char *FormatName(Format format);
+
+	// Blocks for every level of a mip chain laid out by MipGenerator, one level after another
+	// Offsets are multiples of 16, returns the bytes the whole chain needs
+	static size_t Layout(Format format, const std::vector<MipGenerator::Level> &levels, std::vector<MipGenerator::Level> &blockLevels);
+
+	// Tightly packed RGBA8 rows to blocks, left to right then top to bottom
+	// Blocks hanging over the edge repeat the last row and column
+	// The result doesn't depend on the thread count or kernel
+	static void Compress(const unsigned char *rgba, uint32_t width, uint32_t height, unsigned char *blocks, const Settings &settings = Settings());
+
+	// Back to RGBA8 rows, for checking the encoder, BC7 only reads the mode 6 blocks Compress writes
+	static void Decompress(const unsigned char *blocks, Format format, uint32_t width, uint32_t height, unsigned char *rgba);
+};
@@ -0,0 +1,152 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include "ScratchArena.h"
+
+// Open-addressing hash table mapping a packed (v, vt, vn) .obj index triple
+// to the index of the vertex already emitted for it
+// Linear probing, clearing bumps a generation counter instead of touching every slot
+// Slots come from the arena when there is one, outgrown slot arrays are left for its Reset
+class VertexDedupTable
+{
+public:
+	explicit VertexDedupTable(ScratchArena *arena = NULL) : m_arena(arena), m_slots(NULL), m_capacity(0), m_mask(0), m_count(0), m_generation(1) {}
+
+	// Size the table for an expected number of unique vertices
+	// Keeps the load factor under 50% so probe chains stay short
+	void Reserve(size_t vertexCount)
+	{
+		size_t capacity = 16;
+		while (capacity < vertexCount * 2)
+		{
+			capacity <<= 1;
+		}
+
+		if (capacity > m_capacity)
+		{
+			Rehash(capacity);
+		}
+	}
+
+	// Forget every entry, capacity is kept for the next group
+	void Clear()
+	{
+		m_count = 0;
+		if (++m_generation == 0)
+		{
+			// Wrapped around, stale slots could look live again so really clear them
+			std::fill(m_slots, m_slots + m_capacity, Slot());
+			m_generation = 1;
+		}
+	}
+
+	// Returns the index stored for the triple, or stores newIndex and returns it
+	// Missing components (-1) are valid parts of the key
+	uint32_t FindOrInsert(int v, int vt, int vn, uint32_t newIndex, bool &inserted)
+	{
+		if ((m_count + 1) * 2 > m_capacity)
+		{
+			Rehash(m_capacity == 0 ? 16 : m_capacity * 2);
+		}
+
+		Key key = { static_cast<uint32_t>(v), static_cast<uint32_t>(vt), static_cast<uint32_t>(vn) };
+		for (size_t slot = Hash(key) & m_mask;; slot = (slot + 1) & m_mask)
+		{
+			Slot &entry = m_slots[slot];
+			if (entry.generation != m_generation)
+			{
+				entry.key = key;
+				entry.index = newIndex;
+				entry.generation = m_generation;
+				++m_count;
+				inserted = true;
+				return newIndex;
+			}
+
+			if (entry.key.v == key.v && entry.key.vt == key.vt && entry.key.vn == key.vn)
+			{
+				inserted = false;
+				return entry.index;
+			}
+		}
+	}
+
+private:
+	struct Key
+	{
+		uint32_t v;
+		uint32_t vt;
+		uint32_t vn;
+	};
+
+	struct Slot
+	{
+		Key key;
+		uint32_t index;
+		uint32_t generation;
+
+		Slot() : index(0), generation(0) { key.v = key.vt = key.vn = 0; }
+	};
+
+	static size_t Hash(const Key &key)
+	{
+		// Positions are usually sequential, so mix well before masking off the low bits
+		uint64_t hash = key.v * 0x9E3779B97F4A7C15ull;
+		hash ^= (key.vt + 0x7F4A7C15ull) * 0xC2B2AE3D27D4EB4Full;
+		hash ^= (key.vn + 0x165667B1ull) * 0x165667B19E3779F9ull;
+		hash ^= hash >> 29;
+		return static_cast<size_t>(hash);
+	}
+
+	// Slots point into m_owned or the arena, so don't allow copies
+	VertexDedupTable(const VertexDedupTable &);
+	VertexDedupTable &operator=(const VertexDedupTable &);
+
+	void Rehash(size_t capacity)
+	{
+		std::vector<Slot> oldOwned;
+		oldOwned.swap(m_owned);
+		const Slot *old = m_slots;
+		size_t oldCapacity = m_capacity;
+		uint32_t oldGeneration = m_generation;
+
+		if (m_arena != NULL)
+		{
+			m_slots = m_arena->AllocateArray<Slot>(capacity);
+		}
+		else
+		{
+			m_owned.assign(capacity, Slot());
+			m_slots = m_owned.data();
+		}
+		m_capacity = capacity;
+		m_mask = capacity - 1;
+		m_count = 0;
+		m_generation = 1;
+
+		for (size_t i = 0; i < oldCapacity; ++i)
+		{
+			if (old[i].generation == oldGeneration)
+			{
+				size_t slot = Hash(old[i].key) & m_mask;
+				while (m_slots[slot].generation == m_generation)
+				{
+					slot = (slot + 1) & m_mask;
+				}
+				m_slots[slot] = old[i];
+				m_slots[slot].generation = m_generation;
+				++m_count;
+			}
+		}
+	}
+
+	ScratchArena *m_arena;
+	std::vector<Slot> m_owned;
+	Slot *m_slots;
+	size_t m_capacity;
+	size_t m_mask;
+	size_t m_count;
+	uint32_t m_generation;
+};
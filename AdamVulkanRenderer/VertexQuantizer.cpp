@@ -0,0 +1,214 @@
+#include "stdafx.h"
+#include "VertexQuantizer.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+	const float unormScale = 65535.0f;
+	const float snormScale = 32767.0f;
+	const float radiansToDegrees = 57.2957795f;
+
+	inline float SignNotZero(float value)
+	{
+		return value >= 0.0f ? 1.0f : -1.0f;
+	}
+
+	// Project onto the octahedron |x| + |y| + |z| = 1 and fold the lower half over the upper one
+	void EncodeOctahedral(const float *normal, int16_t *encoded)
+	{
+		float length = std::fabs(normal[0]) + std::fabs(normal[1]) + std::fabs(normal[2]);
+		float u = 0.0f;
+		float v = 0.0f;
+		if (length > 0.0f)
+		{
+			u = normal[0] / length;
+			v = normal[1] / length;
+			if (normal[2] < 0.0f)
+			{
+				float foldedU = (1.0f - std::fabs(v)) * SignNotZero(u);
+				float foldedV = (1.0f - std::fabs(u)) * SignNotZero(v);
+				u = foldedU;
+				v = foldedV;
+			}
+		}
+
+		encoded[0] = static_cast<int16_t>(std::floor(std::max(-1.0f, std::min(1.0f, u)) * snormScale + 0.5f));
+		encoded[1] = static_cast<int16_t>(std::floor(std::max(-1.0f, std::min(1.0f, v)) * snormScale + 0.5f));
+	}
+
+	// Same steps as vertex_quantized.vs
+	void DecodeOctahedral(const int16_t *encoded, float *normal)
+	{
+		float x = std::max(encoded[0] / snormScale, -1.0f);
+		float y = std::max(encoded[1] / snormScale, -1.0f);
+		float z = 1.0f - std::fabs(x) - std::fabs(y);
+		float t = std::max(-z, 0.0f);
+		x += x >= 0.0f ? -t : t;
+		y += y >= 0.0f ? -t : t;
+
+		float length = std::sqrt(x * x + y * y + z * z);
+		normal[0] = x / length;
+		normal[1] = y / length;
+		normal[2] = z / length;
+	}
+}
+
+size_t VertexQuantizer::VertexSize(Format format)
+{
+	return format == FormatQuantized ? sizeof(QuantizedVertex) : Model::vertexStride * sizeof(float);
+}
+
+void VertexQuantizer::Quantize(const Model &model, QuantizedMesh &mesh)
+{
+	size_t vertexCount = model.fileVertices.size() / Model::vertexStride;
+	bool hasNormals = model.fileNormals.size() == vertexCount * 3;
+
+	float low[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+	float high[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+	for (size_t v = 0; v < vertexCount; ++v)
+	{
+		const float *position = &model.fileVertices[v * Model::vertexStride];
+		for (int k = 0; k < 3; ++k)
+		{
+			low[k] = std::min(low[k], position[k]);
+			high[k] = std::max(high[k], position[k]);
+		}
+	}
+
+	float extent[3];
+	float largestExtent = 0.0f;
+	for (int k = 0; k < 3; ++k)
+	{
+		if (vertexCount == 0)
+		{
+			low[k] = high[k] = 0.0f;
+		}
+		extent[k] = high[k] - low[k];
+		largestExtent = std::max(largestExtent, extent[k]);
+	}
+
+	// Scale each axis by its extent, then move to the minimum corner
+	memset(mesh.dequantize, 0, sizeof(mesh.dequantize));
+	mesh.dequantize[0] = extent[0];
+	mesh.dequantize[5] = extent[1];
+	mesh.dequantize[10] = extent[2];
+	mesh.dequantize[12] = low[0];
+	mesh.dequantize[13] = low[1];
+	mesh.dequantize[14] = low[2];
+	mesh.dequantize[15] = 1.0f;
+
+	mesh.vertices.resize(vertexCount);
+	memset(&mesh.error, 0, sizeof(mesh.error));
+	for (size_t v = 0; v < vertexCount; ++v)
+	{
+		const float *source = &model.fileVertices[v * Model::vertexStride];
+		QuantizedVertex &vertex = mesh.vertices[v];
+
+		for (int k = 0; k < 3; ++k)
+		{
+			float normalized = extent[k] > 0.0f ? (source[k] - low[k]) / extent[k] : 0.0f;
+			vertex.position[k] = static_cast<uint16_t>(std::floor(std::max(0.0f, std::min(1.0f, normalized)) * unormScale + 0.5f));
+
+			float decoded = low[k] + (vertex.position[k] / unormScale) * extent[k];
+			mesh.error.position = std::max(mesh.error.position, std::fabs(decoded - source[k]));
+		}
+		vertex.position[3] = 0;
+
+		for (int k = 0; k < 2; ++k)
+		{
+			vertex.uv[k] = FloatToHalf(source[4 + k]);
+			mesh.error.uv = std::max(mesh.error.uv, std::fabs(HalfToFloat(vertex.uv[k]) - source[4 + k]));
+		}
+
+		const float *normal = hasNormals ? &model.fileNormals[v * 3] : NULL;
+		float normalLength = normal != NULL ? std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]) : 0.0f;
+		if (normalLength <= 0.0f)
+		{
+			// Decodes to +z
+			vertex.normal[0] = 0;
+			vertex.normal[1] = 0;
+			continue;
+		}
+
+		EncodeOctahedral(normal, vertex.normal);
+		float decoded[3];
+		DecodeOctahedral(vertex.normal, decoded);
+		float cosine = (decoded[0] * normal[0] + decoded[1] * normal[1] + decoded[2] * normal[2]) / normalLength;
+		float degrees = std::acos(std::max(-1.0f, std::min(1.0f, cosine))) * radiansToDegrees;
+		mesh.error.normalDegrees = std::max(mesh.error.normalDegrees, degrees);
+	}
+
+	mesh.error.relativePosition = largestExtent > 0.0f ? mesh.error.position / largestExtent : 0.0f;
+}
+
+uint16_t VertexQuantizer::FloatToHalf(float value)
+{
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+
+	uint32_t sign = (bits >> 16) & 0x8000;
+	uint32_t exponent = (bits >> 23) & 0xFF;
+	uint32_t mantissa = bits & 0x7FFFFF;
+
+	// Infinity and NaN keep their kind
+	if (exponent == 0xFF)
+	{
+		return static_cast<uint16_t>(sign | 0x7C00 | (mantissa != 0 ? 0x200 : 0));
+	}
+
+	int halfExponent = static_cast<int>(exponent) - 127 + 15;
+	if (halfExponent >= 31)
+	{
+		return static_cast<uint16_t>(sign | 0x7C00);
+	}
+
+	// Subnormal, or too small and flushed to zero
+	if (halfExponent <= 0)
+	{
+		if (halfExponent < -10)
+		{
+			return static_cast<uint16_t>(sign);
+		}
+
+		mantissa |= 0x800000;
+		uint32_t shift = static_cast<uint32_t>(14 - halfExponent);
+		uint32_t half = mantissa >> shift;
+		uint32_t remainder = mantissa & ((1u << shift) - 1);
+		uint32_t middle = 1u << (shift - 1);
+		if (remainder > middle || (remainder == middle && (half & 1) != 0))
+		{
+			++half;
+		}
+		return static_cast<uint16_t>(sign | half);
+	}
+
+	// Rounding up can carry into the exponent, which is still the right answer
+	uint32_t half = (static_cast<uint32_t>(halfExponent) << 10) | (mantissa >> 13);
+	uint32_t remainder = mantissa & 0x1FFF;
+	if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1) != 0))
+	{
+		++half;
+	}
+	return static_cast<uint16_t>(sign | half);
+}
+
+float VertexQuantizer::HalfToFloat(uint16_t value)
+{
+	uint32_t sign = static_cast<uint32_t>(value & 0x8000) << 16;
+	uint32_t exponent = (value >> 10) & 0x1F;
+	uint32_t mantissa = value & 0x3FF;
+
+	if (exponent == 0)
+	{
+		float magnitude = std::ldexp(static_cast<float>(mantissa), -24);
+		return sign != 0 ? -magnitude : magnitude;
+	}
+
+	uint32_t bits = exponent == 31 ? (sign | 0x7F800000 | (mantissa << 13)) : (sign | ((exponent + 112) << 23) | (mantissa << 13));
+	float result;
+	memcpy(&result, &bits, sizeof(result));
+	return result;
+}
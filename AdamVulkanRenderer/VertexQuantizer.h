@@ -0,0 +1,61 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include "Model.h"
+
+// Compact vertex layouts for upload, picked per model
+// The float layout is Model::fileVertices as it is, 24 bytes without normals
+// The quantized layout is 16 bytes with normals, positions are normalized against the mesh bounds
+// and the shader maps them back with a per model dequantization matrix
+class VertexQuantizer
+{
+public:
+	enum Format
+	{
+		FormatFloat,
+		FormatQuantized
+	};
+
+	// VK_FORMAT_R16G16B16A16_UNORM position, w is unused padding
+	// VK_FORMAT_R16G16_SNORM octahedral normal
+	// VK_FORMAT_R16G16_SFLOAT uv
+	struct QuantizedVertex
+	{
+		uint16_t position[4];
+		int16_t normal[2];
+		uint16_t uv[2];
+	};
+
+	// Worst case over every vertex, measured by decoding what was encoded
+	struct Error
+	{
+		// Model units, and as a fraction of the largest bounds extent
+		float position;
+		float relativePosition;
+
+		// Degrees between the source and decoded normal, vertices without a normal are skipped
+		float normalDegrees;
+
+		float uv;
+	};
+
+	struct QuantizedMesh
+	{
+		std::vector<QuantizedVertex> vertices;
+
+		// Column major, takes a unorm position with w = 1 back to model space
+		float dequantize[16];
+
+		Error error;
+	};
+
+	// Bytes per vertex in the vertex buffer
+	static size_t VertexSize(Format format);
+
+	static void Quantize(const Model &model, QuantizedMesh &mesh);
+
+	// Round to nearest even, out of range values saturate to infinity
+	static uint16_t FloatToHalf(float value);
+	static float HalfToFloat(uint16_t value);
+};
@@ -3,6 +3,9 @@
 #include <cstdlib>
 #include <cassert>
 #include <string>
+#include <algorithm>
+#include <cmath>
+#include <cfloat>
 #include "VulkanInstance.h"
 #include "Cube.h"
 #include <winsock2.h>
@@ -13,6 +16,16 @@
 #include "VulkanCommon.h"
 VkPhysicalDeviceMemoryProperties VulkanCommon::m_vulkanDeviceMemoryProperties;
 
+namespace
+{
+	// Largest error a model's level of detail may show on screen, in pixels
+	const float maxLodPixelError = 1.0f;
+
+	// A frame's uploads normally fit in a region, the frame fence means at most one region is in flight
+	const VkDeviceSize stagingRingSize = 64 * 1024 * 1024;
+	const uint32_t stagingRingRegions = 3;
+}
+
 // Call all the initialize functions needed to make the Vulkan render pipeline work
 void VulkanInstance::Initialize(HWND hwnd, HINSTANCE inst, int width, int height, bool multithreaded, bool clusteredRendering, bool importObjs)
 {
@@ -61,6 +74,7 @@ void VulkanInstance::Initialize(HWND hwnd, HINSTANCE inst, int width, int height
     InitSurface(hwnd, inst);
     CreateDevice();
     InitCommandBuffer();
+    m_stagingRing.Initialize(m_vulkanDevice, m_graphicsQueueFamilyIndex, m_vulkanQueue, stagingRingSize, stagingRingRegions);
     InitSwapChain();
     CreateDepthBuffer();
     CreateDescriptorLayouts();
@@ -88,10 +102,15 @@ void VulkanInstance::Initialize(HWND hwnd, HINSTANCE inst, int width, int height
     }
 
 	// Create texture for cube
-	albedoTexture.InitTextureFromFile(m_vulkanDevice, m_vulkanDeviceVector[0], m_vulkanCommandBuffer, m_vulkanQueue, "adam.ppm");
-	m_vulkanImageInfo.imageView = albedoTexture.view;
-	m_vulkanImageInfo.sampler = albedoTexture.sampler;
+	// A white texel to draw with until the real one is read in the background
+	const unsigned char white[4] = { 255, 255, 255, 255 };
+	placeholderTexture.InitTextureFromPixels(m_vulkanDevice, m_vulkanDeviceVector[0], m_stagingRing, 1, 1, white);
+	m_vulkanImageInfo.imageView = placeholderTexture.view;
+	m_vulkanImageInfo.sampler = placeholderTexture.sampler;
 	m_vulkanImageInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+	m_albedoUploaded = false;
+	m_albedoReloadPending = false;
+	m_albedoHandle = StreamAlbedoTexture("adam.ppm");
 
 	m_currentCamera = 0;
 	if (importObjs)
@@ -112,7 +131,7 @@ void VulkanInstance::Initialize(HWND hwnd, HINSTANCE inst, int width, int height
 		AddLineBuffer(lineList);
 
 		// Create 3D texture for clustered light list
-		frustum3dTexutre.InitTexture(m_vulkanDevice, m_vulkanDeviceVector[0], m_vulkanCommandBuffer, m_vulkanQueue, VK_IMAGE_TYPE_3D, VK_FORMAT_R32G32_UINT, true, xSlices, ySlices, zSlices);
+		frustum3dTexutre.InitTexture(m_vulkanDevice, m_vulkanDeviceVector[0], m_stagingRing, VK_IMAGE_TYPE_3D, VK_FORMAT_R32G32_UINT, true, xSlices, ySlices, zSlices);
 		m_vulkanImageInfo.imageView = frustum3dTexutre.view;
 		m_vulkanImageInfo.sampler = frustum3dTexutre.sampler;
 	}
@@ -325,6 +344,12 @@ void VulkanInstance::CreateDevice()
     queueInfo.pQueuePriorities = queuePriorities;
     queueInfo.queueFamilyIndex = m_graphicsQueueFamilyIndex;
 
+    // Block compressed textures need their feature turned on, Texture falls back to RGBA8 without it
+    VkPhysicalDeviceFeatures supportedFeatures;
+    vkGetPhysicalDeviceFeatures(m_vulkanDeviceVector[0], &supportedFeatures);
+    VkPhysicalDeviceFeatures enabledFeatures = {};
+    enabledFeatures.textureCompressionBC = supportedFeatures.textureCompressionBC;
+
     // Setup device create info
     VkDeviceCreateInfo deviceInfo = {};
     deviceInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
@@ -333,7 +358,7 @@ void VulkanInstance::CreateDevice()
     deviceInfo.pQueueCreateInfos = &queueInfo;
     deviceInfo.enabledExtensionCount = deviceExtensionNames.size();
     deviceInfo.ppEnabledExtensionNames = deviceExtensionNames.data();
-    deviceInfo.pEnabledFeatures = NULL;
+    deviceInfo.pEnabledFeatures = &enabledFeatures;
 
     // Create the device and verify
     VkResult result = vkCreateDevice(m_vulkanDeviceVector[0], &deviceInfo, NULL, &m_vulkanDevice);
@@ -850,11 +875,17 @@ void VulkanInstance::CreateDescriptorLayouts()
     VkResult result = vkCreateDescriptorSetLayout(m_vulkanDevice, &descriptorLayout, NULL, m_vulkanDescriptorSetLayoutVector.data());
     assert(result == VK_SUCCESS);
 
+    // Dequantization matrix for quantized models, pushed per model since every draw shares the one uniform buffer
+    VkPushConstantRange pushConstantRange = {};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(float) * 16;
+
     VkPipelineLayoutCreateInfo pPipelineLayoutCreateInfo = {};
     pPipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
     pPipelineLayoutCreateInfo.pNext = NULL;
-    pPipelineLayoutCreateInfo.pushConstantRangeCount = 0;
-    pPipelineLayoutCreateInfo.pPushConstantRanges = NULL;
+    pPipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+    pPipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
     pPipelineLayoutCreateInfo.setLayoutCount = NUM_DESCRIPTOR_SETS;
     pPipelineLayoutCreateInfo.pSetLayouts = m_vulkanDescriptorSetLayoutVector.data();
 
@@ -975,6 +1006,9 @@ void VulkanInstance::InitShaders()
 	processor.LoadFile("vertex.vs", vs);
 	processor.LoadFile("fragment.fs", fs);
 
+	std::string quantizedVs;
+	processor.LoadFile("vertex_quantized.vs", quantizedVs);
+
     std::vector<unsigned int> vtxSpv;
     m_vulkanPipelineShaderStageInfo[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
     m_vulkanPipelineShaderStageInfo[0].pNext = NULL;
@@ -1015,6 +1049,17 @@ void VulkanInstance::InitShaders()
     result = vkCreateShaderModule(m_vulkanDevice, &moduleCreateInfo, NULL, &m_vulkanPipelineShaderStageInfo[1].module);
     assert(result == VK_SUCCESS);
 
+	std::vector<unsigned int> quantizedSpv;
+	m_quantizedVertexShaderStage = m_vulkanPipelineShaderStageInfo[0];
+
+	returnVal = processor.GLSLtoSPV(VK_SHADER_STAGE_VERTEX_BIT, quantizedVs.c_str(), quantizedSpv);
+	assert(returnVal);
+
+	moduleCreateInfo.codeSize = quantizedSpv.size() * sizeof(unsigned int);
+	moduleCreateInfo.pCode = quantizedSpv.data();
+	result = vkCreateShaderModule(m_vulkanDevice, &moduleCreateInfo, NULL, &m_quantizedVertexShaderStage.module);
+	assert(result == VK_SUCCESS);
+
     glslang::FinalizeProcess();
 }
 
@@ -1307,12 +1352,51 @@ void VulkanInstance::InitPipeline()
 
 	result = vkCreateGraphicsPipelines(m_vulkanDevice, m_vulkanPipelineCache, 1, &pipelineInfoLines, NULL, &m_vulkanPipeline[1]);
 	assert(result == VK_SUCCESS);
+
+	// Quantized models, same state with the VertexQuantizer::QuantizedVertex layout and its vertex shader
+	VkGraphicsPipelineCreateInfo pipelineInfoQuantized = pipelineInfo;
+
+	VkVertexInputBindingDescription vulkanVertexInputBindingQuantized;
+	VkVertexInputAttributeDescription vulkanVertexInputAttributesQuantized[3];
+
+	vulkanVertexInputBindingQuantized.binding = 0;
+	vulkanVertexInputBindingQuantized.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+	vulkanVertexInputBindingQuantized.stride = sizeof(VertexQuantizer::QuantizedVertex);
+
+	vulkanVertexInputAttributesQuantized[0].binding = 0;
+	vulkanVertexInputAttributesQuantized[0].location = 0;
+	vulkanVertexInputAttributesQuantized[0].format = VK_FORMAT_R16G16B16A16_UNORM;
+	vulkanVertexInputAttributesQuantized[0].offset = offsetof(VertexQuantizer::QuantizedVertex, position);
+	vulkanVertexInputAttributesQuantized[1].binding = 0;
+	vulkanVertexInputAttributesQuantized[1].location = 1;
+	vulkanVertexInputAttributesQuantized[1].format = VK_FORMAT_R16G16_SNORM; // octahedral normal
+	vulkanVertexInputAttributesQuantized[1].offset = offsetof(VertexQuantizer::QuantizedVertex, normal);
+	vulkanVertexInputAttributesQuantized[2].binding = 0;
+	vulkanVertexInputAttributesQuantized[2].location = 2;
+	vulkanVertexInputAttributesQuantized[2].format = VK_FORMAT_R16G16_SFLOAT; // for texture coordinates
+	vulkanVertexInputAttributesQuantized[2].offset = offsetof(VertexQuantizer::QuantizedVertex, uv);
+
+	VkPipelineVertexInputStateCreateInfo viInfoQuantized = viInfo;
+	viInfoQuantized.pVertexBindingDescriptions = &vulkanVertexInputBindingQuantized;
+	viInfoQuantized.vertexAttributeDescriptionCount = 3;
+	viInfoQuantized.pVertexAttributeDescriptions = vulkanVertexInputAttributesQuantized;
+
+	VkPipelineShaderStageCreateInfo quantizedStages[2] = { m_quantizedVertexShaderStage, m_vulkanPipelineShaderStageInfo[1] };
+
+	pipelineInfoQuantized.pVertexInputState = &viInfoQuantized;
+	pipelineInfoQuantized.pStages = quantizedStages;
+
+	result = vkCreateGraphicsPipelines(m_vulkanDevice, m_vulkanPipelineCache, 1, &pipelineInfoQuantized, NULL, &m_vulkanPipeline[2]);
+	assert(result == VK_SUCCESS);
 }
 
 // Draw a cube with Vulkan
 // Information found in step 15 of VulkanAPI samples
 void VulkanInstance::DrawCube(float dt)
 {
+	// Pick up any .obj groups and textures that finished loading since last frame
+	UploadLoadedAssets();
+
     // Update matrix position for cube	
 	if (m_currentCamera == 2)
 		dt = 0;
@@ -1422,13 +1506,35 @@ void VulkanInstance::DrawCube(float dt)
     vkCmdSetScissor(m_vulkanCommandBuffer, 0, 1, &scissor);
 
 	// OBJ MODEL BEGIN
+	// Pipelines share a layout, so the descriptor sets stay bound across switches
+	VertexQuantizer::Format boundFormat = VertexQuantizer::FormatFloat;
 	for (unsigned int i = 0; i < models.size(); ++i)
 	{
+		if (models[i].format != boundFormat)
+		{
+			boundFormat = models[i].format;
+			vkCmdBindPipeline(m_vulkanCommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_vulkanPipeline[boundFormat == VertexQuantizer::FormatQuantized ? 2 : 0]);
+		}
+		if (models[i].format == VertexQuantizer::FormatQuantized)
+		{
+			vkCmdPushConstants(m_vulkanCommandBuffer, m_vulkanPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(models[i].dequantize), models[i].dequantize);
+		}
+
 		const VkDeviceSize offsets[1] = { 0 };
 		vkCmdBindVertexBuffers(m_vulkanCommandBuffer, 0, 1, &models[i].buffer, offsets);
-		vkCmdBindIndexBuffer(m_vulkanCommandBuffer, models[i].indices, 0, VkIndexType::VK_INDEX_TYPE_UINT32);
-
-		vkCmdDrawIndexed(m_vulkanCommandBuffer, models[i].numIndices, 1, 0, 0, 0);
+		vkCmdBindIndexBuffer(m_vulkanCommandBuffer, models[i].indices, 0, models[i].indexType);
+
+		// Material state will be bound per draw once materials get their own descriptor sets
+		const ModelLevel &level = models[i].levels[SelectLevel(models[i], camera[m_currentCamera])];
+		for (size_t j = 0; j < level.draws.size(); ++j)
+		{
+			const IndexPacker::Draw &draw = level.draws[j];
+			vkCmdDrawIndexed(m_vulkanCommandBuffer, draw.indexCount, 1, draw.firstIndex, draw.vertexOffset, 0);
+		}
+	}
+	if (boundFormat != VertexQuantizer::FormatFloat)
+	{
+		vkCmdBindPipeline(m_vulkanCommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_vulkanPipeline[0]);
 	}
 	// OBJ MODEL END
 
@@ -1519,8 +1625,20 @@ void VulkanInstance::Destroy()
     //----------------------------------------------------------------------------
     // Destruction phase
 
+	// Nothing uploads what's still loading after this, don't wait for the queue to drain
+	m_fileWatcher.Stop();
+	m_assetLoader.Cancel();
+	DestroyRetired();
+	placeholderTexture.Destroy(m_vulkanDevice);
+	if (m_albedoUploaded)
+	{
+		albedoTexture.Destroy(m_vulkanDevice);
+	}
+	m_stagingRing.Destroy();
+
     // Destroy pipeline
     vkDestroyPipeline(m_vulkanDevice, m_vulkanPipeline[0], NULL);
+    vkDestroyPipeline(m_vulkanDevice, m_vulkanPipeline[2], NULL);
     vkDestroyPipelineCache(m_vulkanDevice, m_vulkanPipelineCache, NULL);
 
     for (int i = 0; i < 3; ++i)
@@ -1542,6 +1660,7 @@ void VulkanInstance::Destroy()
     // Destroy shaders
     vkDestroyShaderModule(m_vulkanDevice, m_vulkanPipelineShaderStageInfo[0].module, NULL);
     vkDestroyShaderModule(m_vulkanDevice, m_vulkanPipelineShaderStageInfo[1].module, NULL);
+    vkDestroyShaderModule(m_vulkanDevice, m_quantizedVertexShaderStage.module, NULL);
 
     // Destroy render pass
     vkDestroyRenderPass(m_vulkanDevice, m_vulkanRenderPass, NULL);
@@ -1666,6 +1785,9 @@ void CALLBACK WorkCallback(PTP_CALLBACK_INSTANCE Instance, PVOID Parameter, PTP_
 
 void VulkanInstance::DrawCubesMultithreaded(float dt)
 {
+	// Pick up any .obj groups and textures that finished loading since last frame
+	UploadLoadedAssets();
+
     VkResult result = {};
     VkSubmitInfo submitInfo[1] = {};
     VkFenceCreateInfo fenceInfo = {};
@@ -1911,116 +2033,190 @@ void VulkanInstance::InitMultithreaded()
     }
 }
 
-void VulkanInstance::AddModel(Model &model)
+void VulkanInstance::AddModel(Model &&model, VertexQuantizer::Format format)
 {
-	std::vector<float> modifiedVertices;
-	for (unsigned int i = 0; i < model.fileVertices.size(); i+=3)
-	{
-		modifiedVertices.push_back(model.fileVertices[i]);
-		modifiedVertices.push_back(model.fileVertices[i + 1]);
-		modifiedVertices.push_back(model.fileVertices[i + 2]);
-		modifiedVertices.push_back(1.0f);
-		modifiedVertices.push_back(0);
-		modifiedVertices.push_back(0);
-	}
-	model.fileVertices = modifiedVertices;
-
-	VkBufferCreateInfo bufInfo = {};
-	VkMemoryRequirements memoryRequirements = {};
-	VkMemoryAllocateInfo allocInfo = {};
-	VkResult result = {};
 	VertexBuffer buffer;
+	CreateModelBuffer(std::move(model), format, buffer);
 
-	// VERTEX ---------------------------------------------------------
-	// Set buffer info and create vertex buffer per thread
-	bufInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-	bufInfo.pNext = NULL;
-	bufInfo.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
-	bufInfo.size = sizeof(model.fileVertices[0]) * model.fileVertices.size();
-	bufInfo.queueFamilyIndexCount = 0;
-	bufInfo.pQueueFamilyIndices = NULL;
-	bufInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-	bufInfo.flags = 0;
-	result = vkCreateBuffer(m_vulkanDevice, &bufInfo, NULL, &buffer.buffer);
-	assert(result == VK_SUCCESS);
+	// Add to models list for rendering
+	models.push_back(buffer);
+}
 
-	// Get the memory requirements and fill out allocation info
-	vkGetBufferMemoryRequirements(m_vulkanDevice, buffer.buffer, &memoryRequirements);
+void VulkanInstance::CreateModelBuffer(Model &&model, VertexQuantizer::Format format, VertexBuffer &buffer)
+{
+	// Float vertices already match the pipeline's VertexUV layout, upload them as they are
+	static_assert(Model::vertexStride * sizeof(float) == sizeof(VertexUV), "Model vertices must match VertexUV");
 
-	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	allocInfo.pNext = NULL;
-	allocInfo.memoryTypeIndex = 0;
-	allocInfo.allocationSize = memoryRequirements.size;
+	buffer = VertexBuffer();
 
-	// Search memory types to find first index with those properties
-	bool pass = VulkanCommon::GetMemoryType(memoryRequirements.memoryTypeBits, VkMemoryPropertyFlagBits(VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT), allocInfo.memoryTypeIndex);
-	assert(pass);
+	// Quantized models get normals too, in two thirds of the space
+	VertexQuantizer::QuantizedMesh quantized;
+	const void *vertexSource = model.fileVertices.data();
+	buffer.format = format;
+	memset(buffer.dequantize, 0, sizeof(buffer.dequantize));
+	if (format == VertexQuantizer::FormatQuantized)
+	{
+		VertexQuantizer::Quantize(model, quantized);
+		vertexSource = quantized.vertices.data();
+		memcpy(buffer.dequantize, quantized.dequantize, sizeof(buffer.dequantize));
+	}
 
-	// Allocate vertex buffer memory per thread
-	result = vkAllocateMemory(m_vulkanDevice, &allocInfo, NULL, &buffer.memory);
-	assert(result == VK_SUCCESS);
-	buffer.bufferInfo.range = memoryRequirements.size;
-	buffer.bufferInfo.offset = 0;
+	// VERTEX ---------------------------------------------------------
+	size_t vertexCount = model.fileVertices.size() / Model::vertexStride;
+	CreateDeviceBuffer(vertexSource, VertexQuantizer::VertexSize(format) * vertexCount, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, buffer.buffer, buffer.memory, buffer.bufferInfo);
 
-	// Map memory and copy over vertex data
-	uint8_t *pData;
-	result = vkMapMemory(m_vulkanDevice, buffer.memory, 0, memoryRequirements.size, 0, (void **)&pData);
-	assert(result == VK_SUCCESS);
+	// Bounds centre and the furthest vertex from it
+	float low[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+	float high[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+	for (size_t v = 0; v < vertexCount; ++v)
+	{
+		for (int k = 0; k < 3; ++k)
+		{
+			low[k] = std::min(low[k], model.fileVertices[v * Model::vertexStride + k]);
+			high[k] = std::max(high[k], model.fileVertices[v * Model::vertexStride + k]);
+		}
+	}
 
-	memcpy(pData, model.fileVertices.data(), bufInfo.size);
+	float radiusSquared = 0.0f;
+	for (int k = 0; k < 3; ++k)
+	{
+		buffer.center[k] = vertexCount > 0 ? (low[k] + high[k]) * 0.5f : 0.0f;
+	}
+	for (size_t v = 0; v < vertexCount; ++v)
+	{
+		const float *position = &model.fileVertices[v * Model::vertexStride];
+		float dx = position[0] - buffer.center[0];
+		float dy = position[1] - buffer.center[1];
+		float dz = position[2] - buffer.center[2];
+		radiusSquared = std::max(radiusSquared, dx * dx + dy * dy + dz * dz);
+	}
+	buffer.radius = std::sqrt(radiusSquared);
 
-	vkUnmapMemory(m_vulkanDevice, buffer.memory);
+	// INDEX--------------------------------------------------------
+	// Levels of detail follow the full model in the same buffer, each with draws of its own
+	// Every level is written straight from its own list into the staging ring, nothing is gathered into one list first
+	// 16 bit wherever the vertices allow it, halves index memory and fetch bandwidth
+	IndexPacker::PackedIndices packed;
+	IndexPacker::Pack(model, packed);
+	void *indexStaging = CreateDeviceBuffer(packed.indexSize * packed.indexCount, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, buffer.indices, buffer.indexMemory, buffer.indexInfo);
+	IndexPacker::Write(model, packed, indexStaging);
+
+	buffer.numIndices = packed.indexCount;
+	buffer.numVertices = vertexCount;
+	buffer.indexType = packed.indexSize == sizeof(uint16_t) ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+
+	// Draws come out in level order, so each level's are already together
+	const std::vector<unsigned int> &levelStarts = packed.levelStarts;
+	buffer.levels.resize(levelStarts.size());
+	for (size_t level = 0; level < buffer.levels.size(); ++level)
+	{
+		buffer.levels[level].error = level == 0 ? 0.0f : model.lods[level - 1].error;
+	}
+	for (size_t i = 0; i < packed.draws.size(); ++i)
+	{
+		size_t level = std::upper_bound(levelStarts.begin(), levelStarts.end(), packed.draws[i].firstIndex) - levelStarts.begin() - 1;
+		buffer.levels[level].draws.push_back(packed.draws[i]);
+	}
+}
 
-	result = vkBindBufferMemory(m_vulkanDevice, buffer.buffer, buffer.memory, 0);
-	assert(result == VK_SUCCESS);
+void VulkanInstance::CreateDeviceBuffer(const void *data, VkDeviceSize size, VkBufferUsageFlags usage, VkBuffer &buffer, VkDeviceMemory &memory, VkDescriptorBufferInfo &info)
+{
+	void *staging = CreateDeviceBuffer(size, usage, buffer, memory, info);
+	memcpy(staging, data, static_cast<size_t>(size));
+}
 
-	// INDEX--------------------------------------------------------
+void *VulkanInstance::CreateDeviceBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkBuffer &buffer, VkDeviceMemory &memory, VkDescriptorBufferInfo &info)
+{
+	VkResult result;
+
+	VkBufferCreateInfo bufInfo = {};
 	bufInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
 	bufInfo.pNext = NULL;
-	bufInfo.usage = VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
-	bufInfo.size = sizeof(model.fileIndices[0]) * model.fileIndices.size();
+	bufInfo.usage = usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+	bufInfo.size = size;
 	bufInfo.queueFamilyIndexCount = 0;
 	bufInfo.pQueueFamilyIndices = NULL;
 	bufInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 	bufInfo.flags = 0;
-	result = vkCreateBuffer(m_vulkanDevice, &bufInfo, NULL, &buffer.indices);
+	result = vkCreateBuffer(m_vulkanDevice, &bufInfo, NULL, &buffer);
 	assert(result == VK_SUCCESS);
 
 	// Get the memory requirements and fill out allocation info
-	vkGetBufferMemoryRequirements(m_vulkanDevice, buffer.indices, &memoryRequirements);
+	VkMemoryRequirements memoryRequirements = {};
+	vkGetBufferMemoryRequirements(m_vulkanDevice, buffer, &memoryRequirements);
 
+	VkMemoryAllocateInfo allocInfo = {};
 	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
 	allocInfo.pNext = NULL;
 	allocInfo.memoryTypeIndex = 0;
 	allocInfo.allocationSize = memoryRequirements.size;
 
-	// Search memory types to find first index with those properties
-	pass = VulkanCommon::GetMemoryType(memoryRequirements.memoryTypeBits, VkMemoryPropertyFlagBits(VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT), allocInfo.memoryTypeIndex);
+	// Device local, the GPU reads it every frame and the CPU never touches it again
+	bool pass = VulkanCommon::GetMemoryType(memoryRequirements.memoryTypeBits, VkMemoryPropertyFlagBits(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT), allocInfo.memoryTypeIndex);
 	assert(pass);
 
-	// Allocate vertex buffer memory per thread
-	result = vkAllocateMemory(m_vulkanDevice, &allocInfo, NULL, &buffer.indexMemory);
+	result = vkAllocateMemory(m_vulkanDevice, &allocInfo, NULL, &memory);
 	assert(result == VK_SUCCESS);
-	buffer.indexInfo.range = memoryRequirements.size;
-	buffer.indexInfo.offset = 0;
+	info.buffer = buffer;
+	info.range = memoryRequirements.size;
+	info.offset = 0;
 
-	// Map memory and copy over vertex data
-	uint8_t *indexData;
-	result = vkMapMemory(m_vulkanDevice, buffer.indexMemory, 0, memoryRequirements.size, 0, (void **)&indexData);
+	result = vkBindBufferMemory(m_vulkanDevice, buffer, memory, 0);
 	assert(result == VK_SUCCESS);
 
-	memcpy(indexData, model.fileIndices.data(), bufInfo.size);
+	// Staged in the ring and copied over with the frame's other uploads
+	StagingRing::Allocation staging = m_stagingRing.Allocate(size, 16);
+
+	VkCommandBuffer cmdBuf = m_stagingRing.CommandBuffer();
+	VkBufferCopy copyRegion;
+	copyRegion.srcOffset = staging.offset;
+	copyRegion.dstOffset = 0;
+	copyRegion.size = size;
+	vkCmdCopyBuffer(cmdBuf, staging.buffer, buffer, 1, &copyRegion);
+
+	// Draws submitted later wait for the copy before fetching from the buffer
+	VkBufferMemoryBarrier bufferBarrier = {};
+	bufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	bufferBarrier.pNext = NULL;
+	bufferBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	bufferBarrier.dstAccessMask = (usage & VK_BUFFER_USAGE_INDEX_BUFFER_BIT) != 0 ? VK_ACCESS_INDEX_READ_BIT : VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+	bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	bufferBarrier.buffer = buffer;
+	bufferBarrier.offset = 0;
+	bufferBarrier.size = VK_WHOLE_SIZE;
+	vkCmdPipelineBarrier(cmdBuf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, 0, NULL, 1, &bufferBarrier, 0, NULL);
+
+	return staging.data;
+}
 
-	vkUnmapMemory(m_vulkanDevice, buffer.indexMemory);
+size_t VulkanInstance::SelectLevel(const VertexBuffer &model, const Camera &view) const
+{
+	if (model.levels.size() < 2)
+	{
+		return 0;
+	}
 
-	result = vkBindBufferMemory(m_vulkanDevice, buffer.indices, buffer.indexMemory, 0);
-	assert(result == VK_SUCCESS);
+	// Models share the cube's model matrix, a rotation and translation, so distances carry over
+	glm::vec4 center = m_modelMatrices[0] * glm::vec4(model.center[0], model.center[1], model.center[2], 1.0f);
+	glm::vec3 offset = glm::vec3(center) - glm::vec3(view.eye.x, view.eye.y, view.eye.z);
 
-	buffer.numIndices = model.fileIndices.size();
-	buffer.numVertices = model.fileVertices.size();
+	// Measured to the nearest point of the bounds, so no part of the model is closer than assumed
+	float distance = glm::length(offset) - model.radius;
+	if (distance <= view.nearPlane)
+	{
+		return 0;
+	}
 
-	// Add to models list for rendering
-	models.push_back(buffer);
+	// Pixels one model unit covers at that distance
+	float pixelsPerUnit = static_cast<float>(m_windowHeight) / (2.0f * std::tan(view.fov * 0.5f) * distance);
+
+	size_t level = 0;
+	while (level + 1 < model.levels.size() && model.levels[level + 1].error * pixelsPerUnit <= maxLodPixelError)
+	{
+		++level;
+	}
+	return level;
 }
 
 void VulkanInstance::AddLineBuffer(const std::vector<Vec4> &points)
@@ -2081,4 +2277,213 @@ void VulkanInstance::AddLineBuffer(const std::vector<Vec4> &points)
 
 	// Add to lines list for rendering
 	lines.push_back(buffer);
-}
\ No newline at end of file
+}
+
+AssetLoader::Handle VulkanInstance::StreamModels(const std::string &fileName, const OBJFile::LoadSettings &settings, VertexQuantizer::Format format)
+{
+	WatchedModels watched;
+	watched.fileName = fileName;
+	watched.settings = settings;
+	watched.format = format;
+	watched.handle = m_assetLoader.LoadModels(fileName, settings, format);
+	watched.groupsLoaded = 0;
+	watched.reloadPending = false;
+	m_watchedModels.push_back(watched);
+
+	m_fileWatcher.Watch(fileName);
+	return watched.handle;
+}
+
+AssetLoader::Handle VulkanInstance::StreamAlbedoTexture(const std::string &fileName)
+{
+	m_albedoFileName = fileName;
+	m_fileWatcher.Watch(fileName);
+	return LoadAlbedoTexture();
+}
+
+AssetLoader::Handle VulkanInstance::LoadAlbedoTexture()
+{
+	// Block compressed when the device can sample it, the encode is cached next to the file
+	return m_assetLoader.LoadTexture(m_albedoFileName, Texture::SupportsFormat(m_vulkanDeviceVector[0], VK_FORMAT_BC7_UNORM_BLOCK), TextureCompressor::FormatBC7);
+}
+
+AssetLoader::State VulkanInstance::GetAssetState(AssetLoader::Handle handle) const
+{
+	return m_assetLoader.GetState(handle);
+}
+
+void VulkanInstance::UploadLoadedAssets()
+{
+	DestroyRetired();
+	ReloadChangedFiles();
+
+	std::vector<AssetLoader::Result> loaded;
+	m_assetLoader.TakeResults(loaded);
+
+	// CPU copies are freed when loaded goes out of scope
+	for (unsigned int i = 0; i < loaded.size(); ++i)
+	{
+		AssetLoader::Result &asset = loaded[i];
+		WatchedModels *watched = FindWatchedModels(asset.handle);
+		if (asset.hasModel)
+		{
+			if (watched != NULL)
+			{
+				UpdateGroup(*watched, asset);
+			}
+			else
+			{
+				AddModel(std::move(asset.model), asset.format);
+			}
+		}
+
+		// A .dds can hold a format the device can't sample, whatever is bound now stays
+		VkFormat imageFormat = Texture::ImageFormat(asset.imageFormat, asset.srgb);
+		if (asset.hasImage && asset.handle == m_albedoHandle && !Texture::SupportsFormat(m_vulkanDeviceVector[0], imageFormat))
+		{
+			OutputDebugString(L"Texture format not supported by the device\n");
+		}
+		else if (asset.hasImage && asset.handle == m_albedoHandle)
+		{
+			Texture texture;
+			texture.InitTextureFromLevels(m_vulkanDevice, m_vulkanDeviceVector[0], m_stagingRing, imageFormat, asset.levels, asset.LevelData(), asset.LevelBytes());
+
+			// Clustered rendering binds its light grid instead, leave that alone
+			bool bound = m_vulkanImageInfo.imageView == placeholderTexture.view || (m_albedoUploaded && m_vulkanImageInfo.imageView == albedoTexture.view);
+			if (m_albedoUploaded)
+			{
+				m_retiredTextures.push_back(albedoTexture);
+			}
+			albedoTexture = texture;
+			m_albedoUploaded = true;
+
+			if (bound)
+			{
+				m_vulkanImageInfo.imageView = albedoTexture.view;
+				m_vulkanImageInfo.sampler = albedoTexture.sampler;
+			}
+		}
+
+		if (asset.last)
+		{
+			if (watched != NULL)
+			{
+				TrimGroups(*watched);
+			}
+			m_assetLoader.MarkResident(asset.handle);
+		}
+	}
+
+	// Submitted ahead of the frame's draws on the same queue, the copies' barriers hold the draws back until they land
+	m_stagingRing.Submit();
+}
+
+void VulkanInstance::ReloadChangedFiles()
+{
+	std::vector<std::string> changed;
+	m_fileWatcher.TakeChanges(changed);
+	for (size_t i = 0; i < changed.size(); ++i)
+	{
+		for (size_t j = 0; j < m_watchedModels.size(); ++j)
+		{
+			m_watchedModels[j].reloadPending |= m_watchedModels[j].fileName == changed[i];
+		}
+		m_albedoReloadPending |= !m_albedoFileName.empty() && m_albedoFileName == changed[i];
+	}
+
+	// Groups are matched up by their order in the file, two loads of one file at once would interleave
+	for (size_t i = 0; i < m_watchedModels.size(); ++i)
+	{
+		WatchedModels &watched = m_watchedModels[i];
+		AssetLoader::State state = m_assetLoader.GetState(watched.handle);
+		if (watched.reloadPending && (state == AssetLoader::StateResident || state == AssetLoader::StateFailed))
+		{
+			watched.handle = m_assetLoader.LoadModels(watched.fileName, watched.settings, watched.format);
+			watched.groupsLoaded = 0;
+			watched.reloadPending = false;
+		}
+	}
+
+	AssetLoader::State albedoState = m_assetLoader.GetState(m_albedoHandle);
+	if (m_albedoReloadPending && (albedoState == AssetLoader::StateResident || albedoState == AssetLoader::StateFailed))
+	{
+		m_albedoHandle = LoadAlbedoTexture();
+		m_albedoReloadPending = false;
+	}
+}
+
+VulkanInstance::WatchedModels *VulkanInstance::FindWatchedModels(AssetLoader::Handle handle)
+{
+	for (size_t i = 0; i < m_watchedModels.size(); ++i)
+	{
+		if (m_watchedModels[i].handle == handle)
+		{
+			return &m_watchedModels[i];
+		}
+	}
+	return NULL;
+}
+
+void VulkanInstance::UpdateGroup(WatchedModels &watched, AssetLoader::Result &asset)
+{
+	size_t group = watched.groupsLoaded++;
+	if (group >= watched.slots.size())
+	{
+		watched.slots.push_back(models.size());
+		watched.hashes.push_back(asset.hash);
+		AddModel(std::move(asset.model), asset.format);
+		return;
+	}
+
+	// Only what actually changed goes back over the bus, re-exporting a scene usually touches a few groups
+	if (watched.hashes[group] == asset.hash)
+	{
+		return;
+	}
+
+	VertexBuffer &slot = models[watched.slots[group]];
+	m_retiredBuffers.push_back(slot);
+	CreateModelBuffer(std::move(asset.model), asset.format, slot);
+	watched.hashes[group] = asset.hash;
+}
+
+void VulkanInstance::TrimGroups(WatchedModels &watched)
+{
+	while (watched.slots.size() > watched.groupsLoaded)
+	{
+		size_t slot = watched.slots.back();
+		watched.slots.pop_back();
+		watched.hashes.pop_back();
+
+		m_retiredBuffers.push_back(models[slot]);
+		models.erase(models.begin() + slot);
+		for (size_t i = 0; i < m_watchedModels.size(); ++i)
+		{
+			for (size_t j = 0; j < m_watchedModels[i].slots.size(); ++j)
+			{
+				if (m_watchedModels[i].slots[j] > slot)
+				{
+					--m_watchedModels[i].slots[j];
+				}
+			}
+		}
+	}
+}
+
+void VulkanInstance::DestroyRetired()
+{
+	for (size_t i = 0; i < m_retiredBuffers.size(); ++i)
+	{
+		vkDestroyBuffer(m_vulkanDevice, m_retiredBuffers[i].buffer, NULL);
+		vkFreeMemory(m_vulkanDevice, m_retiredBuffers[i].memory, NULL);
+		vkDestroyBuffer(m_vulkanDevice, m_retiredBuffers[i].indices, NULL);
+		vkFreeMemory(m_vulkanDevice, m_retiredBuffers[i].indexMemory, NULL);
+	}
+	m_retiredBuffers.clear();
+
+	for (size_t i = 0; i < m_retiredTextures.size(); ++i)
+	{
+		m_retiredTextures[i].Destroy(m_vulkanDevice);
+	}
+	m_retiredTextures.clear();
+}
@@ -21,9 +21,14 @@
 #include "vulkan/vulkan.h"
 #include "glslang/SPIRV/GlslangToSpv.h"
 #include <vector>
-#include <mutex>
 #include "Model.h"
+#include "OBJFile.h"
+#include "IndexPacker.h"
+#include "VertexQuantizer.h"
 #include "Texture.h"
+#include "StagingRing.h"
+#include "AssetLoader.h"
+#include "FileWatcher.h"
 #include "Vec3.h"
 #include "Vec4.h"
 #include "Camera.h"
@@ -58,9 +63,24 @@ public:
     void Destroy();
 
 	// Model and line drawing for .obj files and debug drawing
-	void AddModel(Model &model);
+	// format picks the vertex layout and so the pipeline it's drawn with
+	// The model is consumed, each level of detail is copied from its own list straight into the staging buffer
+	void AddModel(Model &&model, VertexQuantizer::Format format = VertexQuantizer::FormatFloat);
 	void AddLineBuffer(const std::vector<Vec4> &points);
 
+	// Import an .obj on the asset loader instead of waiting for the whole file
+	// Each group is uploaded at the start of the frame after it finishes, and its CPU copy freed
+	// The file is watched from then on, when it's written again it's reimported in the background
+	// and only the groups whose geometry changed are uploaded again
+	AssetLoader::Handle StreamModels(const std::string &fileName, const OBJFile::LoadSettings &settings, VertexQuantizer::Format format = VertexQuantizer::FormatFloat);
+
+	// Read a .ppm or .dds on the asset loader, the cube is drawn with a plain white texture until it's resident
+	// Watched like StreamModels, a new version replaces the old one once it's uploaded
+	AssetLoader::Handle StreamAlbedoTexture(const std::string &fileName);
+
+	// Resident once everything for the handle has been uploaded
+	AssetLoader::State GetAssetState(AssetLoader::Handle handle) const;
+
 private:
     // Init and creation functions
     void InitInstance();                                                // Vulkan tutorial step 1
@@ -79,6 +99,19 @@ private:
     void InitVertexBuffer();                                            // Vulkan tutorial step 13
     void InitPipeline();                                                // Vulkan tutorial step 14
 
+    // Upload any models and textures the asset loader has finished since the last frame
+    // Their copies, and anything else recorded on the staging ring, go to the GPU in one submission
+    void UploadLoadedAssets();
+
+	// Queue a reimport of every watched file that changed, files still loading wait for that to finish
+	void ReloadChangedFiles();
+
+	// Queue m_albedoFileName on the asset loader, block compressed if the device can sample BC7
+	AssetLoader::Handle LoadAlbedoTexture();
+
+	// Free what reloads replaced the frame before
+	void DestroyRetired();
+
     // Uniform buffer update inside draw
     void UpdateUniformBuffer(int threadNum, float dt, int cameraId);
 
@@ -88,7 +121,13 @@ private:
     void InitMultithreaded();
 
 	// Texture and camera data
+	// The placeholder stands in for the albedo texture while it loads
 	Texture albedoTexture;
+	Texture placeholderTexture;
+	AssetLoader::Handle m_albedoHandle;
+	std::string m_albedoFileName;
+	bool m_albedoUploaded;
+	bool m_albedoReloadPending;
 	Camera camera[3];
 	Texture frustum3dTexutre;
 
@@ -103,11 +142,15 @@ private:
     VkCommandBuffer m_vulkanCommandBuffer;
     VkRenderPass m_vulkanRenderPass;
     VkDescriptorImageInfo m_vulkanImageInfo;
-    VkPipeline m_vulkanPipeline[2];
+    // Textured float vertices, debug lines, textured quantized vertices
+    VkPipeline m_vulkanPipeline[3];
     VkPipelineCache m_vulkanPipelineCache;
     VkPipelineLayout m_vulkanPipelineLayout;
     VkPipelineShaderStageCreateInfo m_vulkanPipelineShaderStageInfo[2];
 
+    // Replaces the vertex stage for quantized models, dequantizes with a push constant matrix
+    VkPipelineShaderStageCreateInfo m_quantizedVertexShaderStage;
+
     // Property checks		
     std::vector<VkQueueFamilyProperties> m_vulkanQueueFamilyPropertiesVector;
 
@@ -157,6 +200,14 @@ private:
         VkDescriptorBufferInfo bufferInfo;
     } m_uniformBuffers[3];
 
+	// One level of detail of an uploaded model, level 0 is the full model
+	struct ModelLevel
+	{
+		// Model units, see ModelLod::error
+		float error;
+		std::vector<IndexPacker::Draw> draws;
+	};
+
     // Structure for vertex buffer
     struct VertexBuffer
     {
@@ -168,6 +219,19 @@ private:
 		VkDescriptorBufferInfo indexInfo;
 		int numVertices;
 		int numIndices;
+
+		// Models pick 16 or 32 bit indices at upload, with one or more draws per material
+		// Every level's draws come out of the same index buffer
+		VkIndexType indexType;
+		std::vector<ModelLevel> levels;
+
+		// Model space bounding sphere, for picking a level
+		float center[3];
+		float radius;
+
+		// Quantized models push dequantize before drawing
+		VertexQuantizer::Format format;
+		float dequantize[16];
     };
 
     // Structure for layer properties
@@ -201,6 +265,62 @@ private:
 	// Loading models
 	std::vector<VertexBuffer> models;
 	std::vector<VertexBuffer> lines;
+
+	// Coarsest level of the model whose error projects to under a pixel from the camera
+	size_t SelectLevel(const VertexBuffer &model, const Camera &view) const;
+
+	// Everything AddModel does but adding it to the list, reloads put the result in the old model's place
+	void CreateModelBuffer(Model &&model, VertexQuantizer::Format format, VertexBuffer &buffer);
+
+	// A device local buffer holding size bytes of data, copied over with the staging ring's next submission
+	void CreateDeviceBuffer(const void *data, VkDeviceSize size, VkBufferUsageFlags usage, VkBuffer &buffer, VkDeviceMemory &memory, VkDescriptorBufferInfo &info);
+
+	// Same, but returns the staging space for the caller to fill before the ring is next submitted
+	void *CreateDeviceBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkBuffer &buffer, VkDeviceMemory &memory, VkDescriptorBufferInfo &info);
+
+	// A streamed .obj, reimported when it changes on disk
+	struct WatchedModels
+	{
+		std::string fileName;
+		OBJFile::LoadSettings settings;
+		VertexQuantizer::Format format;
+
+		// Latest load of the file, the first one or a reload
+		AssetLoader::Handle handle;
+
+		// Groups that load has handed over so far
+		size_t groupsLoaded;
+
+		// Where each group is in models and the hash of what's uploaded there
+		std::vector<size_t> slots;
+		std::vector<unsigned long long> hashes;
+
+		// Changed again while the last load was still running
+		bool reloadPending;
+	};
+
+	WatchedModels *FindWatchedModels(AssetLoader::Handle handle);
+
+	// Swap in a group of a load, unchanged groups keep their buffers and new ones go on the end
+	void UpdateGroup(WatchedModels &watched, AssetLoader::Result &asset);
+
+	// Once a load is done, drop the groups it no longer has
+	void TrimGroups(WatchedModels &watched);
+
+	std::vector<WatchedModels> m_watchedModels;
+	FileWatcher m_fileWatcher;
+
+	// Replaced by a reload, freed at the start of the next frame
+	// Frames wait for their fence before returning, so by then nothing can be using them and the queue never has to drain
+	std::vector<VertexBuffer> m_retiredBuffers;
+	std::vector<Texture> m_retiredTextures;
+
+	// Every texture and model upload is staged here and copied into device local memory
+	StagingRing m_stagingRing;
+
+	// Background .obj and .ppm loading
+	// Finished CPU data waits in the loader until the render thread uploads it
+	AssetLoader m_assetLoader;
 };
 
 // Struct for callback data used in multi-threading
@@ -0,0 +1,34 @@
+#version 400
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shading_language_420pack : enable
+layout (std140, binding = 0) uniform bufferVals {
+    mat4 mvp;
+} myBufferVals;
+// Per model, maps unorm positions back to model space
+layout (push_constant) uniform quantization {
+    mat4 dequantize;
+} myQuantization;
+layout (location = 0) in vec4 pos;
+layout (location = 1) in vec2 inNormal;
+layout (location = 2) in vec2 inTexCoords;
+layout (location = 0) out vec2 texcoord;
+layout (location = 1) out vec3 posColor;
+layout (location = 2) out vec3 normal;
+out gl_PerVertex { 
+    vec4 gl_Position;
+};
+void main() {
+   vec4 position = myQuantization.dequantize * vec4(pos.xyz, 1.0);
+
+   // Octahedral normal, unfold the lower half
+   vec3 n = vec3(inNormal.xy, 1.0 - abs(inNormal.x) - abs(inNormal.y));
+   float t = max(-n.z, 0.0);
+   n.x += n.x >= 0.0 ? -t : t;
+   n.y += n.y >= 0.0 ? -t : t;
+   normal = normalize(n);
+
+   // Vulkan top-left 0,0 like direct-x, so adjust coordinates
+   texcoord = 1.0-inTexCoords;
+   gl_Position = myBufferVals.mvp * position;
+   posColor = position.xyz;
+}